@@ -42,7 +42,7 @@
 // Assembly/architecture defines
 #define __NOASM
 
-#ifdef _WIN64
+#if defined(_WIN64) || defined(__LP64__)
     #ifndef __X64
         #define __X64
     #endif
@@ -73,6 +73,7 @@ typedef HANDLE HACQDESC;
 
 #ifdef __linux__
     typedef unsigned int DEX_RETURN;
+    #define HIS_RETURN UINT
 #else
     #ifdef _DLL_EXPORT
         #define _DLL_API __declspec(dllexport)
@@ -658,4 +659,313 @@ HIS_RETURN Acquisition_GetHwHeader(HACQDESC hAcqDesc, unsigned char* pData, unsi
 
 /* Data Correction & Mapping */
 HIS_RETURN Acquisition_SetCorrData(HACQDESC hAcqDesc, unsigned short *pwOffsetData, DWORD *pdwGainData, DWORD *pdwPxlCorrList);
-HIS_RETURN Acquisition_SetCorrData_Ex(HACQDESC hAcqDesc, unsigned short *pwOffsetData, unsigned short *pwGain
+HIS_RETURN Acquisition_SetCorrData_Ex(HACQDESC hAcqDesc, unsigned short *pwOffsetData, unsigned short *pwGainData,
+                                      unsigned short *pwGainAvgData, UINT nGainFrames,
+                                      DWORD *pdwGainData, DWORD *pdwPxlCorrList);
+HIS_RETURN Acquisition_GetCorrData(HACQDESC hAcqDesc, unsigned short **ppwOffsetData, DWORD **ppdwGainData, DWORD **ppdwPxlCorrList);
+HIS_RETURN Acquisition_GetCorrData_Ex(HACQDESC hAcqDesc, unsigned short **ppwOffsetData, unsigned short **ppwGainData,
+                                      unsigned short **ppwGainAvgData, UINT **nGainFrames,
+                                      DWORD **pdwGainData, DWORD **pdwPxlCorrList);
+HIS_RETURN Acquisition_CreateGainMap(WORD *pGainData, WORD *pGainAVG, int nCount, int nFrame);
+HIS_RETURN Acquisition_CreatePixelMap(WORD *pData, int nDataRows, int nDataColumns, int *pCorrList, int *nCorrListSize);
+HIS_RETURN Acquisition_DoOffsetCorrection(WORD *pSource, WORD *pDest, WORD *pOffsetData, int nCount);
+HIS_RETURN Acquisition_DoOffsetGainCorrection(WORD *pSource, WORD *pDest, WORD *pOffsetData, DWORD *pGainData, int nCount);
+HIS_RETURN Acquisition_DoOffsetGainCorrection_Ex(WORD *pSource, WORD *pDest, WORD *pOffsetData, WORD *pGainData,
+                                                 WORD *pGainAVG, int nCount, int nFrame);
+HIS_RETURN Acquisition_DoOffsetCorrection32(unsigned long *pSource, unsigned long *pDest, unsigned long *pOffsetData, int nCount);
+HIS_RETURN Acquisition_DoOffsetGainCorrection32(unsigned long *pSource, unsigned long *pDest, unsigned long *pOffsetData,
+                                                unsigned long *pGainData, int nCount);
+HIS_RETURN Acquisition_DoOffsetGainCorrection_Ex32(unsigned long *pSource, unsigned long *pDest, unsigned long *pOffsetData,
+                                                   unsigned long *pGainData, unsigned long *pGainAVG, int nCount, int nFrame);
+HIS_RETURN Acquisition_CreateGainMap32(unsigned long *pGainData, unsigned long *pGainAVG, int nCount, int nFrame);
+HIS_RETURN Acquisition_DoPixelCorrection(WORD *pData, int *pCorrList);
+
+/* Callbacks & User Data */
+HIS_RETURN Acquisition_SetCallbacksAndMessages(HACQDESC pAcqDesc, HWND hWnd,
+                                               UINT dwErrorMsg, UINT dwLoosingFramesMsg,
+                                               void (CALLBACK *lpfnEndFrameCallback)(HACQDESC),
+                                               void (CALLBACK *lpfnEndAcqCallback)(HACQDESC));
+#ifdef XIS_OS_64
+HIS_RETURN Acquisition_SetAcqData(HACQDESC hAcqDesc, void *AcqData);
+HIS_RETURN Acquisition_GetAcqData(HACQDESC hAcqDesc, void **VoidAcqData);
+#else
+HIS_RETURN Acquisition_SetAcqData(HACQDESC hAcqDesc, DWORD dwAcqData);
+HIS_RETURN Acquisition_GetAcqData(HACQDESC hAcqDesc, DWORD *dwAcqData);
+#endif
+HIS_RETURN Acquisition_SetEventCallback(HACQDESC hAcqDesc, XIS_EventCallback EventCallback, void *userData);
+HIS_RETURN Acquisition_DisableEventCallback(HACQDESC hAcqDesc);
+
+/* Camera Mode, Timing & Readout */
+HIS_RETURN Acquisition_SetFPGACameraMode(HACQDESC hAcqDesc, FPGAType FPGACommand, BOOL bInverse);
+HIS_RETURN Acquisition_SetCameraMode(HACQDESC hAcqDesc, UINT dwMode);
+HIS_RETURN Acquisition_SetCameraGain(HACQDESC hAcqDesc, WORD wMode);
+HIS_RETURN Acquisition_SetFrameSync(HACQDESC hAcqDesc);
+HIS_RETURN Acquisition_SetFrameSyncMode(HACQDESC hAcqDesc, DWORD dwMode);
+HIS_RETURN Acquisition_SetFrameSyncTimeMode(HACQDESC hAcqDesc, unsigned int uiMode, unsigned int dwDelayTime);
+HIS_RETURN Acquisition_SetTimerSync(HACQDESC hAcqDesc, DWORD *dwCycleTime);
+HIS_RETURN Acquisition_ResetFrameCnt(HACQDESC hAcqDesc);
+HIS_RETURN Acquisition_SetCameraBinningMode(HACQDESC hAcqDesc, WORD wMode);
+HIS_RETURN Acquisition_GetCameraBinningMode(HACQDESC hAcqDesc, WORD *wMode);
+HIS_RETURN Acquisition_SetCameraROI(HACQDESC hAcqDesc, unsigned short usActivateGrp);
+HIS_RETURN Acquisition_GetCameraROI(HACQDESC hAcqDesc, unsigned short *usActivateGrp);
+HIS_RETURN Acquisition_SetCameraTriggerMode(HACQDESC hAcqDesc, WORD wMode);
+HIS_RETURN Acquisition_GetCameraTriggerMode(HACQDESC hAcqDesc, WORD *wMode);
+HIS_RETURN Acquisition_SetRotationAngle(HACQDESC hAcqDesc, long lRotAngle);
+HIS_RETURN Acquisition_GetRotationAngle(HACQDESC hAcqDesc, long *lRotAngle);
+
+/* GbIF */
+HIS_RETURN Acquisition_GbIF_Init(HACQDESC *phAcqDesc, int nChannelNr, BOOL bEnableIRQ,
+                                 UINT uiRows, UINT uiColumns, BOOL bSelfInit, BOOL bAlwaysOpen,
+                                 long lInitType, GBIF_STRING_DATATYPE *ucAddress);
+HIS_RETURN Acquisition_GbIF_GetDeviceList(GBIF_DEVICE_PARAM *pGBIF_DEVICE_PARAM, int nDeviceCnt);
+HIS_RETURN Acquisition_GbIF_GetDevice(GBIF_STRING_DATATYPE *ucAddress, DWORD dwAddressType, GBIF_DEVICE_PARAM *pDevice);
+HIS_RETURN Acquisition_GbIF_GetDeviceCnt(long *plNrOfboards);
+HIS_RETURN Acquisition_GbIF_GetPacketDelay(HACQDESC hAcqDesc, long *lPacketdelay);
+HIS_RETURN Acquisition_GbIF_SetPacketDelay(HACQDESC hAcqDesc, long lPacketdelay);
+HIS_RETURN Acquisition_GbIF_CheckNetworkSpeed(HACQDESC hAcqDesc, WORD *wTiming, long *lPacketDelay, long lMaxNetworkLoadPercent);
+HIS_RETURN Acquisition_GbIF_GetDetectorProperties(HACQDESC hAcqDesc, GBIF_Detector_Properties *pDetectorProperties);
+HIS_RETURN Acquisition_GbIF_GetDeviceParams(HACQDESC hAcqDesc, GBIF_DEVICE_PARAM *pDevice);
+HIS_RETURN Acquisition_GbIF_GetVersion(int *pMajor, int *pMinor, int *pRelease, char *pStrVersion, int iStrLength);
+
+/* Logging */
+HIS_RETURN Acquisition_EnableLogging(BOOL onOff);
+HIS_RETURN Acquisition_SetLogLevel(XislLoggingLevels xislLogLvl);
+HIS_RETURN Acquisition_GetLogLevel(XislLoggingLevels *xislLogLvl);
+HIS_RETURN Acquisition_TogglePerformanceLogging(BOOL onOff);
+HIS_RETURN Acquisition_SetLogOutput(const char *filePath, BOOL consoleOnOff);
+HIS_RETURN Acquisition_SetFileLogging(const char *filename, BOOL enableLogging);
+HIS_RETURN Acquisition_SetConsoleLogging(BOOL enableConsole);
+
+/* Files */
+HIS_RETURN Acquisition_GetXISFileBufferSize(size_t *pFileSize, UINT dwRows, UINT dwColumns, UINT dwFrames,
+                                            BOOL uiOnboardFileHeader, XIS_FileType filetype);
+HIS_RETURN Acquisition_CreateXISFileInMemory(void *pMemoryFileBuffer, void *pDataBuffer, UINT dwRows, UINT dwColumns,
+                                             UINT dwFrames, BOOL uiOnboardFileHeader, XIS_FileType filetype);
+HIS_RETURN Acquisition_SaveFile(const char *filename, void *pImageBuffer, UINT dwRows, UINT dwColumns, UINT dwFrames,
+                                BOOL uiOnboardFileHeader, XIS_FileType usTypeOfNumbers);
+HIS_RETURN Acquisition_SaveRawData(const char *filename, const unsigned char *buffer, size_t bufferSize);
+HIS_RETURN Acquisition_LoadXISFileToMemory(const char *filename, void *pMemoryFileBuffer, size_t bufferSize);
+
+/* Version & Detector Information */
+HIS_RETURN Acquisition_GetVersion(int *major, int *minor, int *release, int *build);
+HIS_RETURN Acquisition_GetDetectorProperties(HACQDESC hAcqDesc, GBIF_Detector_Properties *pDetectorProperties);
+HIS_RETURN Acquisition_GetConnectionStatus(HACQDESC hAcqDesc);
+HIS_RETURN Acquisition_Test_SDCardPerformance(HACQDESC hAcqDesc, unsigned int buffersize,
+                                              double *wbitrate, unsigned int *wmicroseconds,
+                                              double *rbitrate, unsigned int *rmicroseconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+////////////////////////////////////////////////////////////
+// Error Codes
+////////////////////////////////////////////////////////////
+
+#define HIS_ALL_OK                                   0    /**< No error */
+#define HIS_ERROR_MEMORY                             1    /**< Memory couldn't be allocated. */
+#define HIS_ERROR_BOARDINIT                          2    /**< Unable to initialize board. */
+#define HIS_ERROR_NOCAMERA                           3    /**< Got a time out. May be no detector present. */
+#define HIS_ERROR_CORRBUFFER_INCOMPATIBLE            4    /**< Your correction files do not have a proper size. */
+#define HIS_ERROR_ACQ_ALREADY_RUNNING                5    /**< Acquisition is already running. */
+#define HIS_ERROR_TIMEOUT                            6    /**< Got a time out from hardware. */
+#define HIS_ERROR_INVALIDACQDESC                     7    /**< Acquisition descriptor invalid. */
+#define HIS_ERROR_VXDNOTFOUND                        8    /**< Unable to find VxD. */
+#define HIS_ERROR_VXDNOTOPEN                         9    /**< Unable to open VxD. */
+#define HIS_ERROR_VXDUNKNOWNERROR                    10   /**< Unknown error during VxD loading. */
+#define HIS_ERROR_VXDGETDMAADR                       11   /**< VxD Error: GetDmaAddr failed. */
+#define HIS_ERROR_ACQABORT                           12   /**< An unexpected acquisition abort occurred. */
+#define HIS_ERROR_ACQUISITION                        13   /**< error occurred during data acquisition. */
+#define HIS_ERROR_VXD_REGISTER_IRQ                   14   /**< Unable to register interrupt. */
+#define HIS_ERROR_VXD_REGISTER_STATADR               15   /**< Register status address failed. */
+#define HIS_ERROR_GETOSVERSION                       16   /**< Getting version of operating system failed. */
+#define HIS_ERROR_SETFRMSYNC                         17   /**< Can not set frame sync. */
+#define HIS_ERROR_SETFRMSYNCMODE                     18   /**< Can not set frame sync mode. */
+#define HIS_ERROR_SETTIMERSYNC                       19   /**< Can not set timer sync. */
+#define HIS_ERROR_INVALID_FUNC_CALL                  20   /**< Invalid function call. */
+#define HIS_ERROR_ABORTCURRFRAME                     21   /**< Aborting current frame failed. */
+#define HIS_ERROR_GETHWHEADERINFO                    22   /**< Getting hardware header failed. */
+#define HIS_ERROR_HWHEADER_INV                       23   /**< Hardware header is invalid. */
+#define HIS_ERROR_SETLINETRIG_MODE                   24   /**< Setting line trigger mode failed. */
+#define HIS_ERROR_WRITE_DATA                         25   /**< Writing data failed. */
+#define HIS_ERROR_READ_DATA                          26   /**< Reading data failed. */
+#define HIS_ERROR_SETBAUDRATE                        27   /**< Setting baud rate failed. */
+#define HIS_ERROR_NODESC_AVAILABLE                   28   /**< No acquisition descriptor available. */
+#define HIS_ERROR_BUFFERSPACE_NOT_SUFF               29   /**< Buffer space not sufficient. */
+#define HIS_ERROR_SETCAMERAMODE                      30   /**< Setting detector mode failed. */
+#define HIS_ERROR_FRAME_INV                          31   /**< Frame invalid. */
+#define HIS_ERROR_SLOW_SYSTEM                        32   /**< System to slow. */
+#define HIS_ERROR_GET_NUM_BOARDS                     33   /**< Error during getting number of boards. */
+#define HIS_ERROR_HW_ALREADY_OPEN_BY_ANOTHER_PROCESS 34   /**< Communication channel already opened by another process. */
+#define HIS_ERROR_CREATE_MEMORYMAPPING               35   /**< Error creating memory mapped file. */
+#define HIS_ERROR_VXD_REGISTER_DMA_ADDRESS           36   /**< Error registering DMA address. */
+#define HIS_ERROR_VXD_REGISTER_STAT_ADDR             37   /**< Error registering static address. */
+#define HIS_ERROR_VXD_UNMASK_IRQ                     38   /**< Unable to unmask interrupt. */
+#define HIS_ERROR_LOADDRIVER                         39   /**< Unable to load driver. */
+#define HIS_ERROR_FUNC_NOTIMPL                       40   /**< Function is not implemented. */
+#define HIS_ERROR_MEMORY_MAPPING                     41   /**< Unable to create memory mapping. */
+#define HIS_ERROR_CREATE_MUTEX                       42   /**< Could not create Mutex. */
+#define HIS_ERROR_ACQ                                43   /**< Error starting the acquisition. */
+#define HIS_ERROR_DESC_NOT_LOCAL                     44   /**< Acquisition descriptor is not local. */
+#define HIS_ERROR_INVALID_PARAM                      45   /**< Invalid Parameter. */
+#define HIS_ERROR_ABORT                              46   /**< Error during abort acquisition function. */
+#define HIS_ERROR_WRONGBOARDSELECT                   47   /**< The wrong board is selected. */
+#define HIS_ERROR_WRONG_CAMERA_MODE                  48   /**< Change of Detector Mode during Acquisition. */
+#define HIS_ERROR_AVERAGED_LOST                      49   /**< The number of images for frame grabber onboard averaging must be 2 to the power of n. */
+#define HIS_ERROR_BAD_SORTING_PARAM                  50   /**< Parameter for (onboard) sorting not valid. */
+#define HIS_ERROR_UNKNOWN_IP_MAC_NAME                51   /**< Connection to Network Detector cannot be opened due to invalid IP address / MAC / Detector name. */
+#define HIS_ERROR_NO_BOARD_IN_SUBNET                 52   /**< Detector could not be found in the Subnet. */
+#define HIS_ERROR_UNABLE_TO_OPEN_BOARD               53   /**< Unable to open connection to Network Detector. */
+#define HIS_ERROR_UNABLE_TO_CLOSE_BOARD              54   /**< Unable to close connection to Network Detector. */
+#define HIS_ERROR_UNABLE_TO_ACCESS_DETECTOR_FLASH    55   /**< Unable to access the flash memory of Detector. */
+#define HIS_ERROR_HEADER_TIMEOUT                     56   /**< No frame header received from Detector. */
+#define HIS_ERROR_NO_FPGA_ACK                        57   /**< Command not acknowledged. */
+#define HIS_ERROR_NR_OF_BOARDS_CHANGED               58   /**< Number of boards within network changed during broadcast. */
+#define HIS_ERROR_SETEXAMFLAG                        59   /**< Unable to set the exam flag. */
+#define HIS_ERROR_ILLEGAL_INDEX                      60   /**< Error Function called with an illegal index number. */
+#define HIS_ERROR_NOT_INITIALIZED                    61   /**< Error Function or function environment not correctly initialised. */
+#define HIS_ERROR_NOT_DISCOVERED                     62   /**< Error No detectors discovered yet. */
+#define HIS_ERROR_ONBOARDAVGFAILED                   63   /**< Error onbaord averaging failed. */
+#define HIS_ERROR_GET_ONBOARD_OFFSET                 64   /**< Error getting onboard offset. */
+#define HIS_ERROR_CURL                               65   /**< Error CURL. */
+#define HIS_ERROR_ENABLE_ONBOARD_OFFSET              66   /**< Error setting onboard offset corr mode. */
+#define HIS_ERROR_ENABLE_ONBOARD_MEAN                67   /**< Error setting onboard mean corr mode. */
+#define HIS_ERROR_ENABLE_ONBOARD_GAINOFFSET          68   /**< Error setting onboard gain corr mode. */
+#define HIS_ERROR_ENABLE_ONBOARD_PREVIEW             69   /**< Error setting onboard preview mode. */
+#define HIS_ERROR_SET_ONBOARD_BINNING                70   /**< Error setting onboard binning mode. */
+#define HIS_ERROR_LOAD_COORECTIONIMAGETOBUFFER       71   /**< Error Loading image from SD to onboard buffer. */
+#define HIS_ERROR_INVALIDBUFFERNR                    72   /**< Error Invalid pointer/buffer passed as parameter. */
+#define HIS_ERROR_INVALID_HANDLE                     73   /**< Error Invalid SHOCKID. */
+#define HIS_ERROR_ALREADY_EXISTS                     74   /**< Error Invalid filename, file already exists. */
+#define HIS_ERROR_DOES_NOT_EXIST                     75   /**< Error Invalid filename type does not exist. */
+#define HIS_ERROR_OPEN_FILE                          76   /**< Error Invalid filename for image tag or log file. */
+#define HIS_ERROR_INVALID_FILENAME                   77   /**< Error Invalid filename for image tag or log file. */
+#define HIS_ERROR_SETDISCOVERYTIMEOUT                78   /**< Error setting gbif discovery timeout. */
+#define HIS_ERROR_SERIALREAD                         100
+#define HIS_ERROR_SERIALWRITE                        101
+#define HIS_ERROR_SETDAC                             102
+#define HIS_ERROR_SETADC                             103
+#define HIS_ERROR_SET_IMAGE_TAG                      104  /**< Error setting the onboard image tag. */
+#define HIS_ERROR_SET_PROC_SCRIPT                    105  /**< Error setting the onboard process script. */
+#define HIS_ERROR_SET_IMAGE_TAG_LENGTH               106  /**< Error Image tag length exceeded 128char (including path: autosave/). */
+#define HIS_ERROR_RETRIEVE_ENHANCED_HEADER           107  /**< Error retrieving the enhanced header. */
+#define HIS_ERROR_ENABLE_INTERRUPTS                  108  /**< Error enabling XRPD interrupts. */
+#define HIS_ERROR_XRPD_SESSION_ERROR                 109  /**< Error XRPD session Error. */
+#define HIS_ERROR_XRPD_SET_EVENT                     110  /**< Error No interface to communicate event messages active. */
+#define HIS_ERROR_XRPD_NO_EVENT_INTERFACE            111  /**< Error No interface to communicate event messages active. */
+#define HIS_ERROR_XRPD_CREATE_FAKE_SHOCK_EVENT       112  /**< Error creating fake shock events. */
+#define HIS_ERROR_XRPD_GET_SDCARD_INFO               113  /**< Error retrieving the sd card info. */
+#define HIS_ERROR_XRPD_SET_TEMP_FAKE_MODE            114  /**< Error activating the fake temperatur mode on the detector. */
+#define HIS_ERROR_EMI_NOT_SET                        115  /**< Error the requested EMI readout mode was not reported by the detector. */
+#define HIS_ERROR_XRPD_NO_LOCATION                   116  /**< Error retrieving the location info from the detector. */
+#define HIS_ERROR_SET_IDLE_TIMEOUT                   117  /**< Error setting the on detector idle timeout. */
+#define HIS_ERROR_SET_CHARGE_MODE                    118  /**< Error setting the software requested charge mode. */
+#define HIS_ERROR_XRPD_CREATE_FAKE_SHOCK_EVENT_CRIT  119  /**< Error creating critical level fake shock events. */
+#define HIS_ERROR_XRPD_CREATE_FAKE_SHOCK_EVENT_WARN  120  /**< Error creating warning level fake shock events. */
+#define HIS_ERROR_XRPD_FACTORY_RESET_SHOCK_EVENT     121  /**< Error resetting the shock events to factory values. */
+#define HIS_ERROR_XRPD_NO_NETWORK                    122  /**< Error getting the on detector LAN network speed. */
+#define HIS_ERROR_XRPD_SET_NETWORK                   123  /**< Error setting the on detector LAN network speed. */
+#define HIS_ERROR_XRPD_VERIFY_GENUINENESS            124  /**< Error verifying the private key for genuiness. */
+#define HIS_ERROR_XRPD_SET_PRIVATE_KEY               125  /**< Error setting the private key for genuiness. */
+#define HIS_ERROR_XRPD_SET_TEMPERATURE_TIMEOUT       126  /**< Error setting the temperature timeout. */
+#define HIS_ERROR_XRPD_RESET_TEMPERATURE_TIMEOUT     127  /**< Error resetting the temperature timeout counter. */
+#define HIS_ERROR_XRPD_SET_TEMPERATURE_THRESHOLDS    128  /**< Error setting the temperature thresholds on the detector. */
+#define HIS_ERROR_XRPD_GET_TEMPERATURE_THRESHOLDS    129  /**< Error getting the temperature thresholds from the detector. */
+#define HIS_ERROR_XRPD_NO_EVENTCALLBACK_DEFINED      130  /**< Error no eventcallback defined for irq messages. */
+#define HIS_ERROR_XRPD_SET_DATE_TIME                 131  /**< Error setting on detectors date and time. */
+#define HIS_ERROR_XRPD_RESEND_ALL_MSG                132  /**< Error triggering the resend of all current messages by the XRPD. */
+#define HIS_ERROR_ACKNOWLEDGE_IMAGE                  133  /**< Error acknowledging the image. */
+#define HIS_ERROR_XRPD_CONNECT                       134  /**< Error connecting to the on detector XRPD process. */
+#define HIS_ERROR_XRPD_RESET_SHOCK                   135  /**< Error resetting the shock event. */
+#define HIS_ERROR_XRPD_REQUEST_POWERSTATE            136  /**< Error setting the power state on the detector. */
+#define HIS_ERROR_XRPD_GET_AUTOPOWERONLOCATIONS      137  /**< Error retrieving the auto power on locations from the detector. */
+#define HIS_ERROR_XRPD_SET_AUTOPOWERONLOCATIONS      138  /**< Error setting the auto power on locations on the detector. */
+#define HIS_ERROR_GET_CHARGE_MODE                    139  /**< Error retrieving the requested charge mode from the detector. */
+#define HIS_ERROR_XRPD_SET_FORCE_FSCK                140  /**< Error requesting an fscheck on next boot. */
+#define HIS_ERROR_XRPD_SET_SDCARD_TIMEOUT            141  /**< Error setting the sd card timeout on the detector. */
+#define HIS_ERROR_XRPD_GET_SDCARD_TIMEOUT            142  /**< Error getting the sd card timeout from the detector. */
+#define HIS_ERROR_MISSING_VERSION_INFORMATION        143  /**< Error not connected to on detector XRPD process. */
+#define HIS_ERROR_XRPD_NOT_CONNECTED                 144  /**< Error not connected to on detector XRPD process. */
+#define HIS_ERROR_XRPD_SDCARDPERFORMANCE             145  /**< Error retrieving the SD card performance. */
+#define HIS_ERROR_HW_BOARD_CHANNEL_ALREADY_USED      146  /**< Requested channel is already openend. */
+#define HIS_ERROR_XRPD_GET_CURRENT_VOLTAGE           147  /**< Error retrieving the Voltage or Current from detector. */
+#define HIS_ERROR_XRPD_SET_CPUFREQ_GOVERNOR          148  /**< Unable to set on detector CPU govenor. */
+
+////////////////////////////////////////////////////////////
+// Sorting, Sequence and Sync Options
+////////////////////////////////////////////////////////////
+
+#define HIS_SORT_NOSORT                     0
+#define HIS_SORT_QUAD                       1
+#define HIS_SORT_COLUMN                     2
+#define HIS_SORT_COLUMNQUAD                 3
+#define HIS_SORT_QUAD_INVERSE               4
+#define HIS_SORT_QUAD_TILE                  5
+#define HIS_SORT_QUAD_TILE_INVERSE          6
+#define HIS_SORT_QUAD_TILE_INVERSE_SCRAMBLE 7
+#define HIS_SORT_OCT_TILE_INVERSE           8   /**< 1640 and 1620 */
+#define HIS_SORT_OCT_TILE_INVERSE_BINDING   9   /**< 1680 */
+#define HIS_SORT_OCT_TILE_INVERSE_DOUBLE    10  /**< 1620 reverse */
+#define HIS_SORT_HEX_TILE_INVERSE           11  /**< 1621 ADIC */
+#define HIS_SORT_HEX_CS                     12  /**< 1620/1640 continuous scan */
+#define HIS_SORT_12x1                       13  /**< 12x1 combo */
+#define HIS_SORT_14                         14
+#define HIS_SORT_TOP_BOTTOM                 15  /**< Full lines, top row then bottom row */
+
+#define HIS_SEQ_TWO_BUFFERS     0x1
+#define HIS_SEQ_ONE_BUFFER      0x2
+#define HIS_SEQ_AVERAGE         0x4
+#define HIS_SEQ_DEST_ONE_FRAME  0x8
+#define HIS_SEQ_COLLATE         0x10
+#define HIS_SEQ_CONTINUOUS      0x100
+#define HIS_SEQ_LEAKAGE         0x1000
+#define HIS_SEQ_NONLINEAR       0x2000
+#define HIS_SEQ_AVERAGESEQ      0x4000  /**< Sequence of averaged frames */
+#define HIS_SEQ_PREVIEW         0x8000
+
+#define HIS_SYNCMODE_SOFT_TRIGGER           1
+#define HIS_SYNCMODE_INTERNAL_TIMER         2
+#define HIS_SYNCMODE_EXTERNAL_TRIGGER       3
+#define HIS_SYNCMODE_FREE_RUNNING           4
+#define HIS_SYNCMODE_AUTO_TRIGGER           8
+#define HIS_SYNCMODE_EXTERNAL_TRIGGER_FG    16
+
+#define HIS_CAMMODE_SETSYNC     0x8
+#define HIS_CAMMODE_TIMEMASK    0x7
+#define HIS_CAMMODE_FPGA        0x7F
+
+////////////////////////////////////////////////////////////
+// Board Types
+////////////////////////////////////////////////////////////
+
+#define HIS_BOARD_TYPE_NOONE                0x0
+#define HIS_BOARD_TYPE_ELTEC                0x1
+#define HIS_BOARD_TYPE_DIPIX                0x2
+#define HIS_BOARD_TYPE_RS232                0x3
+#define HIS_BOARD_TYPE_USB                  0x4
+#define HIS_BOARD_TYPE_ELTEC_XRD_FGX        0x8
+#define HIS_BOARD_TYPE_ELTEC_XRD_FGE_Opto   0x10
+#define HIS_BOARD_TYPE_ELTEC_GbIF           0x20
+#define HIS_BOARD_TYPE_ELTEC_WPE            0x40
+#define HIS_BOARD_TYPE_ELTEC_EMBEDDED       0x60
+#define HIS_BOARD_TYPE_CMOS                 0x100
+#define HIS_BOARD_TYPE_ELTEC_13x13          0x320
+#define HIS_BOARD_TYPE_DEXELA_1512CL        0x500
+
+#define HIS_MAX_TIMINGS                     0x8
+
+////////////////////////////////////////////////////////////
+// Detector Capabilities
+////////////////////////////////////////////////////////////
+
+#define XIS_DETECTOR_PROVIDES_BINNING_1x1   0x1
+#define XIS_DETECTOR_PROVIDES_BINNING_2x2   0x2
+#define XIS_DETECTOR_PROVIDES_BINNING_4x4   0x4
+#define XIS_DETECTOR_PROVIDES_BINNING_1x2   0x8
+#define XIS_DETECTOR_PROVIDES_BINNING_1x4   0x10
+#define XIS_DETECTOR_PROVIDES_BINNING_3x3   0x20
+#define XIS_DETECTOR_PROVIDES_BINNING_9to4  0x40
+#define XIS_DETECTOR_PROVIDES_BINNING_AVG   0x100
+#define XIS_DETECTOR_PROVIDES_BINNING_SUM   0x200
+
+#endif // ACQUISITION_H
@@ -0,0 +1,14 @@
+/**
+ * @file DataType.h
+ * @brief Pixel data types used by the XISL API on Linux.
+ */
+
+#ifndef DATATYPE_H
+#define DATATYPE_H
+
+#include <stdint.h>
+
+typedef uint16_t XIS_PIXEL16;   /**< 16-bit detector pixel (PKI_SHORT) */
+typedef uint32_t XIS_PIXEL32;   /**< 32-bit detector pixel (PKI_LONG) */
+
+#endif // DATATYPE_H
@@ -0,0 +1,382 @@
+#include "accumulate.h"
+#include "simd.h"
+
+#include <algorithm>
+
+namespace {
+
+void addScalar(uint32_t *sum, const uint16_t *src, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i)
+        sum[i] += src[i];
+}
+
+void addScalar(uint32_t *sum, const uint32_t *src, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i)
+        sum[i] += src[i];
+}
+
+template <typename T>
+void setScalar(uint32_t *sum, const T *src, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i)
+        sum[i] = src[i];
+}
+
+// Wraps modulo 2^32 like the vector code; the window sum itself never
+// goes negative.
+template <typename T>
+void slideScalar(uint32_t *sum, const T *src, T *oldest, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i) {
+        sum[i] = sum[i] + src[i] - oldest[i];
+        oldest[i] = src[i];
+    }
+}
+
+template <typename T>
+void meanScalar(const uint32_t *sum, T *dst, size_t begin, size_t count,
+                const accumulate::Divider &divider, uint32_t maxValue)
+{
+    for (size_t i = begin; i < count; ++i)
+        dst[i] = static_cast<T>(std::min(divider.divide(sum[i]), maxValue));
+}
+
+#if DAQ_SIMD_X86
+DAQ_TARGET_AVX2
+inline __m256i divideAvx2(__m256i n, __m256i magic, __m128i shift)
+{
+    const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(n, magic), 32);
+    const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(n, 32), magic);
+    const __m256i t = _mm256_blend_epi32(even, odd, 0xAA);
+    const __m256i q = _mm256_add_epi32(t, _mm256_srli_epi32(_mm256_sub_epi32(n, t), 1));
+    return _mm256_srl_epi32(q, shift);
+}
+
+DAQ_TARGET_AVX2
+void addAvx2(uint32_t *sum, const uint16_t *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+        __m256i *acc = reinterpret_cast<__m256i *>(sum + i);
+        _mm256_storeu_si256(acc, _mm256_add_epi32(_mm256_loadu_si256(acc), s));
+    }
+    addScalar(sum, src, i, count);
+}
+
+DAQ_TARGET_AVX2
+void addAvx2(uint32_t *sum, const uint32_t *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i *acc = reinterpret_cast<__m256i *>(sum + i);
+        _mm256_storeu_si256(acc, _mm256_add_epi32(_mm256_loadu_si256(acc), s));
+    }
+    addScalar(sum, src, i, count);
+}
+
+DAQ_TARGET_AVX2
+void setAvx2(uint32_t *sum, const uint16_t *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(sum + i), s);
+    }
+    setScalar(sum, src, i, count);
+}
+
+DAQ_TARGET_AVX2
+void slideAvx2(uint32_t *sum, const uint16_t *src, uint16_t *oldest, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i *old = reinterpret_cast<__m128i *>(oldest + i);
+        const __m256i delta = _mm256_sub_epi32(_mm256_cvtepu16_epi32(in), _mm256_cvtepu16_epi32(_mm_loadu_si128(old)));
+        __m256i *acc = reinterpret_cast<__m256i *>(sum + i);
+        _mm256_storeu_si256(acc, _mm256_add_epi32(_mm256_loadu_si256(acc), delta));
+        _mm_storeu_si128(old, in);
+    }
+    slideScalar(sum, src, oldest, i, count);
+}
+
+DAQ_TARGET_AVX2
+void slideAvx2(uint32_t *sum, const uint32_t *src, uint32_t *oldest, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i *old = reinterpret_cast<__m256i *>(oldest + i);
+        const __m256i delta = _mm256_sub_epi32(in, _mm256_loadu_si256(old));
+        __m256i *acc = reinterpret_cast<__m256i *>(sum + i);
+        _mm256_storeu_si256(acc, _mm256_add_epi32(_mm256_loadu_si256(acc), delta));
+        _mm256_storeu_si256(old, in);
+    }
+    slideScalar(sum, src, oldest, i, count);
+}
+
+DAQ_TARGET_AVX2
+void meanAvx2(const uint32_t *sum, uint16_t *dst, size_t count, const accumulate::Divider &divider)
+{
+    const __m256i magic = _mm256_set1_epi32(static_cast<int>(divider.magic));
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(divider.shift));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i q0 = divideAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(sum + i)), magic, shift);
+        const __m256i q1 = divideAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(sum + i + 8)), magic, shift);
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(q0, q1), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+    meanScalar(sum, dst, i, count, divider, 0xFFFF);
+}
+
+DAQ_TARGET_AVX2
+void meanAvx2(const uint32_t *sum, uint32_t *dst, size_t count, const accumulate::Divider &divider,
+              uint32_t maxValue)
+{
+    const __m256i magic = _mm256_set1_epi32(static_cast<int>(divider.magic));
+    const __m256i maxVec = _mm256_set1_epi32(static_cast<int>(maxValue));
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(divider.shift));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i q = divideAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(sum + i)), magic, shift);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_min_epu32(q, maxVec));
+    }
+    meanScalar(sum, dst, i, count, divider, maxValue);
+}
+
+DAQ_TARGET_SSE41
+inline __m128i divideSse41(__m128i n, __m128i magic, __m128i shift)
+{
+    const __m128i even = _mm_srli_epi64(_mm_mul_epu32(n, magic), 32);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(n, 32), magic);
+    const __m128i t = _mm_blend_epi16(even, odd, 0xCC);
+    const __m128i q = _mm_add_epi32(t, _mm_srli_epi32(_mm_sub_epi32(n, t), 1));
+    return _mm_srl_epi32(q, shift);
+}
+
+DAQ_TARGET_SSE41
+void addSse41(uint32_t *sum, const uint16_t *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+        __m128i *acc = reinterpret_cast<__m128i *>(sum + i);
+        _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), s));
+    }
+    addScalar(sum, src, i, count);
+}
+
+DAQ_TARGET_SSE41
+void addSse41(uint32_t *sum, const uint32_t *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i *acc = reinterpret_cast<__m128i *>(sum + i);
+        _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), s));
+    }
+    addScalar(sum, src, i, count);
+}
+
+DAQ_TARGET_SSE41
+void setSse41(uint32_t *sum, const uint16_t *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(sum + i), s);
+    }
+    setScalar(sum, src, i, count);
+}
+
+DAQ_TARGET_SSE41
+void slideSse41(uint32_t *sum, const uint16_t *src, uint16_t *oldest, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i in = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i));
+        __m128i *old = reinterpret_cast<__m128i *>(oldest + i);
+        const __m128i delta = _mm_sub_epi32(_mm_cvtepu16_epi32(in), _mm_cvtepu16_epi32(_mm_loadl_epi64(old)));
+        __m128i *acc = reinterpret_cast<__m128i *>(sum + i);
+        _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), delta));
+        _mm_storel_epi64(old, in);
+    }
+    slideScalar(sum, src, oldest, i, count);
+}
+
+DAQ_TARGET_SSE41
+void slideSse41(uint32_t *sum, const uint32_t *src, uint32_t *oldest, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i *old = reinterpret_cast<__m128i *>(oldest + i);
+        const __m128i delta = _mm_sub_epi32(in, _mm_loadu_si128(old));
+        __m128i *acc = reinterpret_cast<__m128i *>(sum + i);
+        _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), delta));
+        _mm_storeu_si128(old, in);
+    }
+    slideScalar(sum, src, oldest, i, count);
+}
+
+DAQ_TARGET_SSE41
+void meanSse41(const uint32_t *sum, uint16_t *dst, size_t count, const accumulate::Divider &divider)
+{
+    const __m128i magic = _mm_set1_epi32(static_cast<int>(divider.magic));
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(divider.shift));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i q0 = divideSse41(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + i)), magic, shift);
+        const __m128i q1 = divideSse41(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + i + 4)), magic, shift);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi32(q0, q1));
+    }
+    meanScalar(sum, dst, i, count, divider, 0xFFFF);
+}
+
+DAQ_TARGET_SSE41
+void meanSse41(const uint32_t *sum, uint32_t *dst, size_t count, const accumulate::Divider &divider,
+               uint32_t maxValue)
+{
+    const __m128i magic = _mm_set1_epi32(static_cast<int>(divider.magic));
+    const __m128i maxVec = _mm_set1_epi32(static_cast<int>(maxValue));
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(divider.shift));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i q = divideSse41(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + i)), magic, shift);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_min_epu32(q, maxVec));
+    }
+    meanScalar(sum, dst, i, count, divider, maxValue);
+}
+#endif
+
+} // namespace
+
+namespace accumulate {
+
+Divider::Divider(uint32_t d)
+    : divisor(std::max<uint32_t>(d, 1)), magic(0), shift(0)
+{
+    if (divisor == 1)
+        return;
+    unsigned log2 = 31;
+    while (!(divisor >> log2 & 1))
+        --log2;
+    if ((divisor & (divisor - 1)) == 0) {
+        // n >> log2 == ((n >> 1) >> (log2 - 1)) with t == 0.
+        shift = log2 - 1;
+        return;
+    }
+    // magic is floor(2^(33 + log2) / d) + 1 without its 2^32 bit, which
+    // the add-and-halve step in divide() supplies.
+    const uint64_t numerator = uint64_t(1) << (32 + log2);
+    uint64_t m = numerator / divisor;
+    const uint64_t rem = numerator % divisor;
+    m += m;
+    if (rem + rem >= divisor)
+        m += 1;
+    magic = static_cast<uint32_t>(m + 1);
+    shift = log2;
+}
+
+void add(uint32_t *sum, const uint16_t *src, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  addAvx2(sum, src, count); return;
+    case simd::Level::Sse41: addSse41(sum, src, count); return;
+    default: break;
+    }
+#endif
+    addScalar(sum, src, 0, count);
+}
+
+void add(uint32_t *sum, const uint32_t *src, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  addAvx2(sum, src, count); return;
+    case simd::Level::Sse41: addSse41(sum, src, count); return;
+    default: break;
+    }
+#endif
+    addScalar(sum, src, 0, count);
+}
+
+void set(uint32_t *sum, const uint16_t *src, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  setAvx2(sum, src, count); return;
+    case simd::Level::Sse41: setSse41(sum, src, count); return;
+    default: break;
+    }
+#endif
+    setScalar(sum, src, 0, count);
+}
+
+void set(uint32_t *sum, const uint32_t *src, size_t count)
+{
+    std::copy(src, src + count, sum);
+}
+
+void slide(uint32_t *sum, const uint16_t *src, uint16_t *oldest, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  slideAvx2(sum, src, oldest, count); return;
+    case simd::Level::Sse41: slideSse41(sum, src, oldest, count); return;
+    default: break;
+    }
+#endif
+    slideScalar(sum, src, oldest, 0, count);
+}
+
+void slide(uint32_t *sum, const uint32_t *src, uint32_t *oldest, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  slideAvx2(sum, src, oldest, count); return;
+    case simd::Level::Sse41: slideSse41(sum, src, oldest, count); return;
+    default: break;
+    }
+#endif
+    slideScalar(sum, src, oldest, 0, count);
+}
+
+void mean(const uint32_t *sum, uint16_t *dst, size_t count, uint32_t divisor)
+{
+    const Divider divider(divisor);
+#if DAQ_SIMD_X86
+    // The vector divide needs the t-path; divisor 1 is a plain narrow.
+    if (divider.divisor > 1) {
+        switch (simd::level()) {
+        case simd::Level::Avx2:  meanAvx2(sum, dst, count, divider); return;
+        case simd::Level::Sse41: meanSse41(sum, dst, count, divider); return;
+        default: break;
+        }
+    }
+#endif
+    meanScalar(sum, dst, 0, count, divider, 0xFFFF);
+}
+
+void mean(const uint32_t *sum, uint32_t *dst, size_t count, uint32_t divisor, uint32_t maxValue)
+{
+    const Divider divider(divisor);
+#if DAQ_SIMD_X86
+    if (divider.divisor > 1) {
+        switch (simd::level()) {
+        case simd::Level::Avx2:  meanAvx2(sum, dst, count, divider, maxValue); return;
+        case simd::Level::Sse41: meanSse41(sum, dst, count, divider, maxValue); return;
+        default: break;
+        }
+    }
+#endif
+    meanScalar(sum, dst, 0, count, divider, maxValue);
+}
+
+} // namespace accumulate
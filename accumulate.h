@@ -0,0 +1,57 @@
+#ifndef ACCUMULATE_H
+#define ACCUMULATE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// ------------------------------------------------------------------
+// Frame accumulation kernels
+// 32-bit per-pixel sums of 16- or 32-bit frames and the integer mean
+// that turns them back into a frame (HIS_SEQ_AVERAGE style averaging).
+// The division uses a precomputed multiplier instead of a per-pixel
+// divide, so the mean is exact (floor) for every 32-bit sum without
+// going through floating point. AVX2 / SSE4.1 / scalar via simd::level().
+//
+// Sums must not exceed 32 bits: up to 65537 16-bit frames or 16384
+// 18-bit frames.
+// ------------------------------------------------------------------
+namespace accumulate {
+
+// Unsigned 32-bit division by an invariant divisor:
+// q = (t + ((n - t) >> 1)) >> shift with t = mulhi(n, magic).
+struct Divider {
+    explicit Divider(uint32_t divisor);
+
+    uint32_t divide(uint32_t n) const
+    {
+        if (divisor == 1)
+            return n;
+        const uint32_t t = static_cast<uint32_t>((static_cast<uint64_t>(n) * magic) >> 32);
+        return (t + ((n - t) >> 1)) >> shift;
+    }
+
+    uint32_t divisor;
+    uint32_t magic;
+    uint32_t shift;
+};
+
+void add(uint32_t *sum, const uint16_t *src, size_t count);
+void add(uint32_t *sum, const uint32_t *src, size_t count);
+
+// sum = src: starts a new sum without clearing it first.
+void set(uint32_t *sum, const uint16_t *src, size_t count);
+void set(uint32_t *sum, const uint32_t *src, size_t count);
+
+// One step of a moving-window sum: sum += src - oldest, then
+// oldest = src (the window's oldest frame becomes its newest).
+void slide(uint32_t *sum, const uint16_t *src, uint16_t *oldest, size_t count);
+void slide(uint32_t *sum, const uint32_t *src, uint32_t *oldest, size_t count);
+
+// dst = floor(sum / divisor), clamped to 'maxValue'.
+void mean(const uint32_t *sum, uint16_t *dst, size_t count, uint32_t divisor);
+void mean(const uint32_t *sum, uint32_t *dst, size_t count, uint32_t divisor,
+          uint32_t maxValue = 0xFFFFFFFFu);
+
+} // namespace accumulate
+
+#endif // ACCUMULATE_H
@@ -0,0 +1,120 @@
+#include "acquisitioncontrol.h"
+#include "steadyclock.h"
+
+bool AcquisitionControl::transition(State from, State to)
+{
+    return m_state.compare_exchange_strong(from, to, std::memory_order_acq_rel);
+}
+
+void AcquisitionControl::post(unsigned command)
+{
+    {
+        // The lock only orders the flag update against a worker that is
+        // about to sleep; pollers read m_state/m_pending without it.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.fetch_or(command, std::memory_order_acq_rel);
+    }
+    m_cond.notify_all();
+}
+
+bool AcquisitionControl::begin()
+{
+    // Leftover posts of the previous run (a requestAbort() that raced its
+    // finish(), a late signalComplete()) are discarded here, before
+    // leaving Idle; clearing after would lose an abort requested as soon
+    // as the state reads Starting.
+    if (state() != State::Idle)
+        return false;
+    m_pending.store(None, std::memory_order_release);
+    m_abortRequestedNs.store(0, std::memory_order_relaxed);
+    return transition(State::Idle, State::Starting);
+}
+
+void AcquisitionControl::setRunning()
+{
+    transition(State::Starting, State::Running);
+}
+
+void AcquisitionControl::signalComplete()
+{
+    post(Complete);
+}
+
+unsigned AcquisitionControl::waitForCommands()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this] { return m_pending.load(std::memory_order_acquire) != None; });
+    return m_pending.exchange(None, std::memory_order_acq_rel);
+}
+
+void AcquisitionControl::finish()
+{
+    // State first: an abort that got in before Idle stamped its time
+    // before changing the state, so the exchange below sees it.
+    m_state.exchange(State::Idle, std::memory_order_acq_rel);
+    const int64_t requested = m_abortRequestedNs.exchange(0, std::memory_order_acq_rel);
+    if (requested) {
+        const int64_t latency = steadyclock::nowNs() - requested;
+        m_lastAbortLatencyNs.store(latency, std::memory_order_relaxed);
+        int64_t worst = m_worstAbortLatencyNs.load(std::memory_order_relaxed);
+        while (latency > worst
+               && !m_worstAbortLatencyNs.compare_exchange_weak(worst, latency, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+bool AcquisitionControl::requestPause()
+{
+    if (!transition(State::Running, State::Paused))
+        return false;
+    post(Pause);
+    return true;
+}
+
+bool AcquisitionControl::requestResume()
+{
+    if (!transition(State::Paused, State::Running))
+        return false;
+    post(Resume);
+    return true;
+}
+
+bool AcquisitionControl::requestAbort()
+{
+    // Stamped before the state changes, so the finish() that ends this
+    // run always measures it; taken back if the request is refused.
+    const int64_t now = steadyclock::nowNs();
+    int64_t unstamped = 0;
+    const bool stamped = m_abortRequestedNs.compare_exchange_strong(unstamped, now, std::memory_order_acq_rel);
+    for (State current = state();;) {
+        if (current == State::Idle || current == State::Aborting) {
+            int64_t mine = now;
+            if (stamped)
+                m_abortRequestedNs.compare_exchange_strong(mine, 0, std::memory_order_acq_rel);
+            return false;
+        }
+        if (m_state.compare_exchange_weak(current, State::Aborting, std::memory_order_acq_rel))
+            break;
+    }
+    post(Abort);
+    return true;
+}
+
+bool AcquisitionControl::requestAbortCurrentFrame()
+{
+    const State current = state();
+    if (current != State::Running && current != State::Paused)
+        return false;
+    post(AbortCurrentFrame);
+    return true;
+}
+
+double AcquisitionControl::lastAbortLatencyMs() const
+{
+    return m_lastAbortLatencyNs.load(std::memory_order_relaxed) / 1e6;
+}
+
+double AcquisitionControl::worstAbortLatencyMs() const
+{
+    return m_worstAbortLatencyNs.load(std::memory_order_relaxed) / 1e6;
+}
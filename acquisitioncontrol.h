@@ -0,0 +1,73 @@
+#ifndef ACQUISITIONCONTROL_H
+#define ACQUISITIONCONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// ------------------------------------------------------------------
+// AcquisitionControl
+// Thread-safe control channel between the GUI (or any other caller)
+// and a running acquisition. Requests never go through an event queue:
+// they update an atomic state and a pending-command mask, so the
+// acquisition callback can poll them with a plain load and the worker
+// thread is woken immediately. Mirrors Acquisition_Abort and
+// Acquisition_AbortCurrentFrame, plus pause/resume.
+//
+//   Idle -> Starting -> Running <-> Paused
+//                          \           /
+//                           -> Aborting -> Idle
+//
+// The time from requestAbort() to finish() is measured so that the
+// worst-case abort-to-idle latency can be reported.
+// ------------------------------------------------------------------
+class AcquisitionControl {
+public:
+    enum class State : int { Idle, Starting, Running, Paused, Aborting };
+
+    enum Command : unsigned {
+        None              = 0,
+        Pause             = 0x1,
+        Resume            = 0x2,
+        Abort             = 0x4,
+        AbortCurrentFrame = 0x8,
+        Complete          = 0x10    // raised by the acquisition itself
+    };
+
+    // Worker side.
+    bool begin();
+    void setRunning();
+    void signalComplete();
+    unsigned waitForCommands();
+    void finish();
+
+    // Any thread.
+    bool requestPause();
+    bool requestResume();
+    bool requestAbort();
+    bool requestAbortCurrentFrame();
+
+    State state() const { return m_state.load(std::memory_order_acquire); }
+    bool isPaused() const { return state() == State::Paused; }
+    bool isAborting() const { return state() == State::Aborting; }
+
+    double lastAbortLatencyMs() const;
+    double worstAbortLatencyMs() const;
+
+private:
+    bool transition(State from, State to);
+    void post(unsigned command);
+
+    std::atomic<State> m_state{State::Idle};
+    std::atomic<unsigned> m_pending{None};
+    std::atomic<int64_t> m_abortRequestedNs{0};
+    std::atomic<int64_t> m_lastAbortLatencyNs{0};
+    std::atomic<int64_t> m_worstAbortLatencyNs{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+#endif // ACQUISITIONCONTROL_H
@@ -0,0 +1,778 @@
+#include "acquisitionsession.h"
+#include "affinity.h"
+#include "correction.h"
+#include "defectdetector.h"
+#include "descrambler.h"
+#include "frame.h"
+#include "framering.h"
+#include "gaincalibrator.h"
+#include "logger.h"
+#include "offsetcalibrator.h"
+#include "simd.h"
+#include "steadyclock.h"
+#include "telemetry.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+std::string environment(const char *name)
+{
+    const char *value = std::getenv(name);
+    return value ? value : "";
+}
+
+// Like qEnvironmentVariableIntValue(): 0 when unset or not a number.
+int environmentInt(const char *name)
+{
+    const std::string value = environment(name);
+    char *end = nullptr;
+    const long parsed = std::strtol(value.c_str(), &end, 0);
+    return !value.empty() && *end == '\0' ? static_cast<int>(parsed) : 0;
+}
+
+std::string lower(std::string text)
+{
+    for (char &c : text)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return text;
+}
+
+double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+AcquisitionSession::Options AcquisitionSession::Options::fromEnvironment()
+{
+    Options options;
+    options.sortMode = static_cast<unsigned>(std::max(0, environmentInt("DAQ_DESCRAMBLE")));
+    options.correctionThreads = static_cast<unsigned>(std::max(0, environmentInt("DAQ_CORRECTION_THREADS")));
+    options.bandRows = static_cast<unsigned>(std::max(0, environmentInt("DAQ_CORRECTION_BAND_ROWS")));
+
+    const std::string backend = lower(environment("DAQ_RECORD_BACKEND"));
+    if (backend == "buffered")
+        options.record.backend = HisWriter::Backend::Buffered;
+    else if (backend == "pwrite")
+        options.record.backend = HisWriter::Backend::ThreadPool;
+    else if (backend == "io_uring")
+        options.record.backend = HisWriter::Backend::IoUring;
+    if (environmentInt("DAQ_RECORD_DEPTH") > 0)
+        options.record.queueDepth = static_cast<unsigned>(environmentInt("DAQ_RECORD_DEPTH"));
+
+    const std::string predictor = lower(environment("DAQ_RECORD_COMPRESS"));
+    options.compress = !predictor.empty();
+    if (predictor == "left")
+        options.compression.predictor = FrameCodec::Predictor::Left;
+    else if (predictor == "up")
+        options.compression.predictor = FrameCodec::Predictor::Up;
+
+    FrameAverager::parse(lower(environment("DAQ_AVERAGE")), &options.averaging);
+    parseRoi(environment("DAQ_ROI"), &options.roi);
+    FrameBinner::parse(lower(environment("DAQ_BINNING")), &options.binning);
+    FrameStatistics::parse(lower(environment("DAQ_STATS")), &options.statistics);
+    return options;
+}
+
+AcquisitionSession::AcquisitionSession(Logger *log, Telemetry *telemetry)
+    : m_log(log)
+    , m_telemetry(telemetry)
+    , m_options(Options::fromEnvironment())
+{
+}
+
+AcquisitionSession::~AcquisitionSession() = default;
+
+void AcquisitionSession::log(XislLoggingLevels level, const char *format, ...)
+{
+    if (!m_log->enabled(level))
+        return;
+    char text[Logger::kTextBytes];
+    int prefix = 0;
+    if (!m_options.name.empty())
+        prefix = std::min<int>(std::snprintf(text, sizeof(text), "[%s] ", m_options.name.c_str()),
+                               static_cast<int>(sizeof(text)) - 1);
+    va_list args;
+    va_start(args, format);
+    const int length = std::vsnprintf(text + prefix, sizeof(text) - prefix, format, args);
+    va_end(args);
+    if (length >= 0)
+        m_log->message(level, text, std::min<size_t>(static_cast<size_t>(prefix + length), sizeof(text) - 1));
+}
+
+bool AcquisitionSession::run(Mode mode, const std::string &fileName, int64_t frameCount)
+{
+    if (mode != Mode::Acquire && frameCount <= 0) {
+        log(LEVEL_ERROR, "Calibration needs a frame count.");
+        return false;
+    }
+    if (!m_control.begin()) {
+        log(LEVEL_INFO, "Acquisition already running.");
+        return false;
+    }
+    if (!m_options.cpus.empty() && !affinity::pinCurrentThread(m_options.cpus))
+        log(LEVEL_WARN, "Cannot pin the acquisition to CPUs %s.", affinity::formatCpuList(m_options.cpus).c_str());
+    log(LEVEL_INFO, "Initializing detector...");
+    // From here on stats() describes this run, even if it fails to start.
+    m_frameCount = frameCount > 0 ? frameCount : 0;
+    m_framesDone = 0;
+    m_framesSkipped = 0;
+    m_outputs = 0;
+    m_firstFrameNs = 0;
+    m_lastFrameNs = 0;
+    m_recordStats = HisWriter::Stats();
+    m_compressedStats = CompressedHisWriter::Stats();
+    m_recordingPath.clear();
+    m_recordingCompressed = false;
+    HACQDESC hAcqDesc = openDetector();
+    if (!hAcqDesc) {
+        m_control.finish();
+        return false;
+    }
+    log(LEVEL_INFO, "Detector initialized (%u x %u, %d-bit).", m_sensorColumns, m_sensorRows,
+        m_sensorWide ? 18 : 16);
+    if (m_binner.isActive()) {
+        const FrameBinner::Roi &roi = m_binner.roi();
+        log(LEVEL_INFO, "Frames cropped to %u x %u at (%u, %u) and binned %s%s: %u x %u delivered (%u-bit).",
+            roi.width, roi.height, roi.x, roi.y, FrameBinner::modeName(m_binner.options().mode),
+            m_binner.options().sum ? " into 32-bit sums" : "", m_columns, m_rows, m_binner.bits());
+    }
+    log(LEVEL_INFO, "Correction kernels: %s, %u thread(s), %u-row bands.",
+        simd::levelName(simd::level()), m_correctionPool->threadCount(),
+        m_correction->bandRows(m_wide ? sizeof(uint32_t) : sizeof(uint16_t)));
+    // The calibrators sum frames in 32 bits, like the averager.
+    if (mode != Mode::Acquire && frameCount > FrameAverager::maxFrames(m_binner.maxValue())) {
+        log(LEVEL_ERROR, "Calibrating over %lld frames could overflow the 32-bit sums (at most %u).",
+            static_cast<long long>(frameCount), FrameAverager::maxFrames(m_binner.maxValue()));
+        Acquisition_Close(hAcqDesc);
+        m_ring.reset();
+        m_control.finish();
+        return false;
+    }
+    m_mode = mode;
+    m_telemetry->reset();
+    // Calibration folds the raw frames itself; only acquisitions average.
+    const FrameAverager::Options averaging = mode == Mode::Acquire ? m_options.averaging : FrameAverager::Options();
+    const XIS_FileType dataType = m_wide ? PKI_LONG : PKI_SHORT;
+    if (!m_averager.configure(averaging, m_rows, m_columns, dataType, m_binner.maxValue())) {
+        log(LEVEL_WARN, "Frames are not averaged: %s.", m_averager.error().c_str());
+    } else if (m_averager.isActive()) {
+        if (averaging.mode == FrameAverager::Mode::Running)
+            log(LEVEL_INFO, "Averaging: running mean of every frame (restarting after %u).",
+                FrameAverager::maxFrames(m_binner.maxValue()));
+        else
+            log(LEVEL_INFO, "Averaging: %s over %u frames, %s.", FrameAverager::modeName(averaging.mode),
+                averaging.frames, averaging.mode == FrameAverager::Mode::Block ? "one output per block"
+                                                                               : "one output per frame");
+    }
+    if (!m_statistics.configure(m_options.statistics, m_rows, m_columns))
+        log(LEVEL_WARN, "Statistics off: %s.", m_statistics.error().c_str());
+    else if (m_statistics.isActive())
+        log(LEVEL_INFO, "Statistics: %zu region(s), clip points at the %.1f and %.1f percentiles.",
+            m_statistics.results().size(), m_options.statistics.lowPercentile, m_options.statistics.highPercentile);
+    {
+        std::lock_guard<std::mutex> lock(m_statisticsMutex);
+        m_latestStatistics.clear();
+    }
+    char countText[48];
+    if (frameCount > 0)
+        std::snprintf(countText, sizeof(countText), "for %lld frame(s)", static_cast<long long>(frameCount));
+    else
+        std::snprintf(countText, sizeof(countText), "until stopped");
+    if (mode == Mode::CalibrateOffset) {
+        m_offsetCalibrator = std::make_unique<OffsetCalibrator>(m_rows, m_columns);
+        log(LEVEL_INFO, "Starting offset calibration over %lld dark frame(s)...", static_cast<long long>(frameCount));
+    } else if (mode == Mode::CalibrateGain) {
+        if (!m_gainCalibrator)
+            m_gainCalibrator = std::make_unique<GainCalibrator>(m_rows, m_columns);
+        m_gainCalibrator->beginLevel();
+        log(LEVEL_INFO, "Starting gain level %u over %lld flat-field frame(s)...",
+            m_gainCalibrator->levels() + 1, static_cast<long long>(frameCount));
+    } else if (m_options.compress && !m_wide) {
+        CompressedHisWriter::Options options = m_options.compression;
+        options.written = writeTimer();
+        m_compressedWriter.setOptions(options);
+        if (m_compressedWriter.open(fileName + ".hisz", m_rows, m_columns)) {
+            m_recordingPath = m_compressedWriter.path();
+            m_recordingCompressed = true;
+        } else {
+            log(LEVEL_ERROR, "Not recording: %s", m_compressedWriter.error().c_str());
+        }
+        log(LEVEL_INFO, "Starting acquisition %s...", countText);
+    } else {
+        if (m_options.compress)
+            log(LEVEL_WARN, "DAQ_RECORD_COMPRESS: 32-bit frames (18-bit or binned sums) are recorded uncompressed.");
+        HisWriter::Options options = m_options.record;
+        options.written = writeTimer();
+        if (m_averager.options().mode == FrameAverager::Mode::Block
+            || m_averager.options().mode == FrameAverager::Mode::Moving)
+            options.averagedFrames = static_cast<WORD>(std::min(m_averager.options().frames, 0xFFFFu));
+        m_writer.setOptions(options);
+        if (m_writer.open(fileName + ".his", m_rows, m_columns, m_wide ? PKI_LONG : PKI_SHORT))
+            m_recordingPath = m_writer.path();
+        else
+            log(LEVEL_ERROR, "Not recording: %s", m_writer.error().c_str());
+        log(LEVEL_INFO, "Starting acquisition %s...", countText);
+    }
+
+    m_statsRows = m_rows;
+    m_statsColumns = m_columns;
+    m_frameBytes = static_cast<size_t>(m_rows) * m_columns * (m_wide ? sizeof(uint32_t) : sizeof(uint16_t));
+    m_descrambleNs = 0;
+    m_doneSignalled = false;
+    UINT ret = Acquisition_Acquire_Image(hAcqDesc, kRingFrames, 0, HIS_SEQ_CONTINUOUS, nullptr, nullptr, nullptr);
+    if (ret != HIS_ALL_OK) {
+        log(LEVEL_ERROR, "Acquisition_Acquire_Image failed (error %u).", ret);
+    } else {
+        m_control.setRunning();
+        runControlLoop(hAcqDesc);
+        Acquisition_Abort(hAcqDesc);
+    }
+    Acquisition_Close(hAcqDesc);
+    bool recorded = true;
+    if (m_writer.isOpen()) {
+        closeRecording();
+        recorded = m_writer.error().empty();
+    }
+    if (m_compressedWriter.isOpen()) {
+        closeCompressedRecording();
+        recorded = m_compressedWriter.error().empty();
+    }
+
+    const bool aborted = m_control.isAborting();
+    m_control.finish();
+    const int64_t frames = stats().frames;
+    if (aborted && m_frameCount == 0 && mode == Mode::Acquire) {
+        log(LEVEL_INFO, "Acquisition stopped after %lld frame(s) (abort-to-idle %.1f ms).",
+            static_cast<long long>(frames), m_control.lastAbortLatencyMs());
+    } else if (aborted) {
+        log(LEVEL_WARN, "Acquisition aborted after %lld of %lld frame(s) (abort-to-idle %.1f ms, worst %.1f ms).",
+            static_cast<long long>(frames), static_cast<long long>(m_frameCount.load()),
+            m_control.lastAbortLatencyMs(), m_control.worstAbortLatencyMs());
+    } else if (ret == HIS_ALL_OK && mode == Mode::CalibrateOffset) {
+        loadOffsetCalibration();
+    } else if (ret == HIS_ALL_OK && mode == Mode::CalibrateGain) {
+        loadGainCalibration();
+    } else if (ret == HIS_ALL_OK) {
+        log(LEVEL_INFO, "Acquisition complete.");
+    }
+    if (m_descrambler && frames > 0) {
+        log(LEVEL_INFO, "Host sorting (%s, %u channels): %.2f ms per frame.",
+            Descrambler::modeName(m_descrambler->sortMode()), m_descrambler->channels(),
+            m_descrambleNs.load() / 1e6 / frames);
+    }
+    m_telemetry->set(Telemetry::Counter::PoolExhausted, m_ring->pool().stats().exhausted);
+    m_offsetCalibrator.reset();
+    m_mode = Mode::Acquire;
+    m_ring.reset();
+    return ret == HIS_ALL_OK && recorded;
+}
+
+void AcquisitionSession::clearGain()
+{
+    m_gainCalibrator.reset();
+    if (m_correction)
+        m_correction->setGain(nullptr);
+    log(LEVEL_INFO, "Gain calibration cleared.");
+    if (m_defectDetector) {
+        m_defectDetector->classifyFlats(nullptr, nullptr, 0);
+        reloadDefects();
+    }
+}
+
+std::vector<FrameStatistics::Result> AcquisitionSession::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_statisticsMutex);
+    return m_latestStatistics;
+}
+
+AcquisitionSession::Stats AcquisitionSession::stats() const
+{
+    Stats stats;
+    const int64_t done = m_framesDone.load();
+    const int64_t count = m_frameCount.load();
+    stats.frames = count ? std::min(done, count) : done;
+    stats.skipped = m_framesSkipped.load();
+    stats.outputs = m_outputs.load();
+    stats.seconds = (m_lastFrameNs.load() - m_firstFrameNs.load()) / 1e9;
+    stats.rows = m_statsRows.load();
+    stats.columns = m_statsColumns.load();
+    stats.bytes = static_cast<uint64_t>(stats.frames) * m_frameBytes.load();
+    return stats;
+}
+
+bool AcquisitionSession::parseRoi(const std::string &text, Roi *roi)
+{
+    Roi parsed;
+    char tail = 0;
+    if (std::sscanf(text.c_str(), "%u,%u,%u,%u%c", &parsed.x, &parsed.y, &parsed.width, &parsed.height, &tail) != 4)
+        return false;
+    *roi = parsed;
+    return true;
+}
+
+// Records end-of-frame -> on disk for the writers' completions.
+std::function<void(int64_t)> AcquisitionSession::writeTimer()
+{
+    Telemetry *telemetry = m_telemetry;
+    return [telemetry](int64_t timestampNs) {
+        telemetry->record(Telemetry::Stage::Write, steadyclock::nowNs() - timestampNs);
+    };
+}
+
+void AcquisitionSession::closeRecording()
+{
+    const auto start = std::chrono::steady_clock::now();
+    const bool ok = m_writer.close();
+    const double closeMs = msSince(start);
+    const HisWriter::Stats stats = m_writer.stats();
+    m_recordStats = stats;
+    const char *path = m_writer.path().c_str();
+    if (!ok) {
+        log(LEVEL_ERROR, "Recording to %s failed after %llu frame(s): %s", path,
+            static_cast<unsigned long long>(stats.frames), m_writer.error().c_str());
+        return;
+    }
+    log(LEVEL_INFO, "Saved %llu frame(s) to %s (%.1f MiB, %.0f MB/s via %s%s, %llu stall(s), closed in %.0f ms).",
+        static_cast<unsigned long long>(stats.frames), path, stats.bytes / (1024.0 * 1024.0), stats.mbPerSecond(),
+        stats.backend, stats.direct ? ", O_DIRECT" : "", static_cast<unsigned long long>(stats.stalls), closeMs);
+    if (m_writer.isDirect())
+        log(LEVEL_INFO, "Disk queue depth: %.1f average, %u peak of %u.", stats.averageQueueDepth,
+            stats.peakQueueDepth, m_writer.options().queueDepth);
+}
+
+void AcquisitionSession::closeCompressedRecording()
+{
+    const bool ok = m_compressedWriter.close();
+    const CompressedHisWriter::Stats stats = m_compressedWriter.stats();
+    m_compressedStats = stats;
+    const char *path = m_compressedWriter.path().c_str();
+    if (!ok) {
+        log(LEVEL_ERROR, "Recording to %s failed after %llu frame(s): %s", path,
+            static_cast<unsigned long long>(stats.frames), m_compressedWriter.error().c_str());
+        return;
+    }
+    log(LEVEL_INFO, "Saved %llu frame(s) to %s (%.1f MiB, %.2f:1 %s, %.1f ms per frame on %u thread(s), "
+                    "%llu stall(s)).",
+        static_cast<unsigned long long>(stats.frames), path, stats.bytes / (1024.0 * 1024.0), stats.ratio(),
+        FrameCodec::predictorName(m_compressedWriter.options().predictor),
+        stats.frames ? stats.encodeMs / stats.frames : 0.0, m_compressedWriter.threadCount(),
+        static_cast<unsigned long long>(stats.stalls));
+}
+
+void AcquisitionSession::loadOffsetCalibration()
+{
+    const size_t pixels = m_offsetCalibrator->pixelCount();
+    const OffsetCalibrator::Summary summary = m_offsetCalibrator->summary();
+    if (m_wide) {
+        std::vector<uint32_t> offset(pixels);
+        if (!m_offsetCalibrator->offsetMap32(offset.data()))
+            return;
+        m_correction->setOffset32(offset.data());
+    } else {
+        std::vector<uint16_t> offset(pixels);
+        if (!m_offsetCalibrator->offsetMap(offset.data()))
+            return;
+        m_correction->setOffset(offset.data());
+    }
+    log(LEVEL_INFO, "Offset calibrated from %u frame(s): mean offset %.1f, noise mean %.2f / max %.2f "
+                    "(%.1f MiB working set).",
+        static_cast<unsigned>(m_offsetCalibrator->frames()), summary.meanOffset, summary.meanNoise,
+        summary.maxNoise, m_offsetCalibrator->memoryBytes() / (1024.0 * 1024.0));
+
+    std::vector<uint32_t> offset(pixels);
+    std::vector<float> noise(pixels);
+    m_offsetCalibrator->offsetMap32(offset.data());
+    const bool hasNoise = m_offsetCalibrator->noiseMap(noise.data());
+    defectDetector().classifyDark(offset.data(), hasNoise ? noise.data() : nullptr);
+    reloadDefects();
+}
+
+// Flats are offset-corrected with whatever offset is loaded now, so
+// calibrate the offset first.
+void AcquisitionSession::loadGainCalibration()
+{
+    const uint32_t frames = m_gainCalibrator->framesInLevel();
+    const auto start = std::chrono::steady_clock::now();
+    const bool added = m_wide ? m_gainCalibrator->endLevel32(*m_correctionPool, m_correction->offsetMap32())
+                              : m_gainCalibrator->endLevel(*m_correctionPool, m_correction->offsetMap());
+    if (!added)
+        return;
+    const unsigned levels = m_gainCalibrator->levels();
+    const size_t pixels = m_gainCalibrator->pixelCount();
+    if (m_wide) {
+        std::vector<uint32_t> flats(levels * pixels), averages(levels);
+        m_gainCalibrator->gainDataEx32(flats.data(), averages.data());
+        m_correction->setGainEx32(flats.data(), averages.data(), levels, m_correctionPool.get());
+    } else {
+        std::vector<uint16_t> flats(levels * pixels), averages(levels);
+        m_gainCalibrator->gainDataEx(flats.data(), averages.data());
+        m_correction->setGainEx(flats.data(), averages.data(), levels, m_correctionPool.get());
+    }
+    const double ms = msSince(start);
+    std::string averages;
+    for (unsigned k = 0; k < levels; ++k)
+        averages += (k ? ", " : "") + std::to_string(m_gainCalibrator->levelAverage(k));
+    log(LEVEL_INFO, "Gain level added from %u frame(s); %u-point gain loaded (level averages %s) in %.0f ms.",
+        frames, levels, averages.c_str(), ms);
+
+    std::vector<const uint32_t *> levelFlats(levels);
+    std::vector<uint32_t> levelAverages(levels);
+    for (unsigned k = 0; k < levels; ++k) {
+        levelFlats[k] = m_gainCalibrator->levelFlat(k);
+        levelAverages[k] = m_gainCalibrator->levelAverage(k);
+    }
+    defectDetector().classifyFlats(levelFlats.data(), levelAverages.data(), levels);
+    reloadDefects();
+}
+
+DefectDetector &AcquisitionSession::defectDetector()
+{
+    if (!m_defectDetector)
+        m_defectDetector = std::make_unique<DefectDetector>(m_rows, m_columns);
+    return *m_defectDetector;
+}
+
+void AcquisitionSession::reloadDefects()
+{
+    m_correction->setDefectPlan(m_defectDetector->plan());
+    const DefectDetector::Counts counts = m_defectDetector->counts();
+    log(LEVEL_INFO, "Defect map: %u dead, %u hot, %u noisy, %u nonlinear, %u row(s) and %u column(s) condemned; "
+                    "%zu pixel(s) corrected.",
+        static_cast<unsigned>(counts.dead), static_cast<unsigned>(counts.hot), static_cast<unsigned>(counts.noisy),
+        static_cast<unsigned>(counts.nonlinear), static_cast<unsigned>(counts.lineRows),
+        static_cast<unsigned>(counts.lineColumns), m_correction->defectPlan().size());
+}
+
+// Sleeps until a control request arrives or the acquisition completes.
+// Abort needs no polling interval: requestAbort() wakes this thread
+// at once and the detector stops within the current frame.
+void AcquisitionSession::runControlLoop(HACQDESC hAcqDesc)
+{
+    for (;;) {
+        const unsigned commands = m_control.waitForCommands();
+        if (commands & AcquisitionControl::AbortCurrentFrame)
+            Acquisition_AbortCurrentFrame(hAcqDesc);
+        if (commands & AcquisitionControl::Pause)
+            log(LEVEL_INFO, "Acquisition paused.");
+        if (commands & AcquisitionControl::Resume)
+            log(LEVEL_INFO, "Acquisition resumed (%lld frame(s) skipped while paused).",
+                static_cast<long long>(m_framesSkipped.load()));
+        if (commands & (AcquisitionControl::Abort | AcquisitionControl::Complete))
+            return;
+    }
+}
+
+// The delivered geometry and pixel type: the FrameBinner's output.
+bool AcquisitionSession::setGeometry()
+{
+    if (!m_binner.configure(m_options.binning, m_options.roi, m_sensorRows, m_sensorColumns,
+                            m_sensorWide ? PKI_LONG : PKI_SHORT)) {
+        log(LEVEL_ERROR, "Cannot crop and bin the frames: %s.", m_binner.error().c_str());
+        return false;
+    }
+    m_rows = m_binner.rows();
+    m_columns = m_binner.columns();
+    m_wide = (m_binner.outputType() & PKI_LONG) != 0;
+    m_binned.assign(m_binner.isActive() ? static_cast<size_t>(m_rows) * m_columns * (m_wide ? 2 : 1) : 0, 0);
+    return true;
+}
+
+HACQDESC AcquisitionSession::openDetector()
+{
+    UINT ret = HIS_ALL_OK;
+    HACQDESC hAcqDesc = m_detector;
+    m_detector = nullptr;
+    if (!hAcqDesc) {
+        UINT numSensors = 0;
+        ret = Acquisition_EnumSensors(&numSensors, TRUE, FALSE);
+        if (ret != HIS_ALL_OK || numSensors == 0) {
+            log(LEVEL_ERROR, "No detector found (error %u).", ret);
+            return nullptr;
+        }
+        ACQDESCPOS pos = 0;
+        ret = Acquisition_GetNextSensor(&pos, &hAcqDesc);
+        if (ret != HIS_ALL_OK) {
+            log(LEVEL_ERROR, "Acquisition_GetNextSensor failed (error %u).", ret);
+            return nullptr;
+        }
+    }
+
+    UINT frames, dataType, sortFlags;
+    BOOL irqEnabled;
+    DWORD acqType, systemId, syncMode, hwAccess;
+    Acquisition_GetConfiguration(hAcqDesc, &frames, &m_sensorRows, &m_sensorColumns, &dataType, &sortFlags,
+                                 &irqEnabled, &acqType, &systemId, &syncMode, &hwAccess);
+    // 18-bit panels deliver DWORD pixels into the same destination buffers.
+    m_sensorWide = (dataType & DETEKTOR_DATATYPE_18BIT) != 0;
+    if (!setGeometry()) {
+        Acquisition_Close(hAcqDesc);
+        return nullptr;
+    }
+    m_buffer.assign(static_cast<size_t>(kRingFrames) * m_sensorRows * m_sensorColumns * (m_sensorWide ? 2 : 1), 0);
+    const FrameBinner::Options &binning = m_binner.options();
+    if (!m_correction || m_correction->rows() != m_rows || m_correction->columns() != m_columns
+        || m_correctionBinning.mode != binning.mode || m_correctionBinning.sum != binning.sum) {
+        m_correction = std::make_unique<CorrectionEngine>(m_rows, m_columns);
+        m_correctionBinning = binning;
+        m_gainCalibrator.reset();
+        m_defectDetector.reset();
+    }
+    // Binned sums outgrow the 18-bit clamp of the 32-bit kernels.
+    m_correction->setMaxValue32(m_binner.maxValue());
+    m_correction->setBandRows(m_options.bandRows);
+    const unsigned readout = m_options.sortMode;
+    if (readout == HIS_SORT_NOSORT) {
+        m_descrambler.reset();
+    } else if (!m_descrambler || m_descrambler->sortMode() != readout
+               || m_descrambler->rows() != m_sensorRows || m_descrambler->columns() != m_sensorColumns) {
+        m_descrambler = std::make_unique<Descrambler>(m_sensorRows, m_sensorColumns, readout);
+        if (!m_descrambler->isValid()) {
+            log(LEVEL_WARN, "DAQ_DESCRAMBLE: sort mode %u does not fit a %u x %u panel (error %d); "
+                            "frames are used as delivered.",
+                readout, m_sensorColumns, m_sensorRows, HIS_ERROR_BAD_SORTING_PARAM);
+            m_descrambler.reset();
+        }
+    }
+    m_sorted.assign(m_descrambler ? static_cast<size_t>(m_sensorRows) * m_sensorColumns * (m_sensorWide ? 2 : 1) : 0,
+                    0);
+    if (!m_correctionPool)
+        m_correctionPool = std::make_unique<ThreadPool>(m_options.correctionThreads);
+
+    if (m_options.frameRate > 0) {
+        DWORD cycleTimeUs = static_cast<DWORD>(std::lround(1e6 / m_options.frameRate));
+        ret = Acquisition_SetFrameSyncMode(hAcqDesc, HIS_SYNCMODE_INTERNAL_TIMER);
+        if (ret == HIS_ALL_OK)
+            ret = Acquisition_SetTimerSync(hAcqDesc, &cycleTimeUs);
+        if (ret != HIS_ALL_OK)
+            log(LEVEL_WARN, "Cannot run the internal timer at %.2f fps (error %u); using the detector's timing.",
+                m_options.frameRate, ret);
+        else
+            log(LEVEL_INFO, "Internal timer: %lu us cycle (%.2f fps).", static_cast<unsigned long>(cycleTimeUs),
+                cycleTimeUs ? 1e6 / cycleTimeUs : 0.0);
+    }
+
+    Acquisition_SetCallbacksAndMessages(hAcqDesc, nullptr, 0, 0, onEndFrame, onEndAcquisition);
+    Acquisition_SetAcqData(hAcqDesc, this);
+    Acquisition_SetEventCallback(hAcqDesc, onEvent, m_telemetry);
+    ret = Acquisition_DefineDestBuffers(hAcqDesc, m_buffer.data(), kRingFrames, m_sensorRows, m_sensorColumns);
+    if (ret != HIS_ALL_OK) {
+        log(LEVEL_ERROR, "Acquisition_DefineDestBuffers failed (error %u).", ret);
+        Acquisition_Close(hAcqDesc);
+        return nullptr;
+    }
+
+    // One frame in flight in the callback (two while averaging) and one
+    // held by the consumer on top of the ring slots, plus the frames
+    // queued to the disk (or the encoder), so the pool never runs dry.
+    const size_t recording = std::max<size_t>(m_options.record.queueDepth, m_options.compression.queueFrames);
+    auto pool = std::make_shared<FramePool>(kStreamSlots + 3 + recording, m_rows, m_columns,
+                                            m_wide ? PKI_LONG : PKI_SHORT);
+    m_ring = std::make_shared<FrameRing>(kStreamSlots, std::move(pool), FrameRing::OverrunPolicy::DropOldest);
+    if (m_options.liveStream && m_callbacks.streamStarted)
+        m_callbacks.streamStarted(m_ring);
+    return hAcqDesc;
+}
+
+AcquisitionSession *AcquisitionSession::fromHandle(HACQDESC hAcqDesc)
+{
+    void *data = nullptr;
+    Acquisition_GetAcqData(hAcqDesc, &data);
+    return static_cast<AcquisitionSession *>(data);
+}
+
+void CALLBACK AcquisitionSession::onEndFrame(HACQDESC hAcqDesc)
+{
+    fromHandle(hAcqDesc)->handleEndFrame(hAcqDesc);
+}
+
+void CALLBACK AcquisitionSession::onEndAcquisition(HACQDESC hAcqDesc)
+{
+    fromHandle(hAcqDesc)->signalDone();
+}
+
+// Frames the detector or the network lost before they reached us.
+void AcquisitionSession::onEvent(XIS_Event event, UINT type, UINT, void *, void *userData)
+{
+    Telemetry *telemetry = static_cast<Telemetry *>(userData);
+    if (event == XE_DETECTOR_EVENT && type == XDE_DROPPED_IMAGE)
+        telemetry->add(Telemetry::Counter::DroppedImage);
+    else if (event == XE_LIBRARY_EVENT && type == XLE_HIS_ERROR_PACKET_LOSS)
+        telemetry->add(Telemetry::Counter::PacketLoss);
+}
+
+// Runs on the library's acquisition thread. The detector keeps
+// integrating while paused; those frames are discarded, not counted.
+void AcquisitionSession::handleEndFrame(HACQDESC hAcqDesc)
+{
+    const int64_t endOfFrameNs = steadyclock::nowNs();
+    const AcquisitionControl::State state = m_control.state();
+    if (state == AcquisitionControl::State::Aborting)
+        return;
+    if (state == AcquisitionControl::State::Paused) {
+        ++m_framesSkipped;
+        return;
+    }
+    const int64_t frame = ++m_framesDone;
+    const int64_t frameCount = m_frameCount.load(std::memory_order_relaxed);
+    if (frameCount && frame > frameCount)
+        return;
+    if (frame == 1) {
+        m_firstFrameNs = endOfFrameNs;
+        // The library's thread was not started by run(), so it does not
+        // inherit the pinning.
+        if (!m_options.cpus.empty())
+            affinity::pinCurrentThread(m_options.cpus);
+    }
+    m_lastFrameNs = endOfFrameNs;
+    DWORD actFrame = 0, secFrame = 0;
+    Acquisition_GetActFrame(hAcqDesc, &actFrame, &secFrame);
+    const size_t slotOffset = static_cast<size_t>(secFrame - 1) * m_sensorRows * m_sensorColumns;
+    const unsigned short *raw = m_buffer.data() + slotOffset * (m_sensorWide ? 2 : 1);
+    if (m_descrambler) {
+        const auto start = std::chrono::steady_clock::now();
+        if (m_sensorWide)
+            m_descrambler->descramble(reinterpret_cast<const uint32_t *>(raw),
+                                      reinterpret_cast<uint32_t *>(m_sorted.data()));
+        else
+            m_descrambler->descramble(raw, m_sorted.data());
+        const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        m_descrambleNs += ns;
+        m_telemetry->record(Telemetry::Stage::Sort, ns);
+        raw = m_sorted.data();
+    }
+    // From here on frames have the delivered geometry and type.
+    if (m_binner.isActive()) {
+        const int64_t binStart = steadyclock::nowNs();
+        if (m_sensorWide)
+            m_binner.bin(reinterpret_cast<const uint32_t *>(raw), m_binned.data());
+        else
+            m_binner.bin(raw, m_binned.data());
+        raw = m_binned.data();
+        m_telemetry->record(Telemetry::Stage::Bin, steadyclock::nowNs() - binStart);
+    }
+
+    // Calibration sees the raw detector data, before any correction.
+    if (m_mode == Mode::CalibrateOffset)
+        feedRaw(*m_offsetCalibrator, raw);
+    else if (m_mode == Mode::CalibrateGain)
+        feedRaw(*m_gainCalibrator, raw);
+
+    // The DMA slot is reused by the library, so correcting out of it is
+    // the one copy a frame sees (a plain copy while no correction data
+    // is loaded); every later stage works on the pooled frame itself.
+    FrameRef out = m_ring->pool().acquire();
+    if (out) {
+        const int64_t correctStart = steadyclock::nowNs();
+        if (m_wide) {
+            m_correction->apply(reinterpret_cast<const uint32_t *>(raw), out->pixels32(), *m_correctionPool);
+            out->bits = m_binner.bits();
+        } else {
+            m_correction->apply(raw, out->pixels16(), *m_correctionPool);
+        }
+        m_telemetry->record(Telemetry::Stage::Correct, steadyclock::nowNs() - correctStart);
+        out->frameNumber = actFrame;
+        out->timestampNs = endOfFrameNs;
+        CHwHeaderInfo info;
+        out->hasHeader = Acquisition_GetLatestFrameHeader(hAcqDesc, &info, &out->header) == HIS_ALL_OK;
+        if (frame == 1 && out->hasHeader) {
+            const double integrationUs = out->header.wRealInttime_milliSec * 1000.0
+                                         + out->header.wRealInttime_microSec;
+            if (m_writer.isOpen())
+                m_writer.setIntegrationTime(integrationUs);
+            else if (m_compressedWriter.isOpen())
+                m_compressedWriter.setIntegrationTime(integrationUs);
+        }
+
+        // The averaged frame takes the corrected one's place; between
+        // block outputs nothing goes further.
+        if (m_averager.isActive()) {
+            const int64_t averageStart = steadyclock::nowNs();
+            FrameRef averaged;
+            if (m_averager.add(*out)) {
+                averaged = m_ring->pool().acquire();
+                if (averaged)
+                    m_averager.mean(*averaged);
+            }
+            out = std::move(averaged);
+            m_telemetry->record(Telemetry::Stage::Average, steadyclock::nowNs() - averageStart);
+        }
+    }
+    if (out && m_statistics.isActive())
+        measure(*out);
+    if (out) {
+        ++m_outputs;
+        if (m_writer.isOpen())
+            m_writer.append(out);
+        else if (m_compressedWriter.isOpen())
+            m_compressedWriter.append(out);
+
+        if (m_options.liveStream) {
+            FrameRing::Slot *slot = m_ring->acquireWrite();
+            slot->frame = std::move(out);
+            m_ring->publish(slot);
+            m_telemetry->sample(Telemetry::Gauge::Ring, m_ring->stats().depth);
+        }
+        if (m_writer.isOpen())
+            m_telemetry->sample(Telemetry::Gauge::WriteQueue, m_writer.queueDepth());
+        else if (m_compressedWriter.isOpen())
+            m_telemetry->sample(Telemetry::Gauge::WriteQueue, m_compressedWriter.queueDepth());
+    }
+    m_log->counter(LEVEL_DEBUG, frameCount ? "Acquired frame %lld of %lld." : "Acquired frame %lld.", frame,
+                   frameCount, m_options.name.c_str());
+    if (m_callbacks.frameCaptured)
+        m_callbacks.frameCaptured(frame, frameCount);
+    m_telemetry->record(Telemetry::Stage::Acquire, steadyclock::nowNs() - endOfFrameNs);
+    if (frame == frameCount)
+        signalDone();
+}
+
+template <typename Calibrator>
+void AcquisitionSession::feedRaw(Calibrator &calibrator, const unsigned short *raw)
+{
+    if (m_wide)
+        calibrator.add(reinterpret_cast<const uint32_t *>(raw));
+    else
+        calibrator.add(raw);
+}
+
+// Statistics of a frame about to be delivered. The first recorded frame
+// gives the HIS header its median, so the writers need not take one
+// themselves; they still do when the histogram is binned (wider than 16
+// bits) or the first region is not the whole frame.
+void AcquisitionSession::measure(Frame &frame)
+{
+    const int64_t start = steadyclock::nowNs();
+    m_statistics.compute(frame);
+    const FrameStatistics::Result &first = m_statistics.results().front();
+    frame.summary = first.summary;
+    const bool wholeFrame = first.region.width == m_columns && first.region.height == m_rows;
+    if (m_outputs.load(std::memory_order_relaxed) == 0 && wholeFrame && first.summary.binShift == 0) {
+        const WORD median = static_cast<WORD>(std::min<uint32_t>(first.summary.median, 0xFFFF));
+        if (m_writer.isOpen())
+            m_writer.setMedianValue(median);
+        else if (m_compressedWriter.isOpen())
+            m_compressedWriter.setMedianValue(median);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_statisticsMutex);
+        m_latestStatistics = m_statistics.results();
+    }
+    m_telemetry->record(Telemetry::Stage::Statistics, steadyclock::nowNs() - start);
+}
+
+void AcquisitionSession::signalDone()
+{
+    if (!m_doneSignalled.exchange(true))
+        m_control.signalComplete();
+}
@@ -0,0 +1,226 @@
+#ifndef ACQUISITIONSESSION_H
+#define ACQUISITIONSESSION_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Acq.h"
+#include "acquisitioncontrol.h"
+#include "compressedhiswriter.h"
+#include "frameaverager.h"
+#include "framebinner.h"
+#include "framestatistics.h"
+#include "hiswriter.h"
+
+class CorrectionEngine;
+class DefectDetector;
+class Descrambler;
+class FrameRing;
+class GainCalibrator;
+class Logger;
+class OffsetCalibrator;
+class Telemetry;
+class ThreadPool;
+
+// ------------------------------------------------------------------
+// AcquisitionSession
+// Drives the detector through the XISL API, without any GUI: the
+// acquisition, calibration, correction and recording pipeline shared by
+// the Qt worker and the headless daq_cli. Frames are acquired
+// continuously into a small ring of destination buffers; the end-frame
+// callback (running on the library's acquisition thread) sorts, crops
+// and bins each frame (FrameBinner) as configured, corrects it into a
+// pooled Frame, optionally averages it (FrameAverager), measures it
+// (FrameStatistics, into Frame::summary and the HIS header's median) and
+// hands the result to the recorder and, for a live view, to a FrameRing.
+// On Linux the API is provided by the software detector in xisl_sim/.
+//
+// run() blocks the calling thread until the acquisition completes or
+// control().requestAbort() stops it. A frame count of 0 runs until
+// aborted. Acquire records into <fileName>.his (or .hisz when
+// compressing); CalibrateOffset and CalibrateGain fold the raw frames
+// into an OffsetCalibrator / GainCalibrator and load the result into the
+// correction engine for later runs, along with the DefectDetector's
+// defect plan. Calibration data follows the session's frame geometry
+// (ROI and binning, mean or sums), so it is dropped when that changes.
+//
+// Messages go to the shared Logger and per-frame timings, queue depths
+// and the library's dropped-image and packet-loss events to the shared
+// Telemetry.
+//
+// A session drives one panel: the first sensor Acquisition_EnumSensors
+// finds, or the one given to setDetector(). Several sessions can run at
+// once, one per panel (DetectorManager); with Options::cpus, run()
+// pins its own thread, and so the correction and disk threads it
+// starts, as well as the library's acquisition thread to those CPUs.
+// ------------------------------------------------------------------
+class AcquisitionSession {
+public:
+    enum class Mode { Acquire, CalibrateOffset, CalibrateGain };
+
+    using Roi = FrameBinner::Roi;
+
+    struct Options {
+        double frameRate = 0;           // fps through the internal timer; 0 keeps the detector's own
+        Roi roi;
+        FrameBinner::Options binning;   // after the ROI crop
+        unsigned sortMode = HIS_SORT_NOSORT;    // host descrambling of raw readout order
+        unsigned correctionThreads = 0; // 0 = every core
+        unsigned bandRows = 0;          // 0 = sized to the cache
+        bool liveStream = true;         // publish frames to a FrameRing
+        bool compress = false;          // record 16-bit frames into .hisz
+        FrameAverager::Options averaging;
+        FrameStatistics::Options statistics;    // regions in delivered pixels
+        HisWriter::Options record;
+        CompressedHisWriter::Options compression;
+        std::string name;               // prefixes log lines when sessions share a Logger
+        std::vector<unsigned> cpus;     // pin the acquisition to these; empty: anywhere
+
+        // DAQ_ROI (see parseRoi), DAQ_BINNING (see FrameBinner::parse),
+        // DAQ_DESCRAMBLE, DAQ_CORRECTION_THREADS, DAQ_CORRECTION_BAND_ROWS,
+        // DAQ_RECORD_BACKEND, DAQ_RECORD_DEPTH, DAQ_RECORD_COMPRESS,
+        // DAQ_AVERAGE (see FrameAverager::parse) and DAQ_STATS (see
+        // FrameStatistics::parse).
+        static Options fromEnvironment();
+    };
+
+    struct Callbacks {
+        // On the library's acquisition thread; 'total' is 0 when unbounded.
+        // Called for every frame, so it must not queue work per call;
+        // progress displays poll stats() instead.
+        std::function<void(int64_t frame, int64_t total)> frameCaptured;
+        // On the run() thread, before the first frame.
+        std::function<void(std::shared_ptr<FrameRing> ring)> streamStarted;
+    };
+
+    struct Stats {
+        int64_t frames = 0;             // detector frames delivered
+        int64_t outputs = 0;            // frames passed on after averaging
+        int64_t skipped = 0;            // discarded while paused
+        double seconds = 0;             // first to last frame
+        uint64_t bytes = 0;             // corrected pixel data delivered
+        unsigned rows = 0;              // delivered frame geometry
+        unsigned columns = 0;
+        double framesPerSecond() const { return seconds > 0 && frames > 1 ? (frames - 1) / seconds : 0.0; }
+        double mbPerSecond() const { return frames ? framesPerSecond() * (bytes / frames) / 1e6 : 0.0; }
+    };
+
+    AcquisitionSession(Logger *log, Telemetry *telemetry);
+    ~AcquisitionSession();
+
+    AcquisitionSession(const AcquisitionSession &) = delete;
+    AcquisitionSession &operator=(const AcquisitionSession &) = delete;
+
+    // Not while running; takes effect with the next run().
+    void setOptions(const Options &options) { m_options = options; }
+    const Options &options() const { return m_options; }
+    void setCallbacks(Callbacks callbacks) { m_callbacks = std::move(callbacks); }
+    // The panel the next run() acquires from, instead of the first
+    // enumerated sensor; that run closes it.
+    void setDetector(HACQDESC hAcqDesc) { m_detector = hAcqDesc; }
+
+    // Safe to call from any thread.
+    AcquisitionControl &control() { return m_control; }
+
+    // Returns false if the acquisition could not be started or failed.
+    bool run(Mode mode, const std::string &fileName, int64_t frameCount);
+    void clearGain();
+
+    // Of the last (or current) run; safe to call from any thread.
+    Stats stats() const;
+    // Of the last run's recording, once run() has returned.
+    const HisWriter::Stats &recordStats() const { return m_recordStats; }
+    const CompressedHisWriter::Stats &compressedStats() const { return m_compressedStats; }
+    // The file the last run recorded to (.his or .hisz), once run() has
+    // returned; empty when it recorded nothing (a calibration, or the
+    // file could not be created).
+    const std::string &recordingPath() const { return m_recordingPath; }
+    bool recordingCompressed() const { return m_recordingCompressed; }
+    // Of the newest delivered frame, one per region; empty before the
+    // first or with the statistics off. Safe to call from any thread.
+    std::vector<FrameStatistics::Result> statistics() const;
+
+    // "x,y,width,height"; false when malformed.
+    static bool parseRoi(const std::string &text, Roi *roi);
+
+private:
+    static constexpr UINT kRingFrames = 8;
+    static constexpr size_t kStreamSlots = 4;
+
+    void log(XislLoggingLevels level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+    HACQDESC openDetector();
+    bool setGeometry();
+    void runControlLoop(HACQDESC hAcqDesc);
+    void closeRecording();
+    void closeCompressedRecording();
+    void loadOffsetCalibration();
+    void loadGainCalibration();
+    DefectDetector &defectDetector();
+    void reloadDefects();
+    std::function<void(int64_t)> writeTimer();
+
+    static AcquisitionSession *fromHandle(HACQDESC hAcqDesc);
+    static void CALLBACK onEndFrame(HACQDESC hAcqDesc);
+    static void CALLBACK onEndAcquisition(HACQDESC hAcqDesc);
+    static void onEvent(XIS_Event event, UINT type, UINT, void *, void *userData);
+    void handleEndFrame(HACQDESC hAcqDesc);
+    template <typename Calibrator>
+    void feedRaw(Calibrator &calibrator, const unsigned short *raw);
+    void measure(Frame &frame);
+    void signalDone();
+
+    AcquisitionControl m_control;
+    Logger *m_log;
+    Telemetry *m_telemetry;
+    Options m_options;
+    Callbacks m_callbacks;
+    HACQDESC m_detector = nullptr;      // from setDetector(), for one run
+    UINT m_sensorRows = 0;              // as read out
+    UINT m_sensorColumns = 0;
+    bool m_sensorWide = false;          // 18-bit readout
+    UINT m_rows = 0;                    // as delivered
+    UINT m_columns = 0;
+    bool m_wide = false;                // 32-bit frames delivered (18-bit or binned sums)
+    FrameBinner m_binner;
+    std::vector<unsigned short> m_buffer;
+    std::unique_ptr<CorrectionEngine> m_correction;
+    FrameBinner::Options m_correctionBinning;  // the calibration data's binning
+    std::unique_ptr<ThreadPool> m_correctionPool;
+    Mode m_mode = Mode::Acquire;
+    std::unique_ptr<OffsetCalibrator> m_offsetCalibrator;
+    std::unique_ptr<GainCalibrator> m_gainCalibrator;
+    std::unique_ptr<DefectDetector> m_defectDetector;
+    std::unique_ptr<Descrambler> m_descrambler;
+    FrameAverager m_averager;
+    FrameStatistics m_statistics;
+    mutable std::mutex m_statisticsMutex;
+    std::vector<FrameStatistics::Result> m_latestStatistics;    // guarded by m_statisticsMutex
+    HisWriter m_writer;
+    CompressedHisWriter m_compressedWriter;
+    HisWriter::Stats m_recordStats;
+    CompressedHisWriter::Stats m_compressedStats;
+    std::string m_recordingPath;
+    bool m_recordingCompressed = false;
+    std::vector<unsigned short> m_sorted;      // host-sorted frame when descrambling
+    std::vector<unsigned short> m_binned;      // cropped and binned frame
+    std::atomic<int64_t> m_descrambleNs{0};
+    std::shared_ptr<FrameRing> m_ring;
+    std::atomic<int64_t> m_frameCount{0};
+    std::atomic<int64_t> m_framesDone{0};
+    std::atomic<int64_t> m_framesSkipped{0};
+    std::atomic<int64_t> m_outputs{0};
+    std::atomic<int64_t> m_firstFrameNs{0};
+    std::atomic<int64_t> m_lastFrameNs{0};
+    std::atomic<unsigned> m_statsRows{0};       // m_rows and m_columns, for stats()
+    std::atomic<unsigned> m_statsColumns{0};
+    std::atomic<size_t> m_frameBytes{0};
+    std::atomic<bool> m_doneSignalled{false};
+};
+
+#endif // ACQUISITIONSESSION_H
@@ -0,0 +1,141 @@
+#include "affinity.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#ifdef __linux__
+    #include <dirent.h>
+    #include <sched.h>
+#endif
+
+namespace {
+
+std::vector<unsigned> allowedCpus()
+{
+    std::vector<unsigned> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        const unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned cpu = 0; cpu < count; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+} // namespace
+
+namespace affinity {
+
+std::vector<Node> nodes()
+{
+    const std::vector<unsigned> allowed = allowedCpus();
+    std::vector<Node> found;
+#ifdef __linux__
+    if (DIR *dir = opendir("/sys/devices/system/node")) {
+        while (const dirent *entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4
+                || name.find_first_not_of("0123456789", 4) != std::string::npos)
+                continue;
+            std::ifstream file("/sys/devices/system/node/" + name + "/cpulist");
+            std::string list;
+            std::vector<unsigned> cpus;
+            if (!std::getline(file, list) || !parseCpuList(list, &cpus))
+                continue;
+            Node node;
+            node.id = static_cast<unsigned>(std::strtoul(name.c_str() + 4, nullptr, 10));
+            for (unsigned cpu : cpus) {
+                if (std::binary_search(allowed.begin(), allowed.end(), cpu))
+                    node.cpus.push_back(cpu);
+            }
+            if (!node.cpus.empty())
+                found.push_back(std::move(node));
+        }
+        closedir(dir);
+    }
+#endif
+    if (found.empty()) {
+        Node node;
+        node.cpus = allowed;
+        found.push_back(std::move(node));
+    }
+    std::sort(found.begin(), found.end(), [](const Node &a, const Node &b) { return a.id < b.id; });
+    return found;
+}
+
+bool pinCurrentThread(const std::vector<unsigned> &cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned cpu : cpus) {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    // pid 0: the calling thread, not the whole process.
+    return CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+bool parseCpuList(const std::string &text, std::vector<unsigned> *cpus)
+{
+    std::vector<unsigned> parsed;
+    const char *p = text.c_str();
+    while (*p && *p != '\n') {
+        char *end = nullptr;
+        const unsigned long first = std::strtoul(p, &end, 10);
+        if (end == p)
+            return false;
+        unsigned long last = first;
+        p = end;
+        if (*p == '-') {
+            last = std::strtoul(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return false;
+            p = end;
+        }
+        for (unsigned long cpu = first; cpu <= last; ++cpu)
+            parsed.push_back(static_cast<unsigned>(cpu));
+        if (*p == ',')
+            ++p;
+        else if (*p && *p != '\n')
+            return false;
+    }
+    std::sort(parsed.begin(), parsed.end());
+    parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+    *cpus = std::move(parsed);
+    return true;
+}
+
+std::string formatCpuList(const std::vector<unsigned> &cpus)
+{
+    std::string text;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            ++j;
+        if (!text.empty())
+            text += ',';
+        text += std::to_string(cpus[i]);
+        if (j > i)
+            text += '-' + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return text;
+}
+
+} // namespace affinity
@@ -0,0 +1,39 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------
+// CPU and NUMA placement
+// The NUMA nodes and their CPUs as Linux reports them under
+// /sys/devices/system/node, limited to the CPUs this process may run
+// on, and pinning of the calling thread to a set of them. Threads
+// inherit their creator's CPU mask and Linux places a page on the node
+// of the thread that first touches it, so a thread pinned before it
+// starts its workers and fills its buffers keeps both on one node.
+//
+// Without the sysfs topology (or off Linux) there is one node holding
+// every allowed CPU; pinning is Linux-only and fails elsewhere.
+// ------------------------------------------------------------------
+namespace affinity {
+
+struct Node {
+    unsigned id = 0;
+    std::vector<unsigned> cpus;         // ascending
+};
+
+// Nodes with at least one allowed CPU, by id.
+std::vector<Node> nodes();
+
+// Returns false when the thread could not be pinned (no CPU of 'cpus'
+// is allowed, or no affinity support).
+bool pinCurrentThread(const std::vector<unsigned> &cpus);
+
+// The kernel's list format, "0-3,8,10-11"; false when malformed.
+bool parseCpuList(const std::string &text, std::vector<unsigned> *cpus);
+std::string formatCpuList(const std::vector<unsigned> &cpus);
+
+} // namespace affinity
+
+#endif // AFFINITY_H
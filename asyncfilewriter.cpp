@@ -0,0 +1,474 @@
+#include "asyncfilewriter.h"
+#include "steadyclock.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #define DAQ_IO_URING 1
+    #endif
+#endif
+#ifndef DAQ_IO_URING
+    #define DAQ_IO_URING 0
+#endif
+
+namespace {
+
+constexpr unsigned kPoolThreads = 4;
+
+} // namespace
+
+// ------------------------------------------------------------------
+// Ring
+// Minimal io_uring: the SQ, CQ and SQE array mapped from the kernel,
+// one slot (request + iovec) per write in flight. Producers submit
+// under 'submitMutex'; the reaper thread only consumes the CQ.
+
+#if DAQ_IO_URING
+struct AsyncFileWriter::Ring {
+    int fd = -1;
+    void *sqMap = MAP_FAILED;
+    size_t sqMapBytes = 0;
+    void *cqMap = MAP_FAILED;
+    size_t cqMapBytes = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqesBytes = 0;
+    unsigned *sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    static constexpr uint64_t kWakeTag = ~uint64_t(0);
+
+    std::mutex submitMutex;
+    std::vector<Request> slots;         // guarded by AsyncFileWriter::m_mutex
+    std::vector<unsigned> freeSlots;    // likewise
+    std::vector<iovec> iovecs;
+
+    bool setup(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0)
+            return false;
+        sqMapBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sqMapBytes = cqMapBytes = std::max(sqMapBytes, cqMapBytes);
+        sqMap = mmap(nullptr, sqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED)
+            return false;
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cqMap = sqMap;
+        } else {
+            cqMap = mmap(nullptr, cqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_CQ_RING);
+            if (cqMap == MAP_FAILED)
+                return false;
+        }
+        sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqesBytes, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+            return false;
+
+        uint8_t *sq = static_cast<uint8_t *>(sqMap);
+        uint8_t *cq = static_cast<uint8_t *>(cqMap);
+        sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        slots.resize(entries);
+        iovecs.resize(entries);
+        for (unsigned s = entries; s-- > 0;)
+            freeSlots.push_back(s);
+        return true;
+    }
+
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqesBytes);
+        if (cqMap != MAP_FAILED && cqMap != sqMap)
+            munmap(cqMap, cqMapBytes);
+        if (sqMap != MAP_FAILED)
+            munmap(sqMap, sqMapBytes);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    // Queues slot 's' (its request already filled in) and enters the
+    // kernel. Returns 0 or a negative errno.
+    int submit(int file, unsigned s, const Request &request)
+    {
+        std::lock_guard<std::mutex> lock(submitMutex);
+        iovecs[s].iov_base = const_cast<uint8_t *>(static_cast<const uint8_t *>(request.data) + request.done);
+        iovecs[s].iov_len = request.bytes - request.done;
+        const unsigned tail = *sqTail;
+        const unsigned index = tail & sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITEV;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(&iovecs[s]);
+        sqe.len = 1;
+        sqe.off = request.offset + request.done;
+        sqe.user_data = s;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        for (;;) {
+            const long r = syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+            if (r >= 0)
+                return 0;
+            if (errno != EINTR)
+                return -errno;
+        }
+    }
+
+    // A no-op whose completion wakes the reaper, e.g. for shutdown after
+    // a failed submission left it waiting.
+    int wake()
+    {
+        std::lock_guard<std::mutex> lock(submitMutex);
+        const unsigned tail = *sqTail;
+        const unsigned index = tail & sqMask;
+        std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+        sqes[index].opcode = IORING_OP_NOP;
+        sqes[index].user_data = kWakeTag;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        const long r = syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+        return r < 0 ? -errno : 0;
+    }
+
+    int waitForCompletion()
+    {
+        const long r = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        return r < 0 && errno != EINTR ? -errno : 0;
+    }
+};
+#else
+struct AsyncFileWriter::Ring {};
+#endif
+
+// ------------------------------------------------------------------
+// AsyncFileWriter
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    close();
+}
+
+const char *AsyncFileWriter::backendName(Backend backend)
+{
+    return backend == Backend::IoUring ? "io_uring" : "pwrite pool";
+}
+
+bool AsyncFileWriter::open(const std::string &path, Backend preferred, unsigned depth, Completion completion)
+{
+    if (m_fd >= 0) {
+        m_error = "a file is already open";
+        return false;
+    }
+    m_error.clear();
+#ifdef __linux__
+    m_path = path;
+    m_depth = std::max(depth, 1u);
+    m_completion = std::move(completion);
+    m_direct = true;
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT | O_CLOEXEC, 0644);
+    if (m_fd < 0 && errno == EINVAL) {
+        m_direct = false;
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (m_fd < 0) {
+        m_error = "cannot create " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    m_stop = false;
+    m_failed = false;
+    m_queue.clear();
+    m_inFlight = m_peakInFlight = 0;
+    m_submissions = m_inFlightSum = m_writes = m_bytes = 0;
+    m_firstSubmitNs = -1;
+    m_lastCompleteNs = 0;
+
+    m_backend = Backend::ThreadPool;
+#if DAQ_IO_URING
+    if (preferred == Backend::IoUring) {
+        m_ring = new Ring;
+        if (m_ring->setup(m_depth)) {
+            m_backend = Backend::IoUring;
+        } else {
+            delete m_ring;
+            m_ring = nullptr;
+        }
+    }
+#else
+    (void)preferred;
+#endif
+    if (m_backend == Backend::IoUring) {
+        m_threads.emplace_back([this] { ringLoop(); });
+    } else {
+        for (unsigned t = 0; t < std::min(m_depth, kPoolThreads); ++t)
+            m_threads.emplace_back([this] { poolLoop(); });
+    }
+    return true;
+#else
+    (void)path;
+    (void)preferred;
+    (void)depth;
+    (void)completion;
+    m_error = "asynchronous direct I/O is only available on Linux";
+    return false;
+#endif
+}
+
+bool AsyncFileWriter::write(const void *data, size_t bytes, uint64_t offset, uint64_t tag)
+{
+    if (m_fd < 0)
+        return false;
+    if (m_direct && (reinterpret_cast<uintptr_t>(data) % kAlignment || bytes % kAlignment || offset % kAlignment)) {
+        fail("unaligned write with O_DIRECT");
+        return false;
+    }
+    const Request request{data, bytes, offset, tag, 0};
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_space.wait(lock, [this] { return m_inFlight < m_depth || m_failed; });
+    if (m_failed)
+        return false;
+    ++m_inFlight;
+    m_peakInFlight = std::max(m_peakInFlight, m_inFlight);
+    m_inFlightSum += m_inFlight;
+    ++m_submissions;
+    if (m_firstSubmitNs < 0)
+        m_firstSubmitNs = steadyclock::nowNs();
+
+    if (m_backend == Backend::ThreadPool) {
+        m_queue.push_back(request);
+        lock.unlock();
+        m_work.notify_one();
+        return true;
+    }
+#if DAQ_IO_URING
+    const unsigned slot = m_ring->freeSlots.back();
+    m_ring->freeSlots.pop_back();
+    m_ring->slots[slot] = request;
+    lock.unlock();
+    m_work.notify_one();
+    const int result = m_ring->submit(m_fd, slot, request);
+    if (result < 0) {
+        fail(std::string("io_uring submission failed: ") + std::strerror(-result));
+        {
+            std::lock_guard<std::mutex> relock(m_mutex);
+            m_ring->freeSlots.push_back(slot);
+        }
+        finish(request, false);
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool AsyncFileWriter::writeNow(const void *data, size_t bytes, uint64_t offset)
+{
+#ifdef __linux__
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    size_t done = 0;
+    while (done < bytes) {
+        const ssize_t n = pwrite(m_fd, p + done, bytes - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            fail("write to " + m_path + " failed: " + std::strerror(n < 0 ? errno : EIO));
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+#else
+    (void)data;
+    (void)bytes;
+    (void)offset;
+    return false;
+#endif
+}
+
+void AsyncFileWriter::poolLoop()
+{
+#ifdef __linux__
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_work.wait(lock, [this] { return !m_queue.empty() || m_stop; });
+        if (m_queue.empty())
+            return;
+        Request request = m_queue.front();
+        m_queue.pop_front();
+        lock.unlock();
+
+        const uint8_t *p = static_cast<const uint8_t *>(request.data);
+        bool ok = true;
+        while (request.done < request.bytes) {
+            const ssize_t n = pwrite(m_fd, p + request.done, request.bytes - request.done,
+                                     static_cast<off_t>(request.offset + request.done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                fail("write to " + m_path + " failed: " + std::strerror(n < 0 ? errno : EIO));
+                ok = false;
+                break;
+            }
+            request.done += static_cast<size_t>(n);
+        }
+        finish(request, ok);
+        lock.lock();
+    }
+#endif
+}
+
+void AsyncFileWriter::ringLoop()
+{
+#if DAQ_IO_URING
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_work.wait(lock, [this] { return m_inFlight > 0 || m_stop; });
+            if (m_stop && m_inFlight == 0)
+                return;
+        }
+        const int waited = m_ring->waitForCompletion();
+        if (waited < 0)
+            fail(std::string("io_uring wait failed: ") + std::strerror(-waited));
+        unsigned head = *m_ring->cqHead;
+        while (head != __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe &cqe = m_ring->cqes[head & m_ring->cqMask];
+            const uint64_t tag = cqe.user_data;
+            const int result = cqe.res;
+            __atomic_store_n(m_ring->cqHead, ++head, __ATOMIC_RELEASE);
+            if (tag == Ring::kWakeTag)
+                continue;
+            const unsigned slot = static_cast<unsigned>(tag);
+
+            Request request;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                request = m_ring->slots[slot];
+            }
+            if (result <= 0) {
+                fail("write to " + m_path + " failed: " + std::strerror(result < 0 ? -result : EIO));
+            } else {
+                request.done += static_cast<size_t>(result);
+                if (request.done < request.bytes) {
+                    // Short write: send the rest from the same slot.
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_ring->slots[slot] = request;
+                    }
+                    const int resubmitted = m_ring->submit(m_fd, slot, request);
+                    if (resubmitted == 0)
+                        continue;
+                    fail(std::string("io_uring submission failed: ") + std::strerror(-resubmitted));
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_ring->freeSlots.push_back(slot);
+            }
+            finish(request, request.done == request.bytes);
+        }
+    }
+#endif
+}
+
+void AsyncFileWriter::finish(const Request &request, bool ok)
+{
+    if (m_completion)
+        m_completion(request.tag, ok);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_inFlight;
+        if (ok) {
+            ++m_writes;
+            m_bytes += request.bytes;
+        } else {
+            m_failed = true;
+        }
+        m_lastCompleteNs = steadyclock::nowNs();
+    }
+    m_space.notify_all();
+}
+
+bool AsyncFileWriter::drain()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_space.wait(lock, [this] { return m_inFlight == 0; });
+    return !m_failed;
+}
+
+bool AsyncFileWriter::close()
+{
+    if (m_fd < 0)
+        return false;
+    bool ok = drain();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_work.notify_all();
+#if DAQ_IO_URING
+    if (m_ring)
+        m_ring->wake();
+#endif
+    for (std::thread &thread : m_threads)
+        thread.join();
+    m_threads.clear();
+    delete m_ring;
+    m_ring = nullptr;
+#ifdef __linux__
+    if (::close(m_fd) != 0 && ok) {
+        fail("closing " + m_path + " failed: " + std::strerror(errno));
+        ok = false;
+    }
+#endif
+    m_fd = -1;
+    return ok;
+}
+
+AsyncFileWriter::Stats AsyncFileWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.writes = m_writes;
+    stats.bytes = m_bytes;
+    stats.inFlight = m_inFlight;
+    stats.peakInFlight = m_peakInFlight;
+    stats.averageInFlight = m_submissions ? static_cast<double>(m_inFlightSum) / m_submissions : 0.0;
+    if (m_firstSubmitNs >= 0 && m_lastCompleteNs > m_firstSubmitNs)
+        stats.activeMs = (m_lastCompleteNs - m_firstSubmitNs) / 1e6;
+    return stats;
+}
+
+void AsyncFileWriter::fail(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_failed || m_error.empty())
+        m_error = message;
+    m_failed = true;
+}
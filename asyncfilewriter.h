@@ -0,0 +1,119 @@
+#ifndef ASYNCFILEWRITER_H
+#define ASYNCFILEWRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ------------------------------------------------------------------
+// AsyncFileWriter
+// Queue of positioned writes into one file opened with O_DIRECT, so
+// recording bypasses the page cache and its writeback stalls. Up to
+// 'depth' writes are in flight at once, through either
+//  - IoUring: one thread feeding a raw io_uring (no liburing needed)
+//    and reaping its completions, or
+//  - ThreadPool: a few threads issuing blocking pwrite() calls,
+// with IoUring falling back to ThreadPool where the kernel refuses the
+// ring, and O_DIRECT falling back to cached I/O on filesystems that do
+// not support it (isDirect() tells which one is in use).
+//
+// The caller's buffer is written in place and must stay untouched until
+// the completion callback reports its tag, which is how the recorder
+// hands pooled frames to the disk without copying them. With O_DIRECT,
+// buffer address, length and file offset must be multiples of
+// kAlignment. write() waits while 'depth' writes are outstanding.
+//
+// Available on Linux only; elsewhere open() fails and callers keep
+// their buffered path.
+// ------------------------------------------------------------------
+class AsyncFileWriter {
+public:
+    enum class Backend { IoUring, ThreadPool };
+
+    static constexpr size_t kAlignment = 4096;
+
+    struct Stats {
+        uint64_t writes = 0;            // completed
+        uint64_t bytes = 0;
+        unsigned inFlight = 0;
+        unsigned peakInFlight = 0;
+        double averageInFlight = 0;     // sampled at each submission
+        double activeMs = 0;            // first submission to last completion
+        double mbPerSecond() const { return activeMs > 0 ? bytes / (activeMs * 1000.0) : 0.0; }
+    };
+
+    // Runs on an I/O thread; 'ok' is false if the write failed.
+    using Completion = std::function<void(uint64_t tag, bool ok)>;
+
+    AsyncFileWriter() = default;
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter &) = delete;
+    AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+
+    // Creates (truncates) 'path'. False, with error() set, on failure.
+    bool open(const std::string &path, Backend preferred, unsigned depth, Completion completion);
+    bool isOpen() const { return m_fd >= 0; }
+    Backend backend() const { return m_backend; }
+    bool isDirect() const { return m_direct; }
+    unsigned depth() const { return m_depth; }
+    static const char *backendName(Backend backend);
+
+    bool write(const void *data, size_t bytes, uint64_t offset, uint64_t tag);
+    // Synchronous, outside the queue (headers).
+    bool writeNow(const void *data, size_t bytes, uint64_t offset);
+    // Waits until nothing is in flight; false if any write has failed.
+    bool drain();
+    bool close();
+
+    Stats stats() const;
+    const std::string &error() const { return m_error; }
+
+private:
+    struct Request {
+        const void *data;
+        size_t bytes;
+        uint64_t offset;
+        uint64_t tag;
+        size_t done;                    // bytes already written (short writes)
+    };
+    struct Ring;
+
+    void poolLoop();
+    void ringLoop();
+    void finish(const Request &request, bool ok);
+    void fail(const std::string &message);
+
+    int m_fd = -1;
+    Backend m_backend = Backend::ThreadPool;
+    bool m_direct = false;
+    unsigned m_depth = 0;
+    Completion m_completion;
+    std::string m_path;
+    std::string m_error;
+    Ring *m_ring = nullptr;
+
+    std::vector<std::thread> m_threads;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_work;     // I/O threads: queued requests or stop
+    std::condition_variable m_space;    // producers: a write completed
+    std::deque<Request> m_queue;
+    bool m_stop = false;
+    bool m_failed = false;
+    unsigned m_inFlight = 0;            // queued + submitted
+    unsigned m_peakInFlight = 0;
+    uint64_t m_submissions = 0;
+    uint64_t m_inFlightSum = 0;
+    uint64_t m_writes = 0;
+    uint64_t m_bytes = 0;
+    int64_t m_firstSubmitNs = -1;
+    int64_t m_lastCompleteNs = 0;
+};
+
+#endif // ASYNCFILEWRITER_H
@@ -0,0 +1,153 @@
+#include "compressedhisreader.h"
+#include "compressedhiswriter.h"
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kWinHeaderOffset = 32;
+
+bool hasMagic(const uint8_t *p, const char *magic)
+{
+    return std::memcmp(p, magic, 4) == 0;
+}
+
+} // namespace
+
+CompressedHisReader::~CompressedHisReader()
+{
+    close();
+}
+
+bool CompressedHisReader::open(const std::string &path)
+{
+    close();
+    m_error.clear();
+    m_file = std::fopen(path.c_str(), "rb");
+    if (!m_file)
+        return fail("cannot open " + path + ": " + std::strerror(errno));
+#ifdef _WIN32
+    if (_fseeki64(m_file, 0, SEEK_END) != 0)
+        return fail("cannot size " + path);
+    m_size = static_cast<uint64_t>(_ftelli64(m_file));
+#else
+    if (fseeko(m_file, 0, SEEK_END) != 0)
+        return fail("cannot size " + path);
+    m_size = static_cast<uint64_t>(ftello(m_file));
+#endif
+
+    uint8_t header[CompressedHisWriter::kHeaderBytes];
+    if (m_size < sizeof(header) || !seek(0) || std::fread(header, 1, sizeof(header), m_file) != sizeof(header))
+        return fail(path + " is too short for a .hisz header");
+    uint16_t version;
+    uint32_t stripRows;
+    uint64_t frames, indexOffset;
+    std::memcpy(&version, header + 4, 2);
+    std::memcpy(&stripRows, header + 8, 4);
+    std::memcpy(&frames, header + 16, 8);
+    std::memcpy(&indexOffset, header + 24, 8);
+    if (!hasMagic(header, "HISZ") || version != CompressedHisWriter::kVersion)
+        return fail(path + " is not a .hisz file");
+    if (header[6] > static_cast<uint8_t>(FrameCodec::Predictor::Median))
+        return fail(path + " uses an unknown predictor");
+    std::memcpy(&m_header, header + kWinHeaderOffset, sizeof(m_header));
+    if (m_header.BRX < m_header.ULX || m_header.BRY < m_header.ULY)
+        return fail(path + " has an empty image rectangle");
+    m_columns = static_cast<unsigned>(m_header.BRX - m_header.ULX) + 1;
+    m_rows = static_cast<unsigned>(m_header.BRY - m_header.ULY) + 1;
+    m_codec = std::make_unique<FrameCodec>(m_rows, m_columns, static_cast<FrameCodec::Predictor>(header[6]),
+                                           stripRows);
+
+    m_recovered = indexOffset == 0 || !loadIndex(indexOffset, frames);
+    if (m_recovered)
+        scanChunks();
+    return true;
+}
+
+void CompressedHisReader::close()
+{
+    if (m_file)
+        std::fclose(m_file);
+    m_file = nullptr;
+    m_size = 0;
+    m_header = WinHeaderType101();
+    m_rows = m_columns = 0;
+    m_codec.reset();
+    m_chunks.clear();
+    m_recovered = false;
+}
+
+bool CompressedHisReader::fail(const std::string &message)
+{
+    close();
+    m_error = message;
+    return false;
+}
+
+bool CompressedHisReader::seek(uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(m_file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(m_file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool CompressedHisReader::readChunkHeader(uint64_t offset, Chunk *chunk)
+{
+    uint8_t header[CompressedHisWriter::kChunkHeaderBytes];
+    if (offset + sizeof(header) > m_size || !seek(offset)
+        || std::fread(header, 1, sizeof(header), m_file) != sizeof(header) || !hasMagic(header, "FRMZ"))
+        return false;
+    chunk->offset = offset + sizeof(header);
+    std::memcpy(&chunk->bytes, header + 4, 4);
+    std::memcpy(&chunk->frameNumber, header + 8, 8);
+    std::memcpy(&chunk->timestampNs, header + 16, 8);
+    return chunk->offset + chunk->bytes <= m_size;
+}
+
+bool CompressedHisReader::loadIndex(uint64_t indexOffset, uint64_t frames)
+{
+    uint8_t header[16];
+    uint64_t count;
+    if (indexOffset + sizeof(header) > m_size || !seek(indexOffset)
+        || std::fread(header, 1, sizeof(header), m_file) != sizeof(header) || !hasMagic(header, "IDXZ"))
+        return false;
+    std::memcpy(&count, header + 8, 8);
+    if (count != frames || count > (m_size - indexOffset - sizeof(header)) / sizeof(uint64_t))
+        return false;
+    std::vector<uint64_t> offsets(count);
+    if (std::fread(offsets.data(), sizeof(uint64_t), count, m_file) != count)
+        return false;
+    m_chunks.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!readChunkHeader(offsets[i], &m_chunks[i])) {
+            m_chunks.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void CompressedHisReader::scanChunks()
+{
+    m_chunks.clear();
+    uint64_t offset = CompressedHisWriter::kHeaderBytes;
+    Chunk chunk;
+    while (readChunkHeader(offset, &chunk)) {
+        m_chunks.push_back(chunk);
+        offset = chunk.offset + chunk.bytes;
+    }
+}
+
+bool CompressedHisReader::read(size_t index, uint16_t *pixels, ThreadPool *pool)
+{
+    if (!m_file || index >= m_chunks.size())
+        return false;
+    const Chunk &chunk = m_chunks[index];
+    m_payload.resize(chunk.bytes);
+    if (!seek(chunk.offset) || std::fread(m_payload.data(), 1, chunk.bytes, m_file) != chunk.bytes)
+        return false;
+    return m_codec->decode(m_payload.data(), chunk.bytes, pixels, pool);
+}
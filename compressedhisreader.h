@@ -0,0 +1,82 @@
+#ifndef COMPRESSEDHISREADER_H
+#define COMPRESSEDHISREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Acq.h"
+#include "framecodec.h"
+
+class ThreadPool;
+
+// ------------------------------------------------------------------
+// CompressedHisReader
+// Random access into a .hisz container written by CompressedHisWriter:
+// open() reads the header and the chunk index, read(i) fetches one
+// chunk and decodes it into a caller-provided frame. Files without an
+// index (the recording was cut short) are indexed by walking the chunk
+// headers; recovered() reports that, and a torn last chunk is dropped.
+//
+// read() reuses one payload buffer, so a reader serves one thread at a
+// time; decoding itself can still spread across a ThreadPool.
+// ------------------------------------------------------------------
+class CompressedHisReader {
+public:
+    CompressedHisReader() = default;
+    ~CompressedHisReader();
+
+    CompressedHisReader(const CompressedHisReader &) = delete;
+    CompressedHisReader &operator=(const CompressedHisReader &) = delete;
+
+    // False, with error() set, if the file is not a .hisz container.
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    const WinHeaderType101 &header() const { return m_header; }
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    FrameCodec::Predictor predictor() const { return m_codec->predictor(); }
+    size_t frameCount() const { return m_chunks.size(); }
+    bool recovered() const { return m_recovered; }
+    const std::string &error() const { return m_error; }
+
+    uint64_t frameNumber(size_t index) const { return m_chunks[index].frameNumber; }
+    int64_t timestampNs(size_t index) const { return m_chunks[index].timestampNs; }
+    size_t compressedBytes(size_t index) const { return m_chunks[index].bytes; }
+
+    // 'pixels' holds rows() * columns() values. False if the index is
+    // out of range or the chunk is damaged.
+    bool read(size_t index, uint16_t *pixels, ThreadPool *pool = nullptr);
+
+private:
+    struct Chunk {
+        uint64_t offset;                // of the payload
+        uint32_t bytes;
+        uint64_t frameNumber;
+        int64_t timestampNs;
+    };
+
+    bool fail(const std::string &message);
+    bool seek(uint64_t offset);
+    bool readChunkHeader(uint64_t offset, Chunk *chunk);
+    bool loadIndex(uint64_t indexOffset, uint64_t frames);
+    void scanChunks();
+
+    std::FILE *m_file = nullptr;
+    uint64_t m_size = 0;
+    WinHeaderType101 m_header = {};
+    unsigned m_rows = 0;
+    unsigned m_columns = 0;
+    std::unique_ptr<FrameCodec> m_codec;
+    std::vector<Chunk> m_chunks;
+    std::vector<uint8_t> m_payload;
+    bool m_recovered = false;
+    std::string m_error;
+};
+
+#endif // COMPRESSEDHISREADER_H
@@ -0,0 +1,269 @@
+#include "compressedhiswriter.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+constexpr char kFileMagic[4] = {'H', 'I', 'S', 'Z'};
+constexpr char kChunkMagic[4] = {'F', 'R', 'M', 'Z'};
+constexpr char kIndexMagic[4] = {'I', 'D', 'X', 'Z'};
+constexpr size_t kWinHeaderOffset = 32;
+
+double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+WORD medianValue(const uint16_t *pixels, size_t count)
+{
+    std::vector<uint32_t> histogram(65536, 0);
+    for (size_t i = 0; i < count; ++i)
+        ++histogram[pixels[i]];
+    size_t seen = 0;
+    for (uint32_t v = 0; v < histogram.size(); ++v) {
+        seen += histogram[v];
+        if (seen > count / 2)
+            return static_cast<WORD>(v);
+    }
+    return 0;
+}
+
+} // namespace
+
+CompressedHisWriter::~CompressedHisWriter()
+{
+    close();
+}
+
+unsigned CompressedHisWriter::threadCount() const
+{
+    return m_pool ? m_pool->threadCount() : 0;
+}
+
+bool CompressedHisWriter::open(const std::string &path, unsigned rows, unsigned columns)
+{
+    if (m_file) {
+        m_error = "a file is already open";
+        return false;
+    }
+    m_error.clear();
+    m_path = path;
+    m_rows = rows;
+    m_columns = columns;
+    m_integrationTimeUs = 0;
+    m_median = 0;
+    m_hasMedian = false;
+    m_queuedFrames = 0;
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        m_error = "cannot create " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    std::setvbuf(m_file, nullptr, _IOFBF, 1u << 20);
+
+    m_codec = std::make_unique<FrameCodec>(rows, columns, m_options.predictor, m_options.stripRows);
+    if (!m_pool || (m_options.threads && m_pool->threadCount() != m_options.threads))
+        m_pool = std::make_unique<ThreadPool>(m_options.threads);
+    m_encoded.resize(m_codec->maxEncodedBytes());
+    m_index.clear();
+    m_queue.clear();
+    m_stop = false;
+    m_failed = false;
+    m_frames = m_rawBytes = m_stalls = 0;
+    m_stallMs = m_encodeMs = 0;
+
+    // Rewritten at close() with the counts and the index offset.
+    if (!writeHeader(0)) {
+        m_error = "write to " + path + " failed: " + std::strerror(errno);
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    m_offset = kHeaderBytes;
+    m_thread = std::thread([this] { encodeLoop(); });
+    return true;
+}
+
+bool CompressedHisWriter::append(const FrameRef &frame)
+{
+    if (!m_file || !frame)
+        return false;
+    if (frame->rows() != m_rows || frame->columns() != m_columns || frame->is32Bit()) {
+        m_error = "frame does not match the file's geometry or type";
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const size_t limit = std::max(m_options.queueFrames, 1u);
+    if (m_queue.size() >= limit && !m_failed) {
+        const auto start = std::chrono::steady_clock::now();
+        m_freed.wait(lock, [&] { return m_queue.size() < limit || m_failed; });
+        ++m_stalls;
+        m_stallMs += msSince(start);
+    }
+    if (m_failed)
+        return false;
+    m_queue.push_back(frame);
+    ++m_queuedFrames;
+    lock.unlock();
+    m_queued.notify_one();
+    return true;
+}
+
+void CompressedHisWriter::encodeLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_queued.wait(lock, [this] { return !m_queue.empty() || m_stop; });
+        if (m_queue.empty())
+            return;
+        FrameRef frame = std::move(m_queue.front());
+        m_queue.pop_front();
+        const bool failed = m_failed;
+        lock.unlock();
+        m_freed.notify_one();
+
+        if (!failed && !writeChunk(*frame))
+            fail("write to " + m_path + " failed: " + std::strerror(errno));
+        else if (!failed && m_options.written)
+            m_options.written(frame->timestampNs);
+        frame.reset();
+        lock.lock();
+    }
+}
+
+bool CompressedHisWriter::writeChunk(const Frame &frame)
+{
+    if (m_index.empty() && !m_hasMedian)
+        m_median = medianValue(frame.pixels16(), frame.pixelCount());
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t payload = m_codec->encode(frame.pixels16(), m_encoded.data(), m_pool.get());
+    const double ms = msSince(start);
+
+    uint8_t header[kChunkHeaderBytes];
+    const uint32_t payloadBytes = static_cast<uint32_t>(payload);
+    const uint64_t frameNumber = frame.frameNumber;
+    const int64_t timestampNs = frame.timestampNs;
+    std::memcpy(header, kChunkMagic, 4);
+    std::memcpy(header + 4, &payloadBytes, 4);
+    std::memcpy(header + 8, &frameNumber, 8);
+    std::memcpy(header + 16, &timestampNs, 8);
+    if (std::fwrite(header, 1, sizeof(header), m_file) != sizeof(header)
+        || std::fwrite(m_encoded.data(), 1, payload, m_file) != payload)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.push_back(m_offset);
+    m_offset += sizeof(header) + payload;
+    ++m_frames;
+    m_rawBytes += frame.byteSize();
+    m_encodeMs += ms;
+    return true;
+}
+
+bool CompressedHisWriter::writeHeader(uint64_t indexOffset)
+{
+    uint8_t header[kHeaderBytes] = {};
+    const uint16_t version = kVersion;
+    const uint32_t stripRows = m_codec->stripRows();
+    const uint64_t frames = m_index.size();
+    std::memcpy(header, kFileMagic, 4);
+    std::memcpy(header + 4, &version, 2);
+    header[6] = static_cast<uint8_t>(m_codec->predictor());
+    std::memcpy(header + 8, &stripRows, 4);
+    std::memcpy(header + 16, &frames, 8);
+    std::memcpy(header + 24, &indexOffset, 8);
+
+    // The .his header as HisWriter writes it, for the metadata; sizes
+    // refer to the uncompressed sequence.
+    WinHeaderType101 his;
+    std::memset(&his, 0, sizeof(his));
+    his.FileType = 0x7000;
+    his.HeaderSize = sizeof(his);
+    his.HeaderVersion = 101;
+    his.FileSize = static_cast<UINT>(std::min<uint64_t>(
+        sizeof(his) + WINHARDWAREHEADERSIZE + frames * m_rows * m_columns * sizeof(uint16_t), 0xFFFFFFFFu));
+    his.ImageHeaderSize = WINHARDWAREHEADERSIZE;
+    his.ULX = 1;
+    his.ULY = 1;
+    his.BRX = static_cast<WORD>(m_columns);
+    his.BRY = static_cast<WORD>(m_rows);
+    his.NrOfFrames = static_cast<WORD>(std::min<uint64_t>(frames, 0xFFFF));
+    his.Correction = m_options.correction;
+    his.IntegrationTime = m_integrationTimeUs;
+    his.TypeOfNumbers = PKI_SHORT;
+    his.wMedianValue = m_median;
+    std::memcpy(header + kWinHeaderOffset, &his, sizeof(his));
+
+    return std::fwrite(header, 1, sizeof(header), m_file) == sizeof(header);
+}
+
+bool CompressedHisWriter::close()
+{
+    if (!m_file)
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_queued.notify_one();
+    m_thread.join();
+
+    bool ok = !m_failed;
+    if (ok) {
+        uint8_t index[16] = {};
+        const uint64_t count = m_index.size();
+        std::memcpy(index, kIndexMagic, 4);
+        std::memcpy(index + 8, &count, 8);
+        const uint64_t indexOffset = m_offset;
+        const size_t entries = m_index.size() * sizeof(uint64_t);
+        if (std::fwrite(index, 1, sizeof(index), m_file) != sizeof(index)
+            || std::fwrite(m_index.data(), 1, entries, m_file) != entries
+            || std::fseek(m_file, 0, SEEK_SET) != 0 || !writeHeader(indexOffset)) {
+            fail("cannot write the index of " + m_path + ": " + std::strerror(errno));
+            ok = false;
+        } else {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_offset += sizeof(index) + entries;
+        }
+    }
+    if (std::fclose(m_file) != 0 && ok) {
+        fail("closing " + m_path + " failed: " + std::strerror(errno));
+        ok = false;
+    }
+    m_file = nullptr;
+    std::vector<uint8_t>().swap(m_encoded);
+    return ok;
+}
+
+unsigned CompressedHisWriter::queueDepth() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<unsigned>(m_queue.size());
+}
+
+CompressedHisWriter::Stats CompressedHisWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.frames = m_frames;
+    stats.rawBytes = m_rawBytes;
+    stats.bytes = m_offset;
+    stats.stalls = m_stalls;
+    stats.stallMs = m_stallMs;
+    stats.encodeMs = m_encodeMs;
+    return stats;
+}
+
+void CompressedHisWriter::fail(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_failed = true;
+    m_error = message;
+    m_freed.notify_all();
+}
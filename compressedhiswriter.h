@@ -0,0 +1,143 @@
+#ifndef COMPRESSEDHISWRITER_H
+#define COMPRESSEDHISWRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Acq.h"
+#include "frame.h"
+#include "framecodec.h"
+
+class ThreadPool;
+
+// ------------------------------------------------------------------
+// CompressedHisWriter
+// Records a 16-bit frame sequence losslessly compressed with FrameCodec
+// into a chunked .hisz container:
+//
+//   header   "HISZ", version, predictor, strip rows, frame count, index
+//            offset, then the .his file header (WinHeaderType101) so the
+//            acquisition metadata travels along; 128 bytes in all.
+//   chunks   one per frame: "FRMZ", payload size, detector frame number,
+//            timestamp (24 bytes), then the FrameCodec stream.
+//   index    "IDXZ", frame count, and each chunk's file offset, written
+//            at close() and pointed to from the header.
+//
+// The index gives readers random access; a file whose recording never
+// reached close() has no index and is recovered by walking the chunks.
+//
+// append() queues a reference to the pooled frame and returns; one
+// encoder thread takes frames in order and compresses each across a
+// private ThreadPool (strips in parallel), so compression neither
+// blocks the acquisition thread nor competes with the correction pool.
+// When queueFrames frames are waiting, append() waits (Stats::stalls)
+// rather than dropping one. Options::written, if set, is called on the
+// encoder thread with each frame's timestampNs once its chunk is in the
+// file.
+// ------------------------------------------------------------------
+class CompressedHisWriter {
+public:
+    static constexpr uint16_t kVersion = 1;
+    static constexpr size_t kHeaderBytes = 128;
+    static constexpr size_t kChunkHeaderBytes = 24;
+
+    struct Options {
+        FrameCodec::Predictor predictor = FrameCodec::Predictor::Median;
+        unsigned stripRows = FrameCodec::kDefaultStripRows;
+        unsigned threads = 0;           // encoder pool; 0 = one per core
+        unsigned queueFrames = 8;
+        WORD correction = 0;            // WinHeaderType::Correction
+        std::function<void(int64_t timestampNs)> written;
+    };
+
+    struct Stats {
+        uint64_t frames = 0;            // encoded and written
+        uint64_t rawBytes = 0;
+        uint64_t bytes = 0;             // file size so far
+        uint64_t stalls = 0;            // appends that waited for the encoder
+        double stallMs = 0;
+        double encodeMs = 0;            // encoder thread, compression only
+        double ratio() const { return bytes ? static_cast<double>(rawBytes) / bytes : 0.0; }
+    };
+
+    CompressedHisWriter() = default;
+    ~CompressedHisWriter();
+
+    CompressedHisWriter(const CompressedHisWriter &) = delete;
+    CompressedHisWriter &operator=(const CompressedHisWriter &) = delete;
+
+    // Applies from the next open().
+    void setOptions(const Options &options) { m_options = options; }
+    const Options &options() const { return m_options; }
+
+    // 16-bit (PKI_SHORT) frames only. False, with error() set, on
+    // failure or when a file is already open.
+    bool open(const std::string &path, unsigned rows, unsigned columns);
+    bool isOpen() const { return m_file != nullptr; }
+
+    // False once writing has failed or for a frame of another geometry.
+    bool append(const FrameRef &frame);
+
+    void setIntegrationTime(double microseconds) { m_integrationTimeUs = microseconds; }
+    // wMedianValue; otherwise the median of the first frame. Before the
+    // first append().
+    void setMedianValue(WORD median) { m_median = median; m_hasMedian = true; }
+
+    // Encodes what is queued, writes the index and closes the file.
+    bool close();
+
+    const std::string &path() const { return m_path; }
+    uint64_t frames() const { return m_queuedFrames; }
+    unsigned threadCount() const;
+    // Frames waiting for the encoder.
+    unsigned queueDepth() const;
+    Stats stats() const;
+    const std::string &error() const { return m_error; }
+
+private:
+    void encodeLoop();
+    bool writeChunk(const Frame &frame);
+    bool writeHeader(uint64_t indexOffset);
+    void fail(const std::string &message);
+
+    std::FILE *m_file = nullptr;
+    std::string m_path;
+    std::string m_error;
+    unsigned m_rows = 0;
+    unsigned m_columns = 0;
+    Options m_options;
+    double m_integrationTimeUs = 0;
+    WORD m_median = 0;
+    bool m_hasMedian = false;
+    uint64_t m_queuedFrames = 0;        // producer side
+
+    std::unique_ptr<FrameCodec> m_codec;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::vector<uint8_t> m_encoded;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queued;   // encoder: a frame or stop
+    std::condition_variable m_freed;    // producer: queue has room
+    std::deque<FrameRef> m_queue;
+    bool m_stop = false;
+    bool m_failed = false;
+    std::vector<uint64_t> m_index;      // chunk offsets
+    uint64_t m_offset = 0;              // end of the last chunk
+    uint64_t m_frames = 0;
+    uint64_t m_rawBytes = 0;
+    uint64_t m_stalls = 0;
+    double m_stallMs = 0;
+    double m_encodeMs = 0;
+};
+
+#endif // COMPRESSEDHISWRITER_H
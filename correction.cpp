@@ -0,0 +1,1115 @@
+#include "correction.h"
+#include "frame.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+inline uint16_t offsetGainPixel(uint16_t src, uint16_t offset, uint32_t gain)
+{
+    const uint32_t value = src > offset ? src - offset : 0;
+    const uint64_t scaled = (static_cast<uint64_t>(value) * gain) >> 16;
+    return static_cast<uint16_t>(std::min<uint64_t>(scaled, 0xFFFF));
+}
+
+inline uint32_t offsetGainPixel32(uint32_t src, uint32_t offset, uint32_t gain, uint32_t maxValue)
+{
+    const uint32_t value = src > offset ? src - offset : 0;
+    const uint64_t scaled = (static_cast<uint64_t>(value) * gain) >> 16;
+    return static_cast<uint32_t>(std::min<uint64_t>(scaled, maxValue));
+}
+
+// Picks the last segment whose knot the value has reached.
+inline uint32_t segmentGainPixel(uint32_t value, const correction::GainSegments &gain, size_t i,
+                                 uint32_t maxValue)
+{
+    uint32_t base = 0;
+    uint32_t baseValue = 0;
+    uint32_t slope = gain.slope0[i];
+    for (unsigned k = 0; k + 1 < gain.levels; ++k) {
+        const uint32_t knot = gain.knots[k * gain.stride + i];
+        if (value >= knot) {
+            base = knot;
+            baseValue = gain.averages[k];
+            slope = gain.slopes[k * gain.stride + i];
+        }
+    }
+    const uint64_t scaled = ((static_cast<uint64_t>(value - base) * slope) >> 16) + baseValue;
+    return static_cast<uint32_t>(std::min<uint64_t>(scaled, maxValue));
+}
+
+void offsetScalar(const uint16_t *src, uint16_t *dst, const uint16_t *offset, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i)
+        dst[i] = src[i] > offset[i] ? static_cast<uint16_t>(src[i] - offset[i]) : 0;
+}
+
+template <bool HasOffset>
+void offsetGainScalar(const uint16_t *src, uint16_t *dst, const uint16_t *offset,
+                      const uint32_t *gain, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i)
+        dst[i] = offsetGainPixel(src[i], HasOffset ? offset[i] : 0, gain[i]);
+}
+
+void offsetScalar32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                    size_t begin, size_t count, uint32_t maxValue)
+{
+    for (size_t i = begin; i < count; ++i)
+        dst[i] = std::min(src[i] > offset[i] ? src[i] - offset[i] : 0u, maxValue);
+}
+
+template <bool HasOffset>
+void offsetGainScalar32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                        const uint32_t *gain, size_t begin, size_t count, uint32_t maxValue)
+{
+    for (size_t i = begin; i < count; ++i)
+        dst[i] = offsetGainPixel32(src[i], HasOffset ? offset[i] : 0, gain[i], maxValue);
+}
+
+template <bool HasOffset>
+void offsetGainSegmentsScalar(const uint16_t *src, uint16_t *dst, const uint16_t *offset,
+                              const correction::GainSegments &gain, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i) {
+        const uint32_t value = HasOffset && src[i] <= offset[i] ? 0 : src[i] - (HasOffset ? offset[i] : 0);
+        dst[i] = static_cast<uint16_t>(segmentGainPixel(value, gain, i, 0xFFFF));
+    }
+}
+
+template <bool HasOffset>
+void offsetGainSegmentsScalar32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                                const correction::GainSegments &gain, size_t begin, size_t count,
+                                uint32_t maxValue)
+{
+    for (size_t i = begin; i < count; ++i) {
+        const uint32_t value = HasOffset && src[i] <= offset[i] ? 0 : src[i] - (HasOffset ? offset[i] : 0);
+        dst[i] = segmentGainPixel(value, gain, i, maxValue);
+    }
+}
+
+// Slope of one gain segment in Q16, ((rise << 16) + run / 2) / run; a
+// segment that does not advance (run <= 0) continues the previous one.
+template <typename T>
+void segmentSlopesScalar(const T *knot, const uint32_t *prevKnot, uint64_t rise, const uint32_t *prevSlope,
+                         uint32_t *slope, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i) {
+        const int64_t run = static_cast<int64_t>(knot[i]) - (prevKnot ? prevKnot[i] : 0);
+        if (run <= 0)
+            slope[i] = prevSlope ? prevSlope[i] : 0;
+        else
+            slope[i] = static_cast<uint32_t>(std::min<uint64_t>(((rise << 16) + run / 2) / run, 0xFFFFFFFF));
+    }
+}
+
+// Fixed-width records: the tap loop has a compile-time trip count for
+// the common 8-neighbour width, so a record is straight-line code.
+template <unsigned Width, typename T>
+void applyDefectPlanScalar(T *data, const correction::DefectPlan &plan, size_t first, size_t last)
+{
+    const unsigned width = Width ? Width : plan.width;
+    const uint32_t *targets = plan.targets.data();
+    const uint32_t *taps = plan.taps.data();
+    const uint32_t *weights = plan.weights.data();
+    for (size_t d = first; d < last; ++d) {
+        const uint32_t *tap = taps + d * width;
+        const uint32_t *weight = weights + d * width;
+        uint64_t sum = correction::kWeightOne / 2;
+        for (unsigned j = 0; j < width; ++j)
+            sum += static_cast<uint64_t>(weight[j]) * data[tap[j]];
+        data[targets[d]] = static_cast<T>(sum >> correction::kWeightShift);
+    }
+}
+
+template <typename T>
+void applyDefectPlanDispatch(T *data, const correction::DefectPlan &plan, size_t first, size_t last)
+{
+    switch (plan.width) {
+    case 4:  applyDefectPlanScalar<4>(data, plan, first, last); break;
+    case 8:  applyDefectPlanScalar<8>(data, plan, first, last); break;
+    default: applyDefectPlanScalar<0>(data, plan, first, last); break;
+    }
+}
+
+template <typename T>
+void pixelCorrectionScalar(T *data, const int *corrList)
+{
+    while (*corrList >= 0) {
+        const int target = corrList[0];
+        const int neighbours = corrList[1];
+        const int *n = corrList + 2;
+        uint64_t sum = 0;
+        for (int k = 0; k < neighbours; ++k)
+            sum += data[n[k]];
+        if (neighbours > 0)
+            data[target] = static_cast<T>((sum + neighbours / 2) / neighbours);
+        corrList = n + std::max(neighbours, 0);
+    }
+}
+
+#if DAQ_SIMD_X86
+// 16-bit: the Q16 gain is split into 16-bit halves so every multiply
+// stays in 16-bit lanes: (v * g) >> 16 == v * hi + mulhi(v, lo). A
+// non-zero mulhi(v, hi) means v * hi alone overflows and the result
+// saturates.
+//
+// 32-bit: even and odd lanes are multiplied separately into 64-bit
+// products with mul_epu32; after the >> 16 any bit left in the upper
+// half saturates the lane before the final clamp to maxValue.
+
+DAQ_TARGET_AVX2
+void offsetAvx2(const uint16_t *src, uint16_t *dst, const uint16_t *offset, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        const __m256i o = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offset + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_subs_epu16(s, o));
+    }
+    offsetScalar(src, dst, offset, i, count);
+}
+
+template <bool HasOffset>
+DAQ_TARGET_AVX2
+void offsetGainAvx2(const uint16_t *src, uint16_t *dst, const uint16_t *offset,
+                    const uint32_t *gain, size_t count)
+{
+    const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        if (HasOffset)
+            v = _mm256_subs_epu16(v, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offset + i)));
+        const __m256i g0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain + i));
+        const __m256i g1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain + i + 8));
+        // packus works per 128-bit lane; permute restores pixel order.
+        const __m256i lo = _mm256_permute4x64_epi64(
+            _mm256_packus_epi32(_mm256_and_si256(g0, lowMask), _mm256_and_si256(g1, lowMask)), 0xD8);
+        const __m256i hi = _mm256_permute4x64_epi64(
+            _mm256_packus_epi32(_mm256_srli_epi32(g0, 16), _mm256_srli_epi32(g1, 16)), 0xD8);
+
+        const __m256i overflow = _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_mulhi_epu16(v, hi), zero), ones);
+        __m256i r = _mm256_adds_epu16(_mm256_mullo_epi16(v, hi), _mm256_mulhi_epu16(v, lo));
+        r = _mm256_or_si256(r, overflow);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), r);
+    }
+    offsetGainScalar<HasOffset>(src, dst, offset, gain, i, count);
+}
+
+DAQ_TARGET_AVX2
+void offsetAvx2_32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                   size_t count, uint32_t maxValue)
+{
+    const __m256i maxVec = _mm256_set1_epi32(static_cast<int>(maxValue));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        const __m256i o = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offset + i));
+        const __m256i v = _mm256_sub_epi32(_mm256_max_epu32(s, o), o);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_min_epu32(v, maxVec));
+    }
+    offsetScalar32(src, dst, offset, i, count, maxValue);
+}
+
+template <bool HasOffset>
+DAQ_TARGET_AVX2
+void offsetGainAvx2_32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                       const uint32_t *gain, size_t count, uint32_t maxValue)
+{
+    const __m256i maxVec = _mm256_set1_epi32(static_cast<int>(maxValue));
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        if (HasOffset) {
+            const __m256i o = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offset + i));
+            v = _mm256_sub_epi32(_mm256_max_epu32(v, o), o);
+        }
+        const __m256i g = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain + i));
+        const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(v, g), 16);
+        const __m256i odd = _mm256_srli_epi64(
+            _mm256_mul_epu32(_mm256_srli_epi64(v, 32), _mm256_srli_epi64(g, 32)), 16);
+        const __m256i low = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+        const __m256i high = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+        const __m256i overflow = _mm256_xor_si256(_mm256_cmpeq_epi32(high, zero), ones);
+        const __m256i r = _mm256_min_epu32(_mm256_or_si256(low, overflow), maxVec);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), r);
+    }
+    offsetGainScalar32<HasOffset>(src, dst, offset, gain, i, count, maxValue);
+}
+
+DAQ_TARGET_SSE41
+void offsetSse41(const uint16_t *src, uint16_t *dst, const uint16_t *offset, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i o = _mm_loadu_si128(reinterpret_cast<const __m128i *>(offset + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_subs_epu16(s, o));
+    }
+    offsetScalar(src, dst, offset, i, count);
+}
+
+template <bool HasOffset>
+DAQ_TARGET_SSE41
+void offsetGainSse41(const uint16_t *src, uint16_t *dst, const uint16_t *offset,
+                     const uint32_t *gain, size_t count)
+{
+    const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (HasOffset)
+            v = _mm_subs_epu16(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(offset + i)));
+        const __m128i g0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain + i));
+        const __m128i g1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain + i + 4));
+        const __m128i lo = _mm_packus_epi32(_mm_and_si128(g0, lowMask), _mm_and_si128(g1, lowMask));
+        const __m128i hi = _mm_packus_epi32(_mm_srli_epi32(g0, 16), _mm_srli_epi32(g1, 16));
+
+        const __m128i overflow = _mm_xor_si128(_mm_cmpeq_epi16(_mm_mulhi_epu16(v, hi), zero), ones);
+        __m128i r = _mm_adds_epu16(_mm_mullo_epi16(v, hi), _mm_mulhi_epu16(v, lo));
+        r = _mm_or_si128(r, overflow);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), r);
+    }
+    offsetGainScalar<HasOffset>(src, dst, offset, gain, i, count);
+}
+
+DAQ_TARGET_SSE41
+void offsetSse41_32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                    size_t count, uint32_t maxValue)
+{
+    const __m128i maxVec = _mm_set1_epi32(static_cast<int>(maxValue));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i o = _mm_loadu_si128(reinterpret_cast<const __m128i *>(offset + i));
+        const __m128i v = _mm_sub_epi32(_mm_max_epu32(s, o), o);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_min_epu32(v, maxVec));
+    }
+    offsetScalar32(src, dst, offset, i, count, maxValue);
+}
+
+template <bool HasOffset>
+DAQ_TARGET_SSE41
+void offsetGainSse41_32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                        const uint32_t *gain, size_t count, uint32_t maxValue)
+{
+    const __m128i maxVec = _mm_set1_epi32(static_cast<int>(maxValue));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (HasOffset) {
+            const __m128i o = _mm_loadu_si128(reinterpret_cast<const __m128i *>(offset + i));
+            v = _mm_sub_epi32(_mm_max_epu32(v, o), o);
+        }
+        const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain + i));
+        const __m128i even = _mm_srli_epi64(_mm_mul_epu32(v, g), 16);
+        const __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(v, 32), _mm_srli_epi64(g, 32)), 16);
+        const __m128i low = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+        const __m128i high = _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xCC);
+        const __m128i overflow = _mm_xor_si128(_mm_cmpeq_epi32(high, zero), ones);
+        const __m128i r = _mm_min_epu32(_mm_or_si128(low, overflow), maxVec);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), r);
+    }
+    offsetGainScalar32<HasOffset>(src, dst, offset, gain, i, count, maxValue);
+}
+
+// Multi-point gain: every segment is evaluated as a compare + blend, so
+// the cost is one pass over the knot and slope planes per level and
+// independent of the pixel values.
+
+DAQ_TARGET_AVX2
+inline __m256i segmentGainAvx2(__m256i v, const correction::GainSegments &gain, size_t i, __m256i maxVec)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i base = zero;
+    __m256i baseValue = zero;
+    __m256i slope = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain.slope0 + i));
+    for (unsigned k = 0; k + 1 < gain.levels; ++k) {
+        const size_t plane = k * gain.stride + i;
+        const __m256i knot = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain.knots + plane));
+        const __m256i reached = _mm256_cmpeq_epi32(_mm256_max_epu32(v, knot), v);
+        base = _mm256_blendv_epi8(base, knot, reached);
+        baseValue = _mm256_blendv_epi8(baseValue, _mm256_set1_epi32(static_cast<int>(gain.averages[k])), reached);
+        slope = _mm256_blendv_epi8(slope, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain.slopes + plane)),
+                                   reached);
+    }
+    const __m256i d = _mm256_sub_epi32(v, base);
+    const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(d, slope), 16);
+    const __m256i odd = _mm256_srli_epi64(
+        _mm256_mul_epu32(_mm256_srli_epi64(d, 32), _mm256_srli_epi64(slope, 32)), 16);
+    const __m256i low = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    const __m256i high = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+    const __m256i product = _mm256_or_si256(low, _mm256_xor_si256(_mm256_cmpeq_epi32(high, zero), ones));
+    const __m256i sum = _mm256_add_epi32(product, baseValue);
+    const __m256i carry = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_max_epu32(sum, product), sum), ones);
+    return _mm256_min_epu32(_mm256_or_si256(sum, carry), maxVec);
+}
+
+template <bool HasOffset>
+DAQ_TARGET_AVX2
+void offsetGainSegmentsAvx2(const uint16_t *src, uint16_t *dst, const uint16_t *offset,
+                            const correction::GainSegments &gain, size_t count)
+{
+    const __m256i maxVec = _mm256_set1_epi32(0xFFFF);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+        if (HasOffset) {
+            const __m256i o = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(offset + i)));
+            v = _mm256_sub_epi32(_mm256_max_epu32(v, o), o);
+        }
+        const __m256i r = segmentGainAvx2(v, gain, i, maxVec);
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm256_castsi256_si128(packed));
+    }
+    offsetGainSegmentsScalar<HasOffset>(src, dst, offset, gain, i, count);
+}
+
+template <bool HasOffset>
+DAQ_TARGET_AVX2
+void offsetGainSegmentsAvx2_32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                               const correction::GainSegments &gain, size_t count, uint32_t maxValue)
+{
+    const __m256i maxVec = _mm256_set1_epi32(static_cast<int>(maxValue));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        if (HasOffset) {
+            const __m256i o = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offset + i));
+            v = _mm256_sub_epi32(_mm256_max_epu32(v, o), o);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), segmentGainAvx2(v, gain, i, maxVec));
+    }
+    offsetGainSegmentsScalar32<HasOffset>(src, dst, offset, gain, i, count, maxValue);
+}
+
+DAQ_TARGET_SSE41
+inline __m128i segmentGainSse41(__m128i v, const correction::GainSegments &gain, size_t i, __m128i maxVec)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i base = zero;
+    __m128i baseValue = zero;
+    __m128i slope = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain.slope0 + i));
+    for (unsigned k = 0; k + 1 < gain.levels; ++k) {
+        const size_t plane = k * gain.stride + i;
+        const __m128i knot = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain.knots + plane));
+        const __m128i reached = _mm_cmpeq_epi32(_mm_max_epu32(v, knot), v);
+        base = _mm_blendv_epi8(base, knot, reached);
+        baseValue = _mm_blendv_epi8(baseValue, _mm_set1_epi32(static_cast<int>(gain.averages[k])), reached);
+        slope = _mm_blendv_epi8(slope, _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain.slopes + plane)),
+                                reached);
+    }
+    const __m128i d = _mm_sub_epi32(v, base);
+    const __m128i even = _mm_srli_epi64(_mm_mul_epu32(d, slope), 16);
+    const __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(d, 32), _mm_srli_epi64(slope, 32)), 16);
+    const __m128i low = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+    const __m128i high = _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xCC);
+    const __m128i product = _mm_or_si128(low, _mm_xor_si128(_mm_cmpeq_epi32(high, zero), ones));
+    const __m128i sum = _mm_add_epi32(product, baseValue);
+    const __m128i carry = _mm_xor_si128(_mm_cmpeq_epi32(_mm_max_epu32(sum, product), sum), ones);
+    return _mm_min_epu32(_mm_or_si128(sum, carry), maxVec);
+}
+
+template <bool HasOffset>
+DAQ_TARGET_SSE41
+void offsetGainSegmentsSse41(const uint16_t *src, uint16_t *dst, const uint16_t *offset,
+                             const correction::GainSegments &gain, size_t count)
+{
+    const __m128i maxVec = _mm_set1_epi32(0xFFFF);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+        if (HasOffset) {
+            const __m128i o = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(offset + i)));
+            v = _mm_sub_epi32(_mm_max_epu32(v, o), o);
+        }
+        const __m128i r = segmentGainSse41(v, gain, i, maxVec);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi32(r, r));
+    }
+    offsetGainSegmentsScalar<HasOffset>(src, dst, offset, gain, i, count);
+}
+
+template <bool HasOffset>
+DAQ_TARGET_SSE41
+void offsetGainSegmentsSse41_32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                                const correction::GainSegments &gain, size_t count, uint32_t maxValue)
+{
+    const __m128i maxVec = _mm_set1_epi32(static_cast<int>(maxValue));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (HasOffset) {
+            const __m128i o = _mm_loadu_si128(reinterpret_cast<const __m128i *>(offset + i));
+            v = _mm_sub_epi32(_mm_max_epu32(v, o), o);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), segmentGainSse41(v, gain, i, maxVec));
+    }
+    offsetGainSegmentsScalar32<HasOffset>(src, dst, offset, gain, i, count, maxValue);
+}
+
+// Segment fit in double precision: the numerator (rise << 16) + run / 2
+// stays below 2^53 and a non-integral quotient n / run is at least
+// 1 / run away from the next integer, so floor() of the correctly
+// rounded division equals the integer division exactly.
+
+DAQ_TARGET_SSE41
+inline __m128i loadWidened4(const uint16_t *p)
+{
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+DAQ_TARGET_SSE41
+inline __m128i loadWidened4(const uint32_t *p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+DAQ_TARGET_SSE41
+inline __m128i loadWidened2(const uint16_t *p)
+{
+    uint32_t pair;
+    std::memcpy(&pair, p, sizeof(pair));
+    return _mm_cvtepu16_epi32(_mm_cvtsi32_si128(static_cast<int>(pair)));
+}
+
+DAQ_TARGET_SSE41
+inline __m128i loadWidened2(const uint32_t *p)
+{
+    return _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+}
+
+template <typename T>
+DAQ_TARGET_AVX2
+void segmentSlopesAvx2(const T *knot, const uint32_t *prevKnot, uint64_t rise, const uint32_t *prevSlope,
+                       uint32_t *slope, size_t count)
+{
+    const __m256d scaledRise = _mm256_set1_pd(static_cast<double>(rise << 16));
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d limit = _mm256_set1_pd(4294967295.0);
+    const __m256d bias = _mm256_set1_pd(2147483648.0);
+    const __m128i signBit = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i k = loadWidened4(knot + i);
+        const __m128i p = prevKnot ? loadWidened4(prevKnot + i) : _mm_setzero_si128();
+        const __m128i previous = prevSlope ? loadWidened4(prevSlope + i) : _mm_setzero_si128();
+        const __m256d run = _mm256_sub_pd(_mm256_cvtepi32_pd(k), _mm256_cvtepi32_pd(p));
+        const __m256d numerator = _mm256_add_pd(scaledRise, _mm256_floor_pd(_mm256_mul_pd(run, half)));
+        const __m256d q = _mm256_min_pd(_mm256_floor_pd(_mm256_div_pd(numerator, run)), limit);
+        const __m128i fitted = _mm_xor_si128(_mm256_cvttpd_epi32(_mm256_sub_pd(q, bias)), signBit);
+        const __m128i advances = _mm_cmpgt_epi32(k, p);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(slope + i), _mm_blendv_epi8(previous, fitted, advances));
+    }
+    segmentSlopesScalar(knot, prevKnot, rise, prevSlope, slope, i, count);
+}
+
+template <typename T>
+DAQ_TARGET_SSE41
+void segmentSlopesSse41(const T *knot, const uint32_t *prevKnot, uint64_t rise, const uint32_t *prevSlope,
+                        uint32_t *slope, size_t count)
+{
+    const __m128d scaledRise = _mm_set1_pd(static_cast<double>(rise << 16));
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d limit = _mm_set1_pd(4294967295.0);
+    const __m128d bias = _mm_set1_pd(2147483648.0);
+    const __m128i signBit = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m128i k = loadWidened2(knot + i);
+        const __m128i p = prevKnot ? loadWidened2(prevKnot + i) : _mm_setzero_si128();
+        const __m128i previous = prevSlope ? loadWidened2(prevSlope + i) : _mm_setzero_si128();
+        const __m128d run = _mm_sub_pd(_mm_cvtepi32_pd(k), _mm_cvtepi32_pd(p));
+        const __m128d numerator = _mm_add_pd(scaledRise, _mm_floor_pd(_mm_mul_pd(run, half)));
+        const __m128d q = _mm_min_pd(_mm_floor_pd(_mm_div_pd(numerator, run)), limit);
+        const __m128i fitted = _mm_xor_si128(_mm_cvttpd_epi32(_mm_sub_pd(q, bias)), signBit);
+        const __m128i advances = _mm_cmpgt_epi32(k, p);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(slope + i), _mm_blendv_epi8(previous, fitted, advances));
+    }
+    segmentSlopesScalar(knot, prevKnot, rise, prevSlope, slope, i, count);
+}
+#endif
+
+template <bool HasOffset>
+void offsetGainDispatch(const uint16_t *src, uint16_t *dst, const uint16_t *offset,
+                        const uint32_t *gain, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  offsetGainAvx2<HasOffset>(src, dst, offset, gain, count); return;
+    case simd::Level::Sse41: offsetGainSse41<HasOffset>(src, dst, offset, gain, count); return;
+    default: break;
+    }
+#endif
+    offsetGainScalar<HasOffset>(src, dst, offset, gain, 0, count);
+}
+
+template <bool HasOffset>
+void offsetGainDispatch32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                          const uint32_t *gain, size_t count, uint32_t maxValue)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  offsetGainAvx2_32<HasOffset>(src, dst, offset, gain, count, maxValue); return;
+    case simd::Level::Sse41: offsetGainSse41_32<HasOffset>(src, dst, offset, gain, count, maxValue); return;
+    default: break;
+    }
+#endif
+    offsetGainScalar32<HasOffset>(src, dst, offset, gain, 0, count, maxValue);
+}
+
+template <bool HasOffset>
+void offsetGainSegmentsDispatch(const uint16_t *src, uint16_t *dst, const uint16_t *offset,
+                                const correction::GainSegments &gain, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  offsetGainSegmentsAvx2<HasOffset>(src, dst, offset, gain, count); return;
+    case simd::Level::Sse41: offsetGainSegmentsSse41<HasOffset>(src, dst, offset, gain, count); return;
+    default: break;
+    }
+#endif
+    offsetGainSegmentsScalar<HasOffset>(src, dst, offset, gain, 0, count);
+}
+
+template <bool HasOffset>
+void offsetGainSegmentsDispatch32(const uint32_t *src, uint32_t *dst, const uint32_t *offset,
+                                  const correction::GainSegments &gain, size_t count, uint32_t maxValue)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  offsetGainSegmentsAvx2_32<HasOffset>(src, dst, offset, gain, count, maxValue); return;
+    case simd::Level::Sse41: offsetGainSegmentsSse41_32<HasOffset>(src, dst, offset, gain, count, maxValue); return;
+    default: break;
+    }
+#endif
+    offsetGainSegmentsScalar32<HasOffset>(src, dst, offset, gain, 0, count, maxValue);
+}
+
+template <typename T>
+void segmentSlopes(const T *knot, const uint32_t *prevKnot, uint64_t rise, const uint32_t *prevSlope,
+                   uint32_t *slope, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  segmentSlopesAvx2(knot, prevKnot, rise, prevSlope, slope, count); return;
+    case simd::Level::Sse41: segmentSlopesSse41(knot, prevKnot, rise, prevSlope, slope, count); return;
+    default: break;
+    }
+#endif
+    segmentSlopesScalar(knot, prevKnot, rise, prevSlope, slope, 0, count);
+}
+
+// Knots are kept non-decreasing per pixel so that "last knot reached"
+// picks a single segment; a dead pixel (flat_0 == 0) never leaves its
+// zero first segment.
+template <typename T>
+void gainSegmentsFromLevels(const T *flats, const T *averages, unsigned levels, size_t stride,
+                            uint32_t *slope0, uint32_t *knots, uint32_t *slopes, size_t count)
+{
+    for (unsigned k = 0; k < levels; ++k) {
+        const T *flat = flats + k * stride;
+        const uint32_t *prevKnot = k ? knots + (k - 1) * stride : nullptr;
+        const uint32_t *prevSlope = k == 0 ? nullptr : k == 1 ? slope0 : slopes + (k - 2) * stride;
+        const uint64_t previousAverage = k ? averages[k - 1] : 0;
+        const uint64_t rise = averages[k] > previousAverage ? averages[k] - previousAverage : 0;
+        segmentSlopes(flat, prevKnot, rise, prevSlope, k ? slopes + (k - 1) * stride : slope0, count);
+        if (k + 1 < levels) {
+            uint32_t *knot = knots + k * stride;
+            for (size_t i = 0; i < count; ++i)
+                knot[i] = prevKnot ? std::max<uint32_t>(flat[i], prevKnot[i]) : flat[i];
+        }
+    }
+    for (size_t i = 0; i < count && levels > 1; ++i) {
+        if (flats[i] == 0) {
+            for (unsigned k = 0; k + 1 < levels; ++k)
+                knots[k * stride + i] = 0xFFFFFFFF;
+        }
+    }
+}
+
+} // namespace
+
+namespace correction {
+
+void offset(const uint16_t *src, uint16_t *dst, const uint16_t *offsetMap, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  offsetAvx2(src, dst, offsetMap, count); return;
+    case simd::Level::Sse41: offsetSse41(src, dst, offsetMap, count); return;
+    default: break;
+    }
+#endif
+    offsetScalar(src, dst, offsetMap, 0, count);
+}
+
+void offsetGain(const uint16_t *src, uint16_t *dst, const uint16_t *offsetMap,
+                const uint32_t *gainMap, size_t count)
+{
+    if (offsetMap)
+        offsetGainDispatch<true>(src, dst, offsetMap, gainMap, count);
+    else
+        offsetGainDispatch<false>(src, dst, nullptr, gainMap, count);
+}
+
+void gainMapFromEx(const uint16_t *flat, uint16_t average, uint32_t *gainMap, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        // A zero flat-field pixel is dead; leave it to pixel correction.
+        gainMap[i] = flat[i]
+            ? static_cast<uint32_t>(((static_cast<uint64_t>(average) << 16) + flat[i] / 2) / flat[i])
+            : 0;
+    }
+}
+
+void pixelCorrection(uint16_t *data, const int *corrList)
+{
+    pixelCorrectionScalar(data, corrList);
+}
+
+void addDefect(DefectPlan &plan, uint32_t target, const uint32_t *neighbours, const uint32_t *weights,
+               unsigned count)
+{
+    if (count > plan.width) {
+        // Widen the existing records; rare, since builders size the plan up front.
+        DefectPlan wider;
+        wider.width = count;
+        for (size_t d = 0; d < plan.size(); ++d)
+            addDefect(wider, plan.targets[d], &plan.taps[d * plan.width], &plan.weights[d * plan.width], plan.width);
+        plan = std::move(wider);
+    }
+    plan.targets.push_back(target);
+    for (unsigned j = 0; j < plan.width; ++j) {
+        plan.taps.push_back(j < count ? neighbours[j] : count ? neighbours[0] : target);
+        plan.weights.push_back(j < count ? weights[j] : 0);
+    }
+}
+
+void finalizeDefectPlan(DefectPlan &plan, unsigned rows, unsigned columns)
+{
+    plan.rowStart.clear();
+    if (plan.empty() || rows == 0 || columns == 0)
+        return;
+    std::vector<uint32_t> targets(plan.targets);
+    std::sort(targets.begin(), targets.end());
+    for (size_t t = 0; t < plan.taps.size(); ++t) {
+        // A record reading its own target (no neighbours) is no chain.
+        const uint32_t tap = plan.taps[t];
+        if (plan.weights[t] != 0 && tap != plan.targets[t / plan.width]
+            && std::binary_search(targets.begin(), targets.end(), tap))
+            return;     // chained: keep list order
+    }
+
+    std::vector<uint32_t> order(plan.size());
+    for (uint32_t d = 0; d < order.size(); ++d)
+        order[d] = d;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return plan.targets[a] < plan.targets[b]; });
+    DefectPlan sorted;
+    sorted.width = plan.width;
+    sorted.targets.reserve(plan.size());
+    sorted.taps.reserve(plan.taps.size());
+    sorted.weights.reserve(plan.weights.size());
+    for (uint32_t d : order) {
+        sorted.targets.push_back(plan.targets[d]);
+        sorted.taps.insert(sorted.taps.end(), plan.taps.begin() + d * plan.width,
+                           plan.taps.begin() + (d + 1) * plan.width);
+        sorted.weights.insert(sorted.weights.end(), plan.weights.begin() + d * plan.width,
+                              plan.weights.begin() + (d + 1) * plan.width);
+    }
+    sorted.rowStart.assign(rows + 1, 0);
+    for (uint32_t target : sorted.targets)
+        ++sorted.rowStart[std::min(target / columns, rows - 1) + 1];
+    for (unsigned r = 0; r < rows; ++r)
+        sorted.rowStart[r + 1] += sorted.rowStart[r];
+    plan = std::move(sorted);
+}
+
+DefectPlan defectPlanFromList(const int *corrList, unsigned rows, unsigned columns)
+{
+    const uint32_t pixels = rows * columns;
+    const auto inRange = [&](int index) { return index >= 0 && static_cast<uint32_t>(index) < pixels; };
+    // Size the plan for the widest record up front.
+    DefectPlan plan;
+    plan.width = 1;
+    for (const int *record = corrList; record && *record >= 0; record += 2 + std::max(record[1], 0))
+        plan.width = std::max(plan.width, static_cast<unsigned>(std::max(record[1], 0)));
+
+    std::vector<uint32_t> neighbours;
+    std::vector<uint32_t> weights;
+    for (const int *record = corrList; record && *record >= 0; record += 2 + std::max(record[1], 0)) {
+        if (!inRange(record[0]))
+            continue;
+        neighbours.clear();
+        for (int k = 0; k < record[1]; ++k) {
+            if (inRange(record[2 + k]))
+                neighbours.push_back(static_cast<uint32_t>(record[2 + k]));
+        }
+        const unsigned count = static_cast<unsigned>(neighbours.size());
+        if (count == 0) {
+            // Nothing to interpolate from: leave the pixel as it is.
+            const uint32_t self = static_cast<uint32_t>(record[0]);
+            const uint32_t one = kWeightOne;
+            addDefect(plan, self, &self, &one, 1);
+            continue;
+        }
+        weights.assign(count, kWeightOne / count);
+        for (unsigned j = 0; j < kWeightOne % count; ++j)
+            ++weights[j];
+        addDefect(plan, static_cast<uint32_t>(record[0]), neighbours.data(), weights.data(), count);
+    }
+    finalizeDefectPlan(plan, rows, columns);
+    return plan;
+}
+
+void applyDefectPlan(uint16_t *data, const DefectPlan &plan, size_t first, size_t last)
+{
+    applyDefectPlanDispatch(data, plan, first, last);
+}
+
+void gainSegmentsFromEx(const uint16_t *flats, const uint16_t *averages, unsigned levels, size_t stride,
+                        uint32_t *slope0, uint32_t *knots, uint32_t *slopes, size_t count)
+{
+    gainSegmentsFromLevels(flats, averages, levels, stride, slope0, knots, slopes, count);
+}
+
+void gainSegmentsFromEx32(const uint32_t *flats, const uint32_t *averages, unsigned levels, size_t stride,
+                          uint32_t *slope0, uint32_t *knots, uint32_t *slopes, size_t count)
+{
+    gainSegmentsFromLevels(flats, averages, levels, stride, slope0, knots, slopes, count);
+}
+
+void offsetGainSegments(const uint16_t *src, uint16_t *dst, const uint16_t *offsetMap,
+                        const GainSegments &gain, size_t count)
+{
+    if (offsetMap)
+        offsetGainSegmentsDispatch<true>(src, dst, offsetMap, gain, count);
+    else
+        offsetGainSegmentsDispatch<false>(src, dst, nullptr, gain, count);
+}
+
+void offset32(const uint32_t *src, uint32_t *dst, const uint32_t *offsetMap, size_t count,
+              uint32_t maxValue)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  offsetAvx2_32(src, dst, offsetMap, count, maxValue); return;
+    case simd::Level::Sse41: offsetSse41_32(src, dst, offsetMap, count, maxValue); return;
+    default: break;
+    }
+#endif
+    offsetScalar32(src, dst, offsetMap, 0, count, maxValue);
+}
+
+void offsetGain32(const uint32_t *src, uint32_t *dst, const uint32_t *offsetMap,
+                  const uint32_t *gainMap, size_t count, uint32_t maxValue)
+{
+    if (offsetMap)
+        offsetGainDispatch32<true>(src, dst, offsetMap, gainMap, count, maxValue);
+    else
+        offsetGainDispatch32<false>(src, dst, nullptr, gainMap, count, maxValue);
+}
+
+void offsetGainSegments32(const uint32_t *src, uint32_t *dst, const uint32_t *offsetMap,
+                          const GainSegments &gain, size_t count, uint32_t maxValue)
+{
+    if (offsetMap)
+        offsetGainSegmentsDispatch32<true>(src, dst, offsetMap, gain, count, maxValue);
+    else
+        offsetGainSegmentsDispatch32<false>(src, dst, nullptr, gain, count, maxValue);
+}
+
+void pixelCorrection32(uint32_t *data, const int *corrList)
+{
+    pixelCorrectionScalar(data, corrList);
+}
+
+void applyDefectPlan32(uint32_t *data, const DefectPlan &plan, size_t first, size_t last)
+{
+    applyDefectPlanDispatch(data, plan, first, last);
+}
+
+} // namespace correction
+
+CorrectionEngine::CorrectionEngine(unsigned rows, unsigned columns)
+    : m_rows(rows), m_columns(columns)
+{
+}
+
+void CorrectionEngine::setOffset(const uint16_t *offsetMap)
+{
+    if (offsetMap)
+        m_offset.assign(offsetMap, offsetMap + pixelCount());
+    else
+        m_offset.clear();
+}
+
+void CorrectionEngine::setOffset32(const uint32_t *offsetMap)
+{
+    if (offsetMap)
+        m_offset32.assign(offsetMap, offsetMap + pixelCount());
+    else
+        m_offset32.clear();
+}
+
+void CorrectionEngine::setGain(const uint32_t *gainMap)
+{
+    if (gainMap)
+        m_gain.assign(gainMap, gainMap + pixelCount());
+    else
+        m_gain.clear();
+    m_gainLevels = 1;
+    m_gainKnots.clear();
+    m_gainSlopes.clear();
+    m_gainAverages.clear();
+}
+
+void CorrectionEngine::setGainEx(const uint16_t *flats, const uint16_t *averages, unsigned levels,
+                                 ThreadPool *pool)
+{
+    loadGainEx(flats, averages, levels, pool);
+}
+
+void CorrectionEngine::setGainEx32(const uint32_t *flats, const uint32_t *averages, unsigned levels,
+                                   ThreadPool *pool)
+{
+    loadGainEx(flats, averages, levels, pool);
+}
+
+template <typename T>
+void CorrectionEngine::loadGainEx(const T *flats, const T *averages, unsigned levels, ThreadPool *pool)
+{
+    setGain(nullptr);
+    if (!flats || !averages || levels == 0)
+        return;
+    const size_t count = pixelCount();
+    m_gainLevels = levels;
+    m_gain.resize(count);
+    m_gainKnots.resize((levels - 1) * count);
+    m_gainSlopes.resize((levels - 1) * count);
+    m_gainAverages.assign(averages, averages + levels);
+
+    const auto fit = [&](size_t begin, size_t n) {
+        gainSegmentsFromLevels(flats + begin, averages, levels, count, m_gain.data() + begin,
+                               m_gainKnots.data() + begin, m_gainSlopes.data() + begin, n);
+    };
+    if (!pool) {
+        fit(0, count);
+        return;
+    }
+    const size_t span = static_cast<size_t>(bandRows(sizeof(T) * levels)) * m_columns;
+    pool->parallelFor((count + span - 1) / span, [&](size_t b) {
+        fit(b * span, std::min(span, count - b * span));
+    });
+}
+
+correction::GainSegments CorrectionEngine::gainSegments() const
+{
+    return {m_gain.data(), m_gainKnots.empty() ? nullptr : m_gainKnots.data(),
+            m_gainSlopes.empty() ? nullptr : m_gainSlopes.data(), m_gainAverages.data(), m_gainLevels,
+            pixelCount()};
+}
+
+void CorrectionEngine::setPixelCorrectionList(const int *corrList)
+{
+    m_plan = correction::defectPlanFromList(corrList, m_rows, m_columns);
+}
+
+void CorrectionEngine::setDefectPlan(correction::DefectPlan plan)
+{
+    m_plan = std::move(plan);
+    if (!m_plan.sorted())
+        correction::finalizeDefectPlan(m_plan, m_rows, m_columns);
+}
+
+void CorrectionEngine::apply(const uint16_t *src, uint16_t *dst) const
+{
+    const size_t count = pixelCount();
+    if (m_gainLevels > 1 && hasGain())
+        correction::offsetGainSegments(src, dst, offsetMap(), gainSegments(), count);
+    else if (hasGain())
+        correction::offsetGain(src, dst, hasOffset() ? m_offset.data() : nullptr, m_gain.data(), count);
+    else if (hasOffset())
+        correction::offset(src, dst, m_offset.data(), count);
+    else if (src != dst)
+        std::copy(src, src + count, dst);
+    if (hasPixelCorrection())
+        correction::applyDefectPlan(dst, m_plan, 0, m_plan.size());
+}
+
+void CorrectionEngine::apply(const uint32_t *src, uint32_t *dst) const
+{
+    const size_t count = pixelCount();
+    if (m_gainLevels > 1 && hasGain())
+        correction::offsetGainSegments32(src, dst, offsetMap32(), gainSegments(), count, m_maxValue32);
+    else if (hasGain())
+        correction::offsetGain32(src, dst, hasOffset32() ? m_offset32.data() : nullptr,
+                                 m_gain.data(), count, m_maxValue32);
+    else if (hasOffset32())
+        correction::offset32(src, dst, m_offset32.data(), count, m_maxValue32);
+    else if (src != dst)
+        std::copy(src, src + count, dst);
+    if (hasPixelCorrection())
+        correction::applyDefectPlan32(dst, m_plan, 0, m_plan.size());
+}
+
+bool CorrectionEngine::apply(Frame &frame) const
+{
+    if (frame.rows() != m_rows || frame.columns() != m_columns)
+        return false;
+    if (frame.is32Bit())
+        apply(frame.pixels32(), frame.pixels32());
+    else
+        apply(frame.pixels16(), frame.pixels16());
+    return true;
+}
+
+// ------------------------------------------------------------------
+// Band-parallel correction
+
+unsigned CorrectionEngine::bandRows(size_t bytesPerPixel) const
+{
+    if (m_bandRows)
+        return std::min(m_bandRows, std::max(m_rows, 1u));
+    // Source, offset, gain and destination bytes touched per pixel.
+    const size_t perPixel = bytesPerPixel * 3 + sizeof(uint32_t);
+    const size_t rows = (256u * 1024u) / std::max<size_t>(perPixel * m_columns, 1);
+    return static_cast<unsigned>(std::clamp<size_t>(rows, 4, std::max(m_rows, 4u)));
+}
+
+void CorrectionEngine::correctSpan(const uint16_t *src, uint16_t *dst, size_t begin, size_t count) const
+{
+    if (m_gainLevels > 1 && hasGain())
+        correction::offsetGainSegments(src + begin, dst + begin, hasOffset() ? m_offset.data() + begin : nullptr,
+                                       gainSegments().at(begin), count);
+    else if (hasGain())
+        correction::offsetGain(src + begin, dst + begin, hasOffset() ? m_offset.data() + begin : nullptr,
+                               m_gain.data() + begin, count);
+    else if (hasOffset())
+        correction::offset(src + begin, dst + begin, m_offset.data() + begin, count);
+    else if (src != dst)
+        std::copy(src + begin, src + begin + count, dst + begin);
+}
+
+void CorrectionEngine::correctSpan(const uint32_t *src, uint32_t *dst, size_t begin, size_t count) const
+{
+    if (m_gainLevels > 1 && hasGain())
+        correction::offsetGainSegments32(src + begin, dst + begin,
+                                         hasOffset32() ? m_offset32.data() + begin : nullptr,
+                                         gainSegments().at(begin), count, m_maxValue32);
+    else if (hasGain())
+        correction::offsetGain32(src + begin, dst + begin, hasOffset32() ? m_offset32.data() + begin : nullptr,
+                                 m_gain.data() + begin, count, m_maxValue32);
+    else if (hasOffset32())
+        correction::offset32(src + begin, dst + begin, m_offset32.data() + begin, count, m_maxValue32);
+    else if (src != dst)
+        std::copy(src + begin, src + begin + count, dst + begin);
+}
+
+uint16_t CorrectionEngine::correctedPixel(const uint16_t *src, size_t index) const
+{
+    const uint16_t offset = hasOffset() ? m_offset[index] : 0;
+    if (m_gainLevels > 1 && hasGain())
+        return static_cast<uint16_t>(segmentGainPixel(src[index] > offset ? src[index] - offset : 0,
+                                                      gainSegments(), index, 0xFFFF));
+    if (hasGain())
+        return offsetGainPixel(src[index], offset, m_gain[index]);
+    return src[index] > offset ? static_cast<uint16_t>(src[index] - offset) : 0;
+}
+
+uint32_t CorrectionEngine::correctedPixel(const uint32_t *src, size_t index) const
+{
+    if (m_gainLevels > 1 && hasGain()) {
+        const uint32_t offset = hasOffset32() ? m_offset32[index] : 0;
+        return segmentGainPixel(src[index] > offset ? src[index] - offset : 0, gainSegments(), index,
+                                m_maxValue32);
+    }
+    if (hasGain())
+        return offsetGainPixel32(src[index], hasOffset32() ? m_offset32[index] : 0, m_gain[index], m_maxValue32);
+    if (hasOffset32())
+        return std::min(src[index] > m_offset32[index] ? src[index] - m_offset32[index] : 0u, m_maxValue32);
+    return src[index];
+}
+
+template <typename T>
+void CorrectionEngine::fixBandDefects(const T *src, T *dst, unsigned firstRow, unsigned rowCount,
+                                      bool fromSource) const
+{
+    const size_t first = m_plan.rowStart[firstRow];
+    const size_t last = m_plan.rowStart[firstRow + rowCount];
+    if (!fromSource) {
+        applyDefectPlanDispatch(dst, m_plan, first, last);
+        return;
+    }
+    const unsigned width = m_plan.width;
+    for (size_t d = first; d < last; ++d) {
+        const uint32_t *tap = m_plan.taps.data() + d * width;
+        const uint32_t *weight = m_plan.weights.data() + d * width;
+        uint64_t sum = correction::kWeightOne / 2;
+        for (unsigned j = 0; j < width; ++j)
+            sum += static_cast<uint64_t>(weight[j]) * correctedPixel(src, tap[j]);
+        dst[m_plan.targets[d]] = static_cast<T>(sum >> correction::kWeightShift);
+    }
+}
+
+template <typename T>
+void CorrectionEngine::applyBands(const T *src, T *dst, ThreadPool &pool, const BandReady &ready) const
+{
+    const unsigned band = bandRows(sizeof(T));
+    const size_t bands = (m_rows + band - 1) / band;
+    const auto rowsOf = [&](size_t b) { return std::min(band, m_rows - static_cast<unsigned>(b) * band); };
+    const auto correctBand = [&](size_t b) {
+        correctSpan(src, dst, b * band * static_cast<size_t>(m_columns), static_cast<size_t>(rowsOf(b)) * m_columns);
+    };
+    const auto publish = [&](size_t b) {
+        if (ready)
+            ready(static_cast<unsigned>(b) * band, rowsOf(b));
+    };
+
+    if (!hasPixelCorrection() || (m_plan.sorted() && src != dst)) {
+        pool.parallelFor(bands, [&](size_t b) {
+            correctBand(b);
+            if (hasPixelCorrection())
+                fixBandDefects(src, dst, static_cast<unsigned>(b) * band, rowsOf(b), true);
+            publish(b);
+        });
+        return;
+    }
+
+    pool.parallelFor(bands, correctBand);
+    if (m_plan.sorted()) {
+        pool.parallelFor(bands, [&](size_t b) {
+            fixBandDefects(src, dst, static_cast<unsigned>(b) * band, rowsOf(b), false);
+            publish(b);
+        });
+        return;
+    }
+    // Chained defects depend on list order; keep the serial semantics.
+    applyDefectPlanDispatch(dst, m_plan, 0, m_plan.size());
+    for (size_t b = 0; b < bands; ++b)
+        publish(b);
+}
+
+void CorrectionEngine::apply(const uint16_t *src, uint16_t *dst, ThreadPool &pool, const BandReady &ready) const
+{
+    applyBands(src, dst, pool, ready);
+}
+
+void CorrectionEngine::apply(const uint32_t *src, uint32_t *dst, ThreadPool &pool, const BandReady &ready) const
+{
+    applyBands(src, dst, pool, ready);
+}
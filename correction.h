@@ -0,0 +1,228 @@
+#ifndef CORRECTION_H
+#define CORRECTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Acq.h"
+
+class Frame;
+class ThreadPool;
+
+// ------------------------------------------------------------------
+// Image correction kernels
+// Same semantics as the XISL Acquisition_DoOffsetCorrection,
+// Acquisition_DoOffsetGainCorrection(_Ex) and Acquisition_DoPixelCorrection
+// helpers, with AVX2 / SSE4.1 / scalar implementations selected through
+// simd::level().
+//
+//  - Offset: dst = max(src - offset, 0).
+//  - Gain: the DWORD gain map is unsigned Q16 fixed point (65536 == 1.0);
+//    dst = min(((src - offset) * gain) >> 16, 65535). The _Ex format, a
+//    WORD flat-field image plus its average, is converted to that map
+//    once with gainMapFromEx() (gain = average * 65536 / flat). A null
+//    offset map applies gain only.
+//  - Multi-point gain (the _Ex format with several flat-field levels, as
+//    used by HIS_SEQ_NONLINEAR): each pixel gets a piecewise-linear
+//    response through (0, 0) and its (flat_k, average_k) points, the
+//    last segment extrapolated. gainSegmentsFromEx() turns the flats
+//    into per-pixel knots and Q16 slopes; the first segment's slope is
+//    the ordinary DWORD gain map, so a single level is plain gain. The
+//    segment is picked with compares and blends, never a branch.
+//  - Pixel correction list: a sequence of records
+//        target, n, neighbour_0 ... neighbour_n-1
+//    terminated by -1; each target is replaced by the mean of its
+//    neighbours. Indices are linear pixel offsets.
+//  - Defect plan: the same correction precompiled into fixed-width
+//    records (target, 'width' neighbour indices, Q24 weights summing to
+//    1.0; unused taps have weight 0). Every record costs the same, so
+//    applying it is one linear pass without per-pixel branches. A plan
+//    whose neighbours are never themselves targets is sorted by target
+//    and indexed by row; otherwise it keeps list order and runs
+//    serially. Equal weights may round one LSB differently from the
+//    list's integer mean.
+//
+// The *32 variants mirror Acquisition_DoOffsetCorrection32 /
+// DoOffsetGainCorrection32 for DETEKTOR_DATATYPE_18BIT panels: 32-bit
+// pixels, the same Q16 gain map, and results clamped to 'maxValue'
+// (kMax18Bit for 18-bit data) instead of 65535. All arithmetic is
+// integer; the gain product is formed in 64 bits.
+//
+// src and dst may be the same buffer.
+// ------------------------------------------------------------------
+namespace correction {
+
+constexpr uint32_t kGainOne = 65536;
+constexpr uint32_t kMax18Bit = MAX_GREY_VALUE_18BIT - 1;
+
+void offset(const uint16_t *src, uint16_t *dst, const uint16_t *offsetMap, size_t count);
+void offsetGain(const uint16_t *src, uint16_t *dst, const uint16_t *offsetMap,
+                const uint32_t *gainMap, size_t count);
+void gainMapFromEx(const uint16_t *flat, uint16_t average, uint32_t *gainMap, size_t count);
+void pixelCorrection(uint16_t *data, const int *corrList);
+
+// Level-major planes 'stride' pixels apart. knots and slopes hold
+// levels - 1 planes; averages must be ascending. Flats are assumed to
+// be below 2^31.
+struct GainSegments {
+    const uint32_t *slope0;     // first segment, the DWORD gain map
+    const uint32_t *knots;      // flat_0 ... flat_levels-2
+    const uint32_t *slopes;     // segments 1 ... levels-1
+    const uint32_t *averages;   // output value at each knot
+    unsigned levels;
+    size_t stride;
+
+    GainSegments at(size_t begin) const
+    {
+        return {slope0 + begin, knots ? knots + begin : nullptr, slopes ? slopes + begin : nullptr,
+                averages, levels, stride};
+    }
+};
+
+void gainSegmentsFromEx(const uint16_t *flats, const uint16_t *averages, unsigned levels, size_t stride,
+                        uint32_t *slope0, uint32_t *knots, uint32_t *slopes, size_t count);
+void gainSegmentsFromEx32(const uint32_t *flats, const uint32_t *averages, unsigned levels, size_t stride,
+                          uint32_t *slope0, uint32_t *knots, uint32_t *slopes, size_t count);
+void offsetGainSegments(const uint16_t *src, uint16_t *dst, const uint16_t *offsetMap,
+                        const GainSegments &gain, size_t count);
+
+constexpr unsigned kWeightShift = 24;
+constexpr uint32_t kWeightOne = 1u << kWeightShift;
+
+struct DefectPlan {
+    unsigned width = 0;                 // taps per record
+    std::vector<uint32_t> targets;
+    std::vector<uint32_t> taps;         // width per record
+    std::vector<uint32_t> weights;      // width per record, Q24
+    std::vector<uint32_t> rowStart;     // rows + 1 entries once sorted, else empty
+
+    size_t size() const { return targets.size(); }
+    bool empty() const { return targets.empty(); }
+    bool sorted() const { return !rowStart.empty(); }
+    void clear() { *this = DefectPlan(); }
+};
+
+// Appends one record; taps beyond 'count' are padded with weight 0.
+// Call finalizeDefectPlan() once all records are in.
+void addDefect(DefectPlan &plan, uint32_t target, const uint32_t *neighbours, const uint32_t *weights,
+               unsigned count);
+void finalizeDefectPlan(DefectPlan &plan, unsigned rows, unsigned columns);
+DefectPlan defectPlanFromList(const int *corrList, unsigned rows, unsigned columns);
+// Applies records [first, last).
+void applyDefectPlan(uint16_t *data, const DefectPlan &plan, size_t first, size_t last);
+void applyDefectPlan32(uint32_t *data, const DefectPlan &plan, size_t first, size_t last);
+
+void offset32(const uint32_t *src, uint32_t *dst, const uint32_t *offsetMap, size_t count,
+              uint32_t maxValue = kMax18Bit);
+void offsetGain32(const uint32_t *src, uint32_t *dst, const uint32_t *offsetMap,
+                  const uint32_t *gainMap, size_t count, uint32_t maxValue = kMax18Bit);
+void offsetGainSegments32(const uint32_t *src, uint32_t *dst, const uint32_t *offsetMap,
+                          const GainSegments &gain, size_t count, uint32_t maxValue = kMax18Bit);
+void pixelCorrection32(uint32_t *data, const int *corrList);
+
+} // namespace correction
+
+// ------------------------------------------------------------------
+// CorrectionEngine
+// Holds the correction data for one panel (the equivalent of
+// Acquisition_SetCorrData / _Ex) and applies whichever parts are loaded
+// in the usual order: offset, gain (single or multi-point), defect
+// pixels. 16-bit frames use the
+// WORD offset map, 32-bit frames the DWORD one; gain and defect list are
+// shared. Setters copy the maps and must not run concurrently with
+// apply().
+//
+// The ThreadPool overloads split the frame into bands of bandRows() rows
+// and correct them in parallel, reporting each band through 'ready' (on
+// whichever pool thread finished it) as soon as its pixels are final.
+// Output is bit-identical to the single-threaded apply(). When the
+// defect plan is sorted (no neighbour is itself a defect) and src
+// != dst, defects are filled from their neighbours' corrected values
+// inside the band, so every band is published after a single pass;
+// otherwise defects run in a second pass.
+// ------------------------------------------------------------------
+class CorrectionEngine {
+public:
+    CorrectionEngine(unsigned rows, unsigned columns);
+
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    size_t pixelCount() const { return static_cast<size_t>(m_rows) * m_columns; }
+
+    // nullptr clears the respective map.
+    void setOffset(const uint16_t *offsetMap);
+    void setOffset32(const uint32_t *offsetMap);
+    void setGain(const uint32_t *gainMap);
+    // The _Ex pair: 'levels' offset-corrected flat-field images (level
+    // major) and their averages, ascending. More than one level loads
+    // piecewise-linear gain. With a pool the per-pixel fit runs in bands.
+    void setGainEx(const uint16_t *flats, const uint16_t *averages, unsigned levels = 1,
+                   ThreadPool *pool = nullptr);
+    void setGainEx32(const uint32_t *flats, const uint32_t *averages, unsigned levels = 1,
+                     ThreadPool *pool = nullptr);
+    void setPixelCorrectionList(const int *corrList);
+    void setDefectPlan(correction::DefectPlan plan);
+    const correction::DefectPlan &defectPlan() const { return m_plan; }
+
+    // Clamp for the 32-bit path; 16-bit results always clamp to 65535.
+    void setMaxValue32(uint32_t maxValue) { m_maxValue32 = maxValue; }
+    uint32_t maxValue32() const { return m_maxValue32; }
+
+    bool hasOffset() const { return !m_offset.empty(); }
+    bool hasOffset32() const { return !m_offset32.empty(); }
+    bool hasGain() const { return !m_gain.empty(); }
+    unsigned gainLevels() const { return hasGain() ? m_gainLevels : 0; }
+    bool hasPixelCorrection() const { return !m_plan.empty(); }
+    bool isActive() const { return hasOffset() || hasGain() || hasPixelCorrection(); }
+    bool isActive32() const { return hasOffset32() || hasGain() || hasPixelCorrection(); }
+    const uint16_t *offsetMap() const { return hasOffset() ? m_offset.data() : nullptr; }
+    const uint32_t *offsetMap32() const { return hasOffset32() ? m_offset32.data() : nullptr; }
+
+    void apply(const uint16_t *src, uint16_t *dst) const;
+    void apply(const uint32_t *src, uint32_t *dst) const;
+    // In place on a frame of matching geometry; returns false (frame
+    // untouched) otherwise.
+    bool apply(Frame &frame) const;
+
+    typedef std::function<void(unsigned firstRow, unsigned rowCount)> BandReady;
+
+    // 0 (the default) sizes bands so that one band's source, maps and
+    // output fit in about 256 KiB of L2.
+    void setBandRows(unsigned rows) { m_bandRows = rows; }
+    unsigned bandRows(size_t bytesPerPixel) const;
+
+    void apply(const uint16_t *src, uint16_t *dst, ThreadPool &pool,
+               const BandReady &ready = BandReady()) const;
+    void apply(const uint32_t *src, uint32_t *dst, ThreadPool &pool,
+               const BandReady &ready = BandReady()) const;
+
+private:
+    template <typename T>
+    void loadGainEx(const T *flats, const T *averages, unsigned levels, ThreadPool *pool);
+    correction::GainSegments gainSegments() const;
+    void correctSpan(const uint16_t *src, uint16_t *dst, size_t begin, size_t count) const;
+    void correctSpan(const uint32_t *src, uint32_t *dst, size_t begin, size_t count) const;
+    uint16_t correctedPixel(const uint16_t *src, size_t index) const;
+    uint32_t correctedPixel(const uint32_t *src, size_t index) const;
+    template <typename T>
+    void fixBandDefects(const T *src, T *dst, unsigned firstRow, unsigned rowCount, bool fromSource) const;
+    template <typename T>
+    void applyBands(const T *src, T *dst, ThreadPool &pool, const BandReady &ready) const;
+
+    const unsigned m_rows;
+    const unsigned m_columns;
+    std::vector<uint16_t> m_offset;
+    std::vector<uint32_t> m_offset32;
+    uint32_t m_maxValue32 = correction::kMax18Bit;
+    std::vector<uint32_t> m_gain;                // Q16; the first segment with multi-point gain
+    unsigned m_gainLevels = 1;
+    std::vector<uint32_t> m_gainKnots;           // (levels - 1) planes
+    std::vector<uint32_t> m_gainSlopes;          // (levels - 1) planes
+    std::vector<uint32_t> m_gainAverages;
+    correction::DefectPlan m_plan;
+    unsigned m_bandRows = 0;
+};
+
+#endif // CORRECTION_H
@@ -0,0 +1,553 @@
+// daq_cli: headless acquisition. Drives the same AcquisitionSession as
+// the GUI (acquisition, host sorting, ROI/binning, correction and
+// recording) without Qt, for automated and overnight runs.
+//
+// Settings come from the DAQ_* environment variables, then from the
+// command line in order; --config FILE reads "name = value" lines (the
+// long option names without dashes, '#' starts a comment) at the point
+// where it appears, so later options override the file.
+//
+// Standard output carries one JSON object per line: a "progress" record
+// every --interval seconds and a final "summary" with the throughput,
+// the recording and the pipeline telemetry; both carry the latest frame
+// statistics ("stats", one per region) when --stats is on. The log
+// goes to standard error. SIGINT or SIGTERM stops an acquisition
+// cleanly, which is how an unbounded one (--frames 0, the default) ends.
+//
+// --panels runs several detectors at once through a DetectorManager,
+// each recording into <output>_<panel>. Every progress and summary
+// record then names its "panel", and an "aggregate" record with the
+// summed throughput follows the summaries.
+//
+// --verify reads each recording back once the run is over, with the
+// HisReader or the CompressedHisReader (every chunk is decoded), and
+// adds a "verify" object to its summary. A recording whose geometry or
+// frame count does not match what was written fails the run.
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "acquisitionsession.h"
+#include "compressedhisreader.h"
+#include "detectormanager.h"
+#include "hisreader.h"
+#include "logger.h"
+#include "telemetry.h"
+#include "threadpool.h"
+
+namespace {
+
+volatile std::sig_atomic_t g_stopRequested = 0;
+
+void onStopSignal(int)
+{
+    g_stopRequested = 1;
+}
+
+struct Settings {
+    DetectorManager::Options detectors = DetectorManager::Options::fromEnvironment();
+    int64_t frames = 0;
+    std::string output = "acquisition";
+    double interval = 1.0;
+    XislLoggingLevels logLevel = LEVEL_INFO;
+    std::string logFile;
+    std::string metrics;
+    bool verify = false;
+};
+
+// What --verify found reading one recording back.
+struct Readback {
+    bool ok = false;
+    uint64_t frames = 0;
+    std::string error;
+};
+
+void usage(std::FILE *out)
+{
+    std::fputs("Usage: daq_cli [options]\n"
+               "  --config FILE       read options from FILE (name = value per line)\n"
+               "  --frames N          frames to acquire; 0 runs until SIGINT/SIGTERM (default 0)\n"
+               "  --rate FPS          run the detector's internal timer at FPS (default: its own timing)\n"
+               "  --panels SPEC       detectors to run at once: N, all, gbif or gbif:N (DAQ_PANELS, default 1)\n"
+               "  --pin on|off        pin each panel to its own CPUs and NUMA node when there are several\n"
+               "                      (DAQ_PIN, default on)\n"
+               "  --roi X,Y,W,H       crop every frame before correction and recording (DAQ_ROI)\n"
+               "  --binning MODE      1x1, 2x1, 2x2, 4x1, 4x4, 3x3 or 9to4 after the crop, with :sum\n"
+               "                      for 32-bit sums instead of the mean (DAQ_BINNING, default 1x1)\n"
+               "  --average MODE      off, running, block:N or moving:N (DAQ_AVERAGE)\n"
+               "  --stats SPEC        on, off or regions X,Y,W,H[;X,Y,W,H...], with :LOW,HIGH clip\n"
+               "                      percentiles (DAQ_STATS, default on:0.5,99.5)\n"
+               "  --output PATH       recording base name; .his or .hisz is appended (default acquisition)\n"
+               "  --backend NAME      auto, io_uring, pwrite or buffered (DAQ_RECORD_BACKEND)\n"
+               "  --depth N           frames in flight to the disk (DAQ_RECORD_DEPTH)\n"
+               "  --compress NAME     left, up, median or off (DAQ_RECORD_COMPRESS)\n"
+               "  --descramble MODE   HIS_SORT_* readout order to sort on the host (DAQ_DESCRAMBLE)\n"
+               "  --threads N         correction threads, 0 = every core (DAQ_CORRECTION_THREADS)\n"
+               "  --interval SECONDS  progress record period, 0 = none (default 1)\n"
+               "  --log-level LEVEL   trace, debug, info, warn, error or none (DAQ_LOG_LEVEL, default info)\n"
+               "  --log-file PATH     also log every entry to PATH (DAQ_LOG_FILE)\n"
+               "  --metrics PATH      write the telemetry as JSON to PATH at the end (DAQ_METRICS_JSON)\n"
+               "  --verify on|off     read every recording back after the run and check it (DAQ_VERIFY)\n"
+               "  --help              show this text\n",
+               out);
+}
+
+bool parseInt(const std::string &text, int64_t *value)
+{
+    char *end = nullptr;
+    const long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || parsed < 0)
+        return false;
+    *value = parsed;
+    return true;
+}
+
+bool parseDouble(const std::string &text, double *value)
+{
+    char *end = nullptr;
+    const double parsed = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !(parsed >= 0))
+        return false;
+    *value = parsed;
+    return true;
+}
+
+bool readConfig(const std::string &path, Settings *settings);
+
+// 'name' without the leading dashes. Returns false with a message on
+// standard error when the option or its value is not understood.
+bool apply(const std::string &name, const std::string &value, Settings *settings)
+{
+    AcquisitionSession::Options &session = settings->detectors.session;
+    int64_t number = 0;
+    bool ok = true;
+    if (name == "config") {
+        return readConfig(value, settings);
+    } else if (name == "frames") {
+        ok = parseInt(value, &settings->frames);
+    } else if (name == "rate") {
+        ok = parseDouble(value, &session.frameRate);
+    } else if (name == "panels") {
+        ok = DetectorManager::parse(value, &settings->detectors);
+    } else if (name == "pin") {
+        settings->detectors.pin = value == "on";
+        ok = value == "on" || value == "off";
+    } else if (name == "roi") {
+        ok = AcquisitionSession::parseRoi(value, &session.roi);
+    } else if (name == "binning") {
+        ok = FrameBinner::parse(value, &session.binning);
+    } else if (name == "average") {
+        ok = FrameAverager::parse(value, &session.averaging);
+    } else if (name == "stats") {
+        ok = FrameStatistics::parse(value, &session.statistics);
+    } else if (name == "output") {
+        settings->output = value;
+        ok = !value.empty();
+    } else if (name == "backend") {
+        if (value == "auto")
+            session.record.backend = HisWriter::Backend::Auto;
+        else if (value == "io_uring")
+            session.record.backend = HisWriter::Backend::IoUring;
+        else if (value == "pwrite")
+            session.record.backend = HisWriter::Backend::ThreadPool;
+        else if (value == "buffered")
+            session.record.backend = HisWriter::Backend::Buffered;
+        else
+            ok = false;
+    } else if (name == "depth") {
+        ok = parseInt(value, &number) && number > 0;
+        session.record.queueDepth = static_cast<unsigned>(number);
+    } else if (name == "compress") {
+        session.compress = value != "off";
+        if (value == "left")
+            session.compression.predictor = FrameCodec::Predictor::Left;
+        else if (value == "up")
+            session.compression.predictor = FrameCodec::Predictor::Up;
+        else if (value == "median")
+            session.compression.predictor = FrameCodec::Predictor::Median;
+        else
+            ok = value == "off";
+    } else if (name == "descramble") {
+        ok = parseInt(value, &number);
+        session.sortMode = static_cast<unsigned>(number);
+    } else if (name == "threads") {
+        ok = parseInt(value, &number);
+        session.correctionThreads = static_cast<unsigned>(number);
+    } else if (name == "interval") {
+        ok = parseDouble(value, &settings->interval);
+    } else if (name == "log-level") {
+        settings->logLevel = Logger::parseLevel(value);
+        ok = settings->logLevel != LEVEL_ALL;
+    } else if (name == "log-file") {
+        settings->logFile = value;
+    } else if (name == "metrics") {
+        settings->metrics = value;
+    } else if (name == "verify") {
+        settings->verify = value == "on";
+        ok = value == "on" || value == "off";
+    } else {
+        std::fprintf(stderr, "daq_cli: unknown option '%s'\n", name.c_str());
+        return false;
+    }
+    if (!ok)
+        std::fprintf(stderr, "daq_cli: bad value '%s' for %s\n", value.c_str(), name.c_str());
+    return ok;
+}
+
+std::string trim(const std::string &text)
+{
+    size_t begin = 0, end = text.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin])))
+        ++begin;
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1])))
+        --end;
+    return text.substr(begin, end - begin);
+}
+
+bool readConfig(const std::string &path, Settings *settings)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::fprintf(stderr, "daq_cli: cannot read %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        const size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            std::fprintf(stderr, "daq_cli: %s:%d: expected name = value\n", path.c_str(), number);
+            return false;
+        }
+        if (!apply(trim(line.substr(0, equals)), trim(line.substr(equals + 1)), settings))
+            return false;
+    }
+    return true;
+}
+
+// Telemetry::toJson() on one line, for a JSON-lines stream.
+std::string oneLine(const std::string &json)
+{
+    std::string line;
+    line.reserve(json.size());
+    bool indent = false;
+    for (char c : json) {
+        if (c == '\n') {
+            indent = true;
+            continue;
+        }
+        if (indent && c == ' ')
+            continue;
+        indent = false;
+        line += c;
+    }
+    return line;
+}
+
+void printLog(Logger &logger, std::vector<Logger::Line> &lines)
+{
+    logger.takeLines(lines);
+    for (const Logger::Line &line : lines) {
+        if (line.count > 1)
+            std::fprintf(stderr, "%-5s %s (x%llu)\n", Logger::levelName(line.level), line.text.c_str(),
+                         static_cast<unsigned long long>(line.count));
+        else
+            std::fprintf(stderr, "%-5s %s\n", Logger::levelName(line.level), line.text.c_str());
+    }
+}
+
+// The latest frame statistics as a JSON array, one object per region.
+std::string statisticsJson(const AcquisitionSession &session)
+{
+    std::string json = "[";
+    char buffer[256];
+    for (const FrameStatistics::Result &result : session.statistics()) {
+        const FrameSummary &summary = result.summary;
+        std::snprintf(buffer, sizeof(buffer),
+                      "%s{\"roi\": [%u, %u, %u, %u], \"min\": %u, \"max\": %u, \"mean\": %.2f, \"std\": %.2f, "
+                      "\"median\": %u, \"low\": %u, \"high\": %u}",
+                      json.size() > 1 ? ", " : "", result.region.x, result.region.y, result.region.width,
+                      result.region.height, summary.min, summary.max, summary.mean, summary.std, summary.median,
+                      summary.low, summary.high);
+        json += buffer;
+    }
+    return json + "]";
+}
+
+// Reads a finished recording back: the header must give the delivered
+// geometry and the file must hold the 'expected' frames, each of them
+// readable (and, for .hisz, decodable).
+Readback readBack(const std::string &path, bool compressed, unsigned rows, unsigned columns, uint64_t expected)
+{
+    Readback result;
+    if (path.empty()) {
+        result.error = "nothing was recorded";
+        return result;
+    }
+    const auto geometry = [&](unsigned fileRows, unsigned fileColumns) {
+        if (fileRows == rows && fileColumns == columns)
+            return true;
+        result.error = "the file holds " + std::to_string(fileColumns) + "x" + std::to_string(fileRows)
+                       + " frames, " + std::to_string(columns) + "x" + std::to_string(rows) + " were written";
+        return false;
+    };
+    if (compressed) {
+        CompressedHisReader reader;
+        if (!reader.open(path)) {
+            result.error = reader.error();
+            return result;
+        }
+        if (!geometry(reader.rows(), reader.columns()))
+            return result;
+        if (reader.recovered()) {
+            result.error = "the chunk index is missing";
+            return result;
+        }
+        ThreadPool pool;
+        std::vector<uint16_t> pixels(static_cast<size_t>(rows) * columns);
+        for (size_t i = 0; i < reader.frameCount(); ++i, ++result.frames) {
+            if (!reader.read(i, pixels.data(), &pool)) {
+                result.error = "frame " + std::to_string(i) + " does not decode: " + reader.error();
+                return result;
+            }
+        }
+    } else {
+        HisReader reader;
+        if (!reader.open(path)) {
+            result.error = reader.error();
+            return result;
+        }
+        if (!geometry(reader.rows(), reader.columns()))
+            return result;
+        for (size_t i = 0; i < reader.frameCount() && reader.frame(i); ++i)
+            ++result.frames;
+    }
+    if (result.frames != expected) {
+        result.error = std::to_string(result.frames) + " of " + std::to_string(expected) + " frames read back";
+        return result;
+    }
+    result.ok = true;
+    return result;
+}
+
+// '"verify": {...}, ' when the recording was read back.
+std::string verifyField(const Readback *readback)
+{
+    if (!readback)
+        return "";
+    std::string field = "\"verify\": {\"ok\": " + std::string(readback->ok ? "true" : "false") + ", \"frames\": "
+                        + std::to_string(readback->frames);
+    if (!readback->error.empty())
+        field += ", \"error\": " + Telemetry::jsonString(readback->error);
+    return field + "}, ";
+}
+
+// '"panel": "<name>", ' when several panels run, so records can be told apart.
+std::string panelField(const DetectorManager &manager, size_t index)
+{
+    return manager.panelCount() > 1 ? "\"panel\": " + Telemetry::jsonString(manager.panel(index).name) + ", " : "";
+}
+
+void printProgress(const DetectorManager &manager, size_t index, const AcquisitionSession::Stats &stats,
+                   double elapsed, double fps)
+{
+    const DetectorManager::Panel &panel = manager.panel(index);
+    const Telemetry &telemetry = *panel.telemetry;
+    std::printf("{\"type\": \"progress\", %s\"elapsed_s\": %.3f, \"frames\": %lld, \"fps\": %.2f, "
+                "\"mb_per_s\": %.2f, \"dropped_image\": %llu, \"packet_loss\": %llu, \"write_queue\": %llu, "
+                "\"stats\": %s}\n",
+                panelField(manager, index).c_str(), elapsed, static_cast<long long>(stats.frames), fps,
+                fps * (stats.frames ? stats.bytes / stats.frames : 0) / 1e6,
+                static_cast<unsigned long long>(telemetry.counter(Telemetry::Counter::DroppedImage)),
+                static_cast<unsigned long long>(telemetry.counter(Telemetry::Counter::PacketLoss)),
+                static_cast<unsigned long long>(telemetry.gauge(Telemetry::Gauge::WriteQueue).current),
+                statisticsJson(*panel.session).c_str());
+    std::fflush(stdout);
+}
+
+// 'readback' is null without --verify.
+void printSummary(const Settings &settings, const DetectorManager &manager, size_t index, double elapsed,
+                  const Readback *readback)
+{
+    const DetectorManager::Panel &panel = manager.panel(index);
+    const AcquisitionSession &session = *panel.session;
+    const Telemetry &telemetry = *panel.telemetry;
+    const AcquisitionSession::Stats stats = session.stats();
+    const HisWriter::Stats &record = session.recordStats();
+    const CompressedHisWriter::Stats &compressed = session.compressedStats();
+    const bool compressing = session.recordingCompressed();
+    const bool ok = panel.ok && (!readback || readback->ok);
+    std::printf("{\"type\": \"summary\", %s\"ok\": %s, \"elapsed_s\": %.3f, \"frames\": %lld, "
+                "\"requested\": %lld, \"skipped\": %lld, \"outputs\": %lld, \"rows\": %u, \"columns\": %u, "
+                "\"fps\": %.2f, \"mb_per_s\": %.2f, "
+                "\"recording\": {\"path\": %s, \"frames\": %llu, \"bytes\": %llu, \"disk_mb_per_s\": %.2f, "
+                "\"stalls\": %llu, \"ratio\": %.3f}, %s\"stats\": %s, \"telemetry\": %s}\n",
+                panelField(manager, index).c_str(), ok ? "true" : "false", elapsed,
+                static_cast<long long>(stats.frames),
+                static_cast<long long>(settings.frames), static_cast<long long>(stats.skipped),
+                static_cast<long long>(stats.outputs), stats.rows,
+                stats.columns, stats.framesPerSecond(), stats.mbPerSecond(),
+                Telemetry::jsonString(session.recordingPath()).c_str(),
+                static_cast<unsigned long long>(compressing ? compressed.frames : record.frames),
+                static_cast<unsigned long long>(compressing ? compressed.bytes : record.bytes),
+                compressing ? 0.0 : record.mbPerSecond(),
+                static_cast<unsigned long long>(compressing ? compressed.stalls : record.stalls),
+                compressing ? compressed.ratio() : 1.0, verifyField(readback).c_str(), statisticsJson(session).c_str(),
+                oneLine(telemetry.toJson()).c_str());
+    std::fflush(stdout);
+}
+
+// After the per-panel summaries when several panels ran.
+void printAggregate(const DetectorManager &manager, bool ok, double elapsed)
+{
+    const DetectorManager::Stats stats = manager.stats();
+    std::printf("{\"type\": \"aggregate\", \"ok\": %s, \"elapsed_s\": %.3f, \"panels\": %zu, \"frames\": %lld, "
+                "\"outputs\": %lld, \"fps\": %.2f, \"mb_per_s\": %.2f}\n",
+                ok ? "true" : "false", elapsed, manager.panelCount(), static_cast<long long>(stats.frames),
+                static_cast<long long>(stats.outputs), stats.framesPerSecond, stats.mbPerSecond);
+    std::fflush(stdout);
+}
+
+std::string environment(const char *name)
+{
+    const char *value = std::getenv(name);
+    return value ? value : "";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Settings settings;
+    settings.detectors.session.liveStream = false;
+    if (!environment("DAQ_LOG_LEVEL").empty() && Logger::parseLevel(environment("DAQ_LOG_LEVEL")) != LEVEL_ALL)
+        settings.logLevel = Logger::parseLevel(environment("DAQ_LOG_LEVEL"));
+    settings.logFile = environment("DAQ_LOG_FILE");
+    settings.metrics = environment("DAQ_METRICS_JSON");
+    settings.verify = environment("DAQ_VERIFY") == "on";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage(stdout);
+            return 0;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            usage(stderr);
+            return 2;
+        }
+        std::string name = arg.substr(2), value;
+        const size_t equals = name.find('=');
+        if (equals != std::string::npos) {
+            value = name.substr(equals + 1);
+            name.resize(equals);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        } else {
+            std::fprintf(stderr, "daq_cli: %s needs a value\n", arg.c_str());
+            return 2;
+        }
+        if (!apply(name, value, &settings))
+            return 2;
+    }
+
+    Logger logger;
+    logger.setLevel(settings.logLevel);
+    if (!settings.logFile.empty() && !logger.openFile(settings.logFile))
+        std::fprintf(stderr, "daq_cli: cannot open log file %s\n", settings.logFile.c_str());
+    DetectorManager manager(&logger);
+    if (!manager.open(settings.detectors)) {
+        logger.message(LEVEL_ERROR, manager.error() + ".");
+        logger.flush();
+        std::vector<Logger::Line> lines;
+        printLog(logger, lines);
+        return 1;
+    }
+    const size_t panels = manager.panelCount();
+
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<bool> finished{false};
+    bool ok = false;
+    std::thread runner([&] {
+        ok = manager.run(AcquisitionSession::Mode::Acquire, settings.output, settings.frames);
+        finished = true;
+    });
+
+    std::vector<Logger::Line> lines;
+    auto lastReport = start;
+    std::vector<int64_t> lastFrames(panels, 0);
+    while (!finished) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        // Repeated: a panel still starting up when the signal came would
+        // miss a single request.
+        if (g_stopRequested)
+            manager.requestAbort();
+        printLog(logger, lines);
+        const auto now = std::chrono::steady_clock::now();
+        const double sinceReport = std::chrono::duration<double>(now - lastReport).count();
+        if (settings.interval > 0 && sinceReport >= settings.interval) {
+            for (size_t i = 0; i < panels; ++i) {
+                const AcquisitionSession::Stats stats = manager.session(i).stats();
+                printProgress(manager, i, stats, std::chrono::duration<double>(now - start).count(),
+                              (stats.frames - lastFrames[i]) / sinceReport);
+                lastFrames[i] = stats.frames;
+            }
+            lastReport = now;
+        }
+    }
+    runner.join();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t lost = 0;
+    for (size_t i = 0; i < panels; ++i) {
+        Telemetry &telemetry = *manager.panel(i).telemetry;
+        telemetry.set(Telemetry::Counter::LogDropped, logger.stats().dropped);
+        lost += telemetry.counter(Telemetry::Counter::DroppedImage)
+                + telemetry.counter(Telemetry::Counter::PacketLoss);
+    }
+    if (lost > 0)
+        logger.message(LEVEL_WARN, std::to_string(lost) + " frame(s) lost before the host.");
+    if (!settings.metrics.empty()) {
+        // One panel keeps the single-pipeline format.
+        const bool written = panels > 1 ? manager.writeJson(settings.metrics)
+                                        : manager.panel(0).telemetry->writeJson(settings.metrics);
+        if (!written)
+            logger.message(LEVEL_ERROR, "Cannot write metrics to " + settings.metrics);
+    }
+    std::vector<Readback> readbacks;
+    if (settings.verify) {
+        for (size_t i = 0; i < panels; ++i) {
+            const AcquisitionSession &session = manager.session(i);
+            const bool compressed = session.recordingCompressed();
+            const AcquisitionSession::Stats stats = session.stats();
+            readbacks.push_back(readBack(session.recordingPath(), compressed, stats.rows, stats.columns,
+                                         compressed ? session.compressedStats().frames
+                                                    : session.recordStats().frames));
+            if (!readbacks.back().ok) {
+                const std::string what = session.recordingPath().empty() ? manager.panel(i).name
+                                                                         : session.recordingPath();
+                logger.message(LEVEL_ERROR, "Read-back of " + what + " failed: " + readbacks.back().error + ".");
+                ok = false;
+            }
+        }
+    }
+    logger.flush();
+    printLog(logger, lines);
+    for (size_t i = 0; i < panels; ++i)
+        printSummary(settings, manager, i, elapsed, settings.verify ? &readbacks[i] : nullptr);
+    if (panels > 1)
+        printAggregate(manager, ok, elapsed);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,8 @@
+# Headless acquisition driver: the daq_flatpanel pipeline without Qt.
+TEMPLATE = app
+TARGET = daq_cli
+CONFIG += console c++17
+CONFIG -= qt app_bundle
+SOURCES += daq_cli.cpp
+
+include(daq_core.pri)
@@ -0,0 +1,12 @@
+# Qt-free acquisition, correction and recording core shared by the GUI
+# (daq_flatpanel.pro) and the headless driver (daq_cli.pro).
+#
+# XISL: vendor XISL.dll on Windows, the software detector built from
+# xisl_sim/xisl_sim.pro on Linux. Both end up in lib/.
+CONFIG += c++17
+INCLUDEPATH += $$PWD
+SOURCES += $$PWD/accumulate.cpp $$PWD/acquisitioncontrol.cpp $$PWD/acquisitionsession.cpp $$PWD/affinity.cpp $$PWD/asyncfilewriter.cpp $$PWD/compressedhisreader.cpp $$PWD/compressedhiswriter.cpp $$PWD/correction.cpp $$PWD/defectdetector.cpp $$PWD/descrambler.cpp $$PWD/detectormanager.cpp $$PWD/displaypacer.cpp $$PWD/frame.cpp $$PWD/frameaverager.cpp $$PWD/framebinner.cpp $$PWD/framestatistics.cpp $$PWD/framecodec.cpp $$PWD/framering.cpp $$PWD/gaincalibrator.cpp $$PWD/hisreader.cpp $$PWD/hiswriter.cpp $$PWD/logger.cpp $$PWD/offsetcalibrator.cpp $$PWD/telemetry.cpp $$PWD/threadpool.cpp
+HEADERS += $$PWD/Acq.h $$PWD/accumulate.h $$PWD/acquisitioncontrol.h $$PWD/acquisitionsession.h $$PWD/affinity.h $$PWD/asyncfilewriter.h $$PWD/compressedhisreader.h $$PWD/compressedhiswriter.h $$PWD/correction.h $$PWD/defectdetector.h $$PWD/descrambler.h $$PWD/detectormanager.h $$PWD/displaypacer.h $$PWD/frame.h $$PWD/frameaverager.h $$PWD/framebinner.h $$PWD/framestatistics.h $$PWD/framecodec.h $$PWD/framering.h $$PWD/gaincalibrator.h $$PWD/hisreader.h $$PWD/hiswriter.h $$PWD/logger.h $$PWD/offsetcalibrator.h $$PWD/simd.h $$PWD/steadyclock.h $$PWD/telemetry.h $$PWD/threadpool.h
+LIBS += -L$$PWD/lib -lXISL
+unix: LIBS += -lpthread
+unix: QMAKE_RPATHDIR += $$PWD/lib
@@ -1,4 +1,7 @@
 QT += core gui widgets
 CONFIG += c++17
 TEMPLATE += app
-SOURCES += main.cpp
+SOURCES += main.cpp liverenderer.cpp
+HEADERS += liverenderer.h
+
+include(daq_core.pri)
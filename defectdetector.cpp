@@ -0,0 +1,238 @@
+#include "defectdetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int kSearchRadius = 3;
+constexpr unsigned kMaxNeighbours = 8;
+
+template <typename T>
+double median(const T *values, size_t count)
+{
+    if (count == 0)
+        return 0;
+    std::vector<T> copy(values, values + count);
+    auto middle = copy.begin() + count / 2;
+    std::nth_element(copy.begin(), middle, copy.end());
+    return static_cast<double>(*middle);
+}
+
+// Median absolute deviation scaled to a normal sigma.
+double robustSigma(const uint32_t *values, size_t count, double centre)
+{
+    std::vector<float> deviation(count);
+    for (size_t i = 0; i < count; ++i)
+        deviation[i] = static_cast<float>(std::fabs(values[i] - centre));
+    return 1.4826 * median(deviation.data(), count);
+}
+
+struct Candidate {
+    uint32_t index;
+    int distance2;
+};
+
+} // namespace
+
+DefectDetector::DefectDetector(unsigned rows, unsigned columns)
+    : m_rows(rows), m_columns(columns)
+{
+    clear();
+}
+
+void DefectDetector::clear()
+{
+    m_darkFlags.assign(pixelCount(), 0);
+    m_flatFlags.assign(pixelCount(), 0);
+    combine();
+}
+
+void DefectDetector::classifyDark(const uint32_t *offsetMap, const float *noiseMap)
+{
+    const size_t count = pixelCount();
+    std::fill(m_darkFlags.begin(), m_darkFlags.end(), 0);
+    if (offsetMap) {
+        const double centre = median(offsetMap, count);
+        const double sigma = std::max(robustSigma(offsetMap, count, centre), 1.0);
+        const double limit = centre + m_thresholds.hotOffsetSigma * sigma;
+        for (size_t i = 0; i < count; ++i)
+            m_darkFlags[i] |= offsetMap[i] > limit ? Hot : 0;
+    }
+    if (noiseMap) {
+        const double typical = median(noiseMap, count);
+        const double noisy = m_thresholds.noisyFactor * typical;
+        const double stuck = m_thresholds.stuckFactor * typical;
+        for (size_t i = 0; i < count; ++i) {
+            m_darkFlags[i] |= noiseMap[i] > noisy ? Noisy : 0;
+            m_darkFlags[i] |= noiseMap[i] < stuck ? Dead : 0;
+        }
+    }
+    combine();
+}
+
+void DefectDetector::classifyFlats(const uint32_t *const *flats, const uint32_t *averages, unsigned levels)
+{
+    const size_t count = pixelCount();
+    std::fill(m_flatFlags.begin(), m_flatFlags.end(), 0);
+    if (levels > 0 && averages[levels - 1] > 0) {
+        const uint32_t *brightest = flats[levels - 1];
+        const double low = m_thresholds.minResponse * averages[levels - 1];
+        const double high = m_thresholds.maxResponse * averages[levels - 1];
+        for (size_t i = 0; i < count; ++i) {
+            m_flatFlags[i] |= brightest[i] < low ? Dead : 0;
+            m_flatFlags[i] |= brightest[i] > high ? Hot : 0;
+        }
+    }
+    if (levels > 1) {
+        std::vector<double> scale(levels);
+        for (unsigned k = 0; k < levels; ++k)
+            scale[k] = averages[k] ? 1.0 / averages[k] : 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            if (m_flatFlags[i] & Dead)
+                continue;
+            double lowest = HUGE_VAL, highest = 0, sum = 0;
+            unsigned used = 0;
+            for (unsigned k = 0; k < levels; ++k) {
+                if (scale[k] == 0)
+                    continue;
+                const double response = flats[k][i] * scale[k];
+                lowest = std::min(lowest, response);
+                highest = std::max(highest, response);
+                sum += response;
+                ++used;
+            }
+            if (used > 1 && highest - lowest > m_thresholds.nonlinearity * sum / used)
+                m_flatFlags[i] |= Nonlinear;
+        }
+    }
+    combine();
+}
+
+void DefectDetector::combine()
+{
+    const size_t count = pixelCount();
+    m_flags.resize(count);
+    std::vector<unsigned> perColumn(m_columns, 0);
+    std::vector<uint8_t> lineRow(m_rows, 0);
+    for (unsigned r = 0; r < m_rows; ++r) {
+        unsigned perRow = 0;
+        for (unsigned c = 0; c < m_columns; ++c) {
+            const size_t i = static_cast<size_t>(r) * m_columns + c;
+            m_flags[i] = m_darkFlags[i] | m_flatFlags[i];
+            const unsigned bad = m_flags[i] ? 1 : 0;
+            perRow += bad;
+            perColumn[c] += bad;
+        }
+        lineRow[r] = perRow > m_thresholds.lineFraction * m_columns;
+    }
+
+    m_lineRows = 0;
+    m_lineColumns = 0;
+    for (unsigned r = 0; r < m_rows; ++r) {
+        if (!lineRow[r])
+            continue;
+        ++m_lineRows;
+        std::for_each(m_flags.begin() + static_cast<size_t>(r) * m_columns,
+                      m_flags.begin() + static_cast<size_t>(r + 1) * m_columns, [](uint8_t &f) { f |= Line; });
+    }
+    for (unsigned c = 0; c < m_columns; ++c) {
+        if (perColumn[c] <= m_thresholds.lineFraction * m_rows)
+            continue;
+        ++m_lineColumns;
+        for (unsigned r = 0; r < m_rows; ++r)
+            m_flags[static_cast<size_t>(r) * m_columns + c] |= Line;
+    }
+}
+
+DefectDetector::Counts DefectDetector::counts() const
+{
+    Counts counts;
+    for (uint8_t f : m_flags) {
+        counts.dead += (f & Dead) ? 1 : 0;
+        counts.hot += (f & Hot) ? 1 : 0;
+        counts.noisy += (f & Noisy) ? 1 : 0;
+        counts.nonlinear += (f & Nonlinear) ? 1 : 0;
+        counts.total += f ? 1 : 0;
+    }
+    counts.lineRows = m_lineRows;
+    counts.lineColumns = m_lineColumns;
+    return counts;
+}
+
+correction::DefectPlan DefectDetector::plan() const
+{
+    correction::DefectPlan plan;
+    plan.width = kMaxNeighbours;
+    std::vector<Candidate> candidates;
+    uint32_t taps[kMaxNeighbours];
+    uint32_t weights[kMaxNeighbours];
+
+    // Row-major scan, so records come out sorted by target.
+    for (unsigned r = 0; r < m_rows; ++r) {
+        for (unsigned c = 0; c < m_columns; ++c) {
+            const size_t i = static_cast<size_t>(r) * m_columns + c;
+            if (!m_flags[i])
+                continue;
+            // Grow the ring until it yields two good pixels (one will do at
+            // the last radius).
+            candidates.clear();
+            for (int radius = 1; radius <= kSearchRadius; ++radius) {
+                for (int dr = -radius; dr <= radius; ++dr) {
+                    for (int dc = -radius; dc <= radius; ++dc) {
+                        if (std::max(std::abs(dr), std::abs(dc)) != radius)
+                            continue;
+                        const int nr = static_cast<int>(r) + dr;
+                        const int nc = static_cast<int>(c) + dc;
+                        if (nr < 0 || nc < 0 || nr >= static_cast<int>(m_rows) || nc >= static_cast<int>(m_columns))
+                            continue;
+                        const uint32_t n = static_cast<uint32_t>(nr) * m_columns + static_cast<uint32_t>(nc);
+                        if (!m_flags[n])
+                            candidates.push_back({n, dr * dr + dc * dc});
+                    }
+                }
+                if (candidates.size() >= 2)
+                    break;
+            }
+            if (candidates.empty())
+                continue;   // nothing good nearby; left uncorrected
+
+            std::stable_sort(candidates.begin(), candidates.end(),
+                             [](const Candidate &a, const Candidate &b) { return a.distance2 < b.distance2; });
+            const unsigned used = std::min<unsigned>(static_cast<unsigned>(candidates.size()), kMaxNeighbours);
+            double total = 0;
+            for (unsigned j = 0; j < used; ++j)
+                total += 1.0 / candidates[j].distance2;
+            unsigned assigned = 0;
+            for (unsigned j = 0; j < used; ++j) {
+                taps[j] = candidates[j].index;
+                weights[j] = static_cast<uint32_t>(correction::kWeightOne / candidates[j].distance2 / total);
+                assigned += weights[j];
+            }
+            // Rounding slack goes to the nearest neighbour so weights sum to 1.0.
+            weights[0] += correction::kWeightOne - assigned;
+            correction::addDefect(plan, static_cast<uint32_t>(i), taps, weights, used);
+        }
+    }
+    correction::finalizeDefectPlan(plan, m_rows, m_columns);
+    return plan;
+}
+
+std::vector<int> DefectDetector::correctionList() const
+{
+    const correction::DefectPlan defects = plan();
+    std::vector<int> list;
+    for (size_t d = 0; d < defects.size(); ++d) {
+        list.push_back(static_cast<int>(defects.targets[d]));
+        const size_t sizeAt = list.size();
+        list.push_back(0);
+        for (unsigned j = 0; j < defects.width; ++j) {
+            if (defects.weights[d * defects.width + j] == 0)
+                continue;
+            list.push_back(static_cast<int>(defects.taps[d * defects.width + j]));
+            ++list[sizeAt];
+        }
+    }
+    list.push_back(-1);
+    return list;
+}
@@ -0,0 +1,98 @@
+#ifndef DEFECTDETECTOR_H
+#define DEFECTDETECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "correction.h"
+
+// ------------------------------------------------------------------
+// DefectDetector
+// In-tree replacement for Acquisition_CreatePixelMap. Classifies pixels
+// from the calibration statistics:
+//  - dark (OffsetCalibrator): hot, with an offset far above the panel's
+//    median (robust sigma from the MAD); noisy, with temporal noise a
+//    multiple of the median; stuck (counted as dead), with almost none;
+//  - flat fields (GainCalibrator levels): dead or hot, with a response
+//    (flat / level average) outside the limits at the brightest level;
+//    nonlinear, with a response that drifts across levels;
+//  - lines: a row or column with more than lineFraction of its pixels
+//    defective is condemned entirely.
+// Each classify call replaces the findings of its source; the map is
+// their union.
+//
+// plan() interpolates every defect from the nearest good pixels (up to
+// eight within a radius of three, weighted by inverse squared distance)
+// and returns a sorted, row-indexed correction::DefectPlan for
+// CorrectionEngine::setDefectPlan(). correctionList() gives the same
+// defects as an XISL pixel correction list.
+// ------------------------------------------------------------------
+class DefectDetector {
+public:
+    enum Flag : uint8_t {
+        Dead = 1,
+        Hot = 2,
+        Noisy = 4,
+        Nonlinear = 8,
+        Line = 16
+    };
+
+    struct Thresholds {
+        double hotOffsetSigma = 8.0;    // offset above median + k * robust sigma
+        double noisyFactor = 3.0;       // noise above k * median noise
+        double stuckFactor = 0.1;       // noise below k * median noise
+        double minResponse = 0.5;       // flat / average below: dead
+        double maxResponse = 1.5;       // flat / average above: hot
+        double nonlinearity = 0.05;     // relative spread of the response across levels
+        double lineFraction = 0.5;      // defective share that condemns a row or column
+    };
+
+    struct Counts {
+        size_t dead = 0;
+        size_t hot = 0;
+        size_t noisy = 0;
+        size_t nonlinear = 0;
+        unsigned lineRows = 0;
+        unsigned lineColumns = 0;
+        size_t total = 0;               // pixels with any flag
+    };
+
+    DefectDetector(unsigned rows, unsigned columns);
+
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    size_t pixelCount() const { return static_cast<size_t>(m_rows) * m_columns; }
+
+    void setThresholds(const Thresholds &thresholds) { m_thresholds = thresholds; }
+    const Thresholds &thresholds() const { return m_thresholds; }
+
+    // Either map may be nullptr. Offsets are in ADU, noise is the
+    // per-pixel standard deviation.
+    void classifyDark(const uint32_t *offsetMap, const float *noiseMap);
+    // 'flats' holds one offset-corrected image per level, averages
+    // ascending (GainCalibrator::levelFlat / levelAverage). levels == 0
+    // clears the flat-field findings.
+    void classifyFlats(const uint32_t *const *flats, const uint32_t *averages, unsigned levels);
+    void clear();
+
+    const std::vector<uint8_t> &flagMap() const { return m_flags; }
+    Counts counts() const;
+
+    correction::DefectPlan plan() const;
+    std::vector<int> correctionList() const;
+
+private:
+    void combine();
+
+    const unsigned m_rows;
+    const unsigned m_columns;
+    Thresholds m_thresholds;
+    std::vector<uint8_t> m_darkFlags;
+    std::vector<uint8_t> m_flatFlags;
+    std::vector<uint8_t> m_flags;       // union plus Line
+    unsigned m_lineRows = 0;
+    unsigned m_lineColumns = 0;
+};
+
+#endif // DEFECTDETECTOR_H
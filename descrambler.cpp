@@ -0,0 +1,313 @@
+#include "descrambler.h"
+#include "Acq.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Strided runs are cut to this many pixels, so the chunks of all
+// channels that cover one stretch of the raw frame (channels * kChunk
+// pixels, 64 KB for 32 channels of 16-bit data) stay in L2 while the
+// chunks are gathered one after the other.
+constexpr uint32_t kChunk = 1024;
+
+struct Layout {
+    const char *name;
+    unsigned tileRows;          // 1, or 2 with a top and a bottom half
+    unsigned tilesAcross;
+    bool flipBottom;            // bottom tiles read from the last row up
+    bool flipTiles;             // every tile read right to left
+    bool flipRightHalf;         // tiles in the right half read right to left
+    bool swapChannels;          // neighbouring channels exchanged on the link
+    bool lineClock;             // a whole tile row per clock instead of a pixel
+};
+
+// Indexed by HIS_SORT_*.
+const Layout kLayouts[] = {
+    {"none",                       1,  1, false, false, false, false, false},
+    {"quad",                       2,  2, false, false, false, false, false},
+    {"column",                     1,  2, false, false, false, false, false},
+    {"column quad",                2,  4, false, false, false, false, false},
+    {"quad inverse",               2,  2, true,  false, false, false, false},
+    {"quad tile",                  2,  8, false, false, false, false, false},
+    {"quad tile inverse",          2,  8, true,  false, false, false, false},
+    {"quad tile inverse scramble", 2,  8, true,  false, false, true,  false},
+    {"oct tile inverse",           2, 16, true,  false, false, false, false},
+    {"oct tile inverse binding",   2, 16, true,  false, true,  false, false},
+    {"oct tile inverse double",    2, 16, true,  true,  false, false, false},
+    {"hex tile inverse",           2, 32, true,  false, false, false, false},
+    {"hex cs",                     2, 32, false, false, false, false, false},
+    {"12x1",                       1, 12, false, false, false, false, false},
+    {"14",                         1, 14, false, false, false, false, false},
+    {"top bottom",                 2,  1, true,  false, false, false, true},
+};
+constexpr unsigned kLayoutCount = sizeof(kLayouts) / sizeof(kLayouts[0]);
+static_assert(kLayoutCount == HIS_SORT_TOP_BOTTOM + 1, "one layout per HIS_SORT_* mode");
+
+template <typename T>
+void gatherScalar(const T *src, T *dst, ptrdiff_t stride, size_t begin, size_t length)
+{
+    for (size_t i = begin; i < length; ++i)
+        dst[i] = src[static_cast<ptrdiff_t>(i) * stride];
+}
+
+#if DAQ_SIMD_X86
+// Reversal: dst[i] = src[-i].
+DAQ_TARGET_AVX2
+void reverseAvx2(const uint16_t *src, uint16_t *dst, size_t length)
+{
+    const __m256i words = _mm256_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                                           14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src - i - 15));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, words), 0x4E));
+    }
+    gatherScalar(src, dst, -1, i, length);
+}
+
+DAQ_TARGET_AVX2
+void reverseAvx2_32(const uint32_t *src, uint32_t *dst, size_t length)
+{
+    const __m256i order = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src - i - 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_permutevar8x32_epi32(v, order));
+    }
+    gatherScalar(src, dst, -1, i, length);
+}
+
+// The 16-bit gather fetches a dword per pixel and keeps the low word, so
+// it reads one pixel past the last one it uses; the caller keeps runs
+// that end on the frame's last pixel away from it.
+DAQ_TARGET_AVX2
+void gatherAvx2(const uint16_t *src, uint16_t *dst, ptrdiff_t stride, size_t length)
+{
+    const int s = static_cast<int>(stride);
+    const __m256i step = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(s));
+    const __m256i low = _mm256_set1_epi32(0xFFFF);
+    const int *base = reinterpret_cast<const int *>(src);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m256i first = _mm256_add_epi32(step, _mm256_set1_epi32(static_cast<int>(i) * s));
+        const __m256i second = _mm256_add_epi32(first, _mm256_set1_epi32(8 * s));
+        const __m256i a = _mm256_and_si256(_mm256_i32gather_epi32(base, first, 2), low);
+        const __m256i b = _mm256_and_si256(_mm256_i32gather_epi32(base, second, 2), low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8));
+    }
+    gatherScalar(src, dst, stride, i, length);
+}
+
+DAQ_TARGET_AVX2
+void gatherAvx2_32(const uint32_t *src, uint32_t *dst, ptrdiff_t stride, size_t length)
+{
+    const int s = static_cast<int>(stride);
+    const __m256i step = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(s));
+    const int *base = reinterpret_cast<const int *>(src);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const __m256i index = _mm256_add_epi32(step, _mm256_set1_epi32(static_cast<int>(i) * s));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_i32gather_epi32(base, index, 4));
+    }
+    gatherScalar(src, dst, stride, i, length);
+}
+
+DAQ_TARGET_SSE41
+void reverseSse41(const uint16_t *src, uint16_t *dst, size_t length)
+{
+    const __m128i words = _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src - i - 7));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi8(v, words));
+    }
+    gatherScalar(src, dst, -1, i, length);
+}
+
+DAQ_TARGET_SSE41
+void reverseSse41_32(const uint32_t *src, uint32_t *dst, size_t length)
+{
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src - i - 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi32(v, 0x1B));
+    }
+    gatherScalar(src, dst, -1, i, length);
+}
+#endif
+
+void copyRun(const uint16_t *src, uint16_t *dst, ptrdiff_t stride, size_t length, bool lastPixel)
+{
+    if (stride == 1) {
+        std::memcpy(dst, src, length * sizeof(uint16_t));
+        return;
+    }
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:
+        if (stride == -1)
+            reverseAvx2(src, dst, length);
+        else if (!lastPixel)
+            gatherAvx2(src, dst, stride, length);
+        else
+            break;
+        return;
+    case simd::Level::Sse41:
+        if (stride != -1)
+            break;
+        reverseSse41(src, dst, length);
+        return;
+    default: break;
+    }
+#endif
+    (void)lastPixel;
+    gatherScalar(src, dst, stride, 0, length);
+}
+
+void copyRun(const uint32_t *src, uint32_t *dst, ptrdiff_t stride, size_t length, bool)
+{
+    if (stride == 1) {
+        std::memcpy(dst, src, length * sizeof(uint32_t));
+        return;
+    }
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:
+        if (stride == -1)
+            reverseAvx2_32(src, dst, length);
+        else
+            gatherAvx2_32(src, dst, stride, length);
+        return;
+    case simd::Level::Sse41:
+        if (stride != -1)
+            break;
+        reverseSse41_32(src, dst, length);
+        return;
+    default: break;
+    }
+#endif
+    gatherScalar(src, dst, stride, 0, length);
+}
+
+} // namespace
+
+Descrambler::Descrambler(unsigned rows, unsigned columns, unsigned sortMode)
+    : m_rows(rows), m_columns(columns), m_sortMode(sortMode)
+{
+    if (sortMode >= kLayoutCount || rows == 0 || columns == 0)
+        return;
+    const Layout &layout = kLayouts[sortMode];
+    if (rows % layout.tileRows || columns % layout.tilesAcross)
+        return;
+    const size_t count = pixelCount();
+    if (count > 0x7FFFFFFFu)
+        return;
+
+    const unsigned tileHeight = rows / layout.tileRows;
+    const unsigned tileWidth = columns / layout.tilesAcross;
+    const unsigned channels = layout.tileRows * layout.tilesAcross;
+    const unsigned group = layout.lineClock ? tileWidth : 1;
+
+    // Raw position of every sorted pixel.
+    std::vector<uint32_t> source(count);
+    for (unsigned r = 0; r < rows; ++r) {
+        const unsigned tileRow = r / tileHeight;
+        unsigned y = r % tileHeight;
+        if (layout.flipBottom && tileRow == 1)
+            y = tileHeight - 1 - y;
+        for (unsigned c = 0; c < columns; ++c) {
+            const unsigned tile = c / tileWidth;
+            unsigned x = c % tileWidth;
+            if (layout.flipTiles || (layout.flipRightHalf && tile >= layout.tilesAcross / 2))
+                x = tileWidth - 1 - x;
+            unsigned channel = tileRow * layout.tilesAcross + tile;
+            if (layout.swapChannels)
+                channel ^= 1;
+            const size_t t = static_cast<size_t>(y) * tileWidth + x;
+            source[static_cast<size_t>(r) * columns + c] =
+                static_cast<uint32_t>(((t / group) * channels + channel) * group + t % group);
+        }
+    }
+
+    // Runs never cross a row; strided ones are also cut to kChunk.
+    for (unsigned r = 0; r < rows; ++r) {
+        const uint32_t *row = source.data() + static_cast<size_t>(r) * columns;
+        const uint32_t rowStart = r * columns;
+        unsigned c = 0;
+        while (c < columns) {
+            Run run{rowStart + c, row[c], 1, 1};
+            if (c + 1 < columns)
+                run.stride = static_cast<int32_t>(row[c + 1]) - static_cast<int32_t>(row[c]);
+            const bool unit = run.stride == 1 || run.stride == -1;
+            while (c + run.length < columns && (unit || run.length < kChunk)
+                   && static_cast<int32_t>(row[c + run.length]) - static_cast<int32_t>(row[c + run.length - 1])
+                          == run.stride)
+                ++run.length;
+            if (run.length == 1)
+                run.stride = 1;
+            m_runs.push_back(run);
+            c += run.length;
+        }
+    }
+
+    // Cache blocking: walk the raw frame front to back.
+    const auto lowest = [](const Run &run) {
+        return run.stride < 0 ? run.src + static_cast<int64_t>(run.length - 1) * run.stride : int64_t(run.src);
+    };
+    std::stable_sort(m_runs.begin(), m_runs.end(),
+                     [&](const Run &a, const Run &b) { return lowest(a) < lowest(b); });
+
+    m_channels = channels;
+    m_valid = true;
+}
+
+const char *Descrambler::modeName(unsigned sortMode)
+{
+    return sortMode < kLayoutCount ? kLayouts[sortMode].name : "unknown";
+}
+
+template <typename T>
+void Descrambler::gatherRuns(const T *raw, T *sorted) const
+{
+    const int64_t last = static_cast<int64_t>(pixelCount()) - 1;
+    for (const Run &run : m_runs) {
+        const int64_t end = run.src + static_cast<int64_t>(run.length - 1) * run.stride;
+        copyRun(raw + run.src, sorted + run.dst, run.stride, run.length, std::max<int64_t>(end, run.src) == last);
+    }
+}
+
+template <typename T>
+void Descrambler::scatterRuns(const T *sorted, T *raw) const
+{
+    for (const Run &run : m_runs) {
+        T *out = raw + run.src;
+        const T *in = sorted + run.dst;
+        for (uint32_t i = 0; i < run.length; ++i)
+            out[static_cast<ptrdiff_t>(i) * run.stride] = in[i];
+    }
+}
+
+void Descrambler::descramble(const uint16_t *raw, uint16_t *sorted) const
+{
+    gatherRuns(raw, sorted);
+}
+
+void Descrambler::descramble(const uint32_t *raw, uint32_t *sorted) const
+{
+    gatherRuns(raw, sorted);
+}
+
+void Descrambler::scramble(const uint16_t *sorted, uint16_t *raw) const
+{
+    scatterRuns(sorted, raw);
+}
+
+void Descrambler::scramble(const uint32_t *sorted, uint32_t *raw) const
+{
+    scatterRuns(sorted, raw);
+}
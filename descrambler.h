@@ -0,0 +1,73 @@
+#ifndef DESCRAMBLER_H
+#define DESCRAMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ------------------------------------------------------------------
+// Descrambler
+// Host-side replacement for the library's (or the panel's onboard)
+// sorting, for raw readout-order data from the simulator or from
+// captures. Each HIS_SORT_* mode is modelled as a grid of readout
+// channels (1 or 2 tile rows, 1 to 32 tiles across) that the panel
+// clocks out interleaved, optionally with the bottom tiles read
+// bottom-up, tiles or the right half mirrored, neighbouring channels
+// swapped, or whole lines per clock (HIS_SORT_TOP_BOTTOM). Acq.h only
+// names the modes; the table in descrambler.cpp is the one place that
+// encodes their geometry.
+//
+// The order is compiled once per geometry into a list of runs: dst
+// gets 'length' pixels read from src at a constant stride (1, -1 for a
+// mirrored span, the channel count for interleaved data). Strided runs
+// are cut into chunks and ordered by source position, so the raw frame
+// is streamed through the cache once while each channel writes its own
+// output stream. Unit runs are plain copies, mirrored runs SIMD
+// reversals, strided runs AVX2 gathers (scalar below AVX2).
+//
+// A mode whose tiles do not divide the geometry is not valid; then
+// isValid() is false and descramble() does nothing.
+// ------------------------------------------------------------------
+class Descrambler {
+public:
+    Descrambler(unsigned rows, unsigned columns, unsigned sortMode);
+
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    size_t pixelCount() const { return static_cast<size_t>(m_rows) * m_columns; }
+    unsigned sortMode() const { return m_sortMode; }
+    bool isValid() const { return m_valid; }
+    unsigned channels() const { return m_channels; }
+    size_t runCount() const { return m_runs.size(); }
+
+    // raw and sorted must not overlap.
+    void descramble(const uint16_t *raw, uint16_t *sorted) const;
+    void descramble(const uint32_t *raw, uint32_t *sorted) const;
+    // The inverse, turning a sorted frame into readout order.
+    void scramble(const uint16_t *sorted, uint16_t *raw) const;
+    void scramble(const uint32_t *sorted, uint32_t *raw) const;
+
+    static const char *modeName(unsigned sortMode);
+
+private:
+    struct Run {
+        uint32_t dst;
+        uint32_t src;
+        uint32_t length;
+        int32_t stride;
+    };
+
+    template <typename T>
+    void gatherRuns(const T *raw, T *sorted) const;
+    template <typename T>
+    void scatterRuns(const T *sorted, T *raw) const;
+
+    const unsigned m_rows;
+    const unsigned m_columns;
+    const unsigned m_sortMode;
+    bool m_valid = false;
+    unsigned m_channels = 1;
+    std::vector<Run> m_runs;
+};
+
+#endif // DESCRAMBLER_H
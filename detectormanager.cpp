@@ -0,0 +1,321 @@
+#include "detectormanager.h"
+#include "affinity.h"
+#include "logger.h"
+#include "telemetry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+std::string environment(const char *name)
+{
+    const char *value = std::getenv(name);
+    return value ? value : "";
+}
+
+// A fixed-size, possibly unterminated, string field of the GbIF API.
+template <typename Char, size_t N>
+std::string field(const Char (&text)[N])
+{
+    const char *begin = reinterpret_cast<const char *>(text);
+    return std::string(begin, strnlen(begin, N));
+}
+
+// Telemetry::toJson() nested 'spaces' deeper, without the final newline.
+std::string indented(const std::string &json, unsigned spaces)
+{
+    std::string nested;
+    const std::string margin(spaces, ' ');
+    for (size_t i = 0; i < json.size(); ++i) {
+        nested += json[i];
+        if (json[i] == '\n' && i + 1 < json.size())
+            nested += margin;
+    }
+    while (!nested.empty() && nested.back() == '\n')
+        nested.pop_back();
+    return nested;
+}
+
+} // namespace
+
+DetectorManager::Options DetectorManager::Options::fromEnvironment()
+{
+    Options options;
+    parse(environment("DAQ_PANELS"), &options);
+    const std::string pin = environment("DAQ_PIN");
+    if (!pin.empty())
+        options.pin = pin != "0" && pin != "off";
+    options.session = AcquisitionSession::Options::fromEnvironment();
+    return options;
+}
+
+DetectorManager::DetectorManager(Logger *log)
+    : m_log(log)
+{
+}
+
+DetectorManager::~DetectorManager()
+{
+    closeHandles();
+}
+
+bool DetectorManager::parse(const std::string &text, Options *options)
+{
+    std::string spec;
+    for (char c : text)
+        spec += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    Source source = Source::Sensors;
+    if (spec.compare(0, 4, "gbif") == 0) {
+        source = Source::GbIF;
+        spec.erase(0, 4);
+        if (spec.empty())
+            spec = "all";
+        else if (spec[0] == ':')
+            spec.erase(0, 1);
+        else
+            return false;
+    }
+    unsigned maxPanels = 0;
+    if (spec != "all") {
+        char *end = nullptr;
+        const long count = std::strtol(spec.c_str(), &end, 10);
+        if (spec.empty() || *end != '\0' || count < 1)
+            return false;
+        maxPanels = static_cast<unsigned>(count);
+    }
+    options->source = source;
+    options->maxPanels = maxPanels;
+    return true;
+}
+
+bool DetectorManager::open(const Options &options)
+{
+    closeHandles();
+    m_panels.clear();
+    m_error.clear();
+    const bool found = options.source == Source::GbIF ? enumerateGbIF(options.maxPanels)
+                                                      : enumerateSensors(options.maxPanels);
+    if (!found)
+        return false;
+    createSessions(options);
+    for (const Panel &panel : m_panels) {
+        const std::string where = panel.cpus.empty() ? "not pinned"
+                                                     : "node " + std::to_string(panel.node) + ", CPUs "
+                                                           + affinity::formatCpuList(panel.cpus);
+        m_log->message(LEVEL_INFO, panel.name + (panel.address.empty() ? "" : " at " + panel.address) + ": "
+                                       + where + ".");
+    }
+    return true;
+}
+
+bool DetectorManager::enumerateSensors(unsigned maxPanels)
+{
+    UINT numSensors = 0;
+    UINT ret = Acquisition_EnumSensors(&numSensors, TRUE, FALSE);
+    if (ret != HIS_ALL_OK || numSensors == 0) {
+        m_error = "No detector found (error " + std::to_string(ret) + ")";
+        return false;
+    }
+    // Acquisition_EnumSensors opened every sensor: walk all of them, then
+    // close the ones beyond maxPanels rather than leave them open.
+    std::vector<HACQDESC> handles;
+    ACQDESCPOS pos = 0;
+    do {
+        HACQDESC hAcqDesc = nullptr;
+        ret = Acquisition_GetNextSensor(&pos, &hAcqDesc);
+        if (ret != HIS_ALL_OK)
+            break;
+        handles.push_back(hAcqDesc);
+    } while (pos != 0);
+    for (HACQDESC hAcqDesc : handles) {
+        if (maxPanels != 0 && m_panels.size() >= maxPanels) {
+            Acquisition_Close(hAcqDesc);
+            continue;
+        }
+        Panel panel;
+        panel.name = "panel" + std::to_string(m_panels.size());
+        panel.handle = hAcqDesc;
+        m_panels.push_back(std::move(panel));
+    }
+    if (m_panels.empty()) {
+        m_error = "Acquisition_GetNextSensor failed (error " + std::to_string(ret) + ")";
+        return false;
+    }
+    return true;
+}
+
+bool DetectorManager::enumerateGbIF(unsigned maxPanels)
+{
+    long count = 0;
+    UINT ret = Acquisition_GbIF_GetDeviceCnt(&count);
+    if (ret != HIS_ALL_OK || count <= 0) {
+        m_error = "No GbIF detector found (error " + std::to_string(ret) + ")";
+        return false;
+    }
+    std::vector<GBIF_DEVICE_PARAM> devices(static_cast<size_t>(count));
+    ret = Acquisition_GbIF_GetDeviceList(devices.data(), static_cast<int>(count));
+    if (ret != HIS_ALL_OK) {
+        m_error = "Acquisition_GbIF_GetDeviceList failed (error " + std::to_string(ret) + ")";
+        return false;
+    }
+    for (size_t i = 0; i < devices.size() && (maxPanels == 0 || m_panels.size() < maxPanels); ++i) {
+        GBIF_DEVICE_PARAM &device = devices[i];
+        Panel panel;
+        panel.address = field(device.ucIP);
+        panel.name = field(device.cDeviceName);
+        if (panel.name.empty())
+            panel.name = "gbif" + std::to_string(i);
+        // Rows and columns of 0: the library reads them from the panel.
+        ret = Acquisition_GbIF_Init(&panel.handle, static_cast<int>(i), TRUE, 0, 0, TRUE, FALSE, HIS_GbIF_IP,
+                                    device.ucIP);
+        if (ret != HIS_ALL_OK) {
+            m_log->message(LEVEL_WARN, "Cannot open GbIF detector " + panel.name + " at " + panel.address
+                                           + " (error " + std::to_string(ret) + ").");
+            continue;
+        }
+        m_panels.push_back(std::move(panel));
+    }
+    if (m_panels.empty()) {
+        m_error = "None of the " + std::to_string(count) + " GbIF detector(s) could be opened";
+        return false;
+    }
+    return true;
+}
+
+// Panels go to the NUMA nodes round robin; the panels on a node split
+// its CPUs into contiguous shares (or take one CPU each, wrapping, when
+// there are more panels than CPUs).
+void DetectorManager::createSessions(const Options &options)
+{
+    const std::vector<affinity::Node> nodes = affinity::nodes();
+    const size_t panels = m_panels.size();
+    const bool pin = options.pin && panels > 1;
+    unsigned cores = 0;
+    for (const affinity::Node &node : nodes)
+        cores += static_cast<unsigned>(node.cpus.size());
+    for (size_t i = 0; i < panels; ++i) {
+        Panel &panel = m_panels[i];
+        AcquisitionSession::Options session = options.session;
+        if (pin) {
+            const affinity::Node &node = nodes[i % nodes.size()];
+            const size_t onNode = panels / nodes.size() + (i % nodes.size() < panels % nodes.size() ? 1 : 0);
+            const size_t rank = i / nodes.size();
+            const size_t size = node.cpus.size();
+            panel.node = node.id;
+            if (size >= onNode)
+                panel.cpus.assign(node.cpus.begin() + rank * size / onNode,
+                                  node.cpus.begin() + (rank + 1) * size / onNode);
+            else
+                panel.cpus.push_back(node.cpus[rank % size]);
+            session.cpus = panel.cpus;
+        }
+        if (panels > 1) {
+            session.name = panel.name;
+            if (session.correctionThreads == 0)
+                session.correctionThreads = pin ? static_cast<unsigned>(panel.cpus.size())
+                                                : std::max(1u, cores / static_cast<unsigned>(panels));
+        }
+        panel.telemetry = std::make_unique<Telemetry>();
+        panel.session = std::make_unique<AcquisitionSession>(m_log, panel.telemetry.get());
+        panel.session->setOptions(session);
+    }
+}
+
+bool DetectorManager::run(AcquisitionSession::Mode mode, const std::string &fileName, int64_t frameCount)
+{
+    if (m_panels.empty()) {
+        m_error = "No panel open";
+        return false;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(m_panels.size());
+    for (Panel &panel : m_panels) {
+        panel.ok = false;
+        if (!panel.handle) {
+            m_log->message(LEVEL_ERROR, panel.name + " was closed by the last run; open the panels again.");
+            continue;
+        }
+        panel.session->setDetector(panel.handle);
+        panel.handle = nullptr;
+        const std::string name = m_panels.size() > 1 ? fileName + "_" + panel.name : fileName;
+        threads.emplace_back([&panel, mode, name, frameCount] {
+            panel.ok = panel.session->run(mode, name, frameCount);
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    return std::all_of(m_panels.begin(), m_panels.end(), [](const Panel &panel) { return panel.ok; });
+}
+
+void DetectorManager::requestAbort()
+{
+    for (Panel &panel : m_panels)
+        panel.session->control().requestAbort();
+}
+
+DetectorManager::Stats DetectorManager::stats() const
+{
+    Stats total;
+    for (const Panel &panel : m_panels) {
+        const AcquisitionSession::Stats stats = panel.session->stats();
+        total.frames += stats.frames;
+        total.outputs += stats.outputs;
+        total.bytes += stats.bytes;
+        total.framesPerSecond += stats.framesPerSecond();
+        total.mbPerSecond += stats.mbPerSecond();
+    }
+    return total;
+}
+
+std::string DetectorManager::toJson() const
+{
+    const Stats total = stats();
+    char item[512];
+    std::snprintf(item, sizeof(item),
+                  "{\n  \"panels\": %zu,\n  \"frames\": %lld,\n  \"outputs\": %lld,\n  \"fps\": %.2f,\n"
+                  "  \"mb_per_s\": %.2f,\n  \"per_panel\": [",
+                  m_panels.size(), static_cast<long long>(total.frames), static_cast<long long>(total.outputs),
+                  total.framesPerSecond, total.mbPerSecond);
+    std::string json = item;
+    for (size_t i = 0; i < m_panels.size(); ++i) {
+        const Panel &panel = m_panels[i];
+        const AcquisitionSession::Stats stats = panel.session->stats();
+        std::snprintf(item, sizeof(item),
+                      "%s\n    {\"name\": %s, \"address\": %s, \"node\": %u, \"cpus\": \"%s\", "
+                      "\"ok\": %s, \"frames\": %lld, \"outputs\": %lld, \"fps\": %.2f, \"mb_per_s\": %.2f,\n"
+                      "     \"telemetry\": ",
+                      i ? "," : "", Telemetry::jsonString(panel.name).c_str(),
+                      Telemetry::jsonString(panel.address).c_str(), panel.node,
+                      affinity::formatCpuList(panel.cpus).c_str(), panel.ok ? "true" : "false",
+                      static_cast<long long>(stats.frames), static_cast<long long>(stats.outputs),
+                      stats.framesPerSecond(), stats.mbPerSecond());
+        json += item;
+        json += indented(panel.telemetry->toJson(), 5) + "}";
+    }
+    json += "\n  ]\n}\n";
+    return json;
+}
+
+bool DetectorManager::writeJson(const std::string &path) const
+{
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+    const std::string json = toJson();
+    const bool ok = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+void DetectorManager::closeHandles()
+{
+    for (Panel &panel : m_panels) {
+        if (panel.handle)
+            Acquisition_Close(panel.handle);
+        panel.handle = nullptr;
+    }
+}
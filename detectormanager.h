@@ -0,0 +1,112 @@
+#ifndef DETECTORMANAGER_H
+#define DETECTORMANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Acq.h"
+#include "acquisitionsession.h"
+
+class Logger;
+class Telemetry;
+
+// ------------------------------------------------------------------
+// DetectorManager
+// Runs several panels at once, one AcquisitionSession per panel. The
+// panels come from Acquisition_EnumSensors / Acquisition_GetNextSensor
+// or from the GbIF device list (Acquisition_GbIF_GetDeviceList, opened
+// with Acquisition_GbIF_Init by IP address).
+//
+// Each panel gets a pipeline of its own, so nothing on one panel's
+// frame path waits for another's: its own run() thread, acquisition
+// buffers, correction threads, FramePool, recording (<fileName>_<name>)
+// and Telemetry. With several panels they are also spread over the
+// NUMA nodes, round robin, and each is pinned to an equal share of its
+// node's CPUs; as the session's threads inherit the pinning and first
+// touch their buffers there, each panel's memory stays on its node.
+// Correction threads left at 0 ("every core") become the panel's share.
+// The Logger is the only thing the panels share, and posting to it
+// never blocks.
+//
+// open() enumerates the panels and sets up one session for each; run()
+// acquires from all of them and returns when every one has finished.
+// Each run closes its panels, so open() again before the next run().
+// ------------------------------------------------------------------
+class DetectorManager {
+public:
+    enum class Source { Sensors, GbIF };
+
+    struct Options {
+        Source source = Source::Sensors;
+        unsigned maxPanels = 1;         // 0: every panel found
+        bool pin = true;                // CPU/NUMA placement with several panels
+        AcquisitionSession::Options session;    // for every panel
+
+        // DAQ_PANELS (see parse) and DAQ_PIN=0 to leave the threads
+        // unpinned; the sessions' options from theirs.
+        static Options fromEnvironment();
+    };
+
+    struct Panel {
+        std::string name;               // "panel<N>", or the GbIF device name
+        std::string address;            // GbIF IP address; empty for sensors
+        unsigned node = 0;              // NUMA node
+        std::vector<unsigned> cpus;     // empty: not pinned
+        std::unique_ptr<Telemetry> telemetry;
+        std::unique_ptr<AcquisitionSession> session;
+        HACQDESC handle = nullptr;      // until run() hands it to the session
+        bool ok = false;                // of the last run, once run() has returned
+    };
+
+    // Summed over the panels.
+    struct Stats {
+        int64_t frames = 0;
+        int64_t outputs = 0;
+        uint64_t bytes = 0;
+        double framesPerSecond = 0;     // each panel over its own first to last frame
+        double mbPerSecond = 0;
+    };
+
+    explicit DetectorManager(Logger *log);
+    ~DetectorManager();
+
+    DetectorManager(const DetectorManager &) = delete;
+    DetectorManager &operator=(const DetectorManager &) = delete;
+
+    // Not while running. Returns false, with error() set, when no panel
+    // was found.
+    bool open(const Options &options);
+    // Returns false if any panel failed.
+    bool run(AcquisitionSession::Mode mode, const std::string &fileName, int64_t frameCount);
+    // Stops every panel; safe to call from any thread.
+    void requestAbort();
+
+    const std::string &error() const { return m_error; }
+    size_t panelCount() const { return m_panels.size(); }
+    const Panel &panel(size_t index) const { return m_panels[index]; }
+    AcquisitionSession &session(size_t index) { return *m_panels[index].session; }
+
+    // Of the last (or current) run; safe to call from any thread.
+    Stats stats() const;
+    // Aggregate and per-panel throughput, placement and telemetry.
+    std::string toJson() const;
+    bool writeJson(const std::string &path) const;
+
+    // "all", "N" (at most N sensors), "gbif" or "gbif:N".
+    static bool parse(const std::string &text, Options *options);
+
+private:
+    bool enumerateSensors(unsigned maxPanels);
+    bool enumerateGbIF(unsigned maxPanels);
+    void createSessions(const Options &options);
+    void closeHandles();
+
+    Logger *m_log;
+    std::string m_error;
+    std::vector<Panel> m_panels;
+};
+
+#endif // DETECTORMANAGER_H
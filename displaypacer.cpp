@@ -0,0 +1,38 @@
+#include "displaypacer.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DisplayPacer::setMaxRate(double framesPerSecond)
+{
+    m_maxRate = std::clamp(framesPerSecond, kMinRate, kMaxRate);
+}
+
+int DisplayPacer::intervalMs() const
+{
+    return std::max(1, static_cast<int>(std::lround(1000.0 / m_maxRate)));
+}
+
+void DisplayPacer::start(int64_t nowNs)
+{
+    m_startNs = nowNs;
+    m_lastPaintNs = nowNs;
+    m_offered = m_displayed = 0;
+}
+
+void DisplayPacer::painted(int64_t nowNs)
+{
+    ++m_displayed;
+    m_lastPaintNs = nowNs;
+}
+
+DisplayPacer::Stats DisplayPacer::stats() const
+{
+    Stats stats;
+    stats.offered = m_offered;
+    stats.displayed = m_displayed;
+    stats.skipped = m_offered > m_displayed ? m_offered - m_displayed : 0;
+    const double seconds = (m_lastPaintNs - m_startNs) / 1e9;
+    stats.rate = seconds > 0 ? m_displayed / seconds : 0;
+    return stats;
+}
@@ -0,0 +1,51 @@
+#ifndef DISPLAYPACER_H
+#define DISPLAYPACER_H
+
+#include <cstdint>
+
+// ------------------------------------------------------------------
+// DisplayPacer
+// Bookkeeping for the presentation path. The GUI polls for the newest
+// frame at most maxRate() times a second (intervalMs() is the poll
+// period), so frames arriving faster than that are skipped for display
+// only; recording takes every frame before the display ring sees it.
+//
+// painted() is called when an image has actually been painted and
+// counts it towards the display rate. The glass-to-glass latency of
+// that image (end-of-frame event -> pixels on screen) is Telemetry's
+// display stage, not the pacer's.
+//
+// Not thread-safe: everything runs on the GUI thread.
+// ------------------------------------------------------------------
+class DisplayPacer {
+public:
+    struct Stats {
+        uint64_t offered = 0;           // frames that reached the display ring
+        uint64_t displayed = 0;         // images painted
+        uint64_t skipped = 0;           // offered but never painted
+        double rate = 0;                // painted per second since start()
+    };
+
+    static constexpr double kMinRate = 1;
+    static constexpr double kMaxRate = 240;
+
+    void setMaxRate(double framesPerSecond);
+    double maxRate() const { return m_maxRate; }
+    int intervalMs() const;
+
+    // Clears the counters at the start of an acquisition.
+    void start(int64_t nowNs);
+    void setOffered(uint64_t frames) { m_offered = frames; }
+    void painted(int64_t nowNs);
+
+    Stats stats() const;
+
+private:
+    double m_maxRate = 30;
+    int64_t m_startNs = 0;
+    int64_t m_lastPaintNs = 0;
+    uint64_t m_offered = 0;
+    uint64_t m_displayed = 0;
+};
+
+#endif // DISPLAYPACER_H
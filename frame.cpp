@@ -0,0 +1,131 @@
+#include "frame.h"
+
+#include <cassert>
+
+namespace {
+
+// Page-aligned so frames can be written with O_DIRECT (AsyncFileWriter).
+constexpr size_t kFrameAlignment = 4096;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+// ------------------------------------------------------------------
+// FrameRef
+
+FrameRef::FrameRef(Frame *frame)
+    : m_frame(frame)
+{
+    if (m_frame)
+        m_frame->m_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+FrameRef::FrameRef(const FrameRef &other)
+    : FrameRef(other.m_frame)
+{
+}
+
+FrameRef &FrameRef::operator=(const FrameRef &other)
+{
+    if (other.m_frame != m_frame) {
+        FrameRef copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+FrameRef &FrameRef::operator=(FrameRef &&other) noexcept
+{
+    if (this != &other) {
+        reset();
+        m_frame = other.m_frame;
+        other.m_frame = nullptr;
+    }
+    return *this;
+}
+
+void FrameRef::reset()
+{
+    Frame *frame = m_frame;
+    m_frame = nullptr;
+    if (frame && frame->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        frame->m_pool->recycle(frame);
+}
+
+uint32_t FrameRef::useCount() const
+{
+    return m_frame ? m_frame->m_refs.load(std::memory_order_relaxed) : 0;
+}
+
+// ------------------------------------------------------------------
+// FramePool
+
+FramePool::FramePool(size_t frames, unsigned rows, unsigned columns, XIS_FileType dataType)
+    : m_rows(rows), m_columns(columns), m_dataType(dataType), m_capacity(frames)
+{
+    const size_t bytesPerPixel = (dataType & PKI_LONG) ? sizeof(uint32_t) : sizeof(uint16_t);
+    const size_t stride = alignUp(static_cast<size_t>(rows) * columns * bytesPerPixel, kFrameAlignment);
+    m_storage.resize(stride * frames + kFrameAlignment);
+    uint8_t *base = m_storage.data();
+    base += (kFrameAlignment - reinterpret_cast<uintptr_t>(base) % kFrameAlignment) % kFrameAlignment;
+
+    m_frames.reset(new Frame[frames]);
+    m_free.reserve(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        Frame &frame = m_frames[i];
+        frame.m_pool = this;
+        frame.m_data = base + i * stride;
+        frame.m_rows = rows;
+        frame.m_columns = columns;
+        frame.m_dataType = dataType;
+        frame.bits = (dataType & PKI_LONG) ? 32 : 16;
+        m_free.push_back(&frame);
+    }
+}
+
+FramePool::~FramePool()
+{
+    assert(m_free.size() == m_capacity && "FramePool destroyed while frames are still referenced");
+}
+
+FrameRef FramePool::acquire()
+{
+    Frame *frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.empty()) {
+            ++m_exhausted;
+            return FrameRef();
+        }
+        frame = m_free.back();
+        m_free.pop_back();
+        ++m_acquired;
+    }
+    frame->bits = (m_dataType & PKI_LONG) ? 32 : 16;
+    frame->frameNumber = 0;
+    frame->timestampNs = 0;
+    frame->hasHeader = false;
+    frame->summary = FrameSummary();
+    return FrameRef(frame);
+}
+
+void FramePool::recycle(Frame *frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(frame);
+}
+
+FramePool::Stats FramePool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.acquired = m_acquired;
+    stats.exhausted = m_exhausted;
+    stats.inUse = m_capacity - m_free.size();
+    stats.capacity = m_capacity;
+    return stats;
+}
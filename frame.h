@@ -0,0 +1,166 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Acq.h"
+
+class FramePool;
+
+// ------------------------------------------------------------------
+// FrameSummary
+// One frame's (or region's) statistics from FrameStatistics, in pixel
+// values. The median and the percentile clip points come from a 65536-bin
+// histogram: exact for frames of up to 16 bits, and to within 2^binShift
+// for wider ones (bins of 2^(bits - 16) values).
+// ------------------------------------------------------------------
+struct FrameSummary {
+    bool valid = false;         // the statistics stage ran on the frame
+    uint64_t pixels = 0;
+    uint32_t min = 0;
+    uint32_t max = 0;
+    double mean = 0;
+    double std = 0;             // population standard deviation
+    uint32_t median = 0;
+    uint32_t low = 0;           // percentile clip points (window/level)
+    uint32_t high = 0;
+    unsigned binShift = 0;
+};
+
+// ------------------------------------------------------------------
+// Frame
+// One detector image at native depth: a page-aligned pixel buffer of
+// uint16_t (PKI_SHORT) or uint32_t (PKI_LONG) values plus the metadata
+// that travels with it through the pipeline. Frames are owned by a
+// FramePool and handed out through FrameRef; the pixel memory is reused
+// once the last reference is dropped, so stages pass frames along
+// without copying them.
+// ------------------------------------------------------------------
+class Frame {
+public:
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    size_t pixelCount() const { return static_cast<size_t>(m_rows) * m_columns; }
+    XIS_FileType dataType() const { return m_dataType; }
+    bool is32Bit() const { return (m_dataType & PKI_LONG) != 0; }
+    size_t bytesPerPixel() const { return is32Bit() ? sizeof(uint32_t) : sizeof(uint16_t); }
+    size_t byteSize() const { return pixelCount() * bytesPerPixel(); }
+
+    void *data() { return m_data; }
+    const void *data() const { return m_data; }
+    uint16_t *pixels16() { return static_cast<uint16_t *>(m_data); }
+    const uint16_t *pixels16() const { return static_cast<const uint16_t *>(m_data); }
+    uint32_t *pixels32() { return static_cast<uint32_t *>(m_data); }
+    const uint32_t *pixels32() const { return static_cast<const uint32_t *>(m_data); }
+
+    // Significant bits per pixel (e.g. 14, 16, 18); used for display and
+    // clamping, never for addressing.
+    unsigned bits = 16;
+    uint64_t frameNumber = 0;   // detector frame counter
+    int64_t timestampNs = 0;    // steady clock at end of frame
+    bool hasHeader = false;     // 'header' is valid
+    CHwHeaderInfoEx header = {};
+    FrameSummary summary;       // whole frame, or the first statistics region
+
+private:
+    friend class FramePool;
+    friend class FrameRef;
+
+    Frame() = default;
+
+    FramePool *m_pool = nullptr;
+    void *m_data = nullptr;
+    unsigned m_rows = 0;
+    unsigned m_columns = 0;
+    XIS_FileType m_dataType = PKI_SHORT;
+    std::atomic<uint32_t> m_refs{0};
+};
+
+// ------------------------------------------------------------------
+// FrameRef
+// Intrusive reference to a pooled Frame. Copying adds a reference,
+// destruction or reset() drops one; the last reference returns the
+// frame to its pool. No heap allocation happens on copy.
+// ------------------------------------------------------------------
+class FrameRef {
+public:
+    FrameRef() = default;
+    FrameRef(const FrameRef &other);
+    FrameRef(FrameRef &&other) noexcept : m_frame(other.m_frame) { other.m_frame = nullptr; }
+    FrameRef &operator=(const FrameRef &other);
+    FrameRef &operator=(FrameRef &&other) noexcept;
+    ~FrameRef() { reset(); }
+
+    void reset();
+    Frame *get() const { return m_frame; }
+    Frame *operator->() const { return m_frame; }
+    Frame &operator*() const { return *m_frame; }
+    explicit operator bool() const { return m_frame != nullptr; }
+    uint32_t useCount() const;
+
+private:
+    friend class FramePool;
+    explicit FrameRef(Frame *frame);
+
+    Frame *m_frame = nullptr;
+};
+
+// ------------------------------------------------------------------
+// FramePool
+// Fixed set of frames of one geometry and data type, allocated up front.
+// acquire() never allocates; it returns an empty FrameRef when every
+// frame is in use (counted in Stats::exhausted) so a real-time producer
+// can drop instead of stalling. The pool must outlive its frames; hold
+// it through a shared_ptr alongside whatever keeps frames around.
+// ------------------------------------------------------------------
+class FramePool {
+public:
+    struct Stats {
+        uint64_t acquired = 0;
+        uint64_t exhausted = 0;
+        size_t inUse = 0;
+        size_t capacity = 0;
+    };
+
+    FramePool(size_t frames, unsigned rows, unsigned columns, XIS_FileType dataType = PKI_SHORT);
+    ~FramePool();
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    XIS_FileType dataType() const { return m_dataType; }
+    size_t capacity() const { return m_capacity; }
+
+    // Metadata is reset; pixel contents are whatever the last user left.
+    FrameRef acquire();
+
+    Stats stats() const;
+
+private:
+    friend class FrameRef;
+    void recycle(Frame *frame);
+
+    const unsigned m_rows;
+    const unsigned m_columns;
+    const XIS_FileType m_dataType;
+    const size_t m_capacity;
+    std::vector<uint8_t> m_storage;
+    std::unique_ptr<Frame[]> m_frames;
+
+    mutable std::mutex m_mutex;
+    std::vector<Frame *> m_free;
+    uint64_t m_acquired = 0;
+    uint64_t m_exhausted = 0;
+};
+
+#endif // FRAME_H
@@ -0,0 +1,174 @@
+#include "frameaverager.h"
+#include "accumulate.h"
+#include "frame.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <new>
+
+bool FrameAverager::configure(const Options &options, unsigned rows, unsigned columns, XIS_FileType dataType,
+                              uint32_t maxValue)
+{
+    m_options = Options();
+    m_error.clear();
+    m_pixels = static_cast<size_t>(rows) * columns;
+    m_wide = (dataType & PKI_LONG) != 0;
+    m_sum.clear();
+    m_history16.clear();
+    m_history32.clear();
+    reset();
+    if (options.mode == Mode::Off)
+        return true;
+    const unsigned frames = std::max(options.frames, 1u);
+    const unsigned limit = maxValue ? maxFrames(maxValue) : maxFrames(dataType);
+    if (options.mode != Mode::Running && frames > limit) {
+        m_error = "averaging " + std::to_string(frames) + " frames could overflow the 32-bit sums (at most "
+                  + std::to_string(limit) + ")";
+        return false;
+    }
+    const size_t frameBytes = m_pixels * (m_wide ? sizeof(uint32_t) : sizeof(uint16_t));
+    if (options.mode == Mode::Moving && frameBytes && frames > kMaxHistoryBytes / frameBytes) {
+        m_error = "a moving window of " + std::to_string(frames) + " frames needs "
+                  + std::to_string((frames * frameBytes) >> 20) + " MiB of history (at most "
+                  + std::to_string(kMaxHistoryBytes / frameBytes) + " frames of this size)";
+        return false;
+    }
+
+    try {
+        m_sum.assign(m_pixels, 0);
+        if (options.mode == Mode::Moving) {
+            if (m_wide)
+                m_history32.assign(m_pixels * frames, 0);
+            else
+                m_history16.assign(m_pixels * frames, 0);
+        }
+    } catch (const std::bad_alloc &) {
+        m_sum = std::vector<uint32_t>();
+        m_history16 = std::vector<uint16_t>();
+        m_history32 = std::vector<uint32_t>();
+        m_error = "out of memory for the averaging buffers";
+        return false;
+    }
+    m_options = options;
+    m_options.frames = options.mode == Mode::Running ? 1 : frames;
+    m_limit = options.mode == Mode::Running ? limit : frames;
+    return true;
+}
+
+void FrameAverager::reset()
+{
+    m_count = 0;
+    m_next = 0;
+    m_hasHeader = false;
+}
+
+template <typename T>
+void FrameAverager::fold(const T *pixels, T *history)
+{
+    switch (m_options.mode) {
+    case Mode::Block:
+    case Mode::Running:
+        if (m_count == m_limit)
+            m_count = 0;
+        if (m_count == 0)
+            accumulate::set(m_sum.data(), pixels, m_pixels);
+        else
+            accumulate::add(m_sum.data(), pixels, m_pixels);
+        ++m_count;
+        break;
+    case Mode::Moving: {
+        T *oldest = history + static_cast<size_t>(m_next) * m_pixels;
+        if (m_count == m_limit) {
+            accumulate::slide(m_sum.data(), pixels, oldest, m_pixels);
+        } else {
+            if (m_count == 0)
+                accumulate::set(m_sum.data(), pixels, m_pixels);
+            else
+                accumulate::add(m_sum.data(), pixels, m_pixels);
+            std::copy(pixels, pixels + m_pixels, oldest);
+            ++m_count;
+        }
+        m_next = (m_next + 1) % m_limit;
+        break;
+    }
+    case Mode::Off:
+        break;
+    }
+}
+
+bool FrameAverager::add(const Frame &frame)
+{
+    if (!isActive())
+        return false;
+    if (m_wide)
+        fold(frame.pixels32(), m_history32.data());
+    else
+        fold(frame.pixels16(), m_history16.data());
+    m_bits = frame.bits;
+    m_frameNumber = frame.frameNumber;
+    m_timestampNs = frame.timestampNs;
+    m_hasHeader = frame.hasHeader;
+    if (frame.hasHeader)
+        m_header = frame.header;
+    return m_options.mode != Mode::Block || m_count == m_limit;
+}
+
+void FrameAverager::mean(Frame &out) const
+{
+    if (m_count == 0)
+        return;
+    if (m_wide)
+        accumulate::mean(m_sum.data(), out.pixels32(), m_pixels, m_count);
+    else
+        accumulate::mean(m_sum.data(), out.pixels16(), m_pixels, m_count);
+    out.bits = m_bits;
+    out.frameNumber = m_frameNumber;
+    out.timestampNs = m_timestampNs;
+    out.hasHeader = m_hasHeader;
+    out.header = m_header;
+}
+
+unsigned FrameAverager::maxFrames(XIS_FileType dataType)
+{
+    return maxFrames((dataType & PKI_LONG) ? (1u << 18) - 1 : 0xFFFFu);
+}
+
+unsigned FrameAverager::maxFrames(uint32_t maxValue)
+{
+    return static_cast<unsigned>(0xFFFFFFFFu / std::max(maxValue, 1u));
+}
+
+const char *FrameAverager::modeName(Mode mode)
+{
+    switch (mode) {
+    case Mode::Block:   return "block";
+    case Mode::Running: return "running";
+    case Mode::Moving:  return "moving";
+    default:            return "off";
+    }
+}
+
+bool FrameAverager::parse(const std::string &text, Options *options)
+{
+    Options parsed;
+    const std::string name = text.substr(0, text.find(':'));
+    if (name == "off" || name.empty()) {
+        parsed.mode = Mode::Off;
+    } else if (name == "running") {
+        parsed.mode = Mode::Running;
+    } else if (name == "block" || name == "moving") {
+        parsed.mode = name == "block" ? Mode::Block : Mode::Moving;
+        unsigned frames = 0;
+        char tail = 0;
+        if (text.size() <= name.size() + 1
+            || std::sscanf(text.c_str() + name.size() + 1, "%u%c", &frames, &tail) != 1 || frames == 0)
+            return false;
+        parsed.frames = frames;
+    } else {
+        return false;
+    }
+    if (parsed.mode != Mode::Block && parsed.mode != Mode::Moving && name.size() != text.size())
+        return false;
+    *options = parsed;
+    return true;
+}
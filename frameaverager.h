@@ -0,0 +1,94 @@
+#ifndef FRAMEAVERAGER_H
+#define FRAMEAVERAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Acq.h"
+
+class Frame;
+
+// ------------------------------------------------------------------
+// FrameAverager
+// The library's averaging sequences in software, as a streaming stage
+// on corrected frames. Pixels are summed in 32 bits with the accumulate
+// kernels and turned back into a frame by their exact integer mean;
+// configure() allocates every buffer, so add() and mean() never do.
+//
+//  Block    N frames -> 1, like HIS_SEQ_AVERAGESEQ: one output every N
+//           frames, so only 1/N of the data goes on to the disk.
+//  Running  the mean of every frame so far, like HIS_SEQ_AVERAGE into
+//           HIS_SEQ_DEST_ONE_FRAME; one output per frame. The sum starts
+//           over once it holds maxFrames() frames.
+//  Moving   the mean of the last N frames; one output per frame. The
+//           window keeps a copy of each frame it holds and updates the
+//           sum by adding the newest and subtracting the oldest.
+//
+// Not thread-safe; the acquisition callback is its only user.
+// ------------------------------------------------------------------
+class FrameAverager {
+public:
+    enum class Mode { Off, Block, Running, Moving };
+
+    struct Options {
+        Mode mode = Mode::Off;
+        unsigned frames = 1;            // N for Block and Moving; Moving keeps N frame
+                                        // copies (rows x columns x 2 or 4 bytes each),
+                                        // at most kMaxHistoryBytes in all
+    };
+
+    // Returns false, with error() set, and stays Off when N frames could
+    // overflow the sum or a Moving window would not fit in memory.
+    // 'maxValue' bounds the pixels when they use more than the type's
+    // 16 or 18 bits (binned sums); 0 means the type's own range.
+    bool configure(const Options &options, unsigned rows, unsigned columns, XIS_FileType dataType,
+                   uint32_t maxValue = 0);
+    const Options &options() const { return m_options; }
+    const std::string &error() const { return m_error; }
+    bool isActive() const { return m_options.mode != Mode::Off; }
+    // Starts the next acquisition with an empty sum.
+    void reset();
+
+    // Folds 'frame' (the configured geometry and type) into the sum;
+    // true when an output is due.
+    bool add(const Frame &frame);
+    // Writes the current mean into 'out' with the newest frame's number,
+    // timestamp and header.
+    void mean(Frame &out) const;
+
+    unsigned framesInSum() const { return m_count; }
+
+    // Frames a 32-bit sum holds without overflowing: 65537 at 16 bits,
+    // 16384 at 18 bits.
+    static unsigned maxFrames(XIS_FileType dataType);
+    static unsigned maxFrames(uint32_t maxValue);
+    static const char *modeName(Mode mode);
+    // "off", "running", "block:N" or "moving:N".
+    static bool parse(const std::string &text, Options *options);
+
+    static constexpr size_t kMaxHistoryBytes = size_t(1) << 30;
+
+private:
+    template <typename T>
+    void fold(const T *pixels, T *history);
+
+    Options m_options;
+    std::string m_error;
+    size_t m_pixels = 0;
+    bool m_wide = false;
+    unsigned m_limit = 0;               // frames per sum before it starts over
+    std::vector<uint32_t> m_sum;
+    std::vector<uint16_t> m_history16;  // Moving: N frames, oldest at m_next
+    std::vector<uint32_t> m_history32;
+    unsigned m_count = 0;               // frames in the sum
+    unsigned m_next = 0;                // Moving: history slot to replace
+    unsigned m_bits = 16;               // of the newest frame
+    uint64_t m_frameNumber = 0;
+    int64_t m_timestampNs = 0;
+    bool m_hasHeader = false;
+    CHwHeaderInfoEx m_header = {};
+};
+
+#endif // FRAMEAVERAGER_H
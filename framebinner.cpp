@@ -0,0 +1,437 @@
+#include "framebinner.h"
+#include "accumulate.h"
+#include "correction.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// acc = (add ? acc : 0) + the sum of each run of 'across' pixels.
+template <typename T>
+void rowSumScalar(const T *in, uint32_t *acc, size_t begin, size_t count, unsigned across, bool add)
+{
+    for (size_t i = begin; i < count; ++i) {
+        const T *cell = in + i * across;
+        uint32_t sum = 0;
+        for (unsigned c = 0; c < across; ++c)
+            sum += cell[c];
+        acc[i] = (add ? acc[i] : 0) + sum;
+    }
+}
+
+// 9to4 across a row: input pixels a b c become 2a + b and b + 2c,
+// shifted left by 'shift' (1 for the cell's outer rows). 'begin' and
+// 'count' are even.
+template <typename T>
+void row9to4Scalar(const T *in, uint32_t *acc, size_t begin, size_t count, unsigned shift, bool add)
+{
+    for (size_t i = begin; i < count; i += 2) {
+        const T *cell = in + i / 2 * 3;
+        const uint32_t a = cell[0], b = cell[1], c = cell[2];
+        acc[i] = (add ? acc[i] : 0) + ((2 * a + b) << shift);
+        acc[i + 1] = (add ? acc[i + 1] : 0) + ((b + 2 * c) << shift);
+    }
+}
+
+#if DAQ_SIMD_X86
+// Every kernel widens to 32 bits on load, so the 16- and 32-bit paths
+// share the arithmetic.
+DAQ_TARGET_AVX2
+inline __m256i load8Avx2(const uint16_t *p)
+{
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+DAQ_TARGET_AVX2
+inline __m256i load8Avx2(const uint32_t *p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+DAQ_TARGET_AVX2
+inline void store8Avx2(uint32_t *acc, __m256i v, bool add)
+{
+    __m256i *dst = reinterpret_cast<__m256i *>(acc);
+    _mm256_storeu_si256(dst, add ? _mm256_add_epi32(_mm256_loadu_si256(dst), v) : v);
+}
+
+// Pixels 0..23 in v0..v2 -> a = p[3k], b = p[3k + 1], c = p[3k + 2].
+// Each of a, b and c takes disjoint lanes from v0, v1 and v2, so two
+// blends and one cross-lane permute gather it.
+DAQ_TARGET_AVX2
+inline void deinterleave3Avx2(__m256i v0, __m256i v1, __m256i v2, __m256i *a, __m256i *b, __m256i *c)
+{
+    const __m256i ta = _mm256_blend_epi32(_mm256_blend_epi32(v0, v1, 0x92), v2, 0x24);
+    const __m256i tb = _mm256_blend_epi32(_mm256_blend_epi32(v0, v1, 0x24), v2, 0x49);
+    const __m256i tc = _mm256_blend_epi32(_mm256_blend_epi32(v0, v1, 0x49), v2, 0x92);
+    *a = _mm256_permutevar8x32_epi32(ta, _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+    *b = _mm256_permutevar8x32_epi32(tb, _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+    *c = _mm256_permutevar8x32_epi32(tc, _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+}
+
+template <typename T>
+DAQ_TARGET_AVX2
+void rowSumAvx2(const T *in, uint32_t *acc, size_t count, unsigned across, bool add)
+{
+    size_t i = 0;
+    switch (across) {
+    case 1:
+        for (; i + 8 <= count; i += 8)
+            store8Avx2(acc + i, load8Avx2(in + i), add);
+        break;
+    case 2:
+        // hadd pairs within 128-bit lanes; 0xD8 restores the order.
+        for (; i + 8 <= count; i += 8) {
+            const __m256i h = _mm256_hadd_epi32(load8Avx2(in + 2 * i), load8Avx2(in + 2 * i + 8));
+            store8Avx2(acc + i, _mm256_permute4x64_epi64(h, 0xD8), add);
+        }
+        break;
+    case 3:
+        for (; i + 8 <= count; i += 8) {
+            const T *p = in + 3 * i;
+            __m256i a, b, c;
+            deinterleave3Avx2(load8Avx2(p), load8Avx2(p + 8), load8Avx2(p + 16), &a, &b, &c);
+            store8Avx2(acc + i, _mm256_add_epi32(_mm256_add_epi32(a, b), c), add);
+        }
+        break;
+    case 4: {
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for (; i + 8 <= count; i += 8) {
+            const T *p = in + 4 * i;
+            const __m256i h0 = _mm256_hadd_epi32(load8Avx2(p), load8Avx2(p + 8));
+            const __m256i h1 = _mm256_hadd_epi32(load8Avx2(p + 16), load8Avx2(p + 24));
+            store8Avx2(acc + i, _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(h0, h1), order), add);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    rowSumScalar(in, acc, i, count, across, add);
+}
+
+template <typename T>
+DAQ_TARGET_AVX2
+void row9to4Avx2(const T *in, uint32_t *acc, size_t count, unsigned shift, bool add)
+{
+    const __m128i bits = _mm_cvtsi32_si128(static_cast<int>(shift));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const T *p = in + i / 2 * 3;
+        __m256i a, b, c;
+        deinterleave3Avx2(load8Avx2(p), load8Avx2(p + 8), load8Avx2(p + 16), &a, &b, &c);
+        const __m256i left = _mm256_sll_epi32(_mm256_add_epi32(_mm256_slli_epi32(a, 1), b), bits);
+        const __m256i right = _mm256_sll_epi32(_mm256_add_epi32(b, _mm256_slli_epi32(c, 1)), bits);
+        const __m256i lo = _mm256_unpacklo_epi32(left, right);
+        const __m256i hi = _mm256_unpackhi_epi32(left, right);
+        store8Avx2(acc + i, _mm256_permute2x128_si256(lo, hi, 0x20), add);
+        store8Avx2(acc + i + 8, _mm256_permute2x128_si256(lo, hi, 0x31), add);
+    }
+    row9to4Scalar(in, acc, i, count, shift, add);
+}
+
+DAQ_TARGET_SSE41
+inline __m128i load4Sse41(const uint16_t *p)
+{
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+DAQ_TARGET_SSE41
+inline __m128i load4Sse41(const uint32_t *p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+DAQ_TARGET_SSE41
+inline void store4Sse41(uint32_t *acc, __m128i v, bool add)
+{
+    __m128i *dst = reinterpret_cast<__m128i *>(acc);
+    _mm_storeu_si128(dst, add ? _mm_add_epi32(_mm_loadu_si128(dst), v) : v);
+}
+
+// As deinterleave3Avx2, for pixels 0..11.
+DAQ_TARGET_SSE41
+inline void deinterleave3Sse41(__m128i v0, __m128i v1, __m128i v2, __m128i *a, __m128i *b, __m128i *c)
+{
+    const __m128i ta = _mm_blend_epi16(_mm_blend_epi16(v0, v1, 0x30), v2, 0x0C);
+    const __m128i tb = _mm_blend_epi16(_mm_blend_epi16(v0, v1, 0xC3), v2, 0x30);
+    const __m128i tc = _mm_blend_epi16(_mm_blend_epi16(v0, v1, 0x0C), v2, 0xC3);
+    *a = _mm_shuffle_epi32(ta, _MM_SHUFFLE(1, 2, 3, 0));
+    *b = _mm_shuffle_epi32(tb, _MM_SHUFFLE(2, 3, 0, 1));
+    *c = _mm_shuffle_epi32(tc, _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+template <typename T>
+DAQ_TARGET_SSE41
+void rowSumSse41(const T *in, uint32_t *acc, size_t count, unsigned across, bool add)
+{
+    size_t i = 0;
+    switch (across) {
+    case 1:
+        for (; i + 4 <= count; i += 4)
+            store4Sse41(acc + i, load4Sse41(in + i), add);
+        break;
+    case 2:
+        for (; i + 4 <= count; i += 4)
+            store4Sse41(acc + i, _mm_hadd_epi32(load4Sse41(in + 2 * i), load4Sse41(in + 2 * i + 4)), add);
+        break;
+    case 3:
+        for (; i + 4 <= count; i += 4) {
+            const T *p = in + 3 * i;
+            __m128i a, b, c;
+            deinterleave3Sse41(load4Sse41(p), load4Sse41(p + 4), load4Sse41(p + 8), &a, &b, &c);
+            store4Sse41(acc + i, _mm_add_epi32(_mm_add_epi32(a, b), c), add);
+        }
+        break;
+    case 4:
+        for (; i + 4 <= count; i += 4) {
+            const T *p = in + 4 * i;
+            const __m128i h0 = _mm_hadd_epi32(load4Sse41(p), load4Sse41(p + 4));
+            const __m128i h1 = _mm_hadd_epi32(load4Sse41(p + 8), load4Sse41(p + 12));
+            store4Sse41(acc + i, _mm_hadd_epi32(h0, h1), add);
+        }
+        break;
+    default:
+        break;
+    }
+    rowSumScalar(in, acc, i, count, across, add);
+}
+
+template <typename T>
+DAQ_TARGET_SSE41
+void row9to4Sse41(const T *in, uint32_t *acc, size_t count, unsigned shift, bool add)
+{
+    const __m128i bits = _mm_cvtsi32_si128(static_cast<int>(shift));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const T *p = in + i / 2 * 3;
+        __m128i a, b, c;
+        deinterleave3Sse41(load4Sse41(p), load4Sse41(p + 4), load4Sse41(p + 8), &a, &b, &c);
+        const __m128i left = _mm_sll_epi32(_mm_add_epi32(_mm_slli_epi32(a, 1), b), bits);
+        const __m128i right = _mm_sll_epi32(_mm_add_epi32(b, _mm_slli_epi32(c, 1)), bits);
+        store4Sse41(acc + i, _mm_unpacklo_epi32(left, right), add);
+        store4Sse41(acc + i + 4, _mm_unpackhi_epi32(left, right), add);
+    }
+    row9to4Scalar(in, acc, i, count, shift, add);
+}
+#endif
+
+template <typename T>
+void rowSum(const T *in, uint32_t *acc, size_t count, unsigned across, bool add)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  rowSumAvx2(in, acc, count, across, add); return;
+    case simd::Level::Sse41: rowSumSse41(in, acc, count, across, add); return;
+    default: break;
+    }
+#endif
+    rowSumScalar(in, acc, 0, count, across, add);
+}
+
+template <typename T>
+void row9to4(const T *in, uint32_t *acc, size_t count, unsigned shift, bool add)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  row9to4Avx2(in, acc, count, shift, add); return;
+    case simd::Level::Sse41: row9to4Sse41(in, acc, count, shift, add); return;
+    default: break;
+    }
+#endif
+    row9to4Scalar(in, acc, 0, count, shift, add);
+}
+
+unsigned bitWidth(uint32_t value)
+{
+    unsigned bits = 0;
+    for (; value; value >>= 1)
+        ++bits;
+    return bits;
+}
+
+} // namespace
+
+bool FrameBinner::configure(const Options &options, const Roi &roi, unsigned sensorRows, unsigned sensorColumns,
+                            XIS_FileType dataType)
+{
+    m_options = options;
+    if (options.mode == Mode::Off)
+        m_options.sum = false;
+    m_error.clear();
+    m_wideInput = (dataType & PKI_LONG) != 0;
+    m_sensorColumns = sensorColumns;
+    m_active = false;
+    m_rows = m_columns = 0;
+    m_scratch.clear();
+    if (roi.x >= sensorColumns || roi.y >= sensorRows) {
+        m_error = "ROI origin (" + std::to_string(roi.x) + ", " + std::to_string(roi.y) + ") is outside the "
+                  + std::to_string(sensorColumns) + " x " + std::to_string(sensorRows) + " panel";
+        return false;
+    }
+    m_roi.x = roi.x;
+    m_roi.y = roi.y;
+    m_roi.width = roi.width ? std::min(roi.width, sensorColumns - roi.x) : sensorColumns - roi.x;
+    m_roi.height = roi.height ? std::min(roi.height, sensorRows - roi.y) : sensorRows - roi.y;
+
+    const Mode mode = m_options.mode;
+    const unsigned outPerCell = mode == Mode::Bin9to4 ? 2 : 1;
+    m_columns = m_roi.width / cellColumns(mode) * outPerCell;
+    m_rows = m_roi.height / cellRows(mode) * outPerCell;
+    if (m_rows == 0 || m_columns == 0) {
+        m_error = std::string("binning ") + modeName(mode) + " leaves no pixels of a " + std::to_string(m_roi.width)
+                  + " x " + std::to_string(m_roi.height) + " ROI";
+        return false;
+    }
+
+    const uint32_t inputMax = m_wideInput ? correction::kMax18Bit : 0xFFFFu;
+    const uint32_t area = cellColumns(mode) * cellRows(mode);
+    if (!m_options.sum)
+        m_maxValue = inputMax;
+    else if (mode == Mode::Bin9to4)
+        m_maxValue = static_cast<uint32_t>(static_cast<uint64_t>(inputMax) * 9 / 4);
+    else
+        m_maxValue = inputMax * area;
+    m_bits = std::max(bitWidth(m_maxValue), 16u);
+    m_outputType = m_wideInput || m_options.sum ? PKI_LONG : PKI_SHORT;
+    m_active = mode != Mode::Off || m_rows != sensorRows || m_columns != sensorColumns;
+    if (mode != Mode::Off && !m_options.sum)
+        m_scratch.assign(static_cast<size_t>(m_columns) * outPerCell, 0);
+    return true;
+}
+
+void FrameBinner::bin(const uint16_t *raw, void *out)
+{
+    binRows(raw, out);
+}
+
+void FrameBinner::bin(const uint32_t *raw, void *out)
+{
+    binRows(raw, out);
+}
+
+// Row sums go straight into the output when it keeps them, and through
+// m_scratch into the mean otherwise. A 9to4 cell's three input rows p,
+// q and s weigh 2:1 into the top output row and 1:2 into the bottom
+// one; q is summed once and shared.
+template <typename T>
+void FrameBinner::binRows(const T *raw, void *out)
+{
+    const size_t stride = m_sensorColumns;
+    const size_t columns = m_columns;
+    const T *origin = raw + static_cast<size_t>(m_roi.y) * stride + m_roi.x;
+    const Mode mode = m_options.mode;
+    uint32_t *sums = static_cast<uint32_t *>(out);
+    T *means = static_cast<T *>(out);
+
+    if (mode == Mode::Off) {
+        for (unsigned y = 0; y < m_rows; ++y)
+            std::copy(origin + y * stride, origin + y * stride + columns, means + y * columns);
+        return;
+    }
+    if (mode == Mode::Bin9to4) {
+        for (unsigned y = 0; y < m_rows; y += 2) {
+            const T *p = origin + static_cast<size_t>(y / 2 * 3) * stride;
+            uint32_t *top = m_options.sum ? sums + y * columns : m_scratch.data();
+            uint32_t *bottom = top + columns;
+            row9to4(p, top, columns, 1, false);
+            row9to4(p + stride, bottom, columns, 0, false);
+            accumulate::add(top, bottom, columns);
+            row9to4(p + 2 * stride, bottom, columns, 1, true);
+            if (m_options.sum) {
+                accumulate::mean(top, top, 2 * columns, 4);
+            } else {
+                accumulate::mean(top, means + y * columns, columns, 9);
+                accumulate::mean(bottom, means + (y + 1) * columns, columns, 9);
+            }
+        }
+        return;
+    }
+    const unsigned across = cellColumns(mode);
+    const unsigned down = cellRows(mode);
+    for (unsigned y = 0; y < m_rows; ++y) {
+        const T *p = origin + static_cast<size_t>(y) * down * stride;
+        uint32_t *acc = m_options.sum ? sums + y * columns : m_scratch.data();
+        for (unsigned r = 0; r < down; ++r)
+            rowSum(p + r * stride, acc, columns, across, r > 0);
+        if (!m_options.sum)
+            accumulate::mean(acc, means + y * columns, columns, across * down);
+    }
+}
+
+unsigned FrameBinner::cellColumns(Mode mode)
+{
+    switch (mode) {
+    case Mode::Bin2x1:
+    case Mode::Bin2x2:  return 2;
+    case Mode::Bin4x1:
+    case Mode::Bin4x4:  return 4;
+    case Mode::Bin3x3:
+    case Mode::Bin9to4: return 3;
+    default:            return 1;
+    }
+}
+
+unsigned FrameBinner::cellRows(Mode mode)
+{
+    switch (mode) {
+    case Mode::Bin2x2:  return 2;
+    case Mode::Bin4x4:  return 4;
+    case Mode::Bin3x3:
+    case Mode::Bin9to4: return 3;
+    default:            return 1;
+    }
+}
+
+FrameBinner::Mode FrameBinner::fromOnboard(OnboardBinningMode mode)
+{
+    switch (mode) {
+    case ONBOARDBINNING2x1: return Mode::Bin2x1;
+    case ONBOARDBINNING2x2: return Mode::Bin2x2;
+    case ONBOARDBINNING4x1: return Mode::Bin4x1;
+    case ONBOARDBINNING4x4: return Mode::Bin4x4;
+    case ONBOARDBINNING3x3: return Mode::Bin3x3;
+    case ONBOARDBINNING9to4: return Mode::Bin9to4;
+    }
+    return Mode::Off;
+}
+
+const char *FrameBinner::modeName(Mode mode)
+{
+    switch (mode) {
+    case Mode::Bin2x1:  return "2x1";
+    case Mode::Bin2x2:  return "2x2";
+    case Mode::Bin4x1:  return "4x1";
+    case Mode::Bin4x4:  return "4x4";
+    case Mode::Bin3x3:  return "3x3";
+    case Mode::Bin9to4: return "9to4";
+    default:            return "1x1";
+    }
+}
+
+bool FrameBinner::parse(const std::string &text, Options *options)
+{
+    Options parsed;
+    const size_t colon = text.find(':');
+    const std::string name = text.substr(0, colon);
+    if (colon != std::string::npos) {
+        if (text.compare(colon + 1, std::string::npos, "sum") != 0)
+            return false;
+        parsed.sum = true;
+    }
+    if (name == "off" || name == "1x1" || name.empty()) {
+        parsed.mode = Mode::Off;
+    } else {
+        static const Mode modes[] = {Mode::Bin2x1, Mode::Bin2x2, Mode::Bin4x1,
+                                     Mode::Bin4x4, Mode::Bin3x3, Mode::Bin9to4};
+        const Mode *found = std::find_if(std::begin(modes), std::end(modes),
+                                         [&name](Mode mode) { return name == modeName(mode); });
+        if (found == std::end(modes))
+            return false;
+        parsed.mode = *found;
+    }
+    *options = parsed;
+    return true;
+}
@@ -0,0 +1,105 @@
+#ifndef FRAMEBINNER_H
+#define FRAMEBINNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Acq.h"
+
+// ------------------------------------------------------------------
+// FrameBinner
+// Host-side ROI crop and binning, the software counterpart of
+// Acquisition_SetCameraROI and Acquisition_SetCameraBinningMode for
+// panels that cannot do either on board. It runs on the raw frame,
+// before calibration, correction and recording, so every later stage
+// (and the disk) sees only the reduced frame.
+//
+// The modes are OnboardBinningMode's, named columns x rows:
+//  2x1, 4x1   2 or 4 horizontally adjacent pixels per output pixel
+//  2x2, 3x3,  square cells
+//  4x4
+//  9to4       each 3x3 cell becomes 2x2; an output pixel covers 1.5 x
+//             1.5 input pixels, so the cell's corner, edge and centre
+//             pixels weigh 4:2:2:1 (out of 9)
+//
+// Cells are summed in 32 bits. By default the result is their exact
+// (floor) mean in the input's type; with 'sum' the 32-bit sums are
+// kept instead (PKI_LONG), which loses nothing to the division at the
+// cost of twice the bytes per 16-bit pixel. For 9to4, the sum is
+// that of the 2.25 input pixels an output pixel covers. A partial cell
+// at the right or bottom edge of the ROI is dropped. configure()
+// allocates every buffer; AVX2 / SSE4.1 / scalar via simd::level().
+//
+// Not thread-safe; the acquisition callback is its only user.
+// ------------------------------------------------------------------
+class FrameBinner {
+public:
+    // In the order of OnboardBinningMode, after Off.
+    enum class Mode { Off, Bin2x1, Bin2x2, Bin4x1, Bin4x4, Bin3x3, Bin9to4 };
+
+    // In detector pixels; a zero width or height extends to the edge.
+    struct Roi {
+        unsigned x = 0;
+        unsigned y = 0;
+        unsigned width = 0;
+        unsigned height = 0;
+    };
+
+    struct Options {
+        Mode mode = Mode::Off;
+        bool sum = false;               // 32-bit sums instead of the mean
+    };
+
+    // 'roi' is clamped to the sensor. Returns false, with error() set,
+    // when its origin is off the panel or no whole cell fits.
+    bool configure(const Options &options, const Roi &roi, unsigned sensorRows, unsigned sensorColumns,
+                   XIS_FileType dataType);
+    const Options &options() const { return m_options; }
+    const std::string &error() const { return m_error; }
+
+    // False when frames pass through unchanged (no binning, full frame).
+    bool isActive() const { return m_active; }
+    const Roi &roi() const { return m_roi; }
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    // PKI_LONG for 18-bit input or 'sum'.
+    XIS_FileType outputType() const { return m_outputType; }
+    // Largest output value, and the bits it needs.
+    uint32_t maxValue() const { return m_maxValue; }
+    unsigned bits() const { return m_bits; }
+
+    // 'raw' is a full sensor frame of the configured type; 'out' holds
+    // rows() x columns() pixels of outputType().
+    void bin(const uint16_t *raw, void *out);
+    void bin(const uint32_t *raw, void *out);
+
+    // Cell size in input pixels: 2x1 -> 2 across, 1 down; 9to4 -> 3, 3.
+    static unsigned cellColumns(Mode mode);
+    static unsigned cellRows(Mode mode);
+    static Mode fromOnboard(OnboardBinningMode mode);
+    static const char *modeName(Mode mode);
+    // "off" / "1x1", "2x1", "2x2", "4x1", "4x4", "3x3" or "9to4", with
+    // ":sum" for 32-bit sums.
+    static bool parse(const std::string &text, Options *options);
+
+private:
+    template <typename T>
+    void binRows(const T *raw, void *out);
+
+    Options m_options;
+    std::string m_error;
+    bool m_active = false;
+    bool m_wideInput = false;
+    Roi m_roi;
+    unsigned m_sensorColumns = 0;
+    unsigned m_rows = 0;
+    unsigned m_columns = 0;
+    XIS_FileType m_outputType = PKI_SHORT;
+    uint32_t m_maxValue = 0xFFFF;
+    unsigned m_bits = 16;
+    std::vector<uint32_t> m_scratch;    // row sums ahead of the mean; 9to4 keeps two
+};
+
+#endif // FRAMEBINNER_H
@@ -0,0 +1,583 @@
+#include "framecodec.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using Predictor = FrameCodec::Predictor;
+
+constexpr uint32_t kMagic = 0x315A4346;     // "FCZ1"
+constexpr size_t kFixedHeaderBytes = 20;
+constexpr unsigned kBlock = FrameCodec::kBlockPixels;
+constexpr size_t kMaxBlockBytes = 1 + 8 * 16;
+
+inline uint16_t zigzag(uint16_t d)
+{
+    return static_cast<uint16_t>((d << 1) ^ (static_cast<int16_t>(d) >> 15));
+}
+
+inline uint16_t unzigzag(uint16_t z)
+{
+    return static_cast<uint16_t>((z >> 1) ^ (0u - (z & 1u)));
+}
+
+// LOCO-I median edge detector.
+inline uint16_t medianEdge(uint16_t a, uint16_t b, uint16_t c)
+{
+    const uint16_t lo = std::min(a, b);
+    const uint16_t hi = std::max(a, b);
+    if (c >= hi)
+        return lo;
+    if (c <= lo)
+        return hi;
+    return static_cast<uint16_t>(a + b - c);
+}
+
+// Prediction for pixel x of a row; 'up' is null on a strip's first row.
+inline uint16_t predict(Predictor predictor, const uint16_t *cur, const uint16_t *up, size_t x)
+{
+    if (!up)
+        return x ? cur[x - 1] : 0;
+    if (x == 0)
+        return up[0];
+    switch (predictor) {
+    case Predictor::Left: return cur[x - 1];
+    case Predictor::Up:   return up[x];
+    default:              return medianEdge(cur[x - 1], up[x], up[x - 1]);
+    }
+}
+
+// ------------------------------------------------------------------
+// Residuals
+
+void residualsScalar(Predictor predictor, const uint16_t *cur, const uint16_t *up, uint16_t *out,
+                     size_t begin, size_t count)
+{
+    for (size_t x = begin; x < count; ++x)
+        out[x] = zigzag(static_cast<uint16_t>(cur[x] - predict(predictor, cur, up, x)));
+}
+
+// Inverse of residualsScalar, in place of the pixels being decoded.
+void reconstructScalar(Predictor predictor, const uint16_t *residuals, uint16_t *cur, const uint16_t *up,
+                       size_t begin, size_t count)
+{
+    for (size_t x = begin; x < count; ++x)
+        cur[x] = static_cast<uint16_t>(predict(predictor, cur, up, x) + unzigzag(residuals[x]));
+}
+
+// ------------------------------------------------------------------
+// Bit planes: a width byte, then planes of 64 bits (bit i = pixel i),
+// most significant plane first.
+
+inline unsigned bitWidth(unsigned orValue)
+{
+    return orValue ? 32 - static_cast<unsigned>(__builtin_clz(orValue)) : 0;
+}
+
+size_t packScalar(const uint16_t *z, uint8_t *out)
+{
+    unsigned any = 0;
+    for (unsigned i = 0; i < kBlock; ++i)
+        any |= z[i];
+    const unsigned bits = bitWidth(any);
+    out[0] = static_cast<uint8_t>(bits);
+    uint8_t *plane = out + 1;
+    for (unsigned k = bits; k-- > 0; plane += 8) {
+        uint64_t mask = 0;
+        for (unsigned i = 0; i < kBlock; ++i)
+            mask |= static_cast<uint64_t>((z[i] >> k) & 1u) << i;
+        std::memcpy(plane, &mask, 8);
+    }
+    return 1 + 8 * bits;
+}
+
+void unpackScalar(const uint8_t *planes, unsigned bits, uint16_t *z)
+{
+    std::fill(z, z + kBlock, uint16_t(0));
+    for (unsigned k = 0; k < bits; ++k, planes += 8) {
+        uint64_t mask;
+        std::memcpy(&mask, planes, 8);
+        for (unsigned i = 0; i < kBlock; ++i)
+            z[i] = static_cast<uint16_t>((z[i] << 1) | ((mask >> i) & 1u));
+    }
+}
+
+#if DAQ_SIMD_X86
+template <Predictor P>
+DAQ_TARGET_AVX2
+void residualsAvx2(const uint16_t *cur, const uint16_t *up, uint16_t *out, size_t count)
+{
+    residualsScalar(P, cur, up, out, 0, std::min<size_t>(count, 1));
+    size_t x = 1;
+    for (; x + 16 <= count; x += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cur + x));
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cur + x - 1));
+        __m256i pred = a;
+        if (P == Predictor::Up) {
+            pred = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(up + x));
+        } else if (P == Predictor::Median) {
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(up + x));
+            const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(up + x - 1));
+            const __m256i lo = _mm256_min_epu16(a, b);
+            const __m256i hi = _mm256_max_epu16(a, b);
+            const __m256i gradient = _mm256_sub_epi16(_mm256_add_epi16(a, b), c);
+            const __m256i cAtMost = _mm256_cmpeq_epi16(_mm256_min_epu16(c, lo), c);
+            const __m256i cAtLeast = _mm256_cmpeq_epi16(_mm256_max_epu16(c, hi), c);
+            pred = _mm256_blendv_epi8(gradient, hi, cAtMost);
+            pred = _mm256_blendv_epi8(pred, lo, cAtLeast);
+        }
+        const __m256i d = _mm256_sub_epi16(v, pred);
+        const __m256i z = _mm256_xor_si256(_mm256_slli_epi16(d, 1), _mm256_srai_epi16(d, 15));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), z);
+    }
+    residualsScalar(P, cur, up, out, x, count);
+}
+
+template <Predictor P>
+DAQ_TARGET_SSE41
+void residualsSse41(const uint16_t *cur, const uint16_t *up, uint16_t *out, size_t count)
+{
+    residualsScalar(P, cur, up, out, 0, std::min<size_t>(count, 1));
+    size_t x = 1;
+    for (; x + 8 <= count; x += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + x));
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + x - 1));
+        __m128i pred = a;
+        if (P == Predictor::Up) {
+            pred = _mm_loadu_si128(reinterpret_cast<const __m128i *>(up + x));
+        } else if (P == Predictor::Median) {
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(up + x));
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(up + x - 1));
+            const __m128i lo = _mm_min_epu16(a, b);
+            const __m128i hi = _mm_max_epu16(a, b);
+            const __m128i gradient = _mm_sub_epi16(_mm_add_epi16(a, b), c);
+            const __m128i cAtMost = _mm_cmpeq_epi16(_mm_min_epu16(c, lo), c);
+            const __m128i cAtLeast = _mm_cmpeq_epi16(_mm_max_epu16(c, hi), c);
+            pred = _mm_blendv_epi8(gradient, hi, cAtMost);
+            pred = _mm_blendv_epi8(pred, lo, cAtLeast);
+        }
+        const __m128i d = _mm_sub_epi16(v, pred);
+        const __m128i z = _mm_xor_si128(_mm_slli_epi16(d, 1), _mm_srai_epi16(d, 15));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), z);
+    }
+    residualsScalar(P, cur, up, out, x, count);
+}
+
+DAQ_TARGET_SSE41
+inline __m128i unzigzagSse41(__m128i z)
+{
+    return _mm_xor_si128(_mm_srli_epi16(z, 1), _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi16(1))));
+}
+
+DAQ_TARGET_AVX2
+inline __m256i unzigzagAvx2(__m256i z)
+{
+    return _mm256_xor_si256(_mm256_srli_epi16(z, 1),
+                            _mm256_sub_epi16(_mm256_setzero_si256(), _mm256_and_si256(z, _mm256_set1_epi16(1))));
+}
+
+DAQ_TARGET_AVX2
+void reconstructUpAvx2(const uint16_t *residuals, uint16_t *cur, const uint16_t *up, size_t count)
+{
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        const __m256i z = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(residuals + x));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(up + x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(cur + x), _mm256_add_epi16(b, unzigzagAvx2(z)));
+    }
+    reconstructScalar(Predictor::Up, residuals, cur, up, x, count);
+}
+
+DAQ_TARGET_SSE41
+void reconstructUpSse41(const uint16_t *residuals, uint16_t *cur, const uint16_t *up, size_t count)
+{
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i *>(residuals + x));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(up + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cur + x), _mm_add_epi16(b, unzigzagSse41(z)));
+    }
+    reconstructScalar(Predictor::Up, residuals, cur, up, x, count);
+}
+
+// Left prediction decodes as a running sum of the residuals, eight
+// lanes at a time; the carry is the last pixel of the previous group.
+// Pixel 0 predicts from above (or from 0 on a strip's first row).
+DAQ_TARGET_SSE41
+void reconstructLeftSse41(const uint16_t *residuals, uint16_t *cur, const uint16_t *up, size_t count)
+{
+    if (count == 0)
+        return;
+    reconstructScalar(Predictor::Left, residuals, cur, up, 0, 1);
+    const __m128i broadcastLast = _mm_set1_epi16(0x0F0E);
+    __m128i carry = _mm_set1_epi16(static_cast<short>(cur[0]));
+    size_t x = 1;
+    for (; x + 8 <= count; x += 8) {
+        __m128i v = unzigzagSse41(_mm_loadu_si128(reinterpret_cast<const __m128i *>(residuals + x)));
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi16(v, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cur + x), v);
+        carry = _mm_shuffle_epi8(v, broadcastLast);
+    }
+    reconstructScalar(Predictor::Left, residuals, cur, up, x, count);
+}
+
+DAQ_TARGET_AVX2
+size_t packAvx2(const uint16_t *z, uint8_t *out)
+{
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(z));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(z + 16));
+    __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(z + 32));
+    __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(z + 48));
+    const __m256i all = _mm256_or_si256(_mm256_or_si256(v0, v1), _mm256_or_si256(v2, v3));
+    __m128i any = _mm_or_si128(_mm256_castsi256_si128(all), _mm256_extracti128_si256(all, 1));
+    any = _mm_or_si128(any, _mm_srli_si128(any, 8));
+    any = _mm_or_si128(any, _mm_srli_si128(any, 4));
+    any = _mm_or_si128(any, _mm_srli_si128(any, 2));
+    const unsigned bits = bitWidth(static_cast<unsigned>(_mm_extract_epi16(any, 0)));
+    out[0] = static_cast<uint8_t>(bits);
+    if (bits == 0)
+        return 1;
+
+    // Bring the top plane to bit 15; packs keeps the sign, so movemask
+    // reads one plane of 32 pixels (packs works per 128-bit lane, the
+    // permute restores pixel order). Doubling moves the next plane up.
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(16 - bits));
+    v0 = _mm256_sll_epi16(v0, shift);
+    v1 = _mm256_sll_epi16(v1, shift);
+    v2 = _mm256_sll_epi16(v2, shift);
+    v3 = _mm256_sll_epi16(v3, shift);
+    uint8_t *plane = out + 1;
+    for (unsigned k = 0; k < bits; ++k, plane += 8) {
+        const uint32_t lo = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_permute4x64_epi64(_mm256_packs_epi16(v0, v1), 0xD8)));
+        const uint32_t hi = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_permute4x64_epi64(_mm256_packs_epi16(v2, v3), 0xD8)));
+        const uint64_t mask = lo | static_cast<uint64_t>(hi) << 32;
+        std::memcpy(plane, &mask, 8);
+        v0 = _mm256_add_epi16(v0, v0);
+        v1 = _mm256_add_epi16(v1, v1);
+        v2 = _mm256_add_epi16(v2, v2);
+        v3 = _mm256_add_epi16(v3, v3);
+    }
+    return 1 + 8 * bits;
+}
+
+DAQ_TARGET_SSE41
+size_t packSse41(const uint16_t *z, uint8_t *out)
+{
+    __m128i v[8];
+    __m128i all = _mm_setzero_si128();
+    for (unsigned j = 0; j < 8; ++j) {
+        v[j] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(z + 8 * j));
+        all = _mm_or_si128(all, v[j]);
+    }
+    all = _mm_or_si128(all, _mm_srli_si128(all, 8));
+    all = _mm_or_si128(all, _mm_srli_si128(all, 4));
+    all = _mm_or_si128(all, _mm_srli_si128(all, 2));
+    const unsigned bits = bitWidth(static_cast<unsigned>(_mm_extract_epi16(all, 0)));
+    out[0] = static_cast<uint8_t>(bits);
+    if (bits == 0)
+        return 1;
+
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(16 - bits));
+    for (unsigned j = 0; j < 8; ++j)
+        v[j] = _mm_sll_epi16(v[j], shift);
+    uint8_t *plane = out + 1;
+    for (unsigned k = 0; k < bits; ++k, plane += 8) {
+        uint64_t mask = 0;
+        for (unsigned j = 0; j < 4; ++j) {
+            mask |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_packs_epi16(v[2 * j], v[2 * j + 1]))) << (16 * j);
+            v[2 * j] = _mm_add_epi16(v[2 * j], v[2 * j]);
+            v[2 * j + 1] = _mm_add_epi16(v[2 * j + 1], v[2 * j + 1]);
+        }
+        std::memcpy(plane, &mask, 8);
+    }
+    return 1 + 8 * bits;
+}
+
+// Each lane tests its own bit of the plane and shifts it in at the bottom.
+DAQ_TARGET_AVX2
+void unpackAvx2(const uint8_t *planes, unsigned bits, uint16_t *z)
+{
+    const __m256i laneBits = _mm256_setr_epi16(0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+                                               0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000,
+                                               static_cast<short>(0x8000));
+    __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(),
+                      _mm256_setzero_si256()};
+    for (unsigned k = 0; k < bits; ++k, planes += 8) {
+        uint64_t mask;
+        std::memcpy(&mask, planes, 8);
+        for (unsigned j = 0; j < 4; ++j) {
+            const __m256i m = _mm256_set1_epi16(static_cast<short>(mask >> (16 * j)));
+            const __m256i bit = _mm256_cmpeq_epi16(_mm256_and_si256(m, laneBits), laneBits);
+            acc[j] = _mm256_or_si256(_mm256_add_epi16(acc[j], acc[j]), _mm256_srli_epi16(bit, 15));
+        }
+    }
+    for (unsigned j = 0; j < 4; ++j)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(z + 16 * j), acc[j]);
+}
+
+DAQ_TARGET_SSE41
+void unpackSse41(const uint8_t *planes, unsigned bits, uint16_t *z)
+{
+    const __m128i laneBits = _mm_setr_epi16(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+    __m128i acc[8];
+    for (unsigned j = 0; j < 8; ++j)
+        acc[j] = _mm_setzero_si128();
+    for (unsigned k = 0; k < bits; ++k, planes += 8) {
+        uint64_t mask;
+        std::memcpy(&mask, planes, 8);
+        for (unsigned j = 0; j < 8; ++j) {
+            const __m128i m = _mm_set1_epi16(static_cast<short>((mask >> (8 * j)) & 0xFF));
+            const __m128i bit = _mm_cmpeq_epi16(_mm_and_si128(m, laneBits), laneBits);
+            acc[j] = _mm_or_si128(_mm_add_epi16(acc[j], acc[j]), _mm_srli_epi16(bit, 15));
+        }
+    }
+    for (unsigned j = 0; j < 8; ++j)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(z + 8 * j), acc[j]);
+}
+#endif
+
+// ------------------------------------------------------------------
+// Dispatch
+
+template <Predictor P>
+void residualsFor(const uint16_t *cur, const uint16_t *up, uint16_t *out, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  residualsAvx2<P>(cur, up, out, count); return;
+    case simd::Level::Sse41: residualsSse41<P>(cur, up, out, count); return;
+    default: break;
+    }
+#endif
+    residualsScalar(P, cur, up, out, 0, count);
+}
+
+// A strip's first row (no 'up') always predicts from the left.
+void residualsDispatch(Predictor predictor, const uint16_t *cur, const uint16_t *up, uint16_t *out, size_t count)
+{
+    if (!up || predictor == Predictor::Left)
+        residualsFor<Predictor::Left>(cur, up, out, count);
+    else if (predictor == Predictor::Up)
+        residualsFor<Predictor::Up>(cur, up, out, count);
+    else
+        residualsFor<Predictor::Median>(cur, up, out, count);
+}
+
+void reconstructDispatch(Predictor predictor, const uint16_t *residuals, uint16_t *cur, const uint16_t *up,
+                         size_t count)
+{
+    if (up && predictor == Predictor::Median) {
+        reconstructScalar(predictor, residuals, cur, up, 0, count);
+        return;
+    }
+#if DAQ_SIMD_X86
+    const simd::Level level = simd::level();
+    if (up && predictor == Predictor::Up) {
+        if (level == simd::Level::Avx2)
+            return reconstructUpAvx2(residuals, cur, up, count);
+        if (level == simd::Level::Sse41)
+            return reconstructUpSse41(residuals, cur, up, count);
+    } else if (level != simd::Level::Scalar) {
+        return reconstructLeftSse41(residuals, cur, up, count);
+    }
+#endif
+    reconstructScalar(up ? predictor : Predictor::Left, residuals, cur, up, 0, count);
+}
+
+size_t packDispatch(const uint16_t *z, uint8_t *out)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  return packAvx2(z, out);
+    case simd::Level::Sse41: return packSse41(z, out);
+    default: break;
+    }
+#endif
+    return packScalar(z, out);
+}
+
+void unpackDispatch(const uint8_t *planes, unsigned bits, uint16_t *z)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  unpackAvx2(planes, bits, z); return;
+    case simd::Level::Sse41: unpackSse41(planes, bits, z); return;
+    default: break;
+    }
+#endif
+    unpackScalar(planes, bits, z);
+}
+
+// Residuals of one strip, padded to whole blocks.
+std::vector<uint16_t> &stripScratch(size_t pixels)
+{
+    static thread_local std::vector<uint16_t> scratch;
+    const size_t padded = (pixels + kBlock - 1) / kBlock * kBlock;
+    if (scratch.size() < padded)
+        scratch.resize(padded);
+    std::fill(scratch.begin() + pixels, scratch.begin() + padded, uint16_t(0));
+    return scratch;
+}
+
+inline void put32(uint8_t *p, uint32_t v) { std::memcpy(p, &v, 4); }
+inline uint32_t get32(const uint8_t *p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+} // namespace
+
+FrameCodec::FrameCodec(unsigned rows, unsigned columns, Predictor predictor, unsigned stripRows)
+    : m_rows(rows)
+    , m_columns(columns)
+    , m_predictor(predictor)
+    , m_stripRows(std::max(1u, std::min({stripRows, std::max(rows, 1u), 0xFFFFu})))
+    , m_strips((rows + m_stripRows - 1) / m_stripRows)
+{
+}
+
+const char *FrameCodec::predictorName(Predictor predictor)
+{
+    switch (predictor) {
+    case Predictor::Left: return "left";
+    case Predictor::Up:   return "up";
+    default:              return "median-edge";
+    }
+}
+
+size_t FrameCodec::headerBytes() const
+{
+    return kFixedHeaderBytes + 4 * static_cast<size_t>(m_strips);
+}
+
+unsigned FrameCodec::rowsInStrip(unsigned strip) const
+{
+    return std::min(m_stripRows, m_rows - strip * m_stripRows);
+}
+
+size_t FrameCodec::maxStripBytes(unsigned strip) const
+{
+    const size_t pixels = static_cast<size_t>(rowsInStrip(strip)) * m_columns;
+    return (pixels + kBlock - 1) / kBlock * kMaxBlockBytes;
+}
+
+size_t FrameCodec::maxEncodedBytes() const
+{
+    size_t bytes = headerBytes();
+    for (unsigned s = 0; s < m_strips; ++s)
+        bytes += maxStripBytes(s);
+    return bytes;
+}
+
+size_t FrameCodec::encodeStrip(unsigned strip, const uint16_t *pixels, uint8_t *out) const
+{
+    const unsigned rows = rowsInStrip(strip);
+    const size_t count = static_cast<size_t>(rows) * m_columns;
+    std::vector<uint16_t> &residuals = stripScratch(count);
+    const uint16_t *first = pixels + static_cast<size_t>(strip) * m_stripRows * m_columns;
+    for (unsigned r = 0; r < rows; ++r) {
+        const uint16_t *cur = first + static_cast<size_t>(r) * m_columns;
+        residualsDispatch(m_predictor, cur, r ? cur - m_columns : nullptr,
+                          residuals.data() + static_cast<size_t>(r) * m_columns, m_columns);
+    }
+    uint8_t *p = out;
+    for (size_t b = 0; b < count; b += kBlock)
+        p += packDispatch(residuals.data() + b, p);
+    return static_cast<size_t>(p - out);
+}
+
+size_t FrameCodec::encode(const uint16_t *pixels, uint8_t *out, ThreadPool *pool) const
+{
+    const size_t header = headerBytes();
+    std::vector<size_t> sizes(m_strips);
+    const size_t slot = maxStripBytes(0);
+    const auto task = [&](size_t s) {
+        sizes[s] = encodeStrip(static_cast<unsigned>(s), pixels, out + header + s * slot);
+    };
+    if (pool)
+        pool->parallelFor(m_strips, task);
+    else
+        for (unsigned s = 0; s < m_strips; ++s)
+            task(s);
+
+    // Close the gaps left by the worst-case slots.
+    put32(out, kMagic);
+    put32(out + 4, m_rows);
+    put32(out + 8, m_columns);
+    out[12] = static_cast<uint8_t>(m_predictor);
+    out[13] = 0;
+    const uint16_t stripRows = static_cast<uint16_t>(m_stripRows);
+    std::memcpy(out + 14, &stripRows, 2);
+    put32(out + 16, m_strips);
+    size_t end = 0;
+    for (unsigned s = 0; s < m_strips; ++s) {
+        if (s > 0)
+            std::memmove(out + header + end, out + header + s * slot, sizes[s]);
+        end += sizes[s];
+        put32(out + kFixedHeaderBytes + 4 * s, static_cast<uint32_t>(end));
+    }
+    return header + end;
+}
+
+bool FrameCodec::decodeStrip(unsigned strip, const uint8_t *data, size_t bytes, uint16_t *pixels) const
+{
+    const unsigned rows = rowsInStrip(strip);
+    const size_t count = static_cast<size_t>(rows) * m_columns;
+    std::vector<uint16_t> &residuals = stripScratch(count);
+    const uint8_t *p = data;
+    const uint8_t *end = data + bytes;
+    for (size_t b = 0; b < count; b += kBlock) {
+        if (p >= end)
+            return false;
+        const unsigned bits = *p++;
+        if (bits > 16 || static_cast<size_t>(end - p) < 8u * bits)
+            return false;
+        unpackDispatch(p, bits, residuals.data() + b);
+        p += 8 * bits;
+    }
+    uint16_t *first = pixels + static_cast<size_t>(strip) * m_stripRows * m_columns;
+    for (unsigned r = 0; r < rows; ++r) {
+        uint16_t *cur = first + static_cast<size_t>(r) * m_columns;
+        reconstructDispatch(m_predictor, residuals.data() + static_cast<size_t>(r) * m_columns, cur,
+                            r ? cur - m_columns : nullptr, m_columns);
+    }
+    return p == end;
+}
+
+bool FrameCodec::decode(const uint8_t *data, size_t bytes, uint16_t *pixels, ThreadPool *pool) const
+{
+    const size_t header = headerBytes();
+    if (bytes < header || get32(data) != kMagic || get32(data + 4) != m_rows || get32(data + 8) != m_columns
+        || data[12] != static_cast<uint8_t>(m_predictor) || get32(data + 16) != m_strips)
+        return false;
+    uint16_t stripRows;
+    std::memcpy(&stripRows, data + 14, 2);
+    if (stripRows != m_stripRows)
+        return false;
+
+    std::vector<uint32_t> ends(m_strips);
+    uint32_t previous = 0;
+    for (unsigned s = 0; s < m_strips; ++s) {
+        ends[s] = get32(data + kFixedHeaderBytes + 4 * s);
+        if (ends[s] < previous || ends[s] > bytes - header)
+            return false;
+        previous = ends[s];
+    }
+    std::vector<char> ok(m_strips, 0);
+    const auto task = [&](size_t s) {
+        const uint32_t begin = s ? ends[s - 1] : 0;
+        ok[s] = decodeStrip(static_cast<unsigned>(s), data + header + begin, ends[s] - begin, pixels);
+    };
+    if (pool)
+        pool->parallelFor(m_strips, task);
+    else
+        for (unsigned s = 0; s < m_strips; ++s)
+            task(s);
+    return std::all_of(ok.begin(), ok.end(), [](char v) { return v != 0; });
+}
@@ -0,0 +1,70 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+class ThreadPool;
+
+// ------------------------------------------------------------------
+// FrameCodec
+// Lossless compression for 16-bit frames of one geometry. Each pixel is
+// predicted from its decoded neighbours (left, up, or the median-edge
+// predictor of LOCO-I: min/max of left and up at an edge, left + up -
+// upper-left elsewhere) and the residual is zigzag-mapped so small
+// errors of either sign become small numbers. Residuals are packed in
+// blocks of 64 as bit planes: one byte holding the block's bit width b,
+// then b planes of 64 bits, most significant first. Flat regions cost a
+// byte per block, noise costs its entropy plus a little.
+//
+// The frame is cut into strips of stripRows rows that are coded
+// independently (a strip's first row predicts from the left only), so
+// encode() and decode() spread the strips over a ThreadPool. Residuals,
+// bit-plane packing and unpacking are SIMD kernels; reconstruction is
+// SIMD for Up and Left (a prefix sum) and scalar for Median, whose
+// prediction depends on the pixel just decoded.
+//
+// The encoded stream is self-describing: geometry, predictor and strip
+// offsets come first, so decode() rejects data of another geometry.
+// ------------------------------------------------------------------
+class FrameCodec {
+public:
+    enum class Predictor : uint8_t { Left = 0, Up = 1, Median = 2 };
+
+    static constexpr unsigned kBlockPixels = 64;
+    static constexpr unsigned kDefaultStripRows = 64;
+
+    FrameCodec(unsigned rows, unsigned columns, Predictor predictor, unsigned stripRows = kDefaultStripRows);
+
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    Predictor predictor() const { return m_predictor; }
+    unsigned stripRows() const { return m_stripRows; }
+    unsigned strips() const { return m_strips; }
+    static const char *predictorName(Predictor predictor);
+
+    // Upper bound of encode()'s output; 'out' must hold this many bytes.
+    size_t maxEncodedBytes() const;
+
+    // Returns the encoded size. Without a pool the strips run on the
+    // calling thread.
+    size_t encode(const uint16_t *pixels, uint8_t *out, ThreadPool *pool = nullptr) const;
+
+    // False if 'data' is truncated, damaged or of another geometry.
+    bool decode(const uint8_t *data, size_t bytes, uint16_t *pixels, ThreadPool *pool = nullptr) const;
+
+private:
+    size_t headerBytes() const;
+    size_t maxStripBytes(unsigned strip) const;
+    unsigned rowsInStrip(unsigned strip) const;
+    size_t encodeStrip(unsigned strip, const uint16_t *pixels, uint8_t *out) const;
+    bool decodeStrip(unsigned strip, const uint8_t *data, size_t bytes, uint16_t *pixels) const;
+
+    unsigned m_rows;
+    unsigned m_columns;
+    Predictor m_predictor;
+    unsigned m_stripRows;
+    unsigned m_strips;
+};
+
+#endif // FRAMECODEC_H
@@ -0,0 +1,264 @@
+#include "framegenerator.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Standard deviation of the sum of two 16-bit uniforms shifted right by
+// one, i.e. the triangular base noise both kernels draw from.
+constexpr double kBaseNoiseSigma = 13377.4;
+constexpr double kTwoPi = 6.283185307179586;
+
+inline uint64_t xorshift64(uint64_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// splitmix64, used only to seed the per-lane generators and the maps.
+inline uint64_t splitmix64(uint64_t &state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+inline uint16_t composePixel(uint16_t offset, uint16_t gainHalf, uint16_t level,
+                             int16_t sigma, int16_t noise, uint16_t maxValue)
+{
+    int32_t value = offset + ((static_cast<uint32_t>(level) * gainHalf) >> 16) * 2;
+    value += (static_cast<int32_t>(noise) * sigma + 0x4000) >> 15;
+    return static_cast<uint16_t>(std::clamp<int32_t>(value, 0, maxValue));
+}
+
+#if DAQ_SIMD_X86
+DAQ_TARGET_AVX2
+void renderSpanAvx2(uint16_t *out, const uint16_t *offset, const uint16_t *gainHalf,
+                    unsigned count, uint16_t level, int16_t sigma, uint16_t maxValue,
+                    uint64_t *rngState)
+{
+    const __m256i levelVec = _mm256_set1_epi16(static_cast<short>(level));
+    const __m256i sigmaVec = _mm256_set1_epi16(sigma);
+    const __m256i maxVec = _mm256_set1_epi16(static_cast<short>(maxValue));
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i s = _mm256_load_si256(reinterpret_cast<const __m256i *>(rngState));
+
+    unsigned i = 0;
+    for (; i + 16 <= count; i += 16) {
+        s = _mm256_xor_si256(s, _mm256_slli_epi64(s, 13));
+        s = _mm256_xor_si256(s, _mm256_srli_epi64(s, 7));
+        s = _mm256_xor_si256(s, _mm256_slli_epi64(s, 17));
+        const __m256i r1 = s;
+        s = _mm256_xor_si256(s, _mm256_slli_epi64(s, 13));
+        s = _mm256_xor_si256(s, _mm256_srli_epi64(s, 7));
+        s = _mm256_xor_si256(s, _mm256_slli_epi64(s, 17));
+        const __m256i noise = _mm256_add_epi16(_mm256_srai_epi16(r1, 1), _mm256_srai_epi16(s, 1));
+        const __m256i scaled = _mm256_mulhrs_epi16(noise, sigmaVec);
+
+        const __m256i g = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gainHalf + i));
+        const __m256i o = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offset + i));
+        __m256i v = _mm256_slli_epi16(_mm256_mulhi_epu16(levelVec, g), 1);
+        v = _mm256_adds_epu16(v, o);
+        v = _mm256_adds_epu16(v, _mm256_max_epi16(scaled, zero));
+        v = _mm256_subs_epu16(v, _mm256_max_epi16(_mm256_sub_epi16(zero, scaled), zero));
+        v = _mm256_min_epu16(v, maxVec);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), v);
+    }
+    _mm256_store_si256(reinterpret_cast<__m256i *>(rngState), s);
+
+    for (; i < count; ++i) {
+        const uint64_t r1 = xorshift64(rngState[0]);
+        const uint64_t r2 = xorshift64(rngState[0]);
+        const int16_t noise = static_cast<int16_t>((static_cast<int16_t>(r1) >> 1) + (static_cast<int16_t>(r2) >> 1));
+        out[i] = composePixel(offset[i], gainHalf[i], level, sigma, noise, maxValue);
+    }
+}
+#endif
+
+} // namespace
+
+FrameGeneratorConfig FrameGeneratorConfig::forPanel(unsigned rows, unsigned columns, unsigned bits)
+{
+    FrameGeneratorConfig config;
+    config.rows = rows;
+    config.columns = columns;
+    config.bits = std::clamp(bits, 8u, 16u);
+    const unsigned maxValue = (1u << config.bits) - 1;
+    config.pedestal = maxValue / 64;
+    config.pedestalSpread = maxValue / 320;
+    config.exposure = maxValue * 3 / 10;
+    config.aduPerQuantum = static_cast<double>(maxValue) / 65535.0;
+    return config;
+}
+
+FrameGenerator::FrameGenerator(const FrameGeneratorConfig &config)
+    : m_config(config),
+      m_maxValue(static_cast<uint16_t>((1u << std::clamp(config.bits, 8u, 16u)) - 1))
+{
+    uint64_t seed = m_config.seed;
+    for (uint64_t &lane : m_rng) {
+        lane = splitmix64(seed);
+        if (lane == 0)
+            lane = 1;
+    }
+    buildMaps();
+}
+
+void FrameGenerator::buildMaps()
+{
+    const unsigned rows = m_config.rows;
+    const unsigned columns = m_config.columns;
+    const size_t pixels = static_cast<size_t>(rows) * columns;
+    uint64_t seed = m_config.seed ^ 0xA5A5A5A5A5A5A5A5ull;
+
+    // Pedestal: per-column readout-channel bias plus uniform pixel spread.
+    // Gain: smooth radial falloff with pixel-level jitter.
+    m_offset.resize(pixels);
+    m_gainHalf.resize(pixels);
+    std::vector<int> columnBias(columns);
+    for (unsigned c = 0; c < columns; ++c)
+        columnBias[c] = static_cast<int>(splitmix64(seed) % (m_config.pedestalSpread + 1)) - static_cast<int>(m_config.pedestalSpread / 2);
+
+    const double cx = columns / 2.0, cy = rows / 2.0;
+    const double r2max = cx * cx + cy * cy;
+    for (unsigned r = 0; r < rows; ++r) {
+        for (unsigned c = 0; c < columns; ++c) {
+            const size_t i = static_cast<size_t>(r) * columns + c;
+            const uint64_t rnd = splitmix64(seed);
+            const int spread = static_cast<int>(rnd % (m_config.pedestalSpread + 1)) - static_cast<int>(m_config.pedestalSpread / 2);
+            m_offset[i] = static_cast<uint16_t>(std::clamp<int>(static_cast<int>(m_config.pedestal) + columnBias[c] + spread, 0, m_maxValue));
+
+            const double dx = c - cx, dy = r - cy;
+            const double jitter = ((rnd >> 32) & 0xFFFF) / 65535.0 * 2.0 - 1.0;
+            const double gain = (1.0 - 0.5 * m_config.gainSpread * (dx * dx + dy * dy) / r2max)
+                              * (1.0 + 0.5 * m_config.gainSpread * jitter);
+            m_gainHalf[i] = static_cast<uint16_t>(std::clamp(gain * 32768.0, 0.0, 65535.0));
+        }
+    }
+
+    const size_t defects = static_cast<size_t>(pixels * m_config.deadPixelFraction);
+    for (size_t d = 0; d < defects; ++d) {
+        const uint32_t index = static_cast<uint32_t>(splitmix64(seed) % pixels);
+        (d & 1 ? m_hotPixels : m_deadPixels).push_back(index);
+    }
+    std::sort(m_deadPixels.begin(), m_deadPixels.end());
+    std::sort(m_hotPixels.begin(), m_hotPixels.end());
+
+    m_rowIsDead.assign(rows, 0);
+    for (unsigned d = 0; d < m_config.deadRows && rows; ++d) {
+        const unsigned row = static_cast<unsigned>(splitmix64(seed) % rows);
+        m_rowIsDead[row] = 1;
+    }
+    for (unsigned d = 0; d < m_config.deadColumns && columns; ++d)
+        m_deadColumnList.push_back(static_cast<unsigned>(splitmix64(seed) % columns));
+}
+
+int16_t FrameGenerator::noiseScale(double level) const
+{
+    const double sigma = std::sqrt(level * m_config.aduPerQuantum + m_config.readNoise * m_config.readNoise);
+    return static_cast<int16_t>(std::min(sigma * 32768.0 / kBaseNoiseSigma, 32767.0));
+}
+
+// Splits a row into at most three spans of constant exposure: open field,
+// under the phantom, open field.
+unsigned FrameGenerator::rowSpans(unsigned row, uint64_t frameIndex, Span *spans) const
+{
+    const unsigned rows = m_config.rows;
+    const unsigned columns = m_config.columns;
+    // Anode heel effect: exposure falls off slightly towards the bottom.
+    const double open = m_config.exposure * (1.0 - 0.08 * row / std::max(rows, 1u));
+    const uint16_t openLevel = static_cast<uint16_t>(std::min(open, 65535.0));
+    const int16_t openSigma = noiseScale(open);
+
+    if (m_config.phantom) {
+        const double phase = kTwoPi * static_cast<double>(frameIndex % 240) / 240.0;
+        const double px = columns * (0.5 + 0.3 * std::cos(phase));
+        const double py = rows * (0.5 + 0.2 * std::sin(phase));
+        const double radius = std::min(rows, columns) / 8.0;
+        const double dy = row + 0.5 - py;
+        if (std::abs(dy) < radius) {
+            const double half = std::sqrt(radius * radius - dy * dy);
+            const unsigned x0 = static_cast<unsigned>(std::clamp(px - half, 0.0, static_cast<double>(columns)));
+            const unsigned x1 = static_cast<unsigned>(std::clamp(px + half, 0.0, static_cast<double>(columns)));
+            if (x1 > x0) {
+                const double attenuated = open * m_config.phantomTransmission;
+                spans[0] = {0, x0, openLevel, openSigma};
+                spans[1] = {x0, x1, static_cast<uint16_t>(attenuated), noiseScale(attenuated)};
+                spans[2] = {x1, columns, openLevel, openSigma};
+                return 3;
+            }
+        }
+    }
+    spans[0] = {0, columns, openLevel, openSigma};
+    return 1;
+}
+
+void FrameGenerator::render(uint16_t *dest, uint64_t frameIndex)
+{
+    const unsigned columns = m_config.columns;
+#if DAQ_SIMD_X86
+    const bool avx2 = simd::level() == simd::Level::Avx2;
+#endif
+    Span spans[3];
+    for (unsigned r = 0; r < m_config.rows; ++r) {
+        const size_t base = static_cast<size_t>(r) * columns;
+        uint16_t *out = dest + base;
+        if (m_rowIsDead[r]) {
+            std::memset(out, 0, columns * sizeof(uint16_t));
+            continue;
+        }
+        const unsigned count = rowSpans(r, frameIndex, spans);
+        for (unsigned s = 0; s < count; ++s) {
+            const Span &span = spans[s];
+            if (span.end <= span.begin)
+                continue;
+#if DAQ_SIMD_X86
+            if (avx2) {
+                renderSpanAvx2(out + span.begin, m_offset.data() + base + span.begin,
+                               m_gainHalf.data() + base + span.begin, span.end - span.begin,
+                               span.level, span.sigma, m_maxValue, m_rng);
+                continue;
+            }
+#endif
+            renderSpanScalar(out, m_offset.data() + base, m_gainHalf.data() + base, span);
+        }
+    }
+    applyDefects(dest);
+}
+
+void FrameGenerator::renderSpanScalar(uint16_t *out, const uint16_t *offset, const uint16_t *gain, const Span &span)
+{
+    uint64_t bits = 0;
+    unsigned available = 0;
+    for (unsigned c = span.begin; c < span.end; ++c) {
+        if (available < 2) {
+            bits = xorshift64(m_rng[0]);
+            available = 4;
+        }
+        const int16_t r1 = static_cast<int16_t>(bits);
+        const int16_t r2 = static_cast<int16_t>(bits >> 16);
+        bits >>= 32;
+        available -= 2;
+        const int16_t noise = static_cast<int16_t>((r1 >> 1) + (r2 >> 1));
+        out[c] = composePixel(offset[c], gain[c], span.level, span.sigma, noise, m_maxValue);
+    }
+}
+
+void FrameGenerator::applyDefects(uint16_t *dest) const
+{
+    const unsigned columns = m_config.columns;
+    for (uint32_t index : m_deadPixels)
+        dest[index] = 0;
+    for (uint32_t index : m_hotPixels)
+        dest[index] = m_maxValue;
+    for (unsigned column : m_deadColumnList) {
+        for (unsigned r = 0; r < m_config.rows; ++r)
+            dest[static_cast<size_t>(r) * columns + column] = 0;
+    }
+}
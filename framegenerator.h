@@ -0,0 +1,82 @@
+#ifndef FRAMEGENERATOR_H
+#define FRAMEGENERATOR_H
+
+#include <cstdint>
+#include <vector>
+
+// ------------------------------------------------------------------
+// FrameGeneratorConfig
+// Physical model of the simulated panel. All levels are in ADU.
+// ------------------------------------------------------------------
+struct FrameGeneratorConfig {
+    unsigned rows = 2048;
+    unsigned columns = 2048;
+    unsigned bits = 16;
+
+    unsigned pedestal = 1000;           // mean dark offset
+    unsigned pedestalSpread = 200;      // pixel-to-pixel offset variation (peak)
+    double gainSpread = 0.05;           // relative gain non-uniformity (peak)
+    unsigned exposure = 20000;          // open-field signal above the pedestal
+    double aduPerQuantum = 1.0;         // sets the Poisson noise: sigma^2 = signal * aduPerQuantum
+    double readNoise = 4.0;             // electronic noise, added in quadrature
+
+    double deadPixelFraction = 1e-4;    // half dead (0), half hot (full scale)
+    unsigned deadRows = 1;
+    unsigned deadColumns = 2;
+
+    bool phantom = true;                // disc moving across the field
+    double phantomTransmission = 0.35;
+
+    uint64_t seed = 0x5DEECE66Dull;
+
+    // Defaults scaled to the panel's bit depth.
+    static FrameGeneratorConfig forPanel(unsigned rows, unsigned columns, unsigned bits);
+};
+
+// ------------------------------------------------------------------
+// FrameGenerator
+// Renders synthetic raw detector frames: per-pixel pedestal and gain
+// maps are fixed at construction, each frame adds an exposure level
+// (attenuated under the moving phantom), signal-dependent noise and the
+// panel's defects. The inner loop is an AVX2 kernel with an in-register
+// xorshift generator; a scalar path covers other hosts. An instance is
+// not thread-safe: give every producer thread its own generator.
+// ------------------------------------------------------------------
+class FrameGenerator {
+public:
+    explicit FrameGenerator(const FrameGeneratorConfig &config);
+
+    const FrameGeneratorConfig &config() const { return m_config; }
+    unsigned rows() const { return m_config.rows; }
+    unsigned columns() const { return m_config.columns; }
+
+    // Renders frame number frameIndex (drives the phantom position) into
+    // dest, which must hold rows() * columns() pixels.
+    void render(uint16_t *dest, uint64_t frameIndex);
+
+private:
+    struct Span {
+        unsigned begin;
+        unsigned end;
+        uint16_t level;
+        int16_t sigma;
+    };
+
+    void buildMaps();
+    unsigned rowSpans(unsigned row, uint64_t frameIndex, Span *spans) const;
+    int16_t noiseScale(double level) const;
+    void renderSpanScalar(uint16_t *out, const uint16_t *offset, const uint16_t *gain, const Span &span);
+    void applyDefects(uint16_t *dest) const;
+
+    FrameGeneratorConfig m_config;
+    uint16_t m_maxValue;
+    std::vector<uint16_t> m_offset;     // pedestal per pixel
+    std::vector<uint16_t> m_gainHalf;   // gain / 2 in Q16
+    std::vector<uint32_t> m_deadPixels;
+    std::vector<uint32_t> m_hotPixels;
+    std::vector<unsigned> m_deadColumnList;
+    std::vector<uint8_t> m_rowIsDead;
+    alignas(32) uint64_t m_rng[4];
+};
+
+#endif // FRAMEGENERATOR_H
@@ -0,0 +1,109 @@
+#include "framering.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+FrameRing::FrameRing(size_t slots, std::shared_ptr<FramePool> pool, OverrunPolicy policy)
+    : m_pool(std::move(pool)), m_policy(policy)
+{
+    slots = std::max<size_t>(slots, 2);
+    m_slots.resize(slots);
+    m_free.items.reset(new std::atomic<uint32_t>[slots]);
+    m_ready.items.reset(new std::atomic<uint32_t>[slots]);
+    for (size_t i = 0; i < slots; ++i) {
+        m_slots[i].index = static_cast<uint32_t>(i);
+        m_ready.items[i].store(0, std::memory_order_relaxed);
+        push(m_free, slots, static_cast<uint32_t>(i));
+    }
+}
+
+void FrameRing::push(IndexQueue &queue, size_t capacity, uint32_t index)
+{
+    const uint64_t tail = queue.tail.load(std::memory_order_relaxed);
+    queue.items[tail % capacity].store(index, std::memory_order_relaxed);
+    queue.tail.store(tail + 1, std::memory_order_release);
+}
+
+bool FrameRing::pop(IndexQueue &queue, size_t capacity, uint32_t *index)
+{
+    uint64_t head = queue.head.load(std::memory_order_acquire);
+    for (;;) {
+        if (head == queue.tail.load(std::memory_order_acquire))
+            return false;
+        const uint32_t value = queue.items[head % capacity].load(std::memory_order_relaxed);
+        // Producer and consumer may both pop from the ready queue; the
+        // 64-bit head never repeats, so a successful CAS owns 'value'.
+        if (queue.head.compare_exchange_weak(head, head + 1,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+            *index = value;
+            return true;
+        }
+    }
+}
+
+FrameRing::Slot *FrameRing::acquireWrite(const std::atomic<bool> *cancel)
+{
+    const size_t capacity = m_slots.size();
+    uint32_t index = 0;
+    if (pop(m_free, capacity, &index))
+        return &m_slots[index];
+
+    if (m_policy == OverrunPolicy::DropOldest) {
+        if (pop(m_ready, capacity, &index)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            m_slots[index].frame.reset();
+            return &m_slots[index];
+        }
+    }
+
+    // Every slot is held by the consumer (or the policy is Block): wait.
+    m_blocked.fetch_add(1, std::memory_order_relaxed);
+    for (unsigned spin = 0;; ++spin) {
+        if (cancel && cancel->load(std::memory_order_acquire))
+            return nullptr;
+        if (pop(m_free, capacity, &index))
+            return &m_slots[index];
+        if (spin < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void FrameRing::publish(Slot *slot)
+{
+    slot->sequence = m_nextSequence++;
+    m_produced.fetch_add(1, std::memory_order_relaxed);
+    push(m_ready, m_slots.size(), slot->index);
+}
+
+FrameRing::Slot *FrameRing::tryAcquireRead()
+{
+    uint32_t index = 0;
+    if (!pop(m_ready, m_slots.size(), &index))
+        return nullptr;
+    return &m_slots[index];
+}
+
+void FrameRing::release(Slot *slot)
+{
+    m_consumed.fetch_add(1, std::memory_order_relaxed);
+    slot->frame.reset();
+    push(m_free, m_slots.size(), slot->index);
+}
+
+FrameRing::Stats FrameRing::stats() const
+{
+    Stats stats;
+    stats.produced = m_produced.load(std::memory_order_relaxed);
+    stats.consumed = m_consumed.load(std::memory_order_relaxed);
+    stats.dropped = m_dropped.load(std::memory_order_relaxed);
+    stats.blocked = m_blocked.load(std::memory_order_relaxed);
+    const uint64_t tail = m_ready.tail.load(std::memory_order_acquire);
+    const uint64_t head = m_ready.head.load(std::memory_order_acquire);
+    stats.depth = static_cast<size_t>(tail - std::min(head, tail));
+    stats.capacity = m_slots.size();
+    return stats;
+}
@@ -0,0 +1,98 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "frame.h"
+
+// ------------------------------------------------------------------
+// FrameRing
+// Preallocated ring of frame slots between one producer (the
+// acquisition callback) and one consumer, modelled on the destination
+// buffer ring of Acquisition_DefineDestBuffers / HIS_SEQ_CONTINUOUS.
+// Slots carry FrameRefs from a FramePool, so handing a frame over moves
+// a reference rather than pixels. The ring keeps its pool alive, so
+// frames still queued when the producer goes away remain valid.
+//
+// Slot indices circulate through two bounded index queues: 'free'
+// (consumer -> producer) and 'ready' (producer -> consumer). Both are
+// driven by monotonically increasing atomic sequence counters, so no
+// locks are taken and no memory is allocated after construction.
+//
+// When every slot is filled and the consumer falls behind, the overrun
+// policy decides what happens:
+//  - DropOldest: the producer reclaims the oldest unread slot and drops
+//    its frame (counted in Stats::dropped) so acquisition never stalls.
+//  - Block: the producer waits until the consumer releases a slot
+//    (counted in Stats::blocked).
+// ------------------------------------------------------------------
+class FrameRing {
+public:
+    enum class OverrunPolicy { DropOldest, Block };
+
+    struct Slot {
+        FrameRef frame;
+        uint64_t sequence = 0;      // position in the stream, assigned on publish
+        uint32_t index = 0;
+    };
+
+    struct Stats {
+        uint64_t produced = 0;
+        uint64_t consumed = 0;
+        uint64_t dropped = 0;
+        uint64_t blocked = 0;
+        size_t depth = 0;
+        size_t capacity = 0;
+    };
+
+    FrameRing(size_t slots, std::shared_ptr<FramePool> pool, OverrunPolicy policy);
+
+    FrameRing(const FrameRing &) = delete;
+    FrameRing &operator=(const FrameRing &) = delete;
+
+    FramePool &pool() const { return *m_pool; }
+    size_t capacity() const { return m_slots.size(); }
+    OverrunPolicy policy() const { return m_policy; }
+
+    // Producer side. acquireWrite returns nullptr only if the policy is
+    // Block and 'cancel' becomes true while waiting.
+    Slot *acquireWrite(const std::atomic<bool> *cancel = nullptr);
+    void publish(Slot *slot);
+
+    // Consumer side. The consumer may hold several slots at once but must
+    // release each of them; it may move the frame out before releasing.
+    Slot *tryAcquireRead();
+    void release(Slot *slot);
+
+    Stats stats() const;
+
+private:
+    // Bounded queue of slot indices. A queue never holds more than
+    // capacity() entries because only that many indices exist.
+    struct IndexQueue {
+        std::unique_ptr<std::atomic<uint32_t>[]> items;
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+    };
+
+    static void push(IndexQueue &queue, size_t capacity, uint32_t index);
+    static bool pop(IndexQueue &queue, size_t capacity, uint32_t *index);
+
+    const std::shared_ptr<FramePool> m_pool;   // declared first: outlives m_slots
+    const OverrunPolicy m_policy;
+    std::vector<Slot> m_slots;
+    IndexQueue m_free;
+    IndexQueue m_ready;
+    uint64_t m_nextSequence = 0;
+
+    alignas(64) std::atomic<uint64_t> m_produced{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_blocked{0};
+    alignas(64) std::atomic<uint64_t> m_consumed{0};
+};
+
+#endif // FRAMERING_H
@@ -0,0 +1,358 @@
+#include "framestatistics.h"
+#include "accumulate.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// Pixels per kernel call: small enough that the moments kernel and the
+// histogram update read the same block out of L1, and that neither the
+// 32-bit partial sums nor the 64-bit squares of 24-bit pixels overflow.
+constexpr size_t kBlockPixels = 4096;
+
+struct Moments {
+    uint32_t min = 0xFFFFFFFFu;
+    uint32_t max = 0;
+    uint64_t sum = 0;
+    uint64_t squares = 0;
+};
+
+template <typename T>
+void momentsScalar(const T *pixels, size_t begin, size_t count, Moments &m)
+{
+    for (size_t i = begin; i < count; ++i) {
+        const uint32_t v = pixels[i];
+        m.min = std::min(m.min, v);
+        m.max = std::max(m.max, v);
+        m.sum += v;
+        m.squares += static_cast<uint64_t>(v) * v;
+    }
+}
+
+// Folds a kernel's vector accumulators, stored and widened, into 'm'.
+void foldLanes(const uint32_t *mins, const uint32_t *maxs, size_t minMaxLanes, const uint64_t *sums,
+               const uint64_t *squares, size_t sumLanes, Moments &m)
+{
+    for (size_t k = 0; k < minMaxLanes; ++k) {
+        m.min = std::min(m.min, mins[k]);
+        m.max = std::max(m.max, maxs[k]);
+    }
+    for (size_t k = 0; k < sumLanes; ++k) {
+        m.sum += sums[k];
+        m.squares += squares[k];
+    }
+}
+
+#if DAQ_SIMD_X86
+DAQ_TARGET_AVX2
+void momentsAvx2(const uint16_t *pixels, size_t count, Moments &m)
+{
+    const __m256i low32 = _mm256_set1_epi64x(0xFFFFFFFF);
+    __m256i lo = _mm256_set1_epi16(-1), hi = _mm256_setzero_si256();
+    __m256i sum = _mm256_setzero_si256(), squares = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + i));
+        lo = _mm256_min_epu16(lo, v);
+        hi = _mm256_max_epu16(hi, v);
+        const __m256i a = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        const __m256i b = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        sum = _mm256_add_epi32(sum, _mm256_add_epi32(a, b));
+        // A 16-bit square fits 32 bits; widen pairs of them to 64.
+        const __m256i qa = _mm256_mullo_epi32(a, a);
+        const __m256i qb = _mm256_mullo_epi32(b, b);
+        squares = _mm256_add_epi64(squares, _mm256_add_epi64(_mm256_and_si256(qa, low32), _mm256_srli_epi64(qa, 32)));
+        squares = _mm256_add_epi64(squares, _mm256_add_epi64(_mm256_and_si256(qb, low32), _mm256_srli_epi64(qb, 32)));
+    }
+    if (i) {
+        alignas(32) uint16_t mins16[16], maxs16[16];
+        alignas(32) uint32_t sums32[8];
+        alignas(32) uint64_t squares64[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(mins16), lo);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(maxs16), hi);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(sums32), sum);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(squares64), squares);
+        uint32_t mins[16], maxs[16];
+        uint64_t sums[8] = {}, sq[8] = {};
+        std::copy(mins16, mins16 + 16, mins);
+        std::copy(maxs16, maxs16 + 16, maxs);
+        std::copy(sums32, sums32 + 8, sums);
+        std::copy(squares64, squares64 + 4, sq);
+        foldLanes(mins, maxs, 16, sums, sq, 8, m);
+    }
+    momentsScalar(pixels, i, count, m);
+}
+
+DAQ_TARGET_AVX2
+void momentsAvx2(const uint32_t *pixels, size_t count, Moments &m)
+{
+    const __m256i low32 = _mm256_set1_epi64x(0xFFFFFFFF);
+    __m256i lo = _mm256_set1_epi32(-1), hi = _mm256_setzero_si256();
+    __m256i sum = _mm256_setzero_si256(), squares = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + i));
+        lo = _mm256_min_epu32(lo, v);
+        hi = _mm256_max_epu32(hi, v);
+        const __m256i odd = _mm256_srli_epi64(v, 32);
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_and_si256(v, low32), odd));
+        squares = _mm256_add_epi64(squares, _mm256_add_epi64(_mm256_mul_epu32(v, v), _mm256_mul_epu32(odd, odd)));
+    }
+    if (i) {
+        alignas(32) uint32_t mins[8], maxs[8];
+        alignas(32) uint64_t sums[4], sq[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(mins), lo);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(maxs), hi);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(sums), sum);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(sq), squares);
+        foldLanes(mins, maxs, 8, sums, sq, 4, m);
+    }
+    momentsScalar(pixels, i, count, m);
+}
+
+DAQ_TARGET_SSE41
+void momentsSse41(const uint16_t *pixels, size_t count, Moments &m)
+{
+    const __m128i low32 = _mm_set1_epi64x(0xFFFFFFFF);
+    __m128i lo = _mm_set1_epi16(-1), hi = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128(), squares = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i));
+        lo = _mm_min_epu16(lo, v);
+        hi = _mm_max_epu16(hi, v);
+        const __m128i a = _mm_cvtepu16_epi32(v);
+        const __m128i b = _mm_cvtepu16_epi32(_mm_srli_si128(v, 8));
+        sum = _mm_add_epi32(sum, _mm_add_epi32(a, b));
+        const __m128i qa = _mm_mullo_epi32(a, a);
+        const __m128i qb = _mm_mullo_epi32(b, b);
+        squares = _mm_add_epi64(squares, _mm_add_epi64(_mm_and_si128(qa, low32), _mm_srli_epi64(qa, 32)));
+        squares = _mm_add_epi64(squares, _mm_add_epi64(_mm_and_si128(qb, low32), _mm_srli_epi64(qb, 32)));
+    }
+    if (i) {
+        alignas(16) uint16_t mins16[8], maxs16[8];
+        alignas(16) uint32_t sums32[4];
+        alignas(16) uint64_t squares64[2];
+        _mm_store_si128(reinterpret_cast<__m128i *>(mins16), lo);
+        _mm_store_si128(reinterpret_cast<__m128i *>(maxs16), hi);
+        _mm_store_si128(reinterpret_cast<__m128i *>(sums32), sum);
+        _mm_store_si128(reinterpret_cast<__m128i *>(squares64), squares);
+        uint32_t mins[8], maxs[8];
+        uint64_t sums[4] = {}, sq[4] = {};
+        std::copy(mins16, mins16 + 8, mins);
+        std::copy(maxs16, maxs16 + 8, maxs);
+        std::copy(sums32, sums32 + 4, sums);
+        std::copy(squares64, squares64 + 2, sq);
+        foldLanes(mins, maxs, 8, sums, sq, 4, m);
+    }
+    momentsScalar(pixels, i, count, m);
+}
+
+DAQ_TARGET_SSE41
+void momentsSse41(const uint32_t *pixels, size_t count, Moments &m)
+{
+    const __m128i low32 = _mm_set1_epi64x(0xFFFFFFFF);
+    __m128i lo = _mm_set1_epi32(-1), hi = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128(), squares = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i));
+        lo = _mm_min_epu32(lo, v);
+        hi = _mm_max_epu32(hi, v);
+        const __m128i odd = _mm_srli_epi64(v, 32);
+        sum = _mm_add_epi64(sum, _mm_add_epi64(_mm_and_si128(v, low32), odd));
+        squares = _mm_add_epi64(squares, _mm_add_epi64(_mm_mul_epu32(v, v), _mm_mul_epu32(odd, odd)));
+    }
+    if (i) {
+        alignas(16) uint32_t mins[4], maxs[4];
+        alignas(16) uint64_t sums[2], sq[2];
+        _mm_store_si128(reinterpret_cast<__m128i *>(mins), lo);
+        _mm_store_si128(reinterpret_cast<__m128i *>(maxs), hi);
+        _mm_store_si128(reinterpret_cast<__m128i *>(sums), sum);
+        _mm_store_si128(reinterpret_cast<__m128i *>(sq), squares);
+        foldLanes(mins, maxs, 4, sums, sq, 2, m);
+    }
+    momentsScalar(pixels, i, count, m);
+}
+#endif
+
+template <typename T>
+void moments(const T *pixels, size_t count, Moments &m)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  momentsAvx2(pixels, count, m); return;
+    case simd::Level::Sse41: momentsSse41(pixels, count, m); return;
+    default: break;
+    }
+#endif
+    momentsScalar(pixels, 0, count, m);
+}
+
+// Even and odd pixels count into separate histograms, so a run of equal
+// values (a flat region) does not serialise on one counter.
+void addToHistogram(const uint16_t *pixels, size_t count, unsigned, uint32_t *even, uint32_t *odd)
+{
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        ++even[pixels[i]];
+        ++odd[pixels[i + 1]];
+    }
+    if (i < count)
+        ++even[pixels[i]];
+}
+
+void addToHistogram(const uint32_t *pixels, size_t count, unsigned shift, uint32_t *even, uint32_t *odd)
+{
+    const uint32_t last = FrameStatistics::kBins - 1;
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        ++even[std::min(pixels[i] >> shift, last)];
+        ++odd[std::min(pixels[i + 1] >> shift, last)];
+    }
+    if (i < count)
+        ++even[std::min(pixels[i] >> shift, last)];
+}
+
+// The bin holding the value of rank 'rank' (0-based, ascending).
+uint32_t binOfRank(const uint32_t *histogram, uint64_t rank)
+{
+    uint64_t seen = 0;
+    for (uint32_t v = 0; v < FrameStatistics::kBins; ++v) {
+        seen += histogram[v];
+        if (seen > rank)
+            return v;
+    }
+    return FrameStatistics::kBins - 1;
+}
+
+} // namespace
+
+bool FrameStatistics::configure(const Options &options, unsigned rows, unsigned columns)
+{
+    m_options = options;
+    m_error.clear();
+    m_results.clear();
+    if (!options.enabled)
+        return true;
+    std::vector<Roi> regions = options.regions;
+    if (regions.empty())
+        regions.push_back(Roi());
+    for (const Roi &roi : regions) {
+        if (roi.x >= columns || roi.y >= rows) {
+            m_error = "region origin (" + std::to_string(roi.x) + ", " + std::to_string(roi.y)
+                      + ") is outside the " + std::to_string(columns) + " x " + std::to_string(rows) + " frame";
+            m_results.clear();
+            m_histograms.clear();
+            m_odd.clear();
+            return false;
+        }
+        Result result;
+        result.region.x = roi.x;
+        result.region.y = roi.y;
+        result.region.width = roi.width ? std::min(roi.width, columns - roi.x) : columns - roi.x;
+        result.region.height = roi.height ? std::min(roi.height, rows - roi.y) : rows - roi.y;
+        m_results.push_back(result);
+    }
+    m_histograms.assign(m_results.size() * kBins, 0);
+    m_odd.assign(kBins, 0);
+    return true;
+}
+
+void FrameStatistics::compute(const Frame &frame)
+{
+    if (!isActive())
+        return;
+    const unsigned shift = frame.is32Bit() && frame.bits > 16 ? frame.bits - 16 : 0;
+    for (size_t k = 0; k < m_results.size(); ++k) {
+        if (frame.is32Bit())
+            computeRegion(frame.pixels32(), frame.columns(), shift, k);
+        else
+            computeRegion(frame.pixels16(), frame.columns(), 0, k);
+    }
+}
+
+template <typename T>
+void FrameStatistics::computeRegion(const T *pixels, unsigned columns, unsigned shift, size_t region)
+{
+    Result &result = m_results[region];
+    const Roi &roi = result.region;
+    uint32_t *histogram = m_histograms.data() + region * kBins;
+    std::fill(histogram, histogram + kBins, 0u);
+
+    Moments total;
+    double squares = 0;
+    for (unsigned y = 0; y < roi.height; ++y) {
+        const T *row = pixels + static_cast<size_t>(roi.y + y) * columns + roi.x;
+        for (size_t x = 0; x < roi.width; x += kBlockPixels) {
+            const size_t count = std::min<size_t>(kBlockPixels, roi.width - x);
+            Moments block;
+            moments(row + x, count, block);
+            addToHistogram(row + x, count, shift, histogram, m_odd.data());
+            total.min = std::min(total.min, block.min);
+            total.max = std::max(total.max, block.max);
+            total.sum += block.sum;
+            squares += static_cast<double>(block.squares);
+        }
+    }
+    accumulate::add(histogram, m_odd.data(), kBins);
+    std::fill(m_odd.begin(), m_odd.end(), 0u);
+
+    FrameSummary &summary = result.summary;
+    summary.valid = true;
+    summary.pixels = static_cast<uint64_t>(roi.width) * roi.height;
+    summary.min = total.min;
+    summary.max = total.max;
+    summary.mean = static_cast<double>(total.sum) / summary.pixels;
+    summary.std = std::sqrt(std::max(0.0, squares / summary.pixels - summary.mean * summary.mean));
+    summary.binShift = shift;
+    // The same median as the HIS writers' own: the value of rank n / 2.
+    summary.median = binOfRank(histogram, summary.pixels / 2) << shift;
+    summary.low = percentile(histogram, summary.pixels, m_options.lowPercentile) << shift;
+    summary.high = percentile(histogram, summary.pixels, m_options.highPercentile) << shift;
+}
+
+uint32_t FrameStatistics::percentile(const uint32_t *histogram, uint64_t count, double percentile)
+{
+    if (count == 0)
+        return 0;
+    const double p = std::clamp(percentile, 0.0, 100.0) / 100.0;
+    return binOfRank(histogram, static_cast<uint64_t>(p * static_cast<double>(count - 1)));
+}
+
+bool FrameStatistics::parse(const std::string &text, Options *options)
+{
+    Options parsed;
+    const size_t colon = text.find(':');
+    const std::string regions = text.substr(0, colon);
+    if (colon != std::string::npos) {
+        char tail = 0;
+        if (std::sscanf(text.c_str() + colon + 1, "%lf,%lf%c", &parsed.lowPercentile, &parsed.highPercentile,
+                        &tail) != 2
+            || !(parsed.lowPercentile >= 0 && parsed.lowPercentile <= parsed.highPercentile
+                 && parsed.highPercentile <= 100))
+            return false;
+    }
+    if (regions == "off") {
+        parsed.enabled = false;
+    } else if (regions != "on" && !regions.empty()) {
+        size_t begin = 0;
+        for (;;) {
+            const size_t end = regions.find(';', begin);
+            Roi roi;
+            char tail = 0;
+            if (std::sscanf(regions.substr(begin, end - begin).c_str(), "%u,%u,%u,%u%c", &roi.x, &roi.y,
+                            &roi.width, &roi.height, &tail) != 4)
+                return false;
+            parsed.regions.push_back(roi);
+            if (end == std::string::npos)
+                break;
+            begin = end + 1;
+        }
+    }
+    *options = parsed;
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef FRAMESTATISTICS_H
+#define FRAMESTATISTICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame.h"
+#include "framebinner.h"
+
+// ------------------------------------------------------------------
+// FrameStatistics
+// Per-frame statistics for exposure feedback, the live view's automatic
+// window/level and the HIS header's wMedianValue, in one pass over the
+// pixels: each row of a region is read once, while it is in L1, by a
+// SIMD kernel for min, max, sum and sum of squares and by the histogram
+// update. The median and the percentile clip points then come from the
+// 65536-bin histogram without touching the pixels again.
+//
+// Regions are rectangles in the frame's (delivered) pixels, clamped to
+// it; without any, the whole frame is the one region. 32-bit frames are
+// binned into the histogram by 2^(bits - 16) (FrameSummary::binShift);
+// min, max, mean and std stay exact for pixels of up to 24 bits.
+// configure() allocates every buffer, so compute() never does.
+//
+// Not thread-safe; the acquisition callback is its only user.
+// ------------------------------------------------------------------
+class FrameStatistics {
+public:
+    using Roi = FrameBinner::Roi;
+
+    struct Options {
+        bool enabled = true;
+        std::vector<Roi> regions;       // empty: the whole frame
+        double lowPercentile = 0.5;     // clip points for window/level
+        double highPercentile = 99.5;
+    };
+
+    struct Result {
+        Roi region;                     // as clamped
+        FrameSummary summary;
+    };
+
+    // Returns false, with error() set, when a region's origin is off
+    // the frame; the statistics are then off.
+    bool configure(const Options &options, unsigned rows, unsigned columns);
+    const Options &options() const { return m_options; }
+    const std::string &error() const { return m_error; }
+    bool isActive() const { return m_options.enabled && !m_results.empty(); }
+
+    // 'frame' has the configured geometry.
+    void compute(const Frame &frame);
+    // Of the last compute(), one per region.
+    const std::vector<Result> &results() const { return m_results; }
+    // The last frame's histogram of 'region': 65536 counts.
+    const uint32_t *histogram(size_t region) const { return m_histograms.data() + region * kBins; }
+
+    // The value at 'percentile' (0..100) of a histogram of 'count' values.
+    static uint32_t percentile(const uint32_t *histogram, uint64_t count, double percentile);
+    // "off", "on" or regions "x,y,w,h[;x,y,w,h...]"; ":low,high"
+    // appended sets the clip percentiles, e.g. "on:1,99".
+    static bool parse(const std::string &text, Options *options);
+
+    static constexpr size_t kBins = 65536;
+
+private:
+    template <typename T>
+    void computeRegion(const T *pixels, unsigned columns, unsigned shift, size_t region);
+
+    Options m_options;
+    std::string m_error;
+    std::vector<Result> m_results;
+    std::vector<uint32_t> m_histograms; // kBins per region
+    std::vector<uint32_t> m_odd;        // second histogram for odd pixels
+};
+
+#endif // FRAMESTATISTICS_H
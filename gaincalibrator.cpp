@@ -0,0 +1,269 @@
+#include "gaincalibrator.h"
+#include "accumulate.h"
+#include "correction.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Least-squares gain through the origin over all levels, in Q16:
+// gain = sum(average_k * flat_k) / sum(flat_k^2), rounded. The double
+// arithmetic is done in the same order on every path, so the kernels
+// agree bit for bit.
+void leastSquaresGainScalar(const uint32_t *const *flats, const double *averages, unsigned levels,
+                            uint32_t *gain, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i) {
+        double numerator = 0;
+        double denominator = 0;
+        for (unsigned k = 0; k < levels; ++k) {
+            const double flat = static_cast<double>(static_cast<int32_t>(flats[k][i]));
+            numerator += averages[k] * flat;
+            denominator += flat * flat;
+        }
+        if (denominator == 0) {
+            gain[i] = 0;
+            continue;
+        }
+        const double q = std::floor(numerator * 65536.0 / denominator + 0.5);
+        gain[i] = static_cast<uint32_t>(std::min(q, 4294967295.0));
+    }
+}
+
+#if DAQ_SIMD_X86
+DAQ_TARGET_AVX2
+void leastSquaresGainAvx2(const uint32_t *const *flats, const double *averages, unsigned levels,
+                          uint32_t *gain, size_t count)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d scale = _mm256_set1_pd(65536.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d limit = _mm256_set1_pd(4294967295.0);
+    const __m256d bias = _mm256_set1_pd(2147483648.0);
+    const __m128i signBit = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d numerator = zero;
+        __m256d denominator = zero;
+        for (unsigned k = 0; k < levels; ++k) {
+            const __m256d flat = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i *>(flats[k] + i)));
+            numerator = _mm256_add_pd(numerator, _mm256_mul_pd(_mm256_set1_pd(averages[k]), flat));
+            denominator = _mm256_add_pd(denominator, _mm256_mul_pd(flat, flat));
+        }
+        const __m256d q = _mm256_floor_pd(
+            _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(numerator, scale), denominator), half));
+        const __m128i fitted = _mm_xor_si128(_mm256_cvttpd_epi32(_mm256_sub_pd(_mm256_min_pd(q, limit), bias)),
+                                             signBit);
+        const __m256d empty = _mm256_cmp_pd(denominator, zero, _CMP_EQ_OQ);
+        const __m128i emptyMask = _mm256_cvtpd_epi32(_mm256_and_pd(empty, _mm256_set1_pd(-1.0)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gain + i), _mm_andnot_si128(emptyMask, fitted));
+    }
+    leastSquaresGainScalar(flats, averages, levels, gain, i, count);
+}
+
+DAQ_TARGET_SSE41
+void leastSquaresGainSse41(const uint32_t *const *flats, const double *averages, unsigned levels,
+                           uint32_t *gain, size_t count)
+{
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d scale = _mm_set1_pd(65536.0);
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d limit = _mm_set1_pd(4294967295.0);
+    const __m128d bias = _mm_set1_pd(2147483648.0);
+    const __m128i signBit = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d numerator = zero;
+        __m128d denominator = zero;
+        for (unsigned k = 0; k < levels; ++k) {
+            const __m128d flat = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(flats[k] + i)));
+            numerator = _mm_add_pd(numerator, _mm_mul_pd(_mm_set1_pd(averages[k]), flat));
+            denominator = _mm_add_pd(denominator, _mm_mul_pd(flat, flat));
+        }
+        const __m128d q = _mm_floor_pd(_mm_add_pd(_mm_div_pd(_mm_mul_pd(numerator, scale), denominator), half));
+        const __m128i fitted = _mm_xor_si128(_mm_cvttpd_epi32(_mm_sub_pd(_mm_min_pd(q, limit), bias)), signBit);
+        const __m128d empty = _mm_cmpeq_pd(denominator, zero);
+        const __m128i emptyMask = _mm_cvtpd_epi32(_mm_and_pd(empty, _mm_set1_pd(-1.0)));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(gain + i), _mm_andnot_si128(emptyMask, fitted));
+    }
+    leastSquaresGainScalar(flats, averages, levels, gain, i, count);
+}
+#endif
+
+void leastSquaresGain(const uint32_t *const *flats, const double *averages, unsigned levels,
+                      uint32_t *gain, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  leastSquaresGainAvx2(flats, averages, levels, gain, count); return;
+    case simd::Level::Sse41: leastSquaresGainSse41(flats, averages, levels, gain, count); return;
+    default: break;
+    }
+#endif
+    leastSquaresGainScalar(flats, averages, levels, gain, 0, count);
+}
+
+} // namespace
+
+GainCalibrator::GainCalibrator(unsigned rows, unsigned columns)
+    : m_rows(rows), m_columns(columns)
+{
+}
+
+size_t GainCalibrator::memoryBytes() const
+{
+    size_t bytes = m_sum.capacity() * sizeof(uint32_t);
+    for (const Level &level : m_levels)
+        bytes += level.flat.capacity() * sizeof(uint32_t);
+    return bytes;
+}
+
+void GainCalibrator::reset()
+{
+    m_frames = 0;
+    std::vector<uint32_t>().swap(m_sum);
+    m_levels.clear();
+}
+
+void GainCalibrator::beginLevel()
+{
+    m_frames = 0;
+}
+
+void GainCalibrator::add(const uint16_t *frame)
+{
+    if (m_frames == 0)
+        m_sum.assign(frame, frame + pixelCount());
+    else
+        accumulate::add(m_sum.data(), frame, pixelCount());
+    ++m_frames;
+}
+
+void GainCalibrator::add(const uint32_t *frame)
+{
+    if (m_frames == 0)
+        m_sum.assign(frame, frame + pixelCount());
+    else
+        accumulate::add(m_sum.data(), frame, pixelCount());
+    ++m_frames;
+}
+
+bool GainCalibrator::endLevel(ThreadPool &pool, const uint16_t *offsetMap)
+{
+    return closeLevel(pool, offsetMap);
+}
+
+bool GainCalibrator::endLevel32(ThreadPool &pool, const uint32_t *offsetMap)
+{
+    return closeLevel(pool, offsetMap);
+}
+
+size_t GainCalibrator::bandPixels() const
+{
+    // 64 rows keeps a band's sum and flat in L2 on typical panels.
+    return std::max<size_t>(static_cast<size_t>(m_columns) * 64, 1);
+}
+
+template <typename T>
+bool GainCalibrator::closeLevel(ThreadPool &pool, const T *offsetMap)
+{
+    if (m_frames == 0)
+        return false;
+    const size_t count = pixelCount();
+    const size_t span = bandPixels();
+    const size_t bands = (count + span - 1) / span;
+    const uint32_t frames = m_frames;
+    const uint32_t half = frames / 2;
+
+    Level level;
+    level.flat.resize(count);
+    std::vector<uint64_t> bandTotals(bands, 0);
+    pool.parallelFor(bands, [&](size_t b) {
+        const size_t begin = b * span;
+        const size_t n = std::min(span, count - begin);
+        uint32_t *sum = m_sum.data() + begin;
+        uint32_t *flat = level.flat.data() + begin;
+        // Rounded mean; the sum is consumed here.
+        for (size_t i = 0; i < n; ++i)
+            sum[i] = sum[i] > 0xFFFFFFFFu - half ? 0xFFFFFFFFu : sum[i] + half;
+        accumulate::mean(sum, flat, n, frames);
+        uint64_t total = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (offsetMap)
+                flat[i] = flat[i] > offsetMap[begin + i] ? flat[i] - offsetMap[begin + i] : 0;
+            total += flat[i];
+        }
+        bandTotals[b] = total;
+    });
+
+    uint64_t total = 0;
+    for (uint64_t t : bandTotals)
+        total += t;
+    level.average = static_cast<uint32_t>((total + count / 2) / std::max<size_t>(count, 1));
+
+    const auto position = std::upper_bound(m_levels.begin(), m_levels.end(), level.average,
+                                           [](uint32_t average, const Level &l) { return average < l.average; });
+    m_levels.insert(position, std::move(level));
+    m_frames = 0;
+    std::vector<uint32_t>().swap(m_sum);
+    return true;
+}
+
+bool GainCalibrator::gainDataEx(uint16_t *flats, uint16_t *averages) const
+{
+    if (m_levels.empty())
+        return false;
+    const size_t count = pixelCount();
+    for (size_t k = 0; k < m_levels.size(); ++k) {
+        const uint32_t *flat = m_levels[k].flat.data();
+        uint16_t *out = flats + k * count;
+        for (size_t i = 0; i < count; ++i)
+            out[i] = static_cast<uint16_t>(std::min<uint32_t>(flat[i], 0xFFFF));
+        averages[k] = static_cast<uint16_t>(std::min<uint32_t>(m_levels[k].average, 0xFFFF));
+    }
+    return true;
+}
+
+bool GainCalibrator::gainDataEx32(uint32_t *flats, uint32_t *averages) const
+{
+    if (m_levels.empty())
+        return false;
+    const size_t count = pixelCount();
+    for (size_t k = 0; k < m_levels.size(); ++k) {
+        std::copy(m_levels[k].flat.begin(), m_levels[k].flat.end(), flats + k * count);
+        averages[k] = m_levels[k].average;
+    }
+    return true;
+}
+
+bool GainCalibrator::gainMap(uint32_t *gainMap, ThreadPool &pool) const
+{
+    if (m_levels.empty())
+        return false;
+    const size_t count = pixelCount();
+    const size_t span = bandPixels();
+    const unsigned levelCount = levels();
+    std::vector<double> averages(levelCount);
+    for (unsigned k = 0; k < levelCount; ++k)
+        averages[k] = m_levels[k].average;
+
+    pool.parallelFor((count + span - 1) / span, [&](size_t b) {
+        const size_t begin = b * span;
+        const size_t n = std::min(span, count - begin);
+        if (levelCount == 1) {
+            // Exact integer form, identical to CorrectionEngine::setGainEx.
+            const uint32_t average = m_levels[0].average;
+            correction::gainSegmentsFromEx32(m_levels[0].flat.data() + begin, &average, 1, count,
+                                             gainMap + begin, nullptr, nullptr, n);
+            return;
+        }
+        std::vector<const uint32_t *> flats(levelCount);
+        for (unsigned k = 0; k < levelCount; ++k)
+            flats[k] = m_levels[k].flat.data() + begin;
+        leastSquaresGain(flats.data(), averages.data(), levelCount, gainMap + begin, n);
+    });
+    return true;
+}
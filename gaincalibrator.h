@@ -0,0 +1,79 @@
+#ifndef GAINCALIBRATOR_H
+#define GAINCALIBRATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// ------------------------------------------------------------------
+// GainCalibrator
+// In-tree replacement for Acquisition_Acquire_GainImage(_Ex) and
+// Acquisition_CreateGainMap. Flat-field frames are streamed into a
+// 32-bit running sum, one exposure level at a time; endLevel() turns the
+// sum into the offset-corrected mean flat of that level and its average.
+// From the collected levels it produces
+//  - the _Ex pair (flat images + averages, ascending) for
+//    CorrectionEngine::setGainEx, which fits the multi-point
+//    (HIS_SEQ_NONLINEAR style) piecewise-linear gain, and
+//  - a single DWORD Q16 gain map: flat * gain = average for one level,
+//    the least-squares line through the origin for several.
+//
+// Memory is 4 bytes per pixel for the running sum plus 4 per level.
+// Per-level reduction and the gain-map fit run in bands on a ThreadPool
+// with AVX2 / SSE4.1 / scalar kernels. Not thread-safe otherwise.
+// ------------------------------------------------------------------
+class GainCalibrator {
+public:
+    GainCalibrator(unsigned rows, unsigned columns);
+
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    size_t pixelCount() const { return static_cast<size_t>(m_rows) * m_columns; }
+    unsigned levels() const { return static_cast<unsigned>(m_levels.size()); }
+    uint32_t framesInLevel() const { return m_frames; }
+    size_t memoryBytes() const;
+
+    // Drops all levels.
+    void reset();
+
+    // Starts a new level (discarding frames of an unfinished one). All
+    // frames of a level must have the same depth.
+    void beginLevel();
+    void add(const uint16_t *frame);
+    void add(const uint32_t *frame);
+    // Closes the level: mean flat minus 'offsetMap' (may be nullptr).
+    // Returns false, adding nothing, when the level has no frames.
+    bool endLevel(ThreadPool &pool, const uint16_t *offsetMap);
+    bool endLevel32(ThreadPool &pool, const uint32_t *offsetMap);
+
+    // Levels are kept sorted by average, darkest first.
+    uint32_t levelAverage(unsigned level) const { return m_levels[level].average; }
+    const uint32_t *levelFlat(unsigned level) const { return m_levels[level].flat.data(); }
+
+    // Level-major flats (levels() * pixelCount()) and levels() averages.
+    // The 16-bit variant clamps to 65535. False without levels.
+    bool gainDataEx(uint16_t *flats, uint16_t *averages) const;
+    bool gainDataEx32(uint32_t *flats, uint32_t *averages) const;
+
+    bool gainMap(uint32_t *gainMap, ThreadPool &pool) const;
+
+private:
+    struct Level {
+        std::vector<uint32_t> flat;
+        uint32_t average;
+    };
+
+    template <typename T>
+    bool closeLevel(ThreadPool &pool, const T *offsetMap);
+    size_t bandPixels() const;
+
+    const unsigned m_rows;
+    const unsigned m_columns;
+    uint32_t m_frames = 0;
+    std::vector<uint32_t> m_sum;
+    std::vector<Level> m_levels;
+};
+
+#endif // GAINCALIBRATOR_H
@@ -0,0 +1,190 @@
+#include "hisreader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+constexpr WORD kFileType = 0x7000;
+constexpr size_t kMinimumHeaderBytes = 68;
+
+size_t pixelBytes(WORD typeOfNumbers)
+{
+    switch (typeOfNumbers & ~PKI_SIGNED) {
+    case PKI_SHORT:  return 2;
+    case PKI_LONG:   return 4;
+    case PKI_DOUBLE: return 8;
+    default:         return 0;
+    }
+}
+
+#ifndef _WIN32
+size_t pageSize()
+{
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+#endif
+
+} // namespace
+
+HisReader::~HisReader()
+{
+    close();
+}
+
+bool HisReader::open(const std::string &path)
+{
+    close();
+    m_error.clear();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return fail("cannot open " + path);
+    m_fileHandle = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+        return fail("cannot size " + path);
+    m_size = static_cast<uint64_t>(size.QuadPart);
+    if (m_size < kMinimumHeaderBytes)
+        return fail(path + " is too short for a .his header");
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+        return fail("cannot map " + path);
+    m_mappingHandle = mapping;
+    m_base = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_base)
+        return fail("cannot map " + path);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return fail("cannot open " + path + ": " + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        const int saved = errno;
+        ::close(fd);
+        return fail("cannot size " + path + ": " + std::strerror(saved));
+    }
+    m_size = static_cast<uint64_t>(st.st_size);
+    if (m_size < kMinimumHeaderBytes) {
+        ::close(fd);
+        return fail(path + " is too short for a .his header");
+    }
+    // The mapping keeps the file referenced; the descriptor is not needed.
+    void *base = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    const int saved = errno;
+    ::close(fd);
+    if (base == MAP_FAILED)
+        return fail("cannot map " + path + ": " + std::strerror(saved));
+    m_base = static_cast<const uint8_t *>(base);
+#endif
+
+    // Version 100 headers have no wMedianValue; it reads as padding (0).
+    std::memcpy(&m_header, m_base, sizeof(m_header));
+    if (m_header.FileType != kFileType)
+        return fail(path + " is not a .his file");
+    m_dataOffset = static_cast<size_t>(m_header.HeaderSize) + m_header.ImageHeaderSize;
+    if (m_header.HeaderSize < kMinimumHeaderBytes || m_dataOffset > m_size)
+        return fail(path + " has a damaged header");
+    if (m_header.BRX < m_header.ULX || m_header.BRY < m_header.ULY)
+        return fail(path + " has an empty image rectangle");
+    m_columns = static_cast<unsigned>(m_header.BRX - m_header.ULX) + 1;
+    m_rows = static_cast<unsigned>(m_header.BRY - m_header.ULY) + 1;
+    m_dataType = static_cast<XIS_FileType>(m_header.TypeOfNumbers);
+    m_bytesPerPixel = pixelBytes(m_header.TypeOfNumbers);
+    if (m_bytesPerPixel == 0)
+        return fail(path + " holds an unsupported pixel type " + std::to_string(m_header.TypeOfNumbers));
+    m_frameBytes = static_cast<size_t>(m_rows) * m_columns * m_bytesPerPixel;
+
+    m_frames = static_cast<size_t>((m_size - m_dataOffset) / m_frameBytes);
+    if (m_header.NrOfFrames > 0 && m_header.NrOfFrames < 0xFFFF)
+        m_frames = std::min<size_t>(m_frames, m_header.NrOfFrames);
+    return true;
+}
+
+void HisReader::close()
+{
+    unmap();
+    m_header = WinHeaderType101();
+    m_size = 0;
+    m_dataOffset = 0;
+    m_rows = m_columns = 0;
+    m_bytesPerPixel = m_frameBytes = m_frames = 0;
+}
+
+void HisReader::unmap()
+{
+#ifdef _WIN32
+    if (m_base)
+        UnmapViewOfFile(m_base);
+    if (m_mappingHandle)
+        CloseHandle(m_mappingHandle);
+    if (m_fileHandle)
+        CloseHandle(m_fileHandle);
+    m_mappingHandle = nullptr;
+    m_fileHandle = nullptr;
+#else
+    if (m_base)
+        munmap(const_cast<uint8_t *>(m_base), m_size);
+#endif
+    m_base = nullptr;
+}
+
+bool HisReader::fail(const std::string &message)
+{
+    close();
+    m_error = message;
+    return false;
+}
+
+HisReader::FrameView HisReader::frame(size_t index) const
+{
+    FrameView view;
+    if (!m_base || index >= m_frames)
+        return view;
+    view.data = m_base + m_dataOffset + index * m_frameBytes;
+    view.bytes = m_frameBytes;
+    view.rows = m_rows;
+    view.columns = m_columns;
+    view.dataType = m_dataType;
+    return view;
+}
+
+void HisReader::setAccessPattern(AccessPattern pattern) const
+{
+#ifndef _WIN32
+    if (!m_base)
+        return;
+    const int advice = pattern == AccessPattern::Sequential ? MADV_SEQUENTIAL
+                     : pattern == AccessPattern::Random     ? MADV_RANDOM
+                                                            : MADV_NORMAL;
+    madvise(const_cast<uint8_t *>(m_base), m_size, advice);
+#else
+    (void)pattern;
+#endif
+}
+
+void HisReader::prefetch(size_t first, size_t count) const
+{
+#ifndef _WIN32
+    if (!m_base || first >= m_frames || count == 0)
+        return;
+    count = std::min(count, m_frames - first);
+    const size_t begin = m_dataOffset + first * m_frameBytes;
+    const size_t end = begin + count * m_frameBytes;
+    const size_t alignedBegin = begin / pageSize() * pageSize();
+    madvise(const_cast<uint8_t *>(m_base) + alignedBegin, end - alignedBegin, MADV_WILLNEED);
+#else
+    (void)first;
+    (void)count;
+#endif
+}
@@ -0,0 +1,97 @@
+#ifndef HISREADER_H
+#define HISREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Acq.h"
+
+// ------------------------------------------------------------------
+// HisReader
+// Opens a .his sequence for review without loading it: the headers
+// (WinHeaderType, or WinHeaderType101 with wMedianValue) are parsed and
+// the file is memory-mapped, so open() costs the same for any size and
+// frame(i) returns a view straight into the mapping. Only the pages that
+// are looked at are ever read; scrubbing to frame i touches nothing
+// before it.
+//
+// The frame count comes from the file length (NrOfFrames is a WORD and
+// saturates on long recordings, see HisWriter); a smaller, unsaturated
+// NrOfFrames wins, so trailing bytes are ignored. Views stay valid
+// until close() or destruction.
+//
+// setAccessPattern() and prefetch() pass madvise hints: Sequential for
+// playback (aggressive read-ahead), Random for scrubbing, and WILLNEED
+// for the next few frames. They are no-ops where unsupported.
+// ------------------------------------------------------------------
+class HisReader {
+public:
+    enum class AccessPattern { Normal, Sequential, Random };
+
+    struct FrameView {
+        const void *data = nullptr;
+        size_t bytes = 0;
+        unsigned rows = 0;
+        unsigned columns = 0;
+        XIS_FileType dataType = PKI_SHORT;
+
+        explicit operator bool() const { return data != nullptr; }
+        size_t pixelCount() const { return static_cast<size_t>(rows) * columns; }
+        const uint16_t *pixels16() const { return static_cast<const uint16_t *>(data); }
+        const uint32_t *pixels32() const { return static_cast<const uint32_t *>(data); }
+    };
+
+    HisReader() = default;
+    ~HisReader();
+
+    HisReader(const HisReader &) = delete;
+    HisReader &operator=(const HisReader &) = delete;
+
+    // False, with error() set, if the file cannot be mapped or is not a
+    // .his sequence of a supported type (PKI_SHORT, PKI_LONG, PKI_DOUBLE
+    // and their signed variants).
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return m_base != nullptr; }
+
+    const WinHeaderType101 &header() const { return m_header; }
+    bool hasMedian() const { return m_header.HeaderVersion >= 101; }
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    XIS_FileType dataType() const { return m_dataType; }
+    size_t bytesPerPixel() const { return m_bytesPerPixel; }
+    size_t frameBytes() const { return m_frameBytes; }
+    size_t frameCount() const { return m_frames; }
+    uint64_t fileSize() const { return m_size; }
+    const std::string &error() const { return m_error; }
+
+    // Empty view when 'index' is out of range.
+    FrameView frame(size_t index) const;
+
+    void setAccessPattern(AccessPattern pattern) const;
+    // Starts reading frames [first, first + count) in the background.
+    void prefetch(size_t first, size_t count) const;
+
+private:
+    bool fail(const std::string &message);
+    void unmap();
+
+    const uint8_t *m_base = nullptr;
+    uint64_t m_size = 0;
+#ifdef _WIN32
+    void *m_fileHandle = nullptr;
+    void *m_mappingHandle = nullptr;
+#endif
+    WinHeaderType101 m_header = {};
+    size_t m_dataOffset = 0;
+    unsigned m_rows = 0;
+    unsigned m_columns = 0;
+    XIS_FileType m_dataType = PKI_SHORT;
+    size_t m_bytesPerPixel = 0;
+    size_t m_frameBytes = 0;
+    size_t m_frames = 0;
+    std::string m_error;
+};
+
+#endif // HISREADER_H
@@ -0,0 +1,508 @@
+#include "hiswriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+static_assert(sizeof(WinHeaderType101) == HisWriter::kFileHeaderBytes, "HIS file header must be 68 bytes");
+
+namespace {
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Exact median, clamped to the WORD range of wMedianValue.
+template <typename T>
+WORD medianValue(const T *pixels, size_t count)
+{
+    std::vector<uint32_t> histogram(65536, 0);
+    for (size_t i = 0; i < count; ++i)
+        ++histogram[std::min<uint32_t>(pixels[i], 0xFFFF)];
+    const size_t half = count / 2;
+    size_t seen = 0;
+    for (uint32_t v = 0; v < histogram.size(); ++v) {
+        seen += histogram[v];
+        if (seen > half)
+            return static_cast<WORD>(v);
+    }
+    return 0;
+}
+
+} // namespace
+
+HisWriter::~HisWriter()
+{
+    close();
+}
+
+bool HisWriter::open(const std::string &path, unsigned rows, unsigned columns, XIS_FileType dataType)
+{
+    if (m_open) {
+        m_error = "a file is already open";
+        return false;
+    }
+    m_error.clear();
+    m_path = path;
+    m_rows = rows;
+    m_columns = columns;
+    m_dataType = dataType;
+    m_frameBytes = static_cast<size_t>(rows) * columns * ((dataType & PKI_LONG) ? sizeof(uint32_t) : sizeof(uint16_t));
+    m_frames = 0;
+    m_integrationTimeUs = 0;
+    m_hasMedian = false;
+    m_median = 0;
+    m_failed = false;
+    m_stalls = 0;
+    m_stallMs = 0;
+
+    // O_DIRECT needs every frame to start and end on a 4 KiB boundary.
+    const Backend backend = m_options.backend;
+    if (backend != Backend::Buffered) {
+        const bool aligned = m_frameBytes % kBlockAlignment == 0;
+        if (aligned && openDirect(backend == Backend::ThreadPool ? AsyncFileWriter::Backend::ThreadPool
+                                                                 : AsyncFileWriter::Backend::IoUring))
+            return true;
+        if (backend != Backend::Auto) {
+            if (!aligned)
+                m_error = "frames of " + std::to_string(m_frameBytes) + " bytes cannot be written directly";
+            return false;
+        }
+        m_error.clear();
+    }
+    return openBuffered();
+}
+
+bool HisWriter::openBuffered()
+{
+    m_direct = false;
+    m_dataOffset = kDataOffset;
+    m_blockBytes = alignUp(std::max<size_t>(m_options.blockBytes, kBlockAlignment), kBlockAlignment);
+    const unsigned blocks = std::max(m_options.blocks, 2u);
+
+    m_file = std::fopen(m_path.c_str(), "wb");
+    if (!m_file) {
+        m_error = "cannot create " + m_path + ": " + std::strerror(errno);
+        return false;
+    }
+    // Writes are already block-sized; stdio buffering would only add a copy.
+    std::setvbuf(m_file, nullptr, _IONBF, 0);
+
+    m_storage.resize(m_blockBytes * blocks + kBlockAlignment);
+    uint8_t *base = m_storage.data();
+    base += (kBlockAlignment - reinterpret_cast<uintptr_t>(base) % kBlockAlignment) % kBlockAlignment;
+    m_free.clear();
+    m_pending.clear();
+    m_unwritten.clear();
+    for (unsigned b = 0; b < blocks; ++b)
+        m_free.push_back(base + static_cast<size_t>(b) * m_blockBytes);
+    m_stop = false;
+    m_written = 0;
+    m_writeMs = 0;
+
+    // The first block starts with the headers; they are rewritten at
+    // close() once the counts are known.
+    m_block = takeBlock();
+    std::memset(m_block, 0, kDataOffset);
+    fillHeader(m_block);
+    m_fill = kDataOffset;
+
+    m_thread = std::thread([this] { ioLoop(); });
+    m_open = true;
+    return true;
+}
+
+bool HisWriter::openDirect(AsyncFileWriter::Backend backend)
+{
+    const unsigned depth = std::max(m_options.queueDepth, 1u);
+    if (!m_async.open(m_path, backend, depth, [this](uint64_t slot, bool ok) { releaseSlot(slot, ok); })) {
+        m_error = m_async.error();
+        return false;
+    }
+    // The image header is padded out to the first 4 KiB boundary, which
+    // readers honour through ImageHeaderSize.
+    m_direct = true;
+    m_dataOffset = kBlockAlignment;
+    m_held.assign(depth, FrameRef());
+    m_heldTimestamps.assign(depth, -1);
+    m_freeSlots.clear();
+    for (unsigned s = depth; s-- > 0;)
+        m_freeSlots.push_back(s);
+
+    if (!writeDirectHeader()) {
+        m_error = m_async.error();
+        m_async.close();
+        m_direct = false;
+        return false;
+    }
+    m_open = true;
+    return true;
+}
+
+// Headers and padding fill the first block, so frames stay aligned.
+bool HisWriter::writeDirectHeader()
+{
+    alignas(kBlockAlignment) uint8_t header[kBlockAlignment] = {};
+    fillHeader(header);
+    return m_async.writeNow(header, sizeof(header), 0);
+}
+
+bool HisWriter::matches(const Frame &frame)
+{
+    if (frame.rows() != m_rows || frame.columns() != m_columns || frame.dataType() != m_dataType) {
+        m_error = "frame does not match the file's geometry or type";
+        return false;
+    }
+    return true;
+}
+
+bool HisWriter::append(const Frame &frame)
+{
+    if (!m_open || !matches(frame))
+        return false;
+    return m_direct ? appendDirect(frame.data(), nullptr, frame.timestampNs)
+                    : appendBuffered(frame.data(), frame.timestampNs);
+}
+
+bool HisWriter::append(const FrameRef &frame)
+{
+    if (!m_open || !frame || !matches(*frame))
+        return false;
+    return m_direct ? appendDirect(frame->data(), &frame, frame->timestampNs)
+                    : appendBuffered(frame->data(), frame->timestampNs);
+}
+
+bool HisWriter::append(const void *pixels)
+{
+    if (!m_open)
+        return false;
+    return m_direct ? appendDirect(pixels, nullptr, -1) : appendBuffered(pixels, -1);
+}
+
+bool HisWriter::appendBuffered(const void *pixels, int64_t timestampNs)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_failed)
+            return false;
+    }
+    noteMedian(pixels);
+
+    const uint8_t *src = static_cast<const uint8_t *>(pixels);
+    size_t left = m_frameBytes;
+    while (left > 0) {
+        if (!m_block) {
+            m_block = takeBlock();
+            if (!m_block)
+                return false;
+            m_fill = 0;
+        }
+        const size_t n = std::min(left, m_blockBytes - m_fill);
+        std::memcpy(m_block + m_fill, src, n);
+        m_fill += n;
+        src += n;
+        left -= n;
+        if (m_fill == m_blockBytes)
+            queueBlock(m_fill);
+    }
+    const uint64_t index = m_frames.fetch_add(1, std::memory_order_relaxed);
+    if (m_options.written && timestampNs >= 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_unwritten.emplace_back(kDataOffset + (index + 1) * m_frameBytes, timestampNs);
+    }
+    return true;
+}
+
+// 'frame' is null for a plain buffer, which is copied into the slot's
+// staging buffer; a pooled frame is written from its own pixels.
+bool HisWriter::appendDirect(const void *pixels, const FrameRef *frame, int64_t timestampNs)
+{
+    unsigned slot = 0;
+    if (!takeSlot(&slot))
+        return false;
+    noteMedian(pixels);
+
+    m_heldTimestamps[slot] = timestampNs;
+    const void *data = pixels;
+    const bool aligned = reinterpret_cast<uintptr_t>(pixels) % kBlockAlignment == 0;
+    if (frame && aligned) {
+        m_held[slot] = *frame;
+    } else {
+        if (!m_stagingBase) {
+            m_staging.resize(m_frameBytes * m_held.size() + kBlockAlignment);
+            m_stagingBase = m_staging.data();
+            m_stagingBase += (kBlockAlignment - reinterpret_cast<uintptr_t>(m_stagingBase) % kBlockAlignment)
+                             % kBlockAlignment;
+        }
+        uint8_t *staging = m_stagingBase + static_cast<size_t>(slot) * m_frameBytes;
+        std::memcpy(staging, pixels, m_frameBytes);
+        data = staging;
+    }
+
+    const uint64_t index = m_frames.load(std::memory_order_relaxed);
+    if (!m_async.write(data, m_frameBytes, m_dataOffset + index * m_frameBytes, slot)) {
+        fail(m_async.error());
+        return false;
+    }
+    m_frames.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool HisWriter::takeSlot(unsigned *slot)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_freeSlots.empty() && !m_failed) {
+        const auto start = std::chrono::steady_clock::now();
+        m_freed.wait(lock, [this] { return !m_freeSlots.empty() || m_failed; });
+        ++m_stalls;
+        m_stallMs += msSince(start);
+    }
+    if (m_failed)
+        return false;
+    *slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    return true;
+}
+
+// Runs on an AsyncFileWriter thread. The frame goes back to its pool
+// outside the lock.
+void HisWriter::releaseSlot(uint64_t slot, bool ok)
+{
+    FrameRef frame = std::move(m_held[slot]);
+    if (ok && m_options.written && m_heldTimestamps[slot] >= 0)
+        m_options.written(m_heldTimestamps[slot]);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!ok && !m_failed) {
+            m_failed = true;
+            m_error = m_async.error();
+        }
+        m_freeSlots.push_back(static_cast<unsigned>(slot));
+    }
+    m_freed.notify_one();
+}
+
+void HisWriter::noteMedian(const void *pixels)
+{
+    if (m_frames != 0 || m_hasMedian)
+        return;
+    const size_t count = static_cast<size_t>(m_rows) * m_columns;
+    m_median = (m_dataType & PKI_LONG) ? medianValue(static_cast<const uint32_t *>(pixels), count)
+                                       : medianValue(static_cast<const uint16_t *>(pixels), count);
+}
+
+uint8_t *HisWriter::takeBlock()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_free.empty() && !m_failed) {
+        const auto start = std::chrono::steady_clock::now();
+        m_freed.wait(lock, [this] { return !m_free.empty() || m_failed; });
+        ++m_stalls;
+        m_stallMs += msSince(start);
+    }
+    if (m_failed)
+        return nullptr;
+    uint8_t *block = m_free.front();
+    m_free.pop_front();
+    return block;
+}
+
+void HisWriter::queueBlock(size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back({m_block, bytes});
+    }
+    m_queued.notify_one();
+    m_block = nullptr;
+    m_fill = 0;
+}
+
+void HisWriter::ioLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_queued.wait(lock, [this] { return !m_pending.empty() || m_stop; });
+        if (m_pending.empty())
+            return;
+        const Pending pending = m_pending.front();
+        m_pending.pop_front();
+        const bool failed = m_failed;
+        lock.unlock();
+
+        bool ok = true;
+        double ms = 0;
+        std::vector<int64_t> written;
+        if (!failed) {
+            const auto start = std::chrono::steady_clock::now();
+            ok = std::fwrite(pending.data, 1, pending.bytes, m_file) == pending.bytes;
+            ms = msSince(start);
+        }
+
+        lock.lock();
+        if (!ok && !m_failed) {
+            m_failed = true;
+            m_error = "write to " + m_path + " failed: " + std::strerror(errno);
+        }
+        if (ok && !failed) {
+            m_written += pending.bytes;
+            while (!m_unwritten.empty() && m_unwritten.front().first <= m_written) {
+                written.push_back(m_unwritten.front().second);
+                m_unwritten.pop_front();
+            }
+        }
+        m_writeMs += ms;
+        m_free.push_back(pending.data);
+        m_freed.notify_one();
+        if (!written.empty()) {
+            lock.unlock();
+            for (int64_t timestampNs : written)
+                m_options.written(timestampNs);
+            lock.lock();
+        }
+    }
+}
+
+void HisWriter::fillHeader(uint8_t *header) const
+{
+    const uint64_t frames = m_frames.load(std::memory_order_relaxed);
+    const uint64_t fileSize = m_dataOffset + frames * m_frameBytes;
+    WinHeaderType101 file;
+    std::memset(&file, 0, sizeof(file));
+    file.FileType = kFileType;
+    file.HeaderSize = static_cast<WORD>(kFileHeaderBytes);
+    file.HeaderVersion = kHeaderVersion;
+    file.FileSize = static_cast<UINT>(std::min<uint64_t>(fileSize, 0xFFFFFFFFu));
+    file.ImageHeaderSize = static_cast<WORD>(m_dataOffset - kFileHeaderBytes);
+    file.ULX = 1;
+    file.ULY = 1;
+    file.BRX = static_cast<WORD>(m_columns);
+    file.BRY = static_cast<WORD>(m_rows);
+    file.NrOfFrames = static_cast<WORD>(std::min<uint64_t>(frames, 0xFFFF));
+    file.Correction = m_options.correction;
+    file.IntegrationTime = m_integrationTimeUs;
+    file.TypeOfNumbers = static_cast<WORD>(m_dataType);
+    file.wMedianValue = m_median;
+    std::memcpy(header, &file, sizeof(file));
+
+    // WinImageHeaderType, packed: PROM ID, project, system, prefilter,
+    // kV, mA, averaged frames.
+    WinImageHeaderType image;
+    std::memset(&image, 0, sizeof(image));
+    image.n_avframes = m_options.averagedFrames;
+    uint8_t *out = header + kFileHeaderBytes;
+    std::memcpy(out, &image.dwPROMID, 4);
+    std::memcpy(out + 4, image.strProject, sizeof(image.strProject));
+    std::memcpy(out + 10, image.strSystemused, sizeof(image.strSystemused));
+    std::memcpy(out + 13, image.strPrefilter, sizeof(image.strPrefilter));
+    std::memcpy(out + 22, &image.fKVolt, 4);
+    std::memcpy(out + 26, &image.fAmpere, 4);
+    std::memcpy(out + 30, &image.n_avframes, 2);
+}
+
+bool HisWriter::close()
+{
+    if (!m_open)
+        return false;
+    const bool ok = m_direct ? closeDirect() : closeBuffered();
+    m_open = false;
+    return ok;
+}
+
+bool HisWriter::closeBuffered()
+{
+    if (m_block && m_fill > 0)
+        queueBlock(m_fill);
+    else if (m_block) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(m_block);
+        m_block = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_queued.notify_one();
+    m_thread.join();
+
+    bool ok = !m_failed;
+    uint8_t header[kDataOffset] = {};
+    fillHeader(header);
+    if (ok && (std::fseek(m_file, 0, SEEK_SET) != 0 || std::fwrite(header, 1, sizeof(header), m_file) != sizeof(header))) {
+        fail("cannot update the header of " + m_path + ": " + std::strerror(errno));
+        ok = false;
+    }
+    if (std::fclose(m_file) != 0 && ok) {
+        fail("closing " + m_path + " failed: " + std::strerror(errno));
+        ok = false;
+    }
+    m_file = nullptr;
+    std::vector<uint8_t>().swap(m_storage);
+    m_free.clear();
+    return ok;
+}
+
+bool HisWriter::closeDirect()
+{
+    bool ok = m_async.drain() && !m_failed;
+    if (ok) {
+        if (!writeDirectHeader()) {
+            fail("cannot update the header of " + m_path + ": " + m_async.error());
+            ok = false;
+        }
+    }
+    if (!m_async.close() && ok) {
+        fail(m_async.error());
+        ok = false;
+    }
+    m_held.clear();
+    m_freeSlots.clear();
+    std::vector<uint8_t>().swap(m_staging);
+    m_stagingBase = nullptr;
+    return ok;
+}
+
+unsigned HisWriter::queueDepth() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_direct)
+        return static_cast<unsigned>(m_held.size() - m_freeSlots.size());
+    return static_cast<unsigned>(m_pending.size());
+}
+
+HisWriter::Stats HisWriter::stats() const
+{
+    Stats stats;
+    if (m_direct) {
+        const AsyncFileWriter::Stats io = m_async.stats();
+        stats.backend = AsyncFileWriter::backendName(m_async.backend());
+        stats.direct = m_async.isDirect();
+        stats.bytes = io.bytes + (io.writes > 0 ? m_dataOffset : 0);
+        stats.writeMs = io.activeMs;
+        stats.peakQueueDepth = io.peakInFlight;
+        stats.averageQueueDepth = io.averageInFlight;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.frames = m_frames.load(std::memory_order_relaxed);
+    if (!m_direct) {
+        stats.bytes = m_written;
+        stats.writeMs = m_writeMs;
+    }
+    stats.stalls = m_stalls;
+    stats.stallMs = m_stallMs;
+    return stats;
+}
+
+void HisWriter::fail(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_failed = true;
+    m_error = message;
+}
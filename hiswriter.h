@@ -0,0 +1,204 @@
+#ifndef HISWRITER_H
+#define HISWRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Acq.h"
+#include "asyncfilewriter.h"
+#include "frame.h"
+
+// ------------------------------------------------------------------
+// HisWriter
+// Streams a frame sequence into a .his file while it is acquired: the
+// 68-byte file header (WinHeaderType101: 0x7000, version 101, with the
+// median in wMedianValue), a WinImageHeaderType and the frames back to
+// back at native depth (TypeOfNumbers PKI_SHORT or PKI_LONG).
+//
+// Two paths, chosen at open():
+//  - direct (Linux, frame size a multiple of 4 KiB): the file is opened
+//    with O_DIRECT through an AsyncFileWriter (io_uring or a pwrite
+//    pool), and the image header is padded so frames start at 4 KiB.
+//    append(FrameRef) writes the pooled, page-aligned frame in place and
+//    holds the reference until the write completes; other appends copy
+//    into one of queueDepth staging buffers.
+//  - buffered: append() copies a frame into the current staging block;
+//    full blocks (aligned, blockBytes each, at block-aligned file
+//    offsets) are written by a dedicated I/O thread. The image header
+//    is the plain 32 bytes.
+// Memory stays bounded however long the sequence runs. When every
+// buffer is waiting for the disk, append() waits for one
+// (Stats::stalls) rather than dropping the frame.
+//
+// close() drains the queue and patches the header: FileSize and
+// NrOfFrames saturate at their field widths (4 GiB, 65535 frames) but
+// the file always holds every frame; readers size long sequences from
+// the file length. wMedianValue is the median of the first frame unless
+// set explicitly.
+//
+// Options::written, if set, is called on the I/O side as each frame
+// appended as a Frame or FrameRef reaches the file (the OS, on the
+// buffered path), with the frame's timestampNs; it must be cheap.
+//
+// append() and the setters belong to one producer thread; frames(),
+// queueDepth() and stats() may be read from anywhere.
+// ------------------------------------------------------------------
+class HisWriter {
+public:
+    static constexpr WORD kFileType = 0x7000;
+    static constexpr WORD kHeaderVersion = 101;
+    static constexpr size_t kFileHeaderBytes = 68;
+    static constexpr size_t kImageHeaderBytes = WINHARDWAREHEADERSIZE;
+    static constexpr size_t kDataOffset = kFileHeaderBytes + kImageHeaderBytes;
+    static constexpr size_t kBlockAlignment = AsyncFileWriter::kAlignment;
+
+    enum class Backend {
+        Auto,           // direct over io_uring where possible, else buffered
+        Buffered,
+        ThreadPool,     // direct, pwrite threads
+        IoUring         // direct, io_uring (pwrite threads if refused)
+    };
+
+    struct Options {
+        Backend backend = Backend::Auto;
+        unsigned queueDepth = 8;        // direct: frames in flight
+        size_t blockBytes = 8u << 20;   // buffered: rounded up to kBlockAlignment
+        unsigned blocks = 4;            // buffered
+        WORD correction = 0;            // WinHeaderType::Correction
+        WORD averagedFrames = 1;        // WinImageHeaderType::n_avframes
+        std::function<void(int64_t timestampNs)> written;
+    };
+
+    struct Stats {
+        const char *backend = "buffered";
+        bool direct = false;            // O_DIRECT in effect
+        uint64_t frames = 0;
+        uint64_t bytes = 0;             // file size so far, headers included
+        uint64_t stalls = 0;            // appends that waited for a free buffer
+        double stallMs = 0;
+        double writeMs = 0;             // time the disk was busy with our writes
+        unsigned peakQueueDepth = 0;    // direct: writes in flight
+        double averageQueueDepth = 0;
+        double mbPerSecond() const { return writeMs > 0 ? bytes / (writeMs * 1000.0) : 0.0; }
+    };
+
+    HisWriter() = default;
+    ~HisWriter();
+
+    HisWriter(const HisWriter &) = delete;
+    HisWriter &operator=(const HisWriter &) = delete;
+
+    // Applies from the next open().
+    void setOptions(const Options &options) { m_options = options; }
+    const Options &options() const { return m_options; }
+
+    // Creates (truncates) 'path'. False, with error() set, on failure or
+    // when a file is already open. With Backend::Auto an unsuitable
+    // geometry or platform falls back to the buffered path; an explicit
+    // direct backend fails instead.
+    bool open(const std::string &path, unsigned rows, unsigned columns, XIS_FileType dataType);
+    bool isOpen() const { return m_open; }
+    bool isDirect() const { return m_direct; }
+
+    // 'pixels' holds one frame of the open geometry and type. False once
+    // a write has failed.
+    bool append(const void *pixels);
+    bool append(const Frame &frame);
+    // Zero-copy on the direct path.
+    bool append(const FrameRef &frame);
+
+    void setIntegrationTime(double microseconds) { m_integrationTimeUs = microseconds; }
+    void setMedianValue(WORD median) { m_median = median; m_hasMedian = true; }
+
+    // Writes out what is queued, patches the header and closes the file.
+    bool close();
+
+    const std::string &path() const { return m_path; }
+    uint64_t frames() const { return m_frames.load(std::memory_order_relaxed); }
+    size_t frameBytes() const { return m_frameBytes; }
+    size_t dataOffset() const { return m_dataOffset; }
+    // Buffers waiting for the disk: writes in flight (direct) or full
+    // blocks queued (buffered).
+    unsigned queueDepth() const;
+    Stats stats() const;
+    const std::string &error() const { return m_error; }
+
+private:
+    struct Pending {
+        uint8_t *data;
+        size_t bytes;
+    };
+
+    bool matches(const Frame &frame);
+    bool openBuffered();
+    bool openDirect(AsyncFileWriter::Backend backend);
+    bool appendBuffered(const void *pixels, int64_t timestampNs);
+    bool appendDirect(const void *pixels, const FrameRef *frame, int64_t timestampNs);
+    bool closeBuffered();
+    bool closeDirect();
+    bool writeDirectHeader();
+    void noteMedian(const void *pixels);
+    bool takeSlot(unsigned *slot);
+    void releaseSlot(uint64_t slot, bool ok);
+    void ioLoop();
+    uint8_t *takeBlock();
+    void queueBlock(size_t bytes);
+    void fillHeader(uint8_t *header) const;
+    void fail(const std::string &message);
+
+    bool m_open = false;
+    bool m_direct = false;
+    std::string m_path;
+    std::string m_error;
+    unsigned m_rows = 0;
+    unsigned m_columns = 0;
+    XIS_FileType m_dataType = PKI_SHORT;
+    Options m_options;
+    size_t m_frameBytes = 0;
+    size_t m_dataOffset = kDataOffset;
+    std::atomic<uint64_t> m_frames{0};
+    double m_integrationTimeUs = 0;
+    WORD m_median = 0;
+    bool m_hasMedian = false;
+
+    // Buffered path.
+    std::FILE *m_file = nullptr;
+    size_t m_blockBytes = 0;
+    std::vector<uint8_t> m_storage;
+    uint8_t *m_block = nullptr;         // block being filled
+    size_t m_fill = 0;
+    std::thread m_thread;
+    std::condition_variable m_queued;   // I/O thread: work or stop
+    std::deque<uint8_t *> m_free;
+    std::deque<Pending> m_pending;
+    std::deque<std::pair<uint64_t, int64_t>> m_unwritten;  // frame end offset, timestampNs
+    bool m_stop = false;
+    uint64_t m_written = 0;
+    double m_writeMs = 0;
+
+    // Direct path: one slot per write in flight, holding its frame (or
+    // owning a staging buffer) until the write completes.
+    AsyncFileWriter m_async;
+    std::vector<FrameRef> m_held;
+    std::vector<int64_t> m_heldTimestamps;   // < 0: no Options::written call
+    std::vector<unsigned> m_freeSlots;
+    std::vector<uint8_t> m_staging;     // allocated on the first copied frame
+    uint8_t *m_stagingBase = nullptr;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_freed;    // producer: a buffer came back
+    bool m_failed = false;
+    uint64_t m_stalls = 0;
+    double m_stallMs = 0;
+};
+
+#endif // HISWRITER_H
@@ -0,0 +1,342 @@
+#include "liverenderer.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+void accumulateScalar(const uint16_t *src, uint32_t *acc, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i)
+        acc[i] += src[i];
+}
+
+#if DAQ_SIMD_X86
+DAQ_TARGET_AVX2
+void accumulateAvx2(const uint16_t *src, uint32_t *acc, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i *a = reinterpret_cast<__m256i *>(acc + i);
+        const __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        const __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), lo));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), hi));
+    }
+    accumulateScalar(src, acc, i, count);
+}
+
+DAQ_TARGET_SSE41
+void accumulateSse41(const uint16_t *src, uint32_t *acc, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i *a = reinterpret_cast<__m128i *>(acc + i);
+        const __m128i lo = _mm_cvtepu16_epi32(v);
+        const __m128i hi = _mm_cvtepu16_epi32(_mm_srli_si128(v, 8));
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), lo));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), hi));
+    }
+    accumulateScalar(src, acc, i, count);
+}
+#endif
+
+void accumulate(const uint16_t *src, uint32_t *acc, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  accumulateAvx2(src, acc, count); return;
+    case simd::Level::Sse41: accumulateSse41(src, acc, count); return;
+    default: break;
+    }
+#endif
+    accumulateScalar(src, acc, 0, count);
+}
+
+// 18-bit and wider frames are brought down to the table's 16 bits.
+inline uint16_t to16(uint64_t value, unsigned shift)
+{
+    return static_cast<uint16_t>(std::min<uint64_t>(value >> shift, 0xFFFF));
+}
+
+void boxReduce16(const Frame &frame, unsigned factor, uint16_t *out)
+{
+    const unsigned width = frame.columns() / factor;
+    const unsigned height = frame.rows() / factor;
+    const size_t span = static_cast<size_t>(width) * factor;
+    const uint32_t area = factor * factor;
+    std::vector<uint32_t> acc(span);
+    for (unsigned oy = 0; oy < height; ++oy) {
+        std::fill(acc.begin(), acc.end(), 0u);
+        for (unsigned r = 0; r < factor; ++r)
+            accumulate(frame.pixels16() + (static_cast<size_t>(oy) * factor + r) * frame.columns(), acc.data(), span);
+        const uint32_t *cell = acc.data();
+        for (unsigned ox = 0; ox < width; ++ox, cell += factor) {
+            uint32_t sum = 0;
+            for (unsigned c = 0; c < factor; ++c)
+                sum += cell[c];
+            out[static_cast<size_t>(oy) * width + ox] = static_cast<uint16_t>(sum / area);
+        }
+    }
+}
+
+void boxReduce32(const Frame &frame, unsigned factor, unsigned shift, uint16_t *out)
+{
+    const unsigned width = frame.columns() / factor;
+    const unsigned height = frame.rows() / factor;
+    const uint64_t area = static_cast<uint64_t>(factor) * factor;
+    for (unsigned oy = 0; oy < height; ++oy) {
+        for (unsigned ox = 0; ox < width; ++ox) {
+            uint64_t sum = 0;
+            for (unsigned r = 0; r < factor; ++r) {
+                const uint32_t *row = frame.pixels32() + (static_cast<size_t>(oy) * factor + r) * frame.columns()
+                                      + static_cast<size_t>(ox) * factor;
+                for (unsigned c = 0; c < factor; ++c)
+                    sum += row[c];
+            }
+            out[static_cast<size_t>(oy) * width + ox] = to16(sum / area, shift);
+        }
+    }
+}
+
+double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+LiveRenderer::LiveRenderer()
+    : m_lut(65536)
+{
+    m_thread = std::thread([this] { renderLoop(); });
+}
+
+LiveRenderer::~LiveRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void LiveRenderer::setTargetSize(unsigned width, unsigned height)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_targetWidth = std::max(width, 1u);
+    m_targetHeight = std::max(height, 1u);
+}
+
+void LiveRenderer::setFilter(Filter filter)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_filter = filter;
+}
+
+void LiveRenderer::setWindowLevel(const WindowLevel &windowLevel)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_windowLevel = windowLevel;
+        m_lutDirty = true;
+    }
+    m_wake.notify_one();
+}
+
+LiveRenderer::WindowLevel LiveRenderer::windowLevel() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_windowLevel;
+}
+
+void LiveRenderer::submit(FrameRef frame)
+{
+    if (!frame)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending)
+            ++m_stats.superseded;
+        m_pending = std::move(frame);
+    }
+    m_wake.notify_one();
+}
+
+std::shared_ptr<const LiveRenderer::Image> LiveRenderer::takeImage()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::move(m_latest);
+}
+
+void LiveRenderer::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return !m_busy && !m_pending && !m_lutDirty; });
+}
+
+LiveRenderer::Stats LiveRenderer::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+unsigned LiveRenderer::reductionFactor(unsigned rows, unsigned columns, unsigned width, unsigned height)
+{
+    if (width == 0 || height == 0)
+        return 1;
+    const unsigned across = (columns + width - 1) / width;
+    const unsigned down = (rows + height - 1) / height;
+    return std::max({across, down, 1u});
+}
+
+void LiveRenderer::reduce(const Frame &frame, unsigned factor, Filter filter, uint16_t *out)
+{
+    factor = std::max(factor, 1u);
+    const unsigned shift = frame.is32Bit() && frame.bits > 16 ? frame.bits - 16 : 0;
+    if (filter == Filter::Box && factor > 1) {
+        if (frame.is32Bit())
+            boxReduce32(frame, factor, shift, out);
+        else
+            boxReduce16(frame, factor, out);
+        return;
+    }
+    // The centre pixel of each cell.
+    const unsigned width = frame.columns() / factor;
+    const unsigned height = frame.rows() / factor;
+    const unsigned middle = factor / 2;
+    for (unsigned oy = 0; oy < height; ++oy) {
+        const size_t row = (static_cast<size_t>(oy) * factor + middle) * frame.columns() + middle;
+        uint16_t *line = out + static_cast<size_t>(oy) * width;
+        if (frame.is32Bit()) {
+            const uint32_t *in = frame.pixels32() + row;
+            for (unsigned ox = 0; ox < width; ++ox)
+                line[ox] = to16(in[static_cast<size_t>(ox) * factor], shift);
+        } else {
+            const uint16_t *in = frame.pixels16() + row;
+            for (unsigned ox = 0; ox < width; ++ox)
+                line[ox] = in[static_cast<size_t>(ox) * factor];
+        }
+    }
+}
+
+void LiveRenderer::buildLut(const WindowLevel &windowLevel, uint8_t *lut)
+{
+    const uint32_t low = std::min<uint32_t>(windowLevel.low, 0xFFFF);
+    const uint32_t high = std::min<uint32_t>(windowLevel.high, 0xFFFF);
+    const double range = high > low ? static_cast<double>(high - low) : 1.0;
+    const double logRange = std::log1p(range);
+    for (uint32_t v = 0; v < 65536; ++v) {
+        if (v <= low || high <= low) {
+            lut[v] = v > low ? 255 : 0;
+            continue;
+        }
+        if (v >= high) {
+            lut[v] = 255;
+            continue;
+        }
+        const double t = (v - low) / range;
+        double mapped = t;
+        if (windowLevel.curve == Curve::Log)
+            mapped = std::log1p(static_cast<double>(v - low)) / logRange;
+        else if (windowLevel.curve == Curve::Gamma)
+            mapped = std::pow(t, windowLevel.gamma);
+        lut[v] = static_cast<uint8_t>(std::lround(std::clamp(mapped, 0.0, 1.0) * 255.0));
+    }
+}
+
+void LiveRenderer::applyLut(const uint16_t *in, size_t count, const uint8_t *lut, uint8_t *out)
+{
+    for (size_t i = 0; i < count; ++i)
+        out[i] = lut[in[i]];
+}
+
+// An image the GUI no longer holds, or a new one.
+std::shared_ptr<LiveRenderer::Image> LiveRenderer::freeImage()
+{
+    for (const std::shared_ptr<Image> &image : m_images) {
+        if (image.use_count() == 1)
+            return image;
+    }
+    m_images.push_back(std::make_shared<Image>());
+    return m_images.back();
+}
+
+void LiveRenderer::renderLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_stop || m_pending || m_lutDirty; });
+        if (m_stop)
+            return;
+        FrameRef frame = std::move(m_pending);
+        const bool lutDirty = m_lutDirty;
+        const WindowLevel windowLevel = m_windowLevel;
+        const Filter filter = m_filter;
+        const unsigned targetWidth = m_targetWidth;
+        const unsigned targetHeight = m_targetHeight;
+        m_lutDirty = false;
+        m_busy = true;
+        lock.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+        if (frame && frame->summary.valid) {
+            // Onto the table's scale, as reduce() does with the pixels.
+            const unsigned shift = frame->is32Bit() && frame->bits > 16 ? frame->bits - 16 : 0;
+            m_autoLow = frame->summary.low >> shift;
+            m_autoHigh = frame->summary.high >> shift;
+            m_hasAuto = true;
+        }
+        WindowLevel applied = windowLevel;
+        if (windowLevel.automatic && m_hasAuto) {
+            applied.low = m_autoLow;
+            applied.high = m_autoHigh;
+        }
+        if (lutDirty || applied.low != m_applied.low || applied.high != m_applied.high) {
+            buildLut(applied, m_lut.data());
+            m_applied = applied;
+        }
+        if (frame) {
+            const unsigned factor = reductionFactor(frame->rows(), frame->columns(), targetWidth, targetHeight);
+            m_last.factor = factor;
+            m_last.width = frame->columns() / factor;
+            m_last.height = frame->rows() / factor;
+            m_last.frameNumber = frame->frameNumber;
+            m_last.timestampNs = frame->timestampNs;
+            m_reduced.resize(static_cast<size_t>(m_last.width) * m_last.height);
+            reduce(*frame, factor, filter, m_reduced.data());
+            frame.reset();
+        }
+
+        std::shared_ptr<Image> image;
+        if (!m_reduced.empty()) {
+            image = freeImage();
+            image->width = m_last.width;
+            image->height = m_last.height;
+            image->factor = m_last.factor;
+            image->frameNumber = m_last.frameNumber;
+            image->timestampNs = m_last.timestampNs;
+            image->low = m_applied.low;
+            image->high = m_applied.high;
+            image->pixels.resize(m_reduced.size());
+            applyLut(m_reduced.data(), m_reduced.size(), m_lut.data(), image->pixels.data());
+            image->renderMs = msSince(start);
+        }
+
+        lock.lock();
+        if (image) {
+            m_latest = image;
+            ++m_stats.rendered;
+            m_stats.lastRenderMs = image->renderMs;
+            m_renderMsSum += image->renderMs;
+            m_stats.averageRenderMs = m_renderMsSum / m_stats.rendered;
+        }
+        m_busy = false;
+        m_idle.notify_all();
+    }
+}
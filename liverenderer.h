@@ -0,0 +1,128 @@
+#ifndef LIVERENDERER_H
+#define LIVERENDERER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+
+// ------------------------------------------------------------------
+// LiveRenderer
+// The display stage: turns detector frames into 8-bit images of about
+// the live view's size on a thread of its own, so the GUI only blits.
+//
+//  1. reduce  the frame by an integer factor to fit the target size,
+//             keeping its aspect: Decimate picks one pixel per cell
+//             (cost follows the output size, not the detector), Box
+//             averages each cell (SIMD row sums; reads every pixel).
+//             18-bit frames are scaled to 16 bits here.
+//  2. map     the reduced 16-bit image through a 64K-entry window/level
+//             table (linear, log or gamma between 'low' and 'high').
+//             With 'automatic', 'low' and 'high' follow each frame's
+//             percentile clip points (Frame::summary, from the
+//             FrameStatistics stage) and the table is rebuilt when they
+//             move; frames without statistics keep the last window.
+//
+// submit() is latest-wins: a frame still waiting when the next one
+// arrives is dropped (Stats::superseded) and the worker always renders
+// the newest. takeImage() returns the newest finished image once. The
+// reduced image of the last frame is kept, so a window/level change
+// re-renders without holding on to a pooled frame; frames are released
+// as soon as they are reduced.
+// ------------------------------------------------------------------
+class LiveRenderer {
+public:
+    enum class Curve { Linear, Log, Gamma };
+    enum class Filter { Decimate, Box };
+
+    struct WindowLevel {
+        uint32_t low = 0;               // maps to black
+        uint32_t high = 0xFFFF;         // maps to white
+        Curve curve = Curve::Linear;
+        double gamma = 0.5;             // Curve::Gamma exponent
+        bool automatic = false;         // low/high from Frame::summary
+    };
+
+    struct Image {
+        unsigned width = 0;
+        unsigned height = 0;
+        std::vector<uint8_t> pixels;    // width * height, rows packed
+        unsigned factor = 1;            // detector pixels per image pixel, each axis
+        uint64_t frameNumber = 0;
+        int64_t timestampNs = 0;        // the frame's end-of-frame time
+        double renderMs = 0;
+        uint32_t low = 0;               // the window applied, on the 16-bit scale
+        uint32_t high = 0xFFFF;
+    };
+
+    struct Stats {
+        uint64_t rendered = 0;
+        uint64_t superseded = 0;        // submitted but replaced before rendering
+        double lastRenderMs = 0;
+        double averageRenderMs = 0;
+    };
+
+    LiveRenderer();
+    ~LiveRenderer();
+
+    LiveRenderer(const LiveRenderer &) = delete;
+    LiveRenderer &operator=(const LiveRenderer &) = delete;
+
+    // Applies from the next frame.
+    void setTargetSize(unsigned width, unsigned height);
+    void setFilter(Filter filter);
+    // Re-renders the last frame with the new table.
+    void setWindowLevel(const WindowLevel &windowLevel);
+    WindowLevel windowLevel() const;
+
+    void submit(FrameRef frame);
+    // Null when nothing new was rendered since the last call.
+    std::shared_ptr<const Image> takeImage();
+    // Blocks until everything submitted has been rendered.
+    void waitIdle();
+
+    Stats stats() const;
+
+    // The two steps, usable on their own.
+    static unsigned reductionFactor(unsigned rows, unsigned columns, unsigned width, unsigned height);
+    static void reduce(const Frame &frame, unsigned factor, Filter filter, uint16_t *out);
+    static void buildLut(const WindowLevel &windowLevel, uint8_t *lut);
+    static void applyLut(const uint16_t *in, size_t count, const uint8_t *lut, uint8_t *out);
+
+private:
+    void renderLoop();
+    std::shared_ptr<Image> freeImage();
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;     // worker: frame, new table or stop
+    std::condition_variable m_idle;     // waitIdle()
+    bool m_stop = false;
+    bool m_busy = false;
+    FrameRef m_pending;
+    bool m_lutDirty = true;
+    WindowLevel m_windowLevel;
+    Filter m_filter = Filter::Decimate;
+    unsigned m_targetWidth = 320;
+    unsigned m_targetHeight = 240;
+    std::shared_ptr<Image> m_latest;    // finished, not yet taken
+    Stats m_stats;
+    double m_renderMsSum = 0;
+
+    // Worker thread only.
+    std::vector<uint8_t> m_lut;
+    std::vector<uint16_t> m_reduced;
+    Image m_last;                       // metadata of the reduced frame
+    WindowLevel m_applied;              // the table's window
+    bool m_hasAuto = false;             // m_autoLow/High from a frame's summary
+    uint32_t m_autoLow = 0;
+    uint32_t m_autoHigh = 0xFFFF;
+    std::vector<std::shared_ptr<Image>> m_images;
+};
+
+#endif // LIVERENDERER_H
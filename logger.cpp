@@ -0,0 +1,274 @@
+#include "logger.h"
+#include "steadyclock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+size_t roundUpPow2(size_t value)
+{
+    size_t result = 2;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+} // namespace
+
+Logger::Logger(size_t capacity)
+    : m_mask(roundUpPow2(capacity) - 1)
+    , m_cells(new Cell[m_mask + 1])
+    , m_startNs(steadyclock::nowNs())
+{
+    for (size_t i = 0; i <= m_mask; ++i)
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    m_thread = std::thread([this] { drainLoop(); });
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+    closeFile();
+}
+
+// A free cell at the ring's head, or null when the ring is full. The
+// producer owns the cell until publish().
+Logger::Cell *Logger::claim(XislLoggingLevels level, uint64_t *position)
+{
+    if (!enabled(level))
+        return nullptr;
+    uint64_t head = m_enqueue.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell &cell = m_cells[head & m_mask];
+        const uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const int64_t lag = static_cast<int64_t>(sequence - head);
+        if (lag == 0) {
+            if (m_enqueue.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                break;
+        } else if (lag < 0) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            head = m_enqueue.load(std::memory_order_relaxed);
+        }
+    }
+    *position = head;
+    Cell *cell = &m_cells[head & m_mask];
+    cell->entry.timestampNs = steadyclock::nowNs();
+    cell->entry.level = level;
+    return cell;
+}
+
+void Logger::publish(Cell *cell, uint64_t position)
+{
+    cell->sequence.store(position + 1, std::memory_order_release);
+    m_posted.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::message(XislLoggingLevels level, const char *text, size_t length)
+{
+    uint64_t position;
+    Cell *cell = claim(level, &position);
+    if (!cell)
+        return;
+    length = std::min(length, kTextBytes - 1);
+    std::memcpy(cell->entry.text, text, length);
+    cell->entry.text[length] = '\0';
+    cell->entry.format = nullptr;
+    publish(cell, position);
+}
+
+void Logger::counter(XislLoggingLevels level, const char *format, int64_t a, int64_t b, const char *source)
+{
+    uint64_t position;
+    Cell *cell = claim(level, &position);
+    if (!cell)
+        return;
+    const size_t length = source ? strnlen(source, kTextBytes - 1) : 0;
+    if (length)
+        std::memcpy(cell->entry.text, source, length);
+    cell->entry.text[length] = '\0';
+    cell->entry.format = format;
+    cell->entry.a = a;
+    cell->entry.b = b;
+    publish(cell, position);
+}
+
+bool Logger::pop(Entry *entry)
+{
+    Cell &cell = m_cells[m_dequeue & m_mask];
+    if (cell.sequence.load(std::memory_order_acquire) != m_dequeue + 1)
+        return false;
+    *entry = cell.entry;
+    cell.sequence.store(m_dequeue + m_mask + 1, std::memory_order_release);
+    ++m_dequeue;
+    return true;
+}
+
+bool Logger::openFile(const std::string &path)
+{
+    std::FILE *file = std::fopen(path.c_str(), "a");
+    if (!file)
+        return false;
+    std::setvbuf(file, nullptr, _IOFBF, 1u << 16);
+    closeFile();
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    m_file = file;
+    return true;
+}
+
+void Logger::closeFile()
+{
+    if (m_thread.joinable())
+        flush();
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    if (m_file)
+        std::fclose(m_file);
+    m_file = nullptr;
+}
+
+void Logger::takeLines(std::vector<Line> &lines)
+{
+    lines.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    lines.swap(m_pending);
+    m_openCounters.clear();
+}
+
+void Logger::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const uint64_t request = ++m_flushRequests;
+    m_wake.notify_one();
+    m_drained.wait(lock, [&] { return m_flushesDone >= request || m_stop; });
+}
+
+Logger::Stats Logger::stats() const
+{
+    Stats stats;
+    stats.posted = m_posted.load(std::memory_order_relaxed);
+    stats.dropped = m_dropped.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.coalesced = m_coalesced;
+    stats.fileLines = m_fileLines;
+    return stats;
+}
+
+const char *Logger::levelName(XislLoggingLevels level)
+{
+    switch (level) {
+    case LEVEL_TRACE: return "TRACE";
+    case LEVEL_DEBUG: return "DEBUG";
+    case LEVEL_INFO:  return "INFO";
+    case LEVEL_WARN:  return "WARN";
+    case LEVEL_ERROR: return "ERROR";
+    case LEVEL_FATAL: return "FATAL";
+    default:          return "?";
+    }
+}
+
+XislLoggingLevels Logger::parseLevel(const std::string &name)
+{
+    static const char *const names[] = {"trace", "debug", "info", "warn", "error", "fatal"};
+    for (int i = 0; i < 6; ++i) {
+        if (name == names[i])
+            return static_cast<XislLoggingLevels>(i);
+    }
+    return name == "none" ? LEVEL_NONE : LEVEL_ALL;
+}
+
+void Logger::drainLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait_for(lock, std::chrono::milliseconds(kDrainMs),
+                        [this] { return m_stop || m_flushesDone < m_flushRequests; });
+        const bool stop = m_stop;
+        const uint64_t requests = m_flushRequests;
+        lock.unlock();
+        drain();
+        lock.lock();
+        m_flushesDone = requests;
+        m_drained.notify_all();
+        if (stop)
+            return;
+    }
+}
+
+void Logger::drain()
+{
+    Entry entry;
+    bool wrote = false;
+    while (pop(&entry)) {
+        deliver(entry);
+        wrote = true;
+    }
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    if (wrote && m_file)
+        std::fflush(m_file);
+}
+
+void Logger::deliver(const Entry &entry)
+{
+    char formatted[kTextBytes];
+    const char *text = entry.text;
+    if (entry.format) {
+        int prefix = 0;
+        if (entry.text[0])
+            prefix = std::snprintf(formatted, sizeof(formatted), "[%s] ", entry.text);
+        prefix = std::min(std::max(prefix, 0), static_cast<int>(sizeof(formatted)) - 1);
+        std::snprintf(formatted + prefix, sizeof(formatted) - prefix, entry.format,
+                      static_cast<long long>(entry.a), static_cast<long long>(entry.b));
+        text = formatted;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        if (m_file) {
+            std::fprintf(m_file, "%12.6f %-5s %s\n", (entry.timestampNs - m_startNs) / 1e9,
+                         levelName(entry.level), text);
+            std::lock_guard<std::mutex> counters(m_mutex);
+            ++m_fileLines;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (entry.format) {
+        for (const OpenCounter &open : m_openCounters) {
+            if (open.format != entry.format || open.source != entry.text)
+                continue;
+            Line &line = m_pending[open.line];
+            line.timestampNs = entry.timestampNs;
+            line.level = std::max(line.level, entry.level);
+            ++line.count;
+            line.text = text;
+            ++m_coalesced;
+            return;
+        }
+    } else {
+        m_openCounters.clear();
+    }
+    if (m_pending.size() >= kMaxPendingLines) {
+        m_pending.erase(m_pending.begin());
+        for (size_t i = m_openCounters.size(); i-- > 0;) {
+            if (m_openCounters[i].line == 0)
+                m_openCounters.erase(m_openCounters.begin() + i);
+            else
+                --m_openCounters[i].line;
+        }
+    }
+    Line line;
+    line.timestampNs = entry.timestampNs;
+    line.level = entry.level;
+    line.text = text;
+    m_pending.push_back(std::move(line));
+    if (entry.format)
+        m_openCounters.push_back(OpenCounter{entry.format, entry.text, m_pending.size() - 1});
+}
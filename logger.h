@@ -0,0 +1,151 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Acq.h"
+
+// ------------------------------------------------------------------
+// Logger
+// Application log with XISL's severities (XislLoggingLevels). Posting
+// an entry takes a few atomics and never allocates, formats or locks,
+// so it can be done from the acquisition callback:
+//
+//  - message() copies a short text into a slot of a bounded lock-free
+//    ring (multi-producer, single consumer).
+//  - counter() stores a string literal, two integers and an optional
+//    short source name; formatting is left to the drain thread. Counters
+//    with the same format and source that follow each other, with only
+//    other counters in between, are coalesced into one line ("[panel1]
+//    Acquired frame 500 of 500. (x250)"), which is how per-frame
+//    progress is logged - one line per panel when several interleave.
+//
+// A drain thread empties the ring every kDrainMs, writes every entry to
+// the optional file sink and queues coalesced lines for the view, which
+// collects them with takeLines() a few times per second. When the ring
+// is full, new entries are dropped and counted rather than waited for.
+// ------------------------------------------------------------------
+class Logger {
+public:
+    struct Line {
+        int64_t timestampNs = 0;        // of the newest entry in the line
+        XislLoggingLevels level = LEVEL_INFO;
+        uint64_t count = 1;             // entries coalesced into this line
+        std::string text;
+    };
+
+    struct Stats {
+        uint64_t posted = 0;
+        uint64_t dropped = 0;           // ring full
+        uint64_t coalesced = 0;         // entries folded into an earlier line
+        uint64_t fileLines = 0;
+    };
+
+    static constexpr size_t kTextBytes = 200;
+    static constexpr unsigned kDrainMs = 50;
+    static constexpr size_t kMaxPendingLines = 1000;   // the view's backlog
+
+    // 'capacity' is rounded up to a power of two.
+    explicit Logger(size_t capacity = 1024);
+    ~Logger();
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    // Entries below 'level' are discarded by the caller. LEVEL_NONE
+    // silences the log.
+    void setLevel(XislLoggingLevels level) { m_level.store(level, std::memory_order_relaxed); }
+    XislLoggingLevels level() const { return m_level.load(std::memory_order_relaxed); }
+    bool enabled(XislLoggingLevels level) const {
+        return level >= this->level() && this->level() != LEVEL_NONE && level < LEVEL_ALL;
+    }
+
+    // Longer texts are cut at kTextBytes - 1.
+    void message(XislLoggingLevels level, const char *text, size_t length);
+    void message(XislLoggingLevels level, const std::string &text) { message(level, text.data(), text.size()); }
+    // 'format' must be a string literal (it is read later, on the drain
+    // thread) with at most two integer conversions, e.g. "%lld of %lld".
+    // A non-empty 'source' is copied (cut like a message) and prefixed
+    // as "[source] "; it is part of what the line is coalesced on.
+    void counter(XislLoggingLevels level, const char *format, int64_t a, int64_t b = 0,
+                 const char *source = nullptr);
+
+    // File sink: every entry, uncoalesced, with time and severity.
+    bool openFile(const std::string &path);
+    void closeFile();
+
+    // Lines drained since the last call, oldest first.
+    void takeLines(std::vector<Line> &lines);
+    // Blocks until everything posted so far has been drained.
+    void flush();
+
+    Stats stats() const;
+
+    static const char *levelName(XislLoggingLevels level);
+    // "trace", "debug", ... "none"; LEVEL_ALL for anything else.
+    static XislLoggingLevels parseLevel(const std::string &name);
+
+private:
+    struct Entry {
+        int64_t timestampNs;
+        XislLoggingLevels level;
+        const char *format;             // counter(); null for message()
+        int64_t a;
+        int64_t b;
+        char text[kTextBytes];          // message(), or the counter's source
+    };
+
+    // A counter line still open for coalescing.
+    struct OpenCounter {
+        const char *format;
+        std::string source;
+        size_t line;                    // index into m_pending
+    };
+
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        Entry entry;
+    };
+
+    Cell *claim(XislLoggingLevels level, uint64_t *position);
+    void publish(Cell *cell, uint64_t position);
+    bool pop(Entry *entry);
+    void drainLoop();
+    void drain();
+    void deliver(const Entry &entry);
+
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(64) std::atomic<uint64_t> m_enqueue{0};
+    alignas(64) uint64_t m_dequeue = 0;             // drain thread only
+    std::atomic<XislLoggingLevels> m_level{LEVEL_INFO};
+    std::atomic<uint64_t> m_posted{0};
+    std::atomic<uint64_t> m_dropped{0};
+    const int64_t m_startNs;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_drained;
+    bool m_stop = false;
+    uint64_t m_flushRequests = 0;
+    uint64_t m_flushesDone = 0;
+    std::vector<Line> m_pending;
+    std::vector<OpenCounter> m_openCounters;        // the counter lines after the last message
+    uint64_t m_coalesced = 0;
+
+    std::mutex m_fileMutex;                         // m_file: drain thread vs open/close
+    std::FILE *m_file = nullptr;
+    uint64_t m_fileLines = 0;
+};
+
+#endif // LOGGER_H
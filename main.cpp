@@ -3,8 +3,10 @@
 #include <QWidget>
 #include <QLineEdit>
 #include <QSpinBox>
+#include <QComboBox>
+#include <QCheckBox>
 #include <QPushButton>
-#include <QTextEdit>
+#include <QPlainTextEdit>
 #include <QProgressBar>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -12,77 +14,154 @@
 #include <QThread>
 #include <QImage>
 #include <QPixmap>
-#include <QRandomGenerator>
 #include <QFrame>
+#include <QTimer>
 #include <QDebug>
+#include <QSignalBlocker>
+#include <QFontDatabase>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Acq.h"
+#include "acquisitioncontrol.h"
+#include "acquisitionsession.h"
+#include "displaypacer.h"
+#include "frame.h"
+#include "framering.h"
+#include "liverenderer.h"
+#include "logger.h"
+#include "steadyclock.h"
+#include "telemetry.h"
+
+Q_DECLARE_METATYPE(std::shared_ptr<FrameRing>)
 
 // ------------------------------------------------------------------
 // AcquisitionWorker
-// This worker simulates an acquisition process by generating a new
-// grayscale image (with random pixel values) every second.
-// In your real application, replace this simulated code with your actual
-// image-acquisition API calls.
+// Runs an AcquisitionSession on its own thread and turns its callbacks
+// into signals for the GUI. The session drives the detector through the
+// XISL API (the software detector in xisl_sim/ on Linux), corrects every
+// frame and publishes it to a FrameRing that the GUI drains at its own
+// pace. startAcquisition() also streams every corrected frame into
+// <fileName>.his (or .hisz) so the file is complete when the last frame
+// arrives.
+//
+// calibrateOffset() runs the same loop on dark frames and loads the
+// resulting offset map into the correction engine for later runs.
+// calibrateGainLevel() does the same with flat fields, adding one
+// exposure level per run; one level loads plain gain, several load
+// multi-point (piecewise-linear) gain. Both reload the defect plan.
+//
+// The session reads its settings from the environment (see
+// AcquisitionSession::Options::fromEnvironment): DAQ_DESCRAMBLE sorts
+// raw readout order on the host, DAQ_ROI=x,y,w,h and DAQ_BINNING=2x2
+// (or 2x1, 4x1, 4x4, 3x3, 9to4, with :sum for 32-bit sums) crop and bin
+// the frames before anything else sees them, DAQ_CORRECTION_THREADS and
+// DAQ_CORRECTION_BAND_ROWS size the correction, DAQ_RECORD_BACKEND picks
+// how the .his file is written (auto, io_uring, pwrite or buffered),
+// DAQ_RECORD_DEPTH how many frames may be in flight to the disk, and
+// DAQ_RECORD_COMPRESS=left, up or median records 16-bit frames
+// losslessly compressed into .hisz instead. DAQ_AVERAGE=block:N,
+// moving:N or running averages the corrected frames before they are
+// recorded and shown (FrameAverager). DAQ_STATS=off, or regions
+// x,y,w,h;..., sets what FrameStatistics measures on every frame for
+// the live view's Auto window and the recording's median.
+//
+// While an acquisition runs, the worker's event loop is blocked, so
+// stop/pause requests go through control() directly rather than as
+// queued slot invocations.
 // ------------------------------------------------------------------
 class AcquisitionWorker : public QObject {
     Q_OBJECT
 public:
-    explicit AcquisitionWorker(QObject *parent = nullptr)
-        : QObject(parent), m_abort(false) {}
+    AcquisitionWorker(Logger *log, Telemetry *telemetry, QObject *parent = nullptr)
+        : QObject(parent), m_session(log, telemetry) {
+        AcquisitionSession::Callbacks callbacks;
+        callbacks.streamStarted = [this](std::shared_ptr<FrameRing> ring) { emit streamStarted(std::move(ring)); };
+        m_session.setCallbacks(std::move(callbacks));
+    }
+
+    // Safe to call from any thread.
+    AcquisitionControl &control() { return m_session.control(); }
+    AcquisitionSession::Stats stats() const { return m_session.stats(); }
 
 public slots:
     void startAcquisition(const QString &fileName, int frameCount) {
-        m_abort = false;
-        emit logMessage("Initializing detector...");
-        QThread::sleep(1);  // simulate initialization delay
-        emit logMessage("Detector initialized.");
-        emit logMessage(QString("Starting acquisition for %1 frame(s)...").arg(frameCount));
-
-        const int width = 320, height = 240;
-        for (int i = 1; i <= frameCount; ++i) {
-            if (m_abort) {
-                emit logMessage("Acquisition aborted by user.");
-                break;
-            }
-            // Create a simulated frame: a grayscale image with random pixel values.
-            QImage frame(width, height, QImage::Format_Grayscale8);
-            for (int y = 0; y < height; ++y) {
-                uchar *line = frame.scanLine(y);
-                for (int x = 0; x < width; ++x) {
-                    line[x] = static_cast<uchar>(QRandomGenerator::global()->bounded(256));
-                }
-            }
-            emit frameReady(frame);
-            emit logMessage(QString("Acquired frame %1 of %2.").arg(i).arg(frameCount));
-            emit frameCaptured(i, frameCount);
-            QThread::sleep(1);  // simulate delay between frames
-        }
-        if (!m_abort) {
-            emit logMessage("Acquisition complete. Saving frames...");
-            QThread::sleep(1);
-            emit logMessage(QString("Frames successfully saved to %1.his").arg(fileName));
-        }
+        m_session.run(AcquisitionSession::Mode::Acquire, fileName.toStdString(), frameCount);
         emit acquisitionFinished();
     }
 
-    void abortAcquisition() {
-        m_abort = true;
+    void calibrateOffset(int frameCount) {
+        m_session.run(AcquisitionSession::Mode::CalibrateOffset, std::string(), frameCount);
+        emit acquisitionFinished();
+    }
+
+    void calibrateGainLevel(int frameCount) {
+        m_session.run(AcquisitionSession::Mode::CalibrateGain, std::string(), frameCount);
+        emit acquisitionFinished();
+    }
+
+    void clearGain() {
+        m_session.clearGain();
     }
 
 signals:
-    void logMessage(const QString &msg);
-    void frameCaptured(int currentFrame, int totalFrames);
     void acquisitionFinished();
-    void frameReady(const QImage &frame);
+    void streamStarted(std::shared_ptr<FrameRing> ring);
+
+private:
+    AcquisitionSession m_session;
+};
+
+// ------------------------------------------------------------------
+// LiveViewLabel
+// A QLabel that tells the DisplayPacer and Telemetry when an image
+// handed to it has actually been painted, which is where display
+// latency ends.
+// ------------------------------------------------------------------
+class LiveViewLabel : public QLabel {
+public:
+    LiveViewLabel(DisplayPacer *pacer, Telemetry *telemetry) : m_pacer(pacer), m_telemetry(telemetry) {}
+
+    // 'frameTimestampNs' < 0: a re-render of a frame already counted.
+    void showImage(const QPixmap &pixmap, int64_t frameTimestampNs) {
+        setPixmap(pixmap);
+        m_pendingTimestampNs = frameTimestampNs;
+    }
+
+protected:
+    void paintEvent(QPaintEvent *event) override {
+        QLabel::paintEvent(event);
+        if (m_pendingTimestampNs >= 0) {
+            const int64_t now = steadyclock::nowNs();
+            m_pacer->painted(now);
+            m_telemetry->record(Telemetry::Stage::Display, now - m_pendingTimestampNs);
+        }
+        m_pendingTimestampNs = -1;
+    }
 
 private:
-    bool m_abort;
+    DisplayPacer *m_pacer;
+    Telemetry *m_telemetry;
+    int64_t m_pendingTimestampNs = -1;
 };
 
 // ------------------------------------------------------------------
 // MainWindow
 // This MainWindow provides a simple GUI with input fields for a file name
 // and frame count, Start/Stop buttons, a progress bar, a live view area,
-// and a log area.
+// and a log area. The live view is rendered off the GUI thread by a
+// LiveRenderer (reduction to the view size, window/level table); the GUI
+// thread only hands it frames and blits what comes back. The view is
+// polled at the maximum display rate and always shows the newest frame;
+// everything in between is skipped for display only (recording happens
+// before frames reach the ring).
+//
+// The metrics panel shows the pipeline Telemetry twice a second; with
+// DAQ_METRICS_JSON=<path> it is also written there as JSON at the end of
+// every acquisition.
 // ------------------------------------------------------------------
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -90,21 +169,39 @@ public:
     explicit MainWindow(QWidget *parent = nullptr)
         : QMainWindow(parent)
     {
+        qRegisterMetaType<std::shared_ptr<FrameRing>>();
         setupUI();
 
         // Create the acquisition worker and move it to its own thread.
-        worker = new AcquisitionWorker();
+        setupLog();
+        worker = new AcquisitionWorker(&logger, &telemetry);
         workerThread = new QThread(this);
         worker->moveToThread(workerThread);
         connect(workerThread, &QThread::finished, worker, &QObject::deleteLater);
-        connect(worker, &AcquisitionWorker::logMessage, this, &MainWindow::appendLog);
-        connect(worker, &AcquisitionWorker::frameCaptured, this, &MainWindow::updateProgress);
         connect(worker, &AcquisitionWorker::acquisitionFinished, this, &MainWindow::onAcquisitionFinished);
-        connect(worker, &AcquisitionWorker::frameReady, this, &MainWindow::updateLiveView);
+        connect(worker, &AcquisitionWorker::streamStarted, this, &MainWindow::onStreamStarted);
         workerThread->start();
+
+        // The live view polls the frame ring, and the progress bar the
+        // session's frame count, instead of receiving one queued event
+        // per frame. The timer keeps running between acquisitions so
+        // window/level changes re-render the last frame.
+        liveRenderer = std::make_unique<LiveRenderer>();
+        onDisplaySettingsChanged();
+        liveViewTimer = new QTimer(this);
+        liveViewTimer->setTimerType(Qt::PreciseTimer);
+        onDisplayRateChanged();
+        connect(liveViewTimer, &QTimer::timeout, this, &MainWindow::updateLiveView);
+        liveViewTimer->start();
+
+        metricsTimer = new QTimer(this);
+        metricsTimer->setInterval(500);
+        connect(metricsTimer, &QTimer::timeout, this, &MainWindow::refreshMetrics);
+        metricsTimer->start();
     }
 
     ~MainWindow() override {
+        worker->control().requestAbort();
         workerThread->quit();
         workerThread->wait();
     }
@@ -112,9 +209,13 @@ public:
 private slots:
     void onStartClicked() {
         startButton->setEnabled(false);
+        setCalibrationButtonsEnabled(false);
         stopButton->setEnabled(true);
+        pauseButton->setEnabled(true);
+        pauseButton->setText("Pause");
         logTextEdit->clear();
         progressBar->setValue(0);
+        progressTotal = frameSpinBox->value();
         QString fileName = fileNameEdit->text().trimmed();
         if (fileName.isEmpty())
             fileName = "capture";
@@ -125,33 +226,232 @@ private slots:
                                   Q_ARG(int, frameCount));
     }
 
+    void onCalibrateOffsetClicked() {
+        setCalibrationRunning();
+        appendLog("Starting offset calibration (close the X-ray source)...");
+        QMetaObject::invokeMethod(worker, "calibrateOffset", Q_ARG(int, frameSpinBox->value()));
+    }
+
+    void onAddGainLevelClicked() {
+        setCalibrationRunning();
+        appendLog("Starting gain level (open field at the desired dose)...");
+        QMetaObject::invokeMethod(worker, "calibrateGainLevel", Q_ARG(int, frameSpinBox->value()));
+    }
+
+    void onClearGainClicked() {
+        QMetaObject::invokeMethod(worker, "clearGain");
+    }
+
     void onStopClicked() {
         appendLog("Stopping acquisition...");
-        QMetaObject::invokeMethod(worker, "abortAcquisition");
+        worker->control().requestAbort();
         stopButton->setEnabled(false);
+        pauseButton->setEnabled(false);
+    }
+
+    void onPauseClicked() {
+        AcquisitionControl &control = worker->control();
+        if (control.isPaused()) {
+            if (control.requestResume())
+                pauseButton->setText("Pause");
+        } else if (control.requestPause()) {
+            pauseButton->setText("Resume");
+        }
     }
 
     void appendLog(const QString &msg) {
-        logTextEdit->append(msg);
+        logger.message(LEVEL_INFO, msg.toStdString());
+    }
+
+    // Totals kept by the ring, pool, pacer and logger join the worker's
+    // own measurements.
+    void refreshMetrics() {
+        if (frameRing) {
+            const FrameRing::Stats ringStats = frameRing->stats();
+            telemetry.set(Telemetry::Counter::RingOverrun, ringStats.dropped);
+            telemetry.set(Telemetry::Counter::PoolExhausted, frameRing->pool().stats().exhausted);
+            displayPacer.setOffered(ringStats.produced);
+            telemetry.set(Telemetry::Counter::DisplaySkipped, displayPacer.stats().skipped);
+        }
+        telemetry.set(Telemetry::Counter::LogDropped, logger.stats().dropped);
+        metricsView->setPlainText(QString::fromStdString(telemetry.summary()));
+    }
+
+    // One batched append per refresh; a run of coalesced per-frame
+    // messages shows up as its newest text and a count.
+    void refreshLogView() {
+        logger.takeLines(logLines);
+        if (logLines.empty())
+            return;
+        QString batch;
+        for (const Logger::Line &line : logLines) {
+            if (!batch.isEmpty())
+                batch += '\n';
+            if (line.level >= LEVEL_WARN)
+                batch += QString("%1: ").arg(Logger::levelName(line.level));
+            batch += QString::fromStdString(line.text);
+            if (line.count > 1)
+                batch += QString(" (x%1)").arg(line.count);
+        }
+        logTextEdit->appendPlainText(batch);
+    }
+
+    // Polled while a run is under way and once when it has finished; the
+    // session's counters belong to the current run as soon as it leaves
+    // Idle.
+    void updateProgress() {
+        if (progressTotal <= 0 || worker->control().state() == AcquisitionControl::State::Idle)
+            return;
+        showProgress();
+    }
+
+    void showProgress() {
+        const int64_t frames = worker->stats().frames;
+        progressBar->setValue(static_cast<int>(std::min<int64_t>(frames * 100 / progressTotal, 100)));
+    }
+
+    void onStreamStarted(std::shared_ptr<FrameRing> ring) {
+        frameRing = std::move(ring);
+        liveRenderer->setTargetSize(liveViewLabel->size().width(), liveViewLabel->size().height());
+        displayPacer.start(steadyclock::nowNs());
+        lastDisplayedFrame = 0;
     }
 
-    void updateProgress(int currentFrame, int totalFrames) {
-        int progress = (currentFrame * 100) / totalFrames;
-        progressBar->setValue(progress);
+    void onDisplayRateChanged() {
+        displayPacer.setMaxRate(displayRateSpinBox->value());
+        liveViewTimer->setInterval(displayPacer.intervalMs());
+    }
+
+    void onDisplaySettingsChanged() {
+        LiveRenderer::WindowLevel windowLevel;
+        windowLevel.low = static_cast<uint32_t>(windowLowSpinBox->value());
+        windowLevel.high = static_cast<uint32_t>(windowHighSpinBox->value());
+        windowLevel.curve = static_cast<LiveRenderer::Curve>(curveComboBox->currentIndex());
+        windowLevel.automatic = autoWindowCheckBox->isChecked();
+        windowLowSpinBox->setEnabled(!windowLevel.automatic);
+        windowHighSpinBox->setEnabled(!windowLevel.automatic);
+        liveRenderer->setFilter(static_cast<LiveRenderer::Filter>(filterComboBox->currentIndex()));
+        liveRenderer->setWindowLevel(windowLevel);
     }
 
     void onAcquisitionFinished() {
+        if (progressTotal > 0)
+            showProgress();
+        progressTotal = 0;
+        if (frameRing) {
+            // Show the final frame before the ring (and its pool) goes.
+            updateLiveView();
+            liveRenderer->waitIdle();
+            updateLiveView();
+            const FrameRing::Stats stats = frameRing->stats();
+            const FramePool::Stats poolStats = frameRing->pool().stats();
+            appendLog(QString("Frame ring: %1 produced, %2 read, %3 dropped, %4 pool misses.")
+                          .arg(stats.produced).arg(stats.consumed).arg(stats.dropped)
+                          .arg(poolStats.exhausted));
+            const LiveRenderer::Stats renderStats = liveRenderer->stats();
+            appendLog(QString("Live view: %1 rendered, %2 superseded, %3 ms per image.")
+                          .arg(renderStats.rendered).arg(renderStats.superseded)
+                          .arg(renderStats.averageRenderMs, 0, 'f', 2));
+            displayPacer.setOffered(stats.produced);
+            const DisplayPacer::Stats displayStats = displayPacer.stats();
+            appendLog(QString("Display: %1 of %2 frames shown, %3 skipped, %4 fps (max %5).")
+                          .arg(displayStats.displayed).arg(displayStats.offered).arg(displayStats.skipped)
+                          .arg(displayStats.rate, 0, 'f', 1).arg(displayPacer.maxRate(), 0, 'f', 0));
+            const Telemetry::StageSummary latency = telemetry.stage(Telemetry::Stage::Display);
+            appendLog(QString("Display latency (end of frame to paint): p50 %1 ms, p99 %2 ms, max %3 ms.")
+                          .arg(latency.p50Ms, 0, 'f', 2).arg(latency.p99Ms, 0, 'f', 2).arg(latency.maxMs, 0, 'f', 2));
+            refreshMetrics();
+            const uint64_t lost = telemetry.counter(Telemetry::Counter::DroppedImage)
+                                  + telemetry.counter(Telemetry::Counter::PacketLoss);
+            if (lost > 0)
+                logger.message(LEVEL_WARN, QString("%1 frame(s) lost before the host (%2 dropped by the detector, "
+                                                   "%3 to packet loss).")
+                                               .arg(lost)
+                                               .arg(telemetry.counter(Telemetry::Counter::DroppedImage))
+                                               .arg(telemetry.counter(Telemetry::Counter::PacketLoss))
+                                               .toStdString());
+            const QString metricsPath = qEnvironmentVariable("DAQ_METRICS_JSON");
+            if (!metricsPath.isEmpty() && !telemetry.writeJson(metricsPath.toStdString()))
+                logger.message(LEVEL_ERROR, "Cannot write metrics to " + metricsPath.toStdString());
+            frameRing.reset();
+        }
         appendLog("Acquisition finished.");
         startButton->setEnabled(true);
+        setCalibrationButtonsEnabled(true);
         stopButton->setEnabled(false);
+        pauseButton->setEnabled(false);
+        pauseButton->setText("Pause");
     }
 
-    void updateLiveView(const QImage &frame) {
-        liveViewLabel->setPixmap(QPixmap::fromImage(frame).scaled(
-            liveViewLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    // Drains the ring and passes only the newest frame to the renderer;
+    // older ones are released straight back to the producer. Blits the
+    // renderer's latest image, which is already at display size.
+    void updateLiveView() {
+        updateProgress();
+        if (frameRing) {
+            FrameRef newest;
+            while (FrameRing::Slot *slot = frameRing->tryAcquireRead()) {
+                newest = std::move(slot->frame);
+                frameRing->release(slot);
+            }
+            if (newest)
+                liveRenderer->submit(std::move(newest));
+            displayPacer.setOffered(frameRing->stats().produced);
+        }
+        const std::shared_ptr<const LiveRenderer::Image> image = liveRenderer->takeImage();
+        if (!image)
+            return;
+        // fromImage() copies, so the view need not outlive this call.
+        const QImage view(image->pixels.data(), static_cast<int>(image->width), static_cast<int>(image->height),
+                          static_cast<qint64>(image->width), QImage::Format_Grayscale8);
+        // Only the first showing of a frame counts towards display stats;
+        // window/level changes re-render frames already shown.
+        const bool fresh = frameRing && image->frameNumber != lastDisplayedFrame;
+        lastDisplayedFrame = image->frameNumber;
+        liveViewLabel->showImage(QPixmap::fromImage(view), fresh ? image->timestampNs : -1);
+        if (autoWindowCheckBox->isChecked()) {
+            // Show the window the statistics chose; unchecking Auto keeps it.
+            const QSignalBlocker lowBlocker(windowLowSpinBox);
+            const QSignalBlocker highBlocker(windowHighSpinBox);
+            windowLowSpinBox->setValue(static_cast<int>(image->low));
+            windowHighSpinBox->setValue(static_cast<int>(image->high));
+        }
     }
 
 private:
+    void setCalibrationButtonsEnabled(bool enabled) {
+        calibrateOffsetButton->setEnabled(enabled);
+        addGainLevelButton->setEnabled(enabled);
+        clearGainButton->setEnabled(enabled);
+    }
+
+    void setCalibrationRunning() {
+        startButton->setEnabled(false);
+        setCalibrationButtonsEnabled(false);
+        stopButton->setEnabled(true);
+        pauseButton->setEnabled(true);
+        pauseButton->setText("Pause");
+        logTextEdit->clear();
+        progressBar->setValue(0);
+        progressTotal = frameSpinBox->value();
+    }
+
+    // DAQ_LOG_LEVEL=trace|debug|info|warn|error|fatal|none (default debug,
+    // which includes the coalesced per-frame progress); DAQ_LOG_FILE
+    // additionally writes every entry to that file.
+    void setupLog() {
+        const XislLoggingLevels level =
+            Logger::parseLevel(qEnvironmentVariable("DAQ_LOG_LEVEL").toLower().toStdString());
+        logger.setLevel(level == LEVEL_ALL ? LEVEL_DEBUG : level);
+        const QString logFile = qEnvironmentVariable("DAQ_LOG_FILE");
+        if (!logFile.isEmpty() && !logger.openFile(logFile.toStdString()))
+            logger.message(LEVEL_ERROR, "Cannot open log file " + logFile.toStdString());
+        logViewTimer = new QTimer(this);
+        logViewTimer->setInterval(250);
+        connect(logViewTimer, &QTimer::timeout, this, &MainWindow::refreshLogView);
+        logViewTimer->start();
+    }
+
     void setupUI() {
         QWidget *central = new QWidget(this);
         QVBoxLayout *mainLayout = new QVBoxLayout(central);
@@ -168,21 +468,35 @@ private:
         QHBoxLayout *frameLayout = new QHBoxLayout();
         QLabel *frameLabel = new QLabel("Number of Frames:");
         frameSpinBox = new QSpinBox();
-        frameSpinBox->setRange(1, 600);
+        // Offset calibration wants hundreds to thousands of dark frames.
+        frameSpinBox->setRange(1, 65535);
         frameSpinBox->setValue(5);
         frameLayout->addWidget(frameLabel);
         frameLayout->addWidget(frameSpinBox);
         mainLayout->addLayout(frameLayout);
 
-        // Start and Stop buttons
+        // Start, Pause and Stop buttons
         QHBoxLayout *buttonLayout = new QHBoxLayout();
         startButton = new QPushButton("Start Acquisition");
+        pauseButton = new QPushButton("Pause");
         stopButton = new QPushButton("Stop Acquisition");
+        pauseButton->setEnabled(false);
         stopButton->setEnabled(false);
         buttonLayout->addWidget(startButton);
+        buttonLayout->addWidget(pauseButton);
         buttonLayout->addWidget(stopButton);
         mainLayout->addLayout(buttonLayout);
 
+        // Calibration buttons
+        QHBoxLayout *calibrationLayout = new QHBoxLayout();
+        calibrateOffsetButton = new QPushButton("Calibrate Offset");
+        addGainLevelButton = new QPushButton("Add Gain Level");
+        clearGainButton = new QPushButton("Clear Gain");
+        calibrationLayout->addWidget(calibrateOffsetButton);
+        calibrationLayout->addWidget(addGainLevelButton);
+        calibrationLayout->addWidget(clearGainButton);
+        mainLayout->addLayout(calibrationLayout);
+
         // Progress bar
         progressBar = new QProgressBar();
         progressBar->setRange(0, 100);
@@ -191,17 +505,57 @@ private:
         // Live view area
         QLabel *liveViewTitle = new QLabel("Live View:");
         mainLayout->addWidget(liveViewTitle);
-        liveViewLabel = new QLabel();
+        liveViewLabel = new LiveViewLabel(&displayPacer, &telemetry);
         liveViewLabel->setFixedSize(320, 240);
         liveViewLabel->setFrameStyle(QFrame::Box | QFrame::Sunken);
         liveViewLabel->setAlignment(Qt::AlignCenter);
         mainLayout->addWidget(liveViewLabel);
 
+        // Display: window/level and how frames are reduced to the view.
+        QHBoxLayout *displayLayout = new QHBoxLayout();
+        windowLowSpinBox = new QSpinBox();
+        windowLowSpinBox->setRange(0, 65535);
+        windowLowSpinBox->setValue(0);
+        windowHighSpinBox = new QSpinBox();
+        windowHighSpinBox->setRange(0, 65535);
+        windowHighSpinBox->setValue(65535);
+        autoWindowCheckBox = new QCheckBox("Auto");
+        autoWindowCheckBox->setToolTip("Window from each frame's percentile clip points");
+        curveComboBox = new QComboBox();
+        curveComboBox->addItem("Linear");     // order of LiveRenderer::Curve
+        curveComboBox->addItem("Log");
+        curveComboBox->addItem("Gamma");
+        filterComboBox = new QComboBox();
+        filterComboBox->addItem("Decimate");  // order of LiveRenderer::Filter
+        filterComboBox->addItem("Box filter");
+        displayLayout->addWidget(new QLabel("Window:"));
+        displayLayout->addWidget(windowLowSpinBox);
+        displayLayout->addWidget(windowHighSpinBox);
+        displayLayout->addWidget(autoWindowCheckBox);
+        displayLayout->addWidget(curveComboBox);
+        displayLayout->addWidget(filterComboBox);
+        displayRateSpinBox = new QSpinBox();
+        displayRateSpinBox->setRange(static_cast<int>(DisplayPacer::kMinRate), static_cast<int>(DisplayPacer::kMaxRate));
+        displayRateSpinBox->setValue(qEnvironmentVariableIntValue("DAQ_DISPLAY_FPS") > 0
+                                         ? qEnvironmentVariableIntValue("DAQ_DISPLAY_FPS") : 30);
+        displayLayout->addWidget(new QLabel("Max fps:"));
+        displayLayout->addWidget(displayRateSpinBox);
+        mainLayout->addLayout(displayLayout);
+
+        // Metrics: per-stage latency, queue depths and lost frames.
+        metricsView = new QPlainTextEdit();
+        metricsView->setReadOnly(true);
+        metricsView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+        metricsView->setFixedHeight(150);
+        mainLayout->addWidget(new QLabel("Metrics:"));
+        mainLayout->addWidget(metricsView);
+
         // Log output
         QLabel *logTitle = new QLabel("Log:");
         mainLayout->addWidget(logTitle);
-        logTextEdit = new QTextEdit();
+        logTextEdit = new QPlainTextEdit();
         logTextEdit->setReadOnly(true);
+        logTextEdit->setMaximumBlockCount(kLogViewLines);
         mainLayout->addWidget(logTextEdit);
 
         setCentralWidget(central);
@@ -209,21 +563,60 @@ private:
 
         // Connect button signals
         connect(startButton, &QPushButton::clicked, this, &MainWindow::onStartClicked);
+        connect(calibrateOffsetButton, &QPushButton::clicked, this, &MainWindow::onCalibrateOffsetClicked);
+        connect(addGainLevelButton, &QPushButton::clicked, this, &MainWindow::onAddGainLevelClicked);
+        connect(clearGainButton, &QPushButton::clicked, this, &MainWindow::onClearGainClicked);
+        connect(pauseButton, &QPushButton::clicked, this, &MainWindow::onPauseClicked);
         connect(stopButton, &QPushButton::clicked, this, &MainWindow::onStopClicked);
+        connect(windowLowSpinBox, &QSpinBox::valueChanged, this, &MainWindow::onDisplaySettingsChanged);
+        connect(windowHighSpinBox, &QSpinBox::valueChanged, this, &MainWindow::onDisplaySettingsChanged);
+        connect(autoWindowCheckBox, &QCheckBox::toggled, this, &MainWindow::onDisplaySettingsChanged);
+        connect(curveComboBox, &QComboBox::currentIndexChanged, this, &MainWindow::onDisplaySettingsChanged);
+        connect(filterComboBox, &QComboBox::currentIndexChanged, this, &MainWindow::onDisplaySettingsChanged);
+        connect(displayRateSpinBox, &QSpinBox::valueChanged, this, &MainWindow::onDisplayRateChanged);
     }
 
     // UI elements
     QLineEdit    *fileNameEdit;
     QSpinBox     *frameSpinBox;
     QPushButton  *startButton;
+    QPushButton  *calibrateOffsetButton;
+    QPushButton  *addGainLevelButton;
+    QPushButton  *clearGainButton;
+    QPushButton  *pauseButton;
     QPushButton  *stopButton;
-    QTextEdit    *logTextEdit;
+    QPlainTextEdit *logTextEdit;
     QProgressBar *progressBar;
-    QLabel       *liveViewLabel;
+    LiveViewLabel *liveViewLabel;
+    QSpinBox     *windowLowSpinBox;
+    QSpinBox     *windowHighSpinBox;
+    QCheckBox    *autoWindowCheckBox;
+    QComboBox    *curveComboBox;
+    QComboBox    *filterComboBox;
+    QSpinBox     *displayRateSpinBox;
+    QPlainTextEdit *metricsView;
 
     // Worker and thread
     AcquisitionWorker *worker;
     QThread           *workerThread;
+
+    // Log
+    static constexpr int kLogViewLines = 5000;
+    Logger                       logger;
+    QTimer                       *logViewTimer;
+    std::vector<Logger::Line>    logLines;
+
+    // Metrics
+    Telemetry                    telemetry;
+    QTimer                       *metricsTimer;
+
+    // Live view
+    QTimer                       *liveViewTimer;
+    std::shared_ptr<FrameRing>    frameRing;
+    std::unique_ptr<LiveRenderer> liveRenderer;     // after frameRing: destroyed first
+    DisplayPacer                  displayPacer;
+    uint64_t                      lastDisplayedFrame = 0;
+    int64_t                       progressTotal = 0;     // frames of the run under way; 0 when none
 };
 
 #include "main.moc"
@@ -0,0 +1,211 @@
+#include "offsetcalibrator.h"
+#include "accumulate.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+template <typename T>
+void addDeviationsScalar(const T *frame, const T *reference, uint32_t *sum, float *squares,
+                         size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i) {
+        sum[i] += frame[i];
+        const float d = static_cast<float>(static_cast<int32_t>(frame[i]) - static_cast<int32_t>(reference[i]));
+        squares[i] += d * d;
+    }
+}
+
+#if DAQ_SIMD_X86
+DAQ_TARGET_AVX2
+void addDeviationsAvx2(const uint16_t *frame, const uint16_t *reference, uint32_t *sum, float *squares,
+                       size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(frame + i)));
+        const __m256i r = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(reference + i)));
+        __m256i *s = reinterpret_cast<__m256i *>(sum + i);
+        _mm256_storeu_si256(s, _mm256_add_epi32(_mm256_loadu_si256(s), x));
+        const __m256 d = _mm256_cvtepi32_ps(_mm256_sub_epi32(x, r));
+        _mm256_storeu_ps(squares + i, _mm256_add_ps(_mm256_loadu_ps(squares + i), _mm256_mul_ps(d, d)));
+    }
+    addDeviationsScalar(frame, reference, sum, squares, i, count);
+}
+
+DAQ_TARGET_AVX2
+void addDeviationsAvx2(const uint32_t *frame, const uint32_t *reference, uint32_t *sum, float *squares,
+                       size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(frame + i));
+        const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(reference + i));
+        __m256i *s = reinterpret_cast<__m256i *>(sum + i);
+        _mm256_storeu_si256(s, _mm256_add_epi32(_mm256_loadu_si256(s), x));
+        const __m256 d = _mm256_cvtepi32_ps(_mm256_sub_epi32(x, r));
+        _mm256_storeu_ps(squares + i, _mm256_add_ps(_mm256_loadu_ps(squares + i), _mm256_mul_ps(d, d)));
+    }
+    addDeviationsScalar(frame, reference, sum, squares, i, count);
+}
+
+DAQ_TARGET_SSE41
+void addDeviationsSse41(const uint16_t *frame, const uint16_t *reference, uint32_t *sum, float *squares,
+                        size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i x = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(frame + i)));
+        const __m128i r = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(reference + i)));
+        __m128i *s = reinterpret_cast<__m128i *>(sum + i);
+        _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), x));
+        const __m128 d = _mm_cvtepi32_ps(_mm_sub_epi32(x, r));
+        _mm_storeu_ps(squares + i, _mm_add_ps(_mm_loadu_ps(squares + i), _mm_mul_ps(d, d)));
+    }
+    addDeviationsScalar(frame, reference, sum, squares, i, count);
+}
+
+DAQ_TARGET_SSE41
+void addDeviationsSse41(const uint32_t *frame, const uint32_t *reference, uint32_t *sum, float *squares,
+                        size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frame + i));
+        const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(reference + i));
+        __m128i *s = reinterpret_cast<__m128i *>(sum + i);
+        _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), x));
+        const __m128 d = _mm_cvtepi32_ps(_mm_sub_epi32(x, r));
+        _mm_storeu_ps(squares + i, _mm_add_ps(_mm_loadu_ps(squares + i), _mm_mul_ps(d, d)));
+    }
+    addDeviationsScalar(frame, reference, sum, squares, i, count);
+}
+#endif
+
+template <typename T>
+void addDeviations(const T *frame, const T *reference, uint32_t *sum, float *squares, size_t count)
+{
+#if DAQ_SIMD_X86
+    switch (simd::level()) {
+    case simd::Level::Avx2:  addDeviationsAvx2(frame, reference, sum, squares, count); return;
+    case simd::Level::Sse41: addDeviationsSse41(frame, reference, sum, squares, count); return;
+    default: break;
+    }
+#endif
+    addDeviationsScalar(frame, reference, sum, squares, 0, count);
+}
+
+} // namespace
+
+OffsetCalibrator::OffsetCalibrator(unsigned rows, unsigned columns, bool trackNoise)
+    : m_rows(rows), m_columns(columns), m_trackNoise(trackNoise)
+{
+}
+
+size_t OffsetCalibrator::memoryBytes() const
+{
+    return m_sum.capacity() * sizeof(uint32_t) + m_squares.capacity() * sizeof(float)
+         + m_reference16.capacity() * sizeof(uint16_t) + m_reference32.capacity() * sizeof(uint32_t);
+}
+
+void OffsetCalibrator::reset()
+{
+    m_frames = 0;
+    std::vector<uint32_t>().swap(m_sum);
+    std::vector<float>().swap(m_squares);
+    std::vector<uint16_t>().swap(m_reference16);
+    std::vector<uint32_t>().swap(m_reference32);
+}
+
+void OffsetCalibrator::add(const uint16_t *frame)
+{
+    const size_t count = pixelCount();
+    if (m_frames == 0) {
+        m_sum.assign(frame, frame + count);
+        if (m_trackNoise) {
+            m_reference16.assign(frame, frame + count);
+            m_squares.assign(count, 0.0f);
+        }
+    } else if (m_trackNoise) {
+        addDeviations(frame, m_reference16.data(), m_sum.data(), m_squares.data(), count);
+    } else {
+        accumulate::add(m_sum.data(), frame, count);
+    }
+    ++m_frames;
+}
+
+void OffsetCalibrator::add(const uint32_t *frame)
+{
+    const size_t count = pixelCount();
+    if (m_frames == 0) {
+        m_sum.assign(frame, frame + count);
+        if (m_trackNoise) {
+            m_reference32.assign(frame, frame + count);
+            m_squares.assign(count, 0.0f);
+        }
+    } else if (m_trackNoise) {
+        addDeviations(frame, m_reference32.data(), m_sum.data(), m_squares.data(), count);
+    } else {
+        accumulate::add(m_sum.data(), frame, count);
+    }
+    ++m_frames;
+}
+
+bool OffsetCalibrator::offsetMap(uint16_t *dst) const
+{
+    if (m_frames == 0)
+        return false;
+    const uint64_t half = m_frames / 2;
+    for (size_t i = 0; i < pixelCount(); ++i)
+        dst[i] = static_cast<uint16_t>(std::min<uint64_t>((m_sum[i] + half) / m_frames, 0xFFFF));
+    return true;
+}
+
+bool OffsetCalibrator::offsetMap32(uint32_t *dst) const
+{
+    if (m_frames == 0)
+        return false;
+    const uint64_t half = m_frames / 2;
+    for (size_t i = 0; i < pixelCount(); ++i)
+        dst[i] = static_cast<uint32_t>((m_sum[i] + half) / m_frames);
+    return true;
+}
+
+bool OffsetCalibrator::noiseMap(float *dst) const
+{
+    if (!m_trackNoise || m_frames < 2)
+        return false;
+    const double n = m_frames;
+    for (size_t i = 0; i < pixelCount(); ++i) {
+        const uint32_t reference = m_reference16.empty() ? m_reference32[i] : m_reference16[i];
+        const double deviationSum = static_cast<double>(m_sum[i]) - n * reference;
+        const double variance = (m_squares[i] - deviationSum * deviationSum / n) / (n - 1);
+        dst[i] = static_cast<float>(std::sqrt(std::max(variance, 0.0)));
+    }
+    return true;
+}
+
+OffsetCalibrator::Summary OffsetCalibrator::summary() const
+{
+    Summary summary;
+    if (m_frames == 0)
+        return summary;
+    const size_t count = pixelCount();
+    double total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += m_sum[i];
+    summary.meanOffset = total / m_frames / count;
+
+    std::vector<float> noise(count);
+    if (noiseMap(noise.data())) {
+        double noiseTotal = 0;
+        for (float sigma : noise) {
+            noiseTotal += sigma;
+            summary.maxNoise = std::max<double>(summary.maxNoise, sigma);
+        }
+        summary.meanNoise = noiseTotal / count;
+    }
+    return summary;
+}
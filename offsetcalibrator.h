@@ -0,0 +1,64 @@
+#ifndef OFFSETCALIBRATOR_H
+#define OFFSETCALIBRATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ------------------------------------------------------------------
+// OffsetCalibrator
+// Incremental dark-frame calibration, the streaming counterpart of
+// Acquisition_Acquire_OffsetImage. Frames are folded in one at a time,
+// so memory stays flat however many are averaged:
+//  - a 32-bit per-pixel sum gives the offset map (rounded mean), and
+//  - with noise tracking, the first frame is kept as a reference and
+//    the squared deviations from it are summed in float, which yields
+//    the per-pixel standard deviation without a second pass:
+//        var = (sum(d^2) - sum(d)^2 / N) / (N - 1),  d = x - reference
+//
+// That is 4 bytes per pixel for the offset alone and 10 (16-bit input)
+// or 12 (32-bit input) with noise. The 32-bit sum limits N to 65537
+// 16-bit or 16384 18-bit frames. Not thread-safe; feed it from one
+// thread.
+// ------------------------------------------------------------------
+class OffsetCalibrator {
+public:
+    struct Summary {
+        double meanOffset = 0;
+        double meanNoise = 0;
+        double maxNoise = 0;
+    };
+
+    OffsetCalibrator(unsigned rows, unsigned columns, bool trackNoise = true);
+
+    unsigned rows() const { return m_rows; }
+    unsigned columns() const { return m_columns; }
+    size_t pixelCount() const { return static_cast<size_t>(m_rows) * m_columns; }
+    uint32_t frames() const { return m_frames; }
+    bool tracksNoise() const { return m_trackNoise; }
+    size_t memoryBytes() const;
+
+    void reset();
+    // All frames of one calibration must have the same depth.
+    void add(const uint16_t *frame);
+    void add(const uint32_t *frame);
+
+    // Valid once at least one (noise: two) frames were added; return
+    // false otherwise.
+    bool offsetMap(uint16_t *dst) const;
+    bool offsetMap32(uint32_t *dst) const;
+    bool noiseMap(float *dst) const;
+    Summary summary() const;
+
+private:
+    const unsigned m_rows;
+    const unsigned m_columns;
+    const bool m_trackNoise;
+    uint32_t m_frames = 0;
+    std::vector<uint32_t> m_sum;
+    std::vector<float> m_squares;
+    std::vector<uint16_t> m_reference16;
+    std::vector<uint32_t> m_reference32;
+};
+
+#endif // OFFSETCALIBRATOR_H
@@ -0,0 +1,66 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// ------------------------------------------------------------------
+// SIMD dispatch helpers
+// Kernels are compiled per instruction set with function-level target
+// attributes and selected at runtime, so one binary runs on every
+// x86-64 host and uses AVX2 where it is available. DAQ_SIMD=scalar,
+// sse41 or avx2 caps the level (useful for benchmarking the fallbacks).
+// ------------------------------------------------------------------
+
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    #define DAQ_SIMD_X86 1
+    #include <immintrin.h>
+    #define DAQ_TARGET_SSE41 __attribute__((target("sse4.1")))
+    #define DAQ_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+    #define DAQ_SIMD_X86 0
+#endif
+
+namespace simd {
+
+enum class Level { Scalar = 0, Sse41 = 1, Avx2 = 2 };
+
+inline Level detectLevel()
+{
+#if DAQ_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return Level::Avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return Level::Sse41;
+#endif
+    return Level::Scalar;
+}
+
+inline Level level()
+{
+    static const Level selected = [] {
+        Level detected = detectLevel();
+        const char *cap = std::getenv("DAQ_SIMD");
+        Level limit = Level::Avx2;
+        if (cap && std::strcmp(cap, "scalar") == 0)
+            limit = Level::Scalar;
+        else if (cap && std::strcmp(cap, "sse41") == 0)
+            limit = Level::Sse41;
+        return static_cast<int>(detected) < static_cast<int>(limit) ? detected : limit;
+    }();
+    return selected;
+}
+
+inline const char *levelName(Level l)
+{
+    switch (l) {
+    case Level::Avx2:  return "avx2";
+    case Level::Sse41: return "sse4.1";
+    default:           return "scalar";
+    }
+}
+
+} // namespace simd
+
+#endif // SIMD_H
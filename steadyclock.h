@@ -0,0 +1,24 @@
+#ifndef STEADYCLOCK_H
+#define STEADYCLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+// ------------------------------------------------------------------
+// steadyclock
+// The clock of the core. End-of-frame timestamps, Telemetry's stage
+// latencies, log entries and write throughput are all nanoseconds on
+// std::chrono::steady_clock, so a timestamp taken in one module can be
+// subtracted from one taken in another.
+// ------------------------------------------------------------------
+namespace steadyclock {
+
+inline int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace steadyclock
+
+#endif // STEADYCLOCK_H
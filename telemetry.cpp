@@ -0,0 +1,243 @@
+#include "telemetry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// 'value' is non-zero.
+int msb(uint64_t value)
+{
+    return 63 - __builtin_clzll(value);
+}
+
+template <typename T>
+void raiseTo(std::atomic<T> &target, T value)
+{
+    T seen = target.load(std::memory_order_relaxed);
+    while (seen < value && !target.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+double toMs(int64_t ns)
+{
+    return ns / 1e6;
+}
+
+} // namespace
+
+size_t LatencyHistogram::bucketOf(uint64_t ns)
+{
+    constexpr uint64_t sub = uint64_t(1) << kSubBits;
+    if (ns < sub)
+        return static_cast<size_t>(ns);
+    const int top = std::min(msb(ns), static_cast<int>(kMaxBits));
+    if (top == static_cast<int>(kMaxBits))
+        return kBuckets - 1;
+    const int shift = top - static_cast<int>(kSubBits);
+    return static_cast<size_t>(shift + 1) * sub + static_cast<size_t>((ns >> shift) - sub);
+}
+
+uint64_t LatencyHistogram::upperEdge(size_t bucket)
+{
+    constexpr uint64_t sub = uint64_t(1) << kSubBits;
+    if (bucket < sub)
+        return bucket;
+    const unsigned shift = static_cast<unsigned>(bucket >> kSubBits) - 1;
+    const uint64_t mantissa = (bucket & (sub - 1)) + sub;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t ns)
+{
+    const uint64_t value = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+    m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    raiseTo<int64_t>(m_max, static_cast<int64_t>(value));
+}
+
+void LatencyHistogram::reset()
+{
+    for (std::atomic<uint64_t> &bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const
+{
+    const uint64_t n = count();
+    return n ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+int64_t LatencyHistogram::percentile(double fraction) const
+{
+    const uint64_t n = count();
+    if (n == 0)
+        return 0;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * n)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(static_cast<int64_t>(upperEdge(i)), max());
+    }
+    return max();
+}
+
+void Telemetry::reset()
+{
+    for (LatencyHistogram &stage : m_stages)
+        stage.reset();
+    for (GaugeState &gauge : m_gauges) {
+        gauge.current.store(0, std::memory_order_relaxed);
+        gauge.peak.store(0, std::memory_order_relaxed);
+        gauge.sum.store(0, std::memory_order_relaxed);
+        gauge.samples.store(0, std::memory_order_relaxed);
+    }
+    for (std::atomic<uint64_t> &counter : m_counters)
+        counter.store(0, std::memory_order_relaxed);
+}
+
+void Telemetry::sample(Gauge gauge, uint64_t value)
+{
+    GaugeState &state = m_gauges[index(gauge)];
+    state.current.store(value, std::memory_order_relaxed);
+    raiseTo<uint64_t>(state.peak, value);
+    state.sum.fetch_add(value, std::memory_order_relaxed);
+    state.samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+Telemetry::StageSummary Telemetry::stage(Stage stage) const
+{
+    const LatencyHistogram &histogram = m_stages[index(stage)];
+    StageSummary summary;
+    summary.count = histogram.count();
+    summary.p50Ms = toMs(histogram.percentile(0.50));
+    summary.p99Ms = toMs(histogram.percentile(0.99));
+    summary.maxMs = toMs(histogram.max());
+    summary.meanMs = histogram.mean() / 1e6;
+    return summary;
+}
+
+Telemetry::GaugeSummary Telemetry::gauge(Gauge gauge) const
+{
+    const GaugeState &state = m_gauges[index(gauge)];
+    GaugeSummary summary;
+    summary.current = state.current.load(std::memory_order_relaxed);
+    summary.peak = state.peak.load(std::memory_order_relaxed);
+    const uint64_t samples = state.samples.load(std::memory_order_relaxed);
+    summary.mean = samples ? static_cast<double>(state.sum.load(std::memory_order_relaxed)) / samples : 0.0;
+    return summary;
+}
+
+std::string Telemetry::summary() const
+{
+    std::string text;
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-8s %9s %9s %9s %9s\n", "stage", "frames", "p50 ms", "p99 ms", "max ms");
+    text += line;
+    for (size_t i = 0; i < kStages; ++i) {
+        const StageSummary s = stage(static_cast<Stage>(i));
+        std::snprintf(line, sizeof(line), "%-8s %9llu %9.3f %9.3f %9.3f\n", name(static_cast<Stage>(i)),
+                      static_cast<unsigned long long>(s.count), s.p50Ms, s.p99Ms, s.maxMs);
+        text += line;
+    }
+    for (size_t i = 0; i < kGauges; ++i) {
+        const GaugeSummary g = gauge(static_cast<Gauge>(i));
+        std::snprintf(line, sizeof(line), "queue %-11s now %3llu  peak %3llu  mean %6.2f\n",
+                      name(static_cast<Gauge>(i)), static_cast<unsigned long long>(g.current),
+                      static_cast<unsigned long long>(g.peak), g.mean);
+        text += line;
+    }
+    text += "lost:";
+    for (size_t i = 0; i < kCounters; ++i) {
+        std::snprintf(line, sizeof(line), " %s %llu", name(static_cast<Counter>(i)),
+                      static_cast<unsigned long long>(counter(static_cast<Counter>(i))));
+        text += line;
+    }
+    text += '\n';
+    return text;
+}
+
+std::string Telemetry::toJson() const
+{
+    std::string json = "{\n  \"stages\": {";
+    char item[256];
+    for (size_t i = 0; i < kStages; ++i) {
+        const StageSummary s = stage(static_cast<Stage>(i));
+        std::snprintf(item, sizeof(item),
+                      "%s\n    \"%s\": {\"count\": %llu, \"p50_ms\": %.4f, \"p99_ms\": %.4f, "
+                      "\"max_ms\": %.4f, \"mean_ms\": %.4f}",
+                      i ? "," : "", name(static_cast<Stage>(i)), static_cast<unsigned long long>(s.count),
+                      s.p50Ms, s.p99Ms, s.maxMs, s.meanMs);
+        json += item;
+    }
+    json += "\n  },\n  \"queues\": {";
+    for (size_t i = 0; i < kGauges; ++i) {
+        const GaugeSummary g = gauge(static_cast<Gauge>(i));
+        std::snprintf(item, sizeof(item), "%s\n    \"%s\": {\"current\": %llu, \"peak\": %llu, \"mean\": %.3f}",
+                      i ? "," : "", name(static_cast<Gauge>(i)), static_cast<unsigned long long>(g.current),
+                      static_cast<unsigned long long>(g.peak), g.mean);
+        json += item;
+    }
+    json += "\n  },\n  \"drops\": {";
+    for (size_t i = 0; i < kCounters; ++i) {
+        std::snprintf(item, sizeof(item), "%s\n    \"%s\": %llu", i ? "," : "", name(static_cast<Counter>(i)),
+                      static_cast<unsigned long long>(counter(static_cast<Counter>(i))));
+        json += item;
+    }
+    json += "\n  }\n}\n";
+    return json;
+}
+
+bool Telemetry::writeJson(const std::string &path) const
+{
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+    const std::string json = toJson();
+    const bool ok = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+const char *Telemetry::name(Stage stage)
+{
+    static const char *const names[kStages] = {"acquire", "sort", "bin", "correct", "average", "stats", "display", "write"};
+    return names[index(stage)];
+}
+
+const char *Telemetry::name(Gauge gauge)
+{
+    static const char *const names[kGauges] = {"ring", "write_queue"};
+    return names[index(gauge)];
+}
+
+const char *Telemetry::name(Counter counter)
+{
+    static const char *const names[kCounters] = {"dropped_image", "packet_loss", "ring_overrun",
+                                                 "pool_exhausted", "display_skipped", "log_dropped"};
+    return names[index(counter)];
+}
+
+std::string Telemetry::jsonString(const std::string &text)
+{
+    std::string json = "\"";
+    for (char c : text) {
+        const unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            json += '\\';
+            json += c;
+        } else if (byte < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+            json += escaped;
+        } else {
+            json += c;
+        }
+    }
+    return json + "\"";
+}
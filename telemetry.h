@@ -0,0 +1,132 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ------------------------------------------------------------------
+// LatencyHistogram
+// HDR-style histogram of nanosecond values: every power of two is split
+// into 2^kSubBits linear buckets, so any recorded value is known to
+// within about 3 % from 1 ns up to 2^kMaxBits ns (about 18 minutes;
+// longer values land in the last bucket). record() is a few relaxed
+// atomic adds and may be called from any number of threads.
+// ------------------------------------------------------------------
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBits = 5;
+    static constexpr unsigned kMaxBits = 40;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) << kSubBits;
+
+    void record(int64_t ns);
+    void reset();
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    int64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    double mean() const;
+    // The upper edge of the bucket holding the value at 'fraction'
+    // (0.5 = median), capped at max().
+    int64_t percentile(double fraction) const;
+
+    static size_t bucketOf(uint64_t ns);
+    static uint64_t upperEdge(size_t bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<int64_t> m_max{0};
+};
+
+// ------------------------------------------------------------------
+// Telemetry
+// Where the time goes between the detector's end-of-frame event and the
+// disk or the screen. Each stage gets a LatencyHistogram:
+//
+//  acquire  time spent in the end-frame callback (must stay below the
+//           frame period, or the library starts dropping frames)
+//  sort     host descrambling of the frame
+//  bin      the FrameBinner's ROI crop and binning
+//  correct  offset/gain/defect correction into the pooled frame
+//  average  folding the frame into the FrameAverager (and its mean)
+//  stats    the FrameStatistics pass over the delivered frame
+//  display  end-of-frame -> the live view has painted the frame
+//  write    end-of-frame -> the frame is in the file
+//
+// Gauges sample queue depths (current, peak, mean over samples) and
+// counters total the frames lost or skipped along the way, including
+// the library's XDE_DROPPED_IMAGE and XLE_HIS_ERROR_PACKET_LOSS events.
+// Everything is lock-free and may be updated from any thread; summary()
+// and toJson() read a consistent-enough snapshot for monitoring.
+// ------------------------------------------------------------------
+class Telemetry {
+public:
+    enum class Stage { Acquire, Sort, Bin, Correct, Average, Statistics, Display, Write };
+    enum class Gauge { Ring, WriteQueue };
+    enum class Counter { DroppedImage, PacketLoss, RingOverrun, PoolExhausted, DisplaySkipped, LogDropped };
+
+    static constexpr size_t kStages = 8;
+    static constexpr size_t kGauges = 2;
+    static constexpr size_t kCounters = 6;
+
+    struct StageSummary {
+        uint64_t count = 0;
+        double p50Ms = 0;
+        double p99Ms = 0;
+        double maxMs = 0;
+        double meanMs = 0;
+    };
+
+    struct GaugeSummary {
+        uint64_t current = 0;
+        uint64_t peak = 0;
+        double mean = 0;
+    };
+
+    // Clears everything at the start of an acquisition.
+    void reset();
+
+    void record(Stage stage, int64_t ns) { m_stages[index(stage)].record(ns); }
+    void sample(Gauge gauge, uint64_t value);
+    void add(Counter counter, uint64_t n = 1) { m_counters[index(counter)].fetch_add(n, std::memory_order_relaxed); }
+    // For totals kept elsewhere (FrameRing, FramePool, Logger).
+    void set(Counter counter, uint64_t value) { m_counters[index(counter)].store(value, std::memory_order_relaxed); }
+
+    StageSummary stage(Stage stage) const;
+    GaugeSummary gauge(Gauge gauge) const;
+    uint64_t counter(Counter counter) const { return m_counters[index(counter)].load(std::memory_order_relaxed); }
+
+    // A fixed-width text table for a metrics panel or a terminal.
+    std::string summary() const;
+    std::string toJson() const;
+    bool writeJson(const std::string &path) const;
+
+    static const char *name(Stage stage);
+    static const char *name(Gauge gauge);
+    static const char *name(Counter counter);
+
+    // 'text' as a JSON string, quotes included: '"' and '\' escaped,
+    // control characters as \uXXXX. For names and paths in the records
+    // written next to toJson().
+    static std::string jsonString(const std::string &text);
+
+private:
+    struct GaugeState {
+        std::atomic<uint64_t> current{0};
+        std::atomic<uint64_t> peak{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> samples{0};
+    };
+
+    template <typename E>
+    static size_t index(E value) { return static_cast<size_t>(value); }
+
+    std::array<LatencyHistogram, kStages> m_stages;
+    std::array<GaugeState, kGauges> m_gauges;
+    std::array<std::atomic<uint64_t>, kCounters> m_counters{};
+};
+
+#endif // TELEMETRY_H
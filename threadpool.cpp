@@ -0,0 +1,131 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+namespace {
+
+uint64_t packSpan(size_t begin, size_t end)
+{
+    return static_cast<uint64_t>(begin) << 32 | static_cast<uint64_t>(end);
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads)
+    : m_threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+    , m_runs(std::make_unique<Run[]>(m_threads))
+{
+    for (unsigned i = 0; i + 1 < m_threads; ++i)
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &task)
+{
+    if (count == 0)
+        return;
+    const unsigned participants = threadCount();
+    if (participants == 1 || count == 1 || count > UINT32_MAX) {
+        for (size_t i = 0; i < count; ++i)
+            task(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> batch(m_batchMutex);
+    m_task = &task;
+    m_remaining.store(count, std::memory_order_relaxed);
+
+    // Contiguous runs keep neighbouring bands on the same core. Release:
+    // whoever takes an index from a run also sees m_task.
+    const size_t perRun = (count + participants - 1) / participants;
+    for (unsigned r = 0; r < participants; ++r) {
+        const size_t begin = std::min(count, r * perRun);
+        const size_t end = std::min(count, begin + perRun);
+        m_runs[r].span.store(packSpan(begin, end), std::memory_order_release);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    runTasks(participants - 1);
+
+    std::unique_lock<std::mutex> lock(m_stateMutex);
+    m_done.wait(lock, [this] { return m_remaining.load(std::memory_order_acquire) == 0; });
+    m_task = nullptr;
+}
+
+void ThreadPool::workerLoop(unsigned self)
+{
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_stateMutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop)
+                return;
+            seen = m_generation;
+        }
+        runTasks(self);
+    }
+}
+
+void ThreadPool::runTasks(unsigned self)
+{
+    size_t index = 0;
+    while (popOwn(self, &index) || steal(self, &index)) {
+        (*m_task)(index);
+        if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(m_stateMutex);
+            m_done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::popOwn(unsigned self, size_t *index)
+{
+    std::atomic<uint64_t> &span = m_runs[self].span;
+    uint64_t current = span.load(std::memory_order_acquire);
+    for (;;) {
+        const size_t begin = static_cast<size_t>(current >> 32);
+        const size_t end = static_cast<size_t>(current & UINT32_MAX);
+        if (begin >= end)
+            return false;
+        if (span.compare_exchange_weak(current, packSpan(begin + 1, end), std::memory_order_acq_rel)) {
+            *index = begin;
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::steal(unsigned self, size_t *index)
+{
+    const unsigned runs = threadCount();
+    for (unsigned k = 1; k < runs; ++k) {
+        std::atomic<uint64_t> &span = m_runs[(self + k) % runs].span;
+        uint64_t current = span.load(std::memory_order_acquire);
+        for (;;) {
+            const size_t begin = static_cast<size_t>(current >> 32);
+            const size_t end = static_cast<size_t>(current & UINT32_MAX);
+            if (begin >= end)
+                break;
+            if (span.compare_exchange_weak(current, packSpan(begin, end - 1), std::memory_order_acq_rel)) {
+                *index = end - 1;
+                m_steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,73 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ------------------------------------------------------------------
+// ThreadPool
+// Fixed set of worker threads for data-parallel frame processing.
+// parallelFor(n, task) runs task(0) ... task(n-1) and returns when all
+// of them have finished; the calling thread works too. Indices are dealt
+// out in contiguous runs, one run per participant, and each participant
+// takes its own run front to back (so bands tend to finish in order)
+// while idle participants steal from the back of the others' runs.
+// A run is one atomic [begin, end) pair per participant, allocated with
+// the pool, so a parallelFor neither allocates nor locks to hand out
+// indices.
+//
+// One parallelFor runs at a time; concurrent callers are serialised.
+// ------------------------------------------------------------------
+class ThreadPool {
+public:
+    // 'threads' counts the caller: 1 means no workers. 0 picks
+    // std::thread::hardware_concurrency().
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned threadCount() const { return m_threads; }
+
+    void parallelFor(size_t count, const std::function<void(size_t)> &task);
+
+    // Tasks taken from another participant's queue since construction.
+    uint64_t steals() const { return m_steals.load(std::memory_order_relaxed); }
+
+private:
+    // begin in the high 32 bits, end in the low ones; the owner takes
+    // from begin, thieves from end.
+    struct alignas(64) Run {
+        std::atomic<uint64_t> span{0};
+    };
+
+    void workerLoop(unsigned self);
+    void runTasks(unsigned self);
+    bool popOwn(unsigned self, size_t *index);
+    bool steal(unsigned self, size_t *index);
+
+    const unsigned m_threads;
+    std::unique_ptr<Run[]> m_runs;                  // last one belongs to the caller
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_batchMutex;                        // serialises parallelFor
+    std::mutex m_stateMutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+
+    const std::function<void(size_t)> *m_task = nullptr;
+    std::atomic<size_t> m_remaining{0};
+    std::atomic<uint64_t> m_steals{0};
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,35 @@
+/**
+ * @file windefines.h
+ * @brief Win32 type definitions required by Acq.h on Linux.
+ *
+ * The XISL headers are written against <Windows.h>. This header provides
+ * the subset of Win32 types they use with the same sizes as on Windows,
+ * so that structures such as WinHeaderType keep their on-disk layout.
+ */
+
+#ifndef WINDEFINES_H
+#define WINDEFINES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int             BOOL;
+typedef unsigned char   BYTE;
+typedef char            CHAR;
+typedef unsigned short  WORD;
+typedef uint32_t        DWORD;
+typedef unsigned int    UINT;
+typedef void           *HANDLE;
+typedef void           *HWND;
+
+#ifndef TRUE
+    #define TRUE  1
+#endif
+#ifndef FALSE
+    #define FALSE 0
+#endif
+
+#define WINAPI
+#define CALLBACK
+
+#endif // WINDEFINES_H
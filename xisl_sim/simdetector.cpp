@@ -0,0 +1,306 @@
+#include "simdetector.h"
+#include "accumulate.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+UINT envValue(const char *name, UINT fallback)
+{
+    const char *value = std::getenv(name);
+    if (!value || !*value)
+        return fallback;
+    char *end = nullptr;
+    unsigned long parsed = std::strtoul(value, &end, 10);
+    return (end && *end == '\0') ? static_cast<UINT>(parsed) : fallback;
+}
+
+DWORD cycleTimeFromFps(UINT fps)
+{
+    return fps ? static_cast<DWORD>(1000000u / fps) : 0;
+}
+
+} // namespace
+
+SimDetector::SimDetector(int channel, UINT rows, UINT columns)
+    : m_channel(channel),
+      m_rows(rows ? rows : envValue("XISL_SIM_ROWS", 2048)),
+      m_columns(columns ? columns : envValue("XISL_SIM_COLUMNS", 2048)),
+      m_bits(std::clamp<UINT>(envValue("XISL_SIM_BITS", 16), 8, 18)),
+      m_cycleTimeUs(cycleTimeFromFps(envValue("XISL_SIM_FPS", 15))),
+      m_dropEvery(envValue("XISL_SIM_DROP_EVERY", 0)),
+      m_packetLossEvery(envValue("XISL_SIM_PACKET_LOSS_EVERY", 0))
+{
+    FrameGeneratorConfig config = FrameGeneratorConfig::forPanel(m_rows, m_columns, std::min<UINT>(m_bits, 16));
+    config.seed ^= static_cast<uint64_t>(channel) << 32;
+    m_generator = std::make_unique<FrameGenerator>(config);
+
+    const UINT readout = envValue("XISL_SIM_READOUT", HIS_SORT_NOSORT);
+    if (readout != HIS_SORT_NOSORT) {
+        m_readout = std::make_unique<Descrambler>(m_rows, m_columns, readout);
+        if (!m_readout->isValid())
+            m_readout.reset();
+    }
+}
+
+SimDetector::~SimDetector()
+{
+    abort();
+    joinFinished();
+}
+
+void SimDetector::setCallbacks(Callback endFrame, Callback endAcq)
+{
+    m_endFrame = endFrame;
+    m_endAcq = endAcq;
+}
+
+void SimDetector::setEventCallback(XIS_EventCallback callback, void *userData)
+{
+    m_event = callback;
+    m_eventData = userData;
+}
+
+// True if this detector frame is lost on the way to the host; the loss
+// is reported through the event callback.
+bool SimDetector::lose(DWORD frameCounter)
+{
+    XIS_Event event;
+    UINT type;
+    if (m_dropEvery && frameCounter % m_dropEvery == 0) {
+        event = XE_DETECTOR_EVENT;
+        type = XDE_DROPPED_IMAGE;
+    } else if (m_packetLossEvery && frameCounter % m_packetLossEvery == 0) {
+        event = XE_LIBRARY_EVENT;
+        type = XLE_HIS_ERROR_PACKET_LOSS;
+    } else {
+        return false;
+    }
+    if (m_event)
+        m_event(event, type, frameCounter, nullptr, m_eventData);
+    return true;
+}
+
+UINT SimDetector::defineDestBuffers(unsigned short *buffer, UINT frames, UINT rows, UINT columns)
+{
+    if (isAcquiring())
+        return m_lastError = HIS_ERROR_ACQ_ALREADY_RUNNING;
+    if (!buffer || frames == 0 || rows != m_rows || columns != m_columns)
+        return m_lastError = HIS_ERROR_INVALID_PARAM;
+    m_dest = buffer;
+    m_destFrames = frames;
+    return m_lastError = HIS_ALL_OK;
+}
+
+UINT SimDetector::setCycleTime(DWORD *cycleTimeUs)
+{
+    if (!cycleTimeUs)
+        return m_lastError = HIS_ERROR_INVALID_PARAM;
+    m_cycleTimeUs = *cycleTimeUs;
+    return m_lastError = HIS_ALL_OK;
+}
+
+UINT SimDetector::acquire(UINT frames, UINT skipFrames, UINT options)
+{
+    if (isAcquiring())
+        return m_lastError = HIS_ERROR_ACQ_ALREADY_RUNNING;
+    if (!m_dest)
+        return m_lastError = HIS_ERROR_INVALID_PARAM;
+    if (!(options & HIS_SEQ_CONTINUOUS) && frames == 0)
+        return m_lastError = HIS_ERROR_INVALID_PARAM;
+
+    joinFinished();
+    m_abort.store(false);
+    m_abortCurrent.store(false);
+    m_actAcqFrame.store(0);
+    m_actSecBuffFrame.store(0);
+    m_acquiring.store(true, std::memory_order_release);
+    m_thread = std::thread(&SimDetector::run, this, frames, skipFrames, options);
+    return m_lastError = HIS_ALL_OK;
+}
+
+UINT SimDetector::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_abort.store(true);
+    }
+    m_waitCond.notify_all();
+    // Abort may be issued from inside a callback; never join ourselves.
+    if (m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id())
+        m_thread.join();
+    return m_lastError = HIS_ALL_OK;
+}
+
+UINT SimDetector::abortCurrentFrame()
+{
+    if (!isAcquiring())
+        return m_lastError = HIS_ERROR_ABORTCURRFRAME;
+    m_abortCurrent.store(true);
+    return m_lastError = HIS_ALL_OK;
+}
+
+UINT SimDetector::resetFrameCount()
+{
+    m_frameCounter.store(0);
+    return m_lastError = HIS_ALL_OK;
+}
+
+void SimDetector::actFrame(DWORD *actAcqFrame, DWORD *actSecBuffFrame) const
+{
+    if (actAcqFrame)
+        *actAcqFrame = m_actAcqFrame.load(std::memory_order_acquire);
+    if (actSecBuffFrame)
+        *actSecBuffFrame = m_actSecBuffFrame.load(std::memory_order_acquire);
+}
+
+void SimDetector::latestHeader(CHwHeaderInfo *info, CHwHeaderInfoEx *infoEx) const
+{
+    if (info) {
+        std::memset(info, 0, sizeof(*info));
+        info->dwNrRows = m_rows;
+        info->dwNrColumns = m_columns;
+        info->dwFrmNrRows = m_rows;
+        info->dwDataType = isWide() ? DATALONG : DATASHORT;
+        info->dwDataSorting = m_sortFlags;
+        info->dwBias = m_bits;
+    }
+    if (infoEx) {
+        std::memset(infoEx, 0, sizeof(*infoEx));
+        infoEx->wNrRows = static_cast<WORD>(m_rows);
+        infoEx->wNrColumns = static_cast<WORD>(m_columns);
+        infoEx->wResolutionX = static_cast<WORD>(m_columns);
+        infoEx->wResolutionY = static_cast<WORD>(m_rows);
+        infoEx->wFrmNrRows = static_cast<WORD>(m_rows);
+        infoEx->wDataSorting = static_cast<WORD>(m_sortFlags);
+        infoEx->wFrameCnt = static_cast<WORD>(m_frameCounter.load());
+        infoEx->wRealInttime_milliSec = static_cast<WORD>(m_cycleTimeUs / 1000);
+        infoEx->wRealInttime_microSec = static_cast<WORD>(m_cycleTimeUs % 1000);
+    }
+}
+
+// Frame scheduling. Sequence options are interpreted as follows:
+//  - HIS_SEQ_ONE_BUFFER / HIS_SEQ_TWO_BUFFERS: 'frames' frames are stored,
+//    wrapping around the destination buffers if fewer were defined.
+//  - HIS_SEQ_CONTINUOUS: the destination buffers form a ring that is
+//    refilled until Acquisition_Abort.
+//  - HIS_SEQ_DEST_ONE_FRAME: every frame goes into the first buffer.
+//  - HIS_SEQ_AVERAGE: 'frames' frames are averaged into the first buffer.
+//  - HIS_SEQ_AVERAGESEQ: every destination buffer receives the average of
+//    'frames' consecutive frames.
+//  - HIS_SEQ_COLLATE: 'skipFrames' frames are read out and discarded
+//    after every stored frame.
+void SimDetector::run(UINT frames, UINT skipFrames, UINT options)
+{
+    const bool continuous = options & HIS_SEQ_CONTINUOUS;
+    const bool averageOne = options & HIS_SEQ_AVERAGE;
+    const bool averageSeq = options & HIS_SEQ_AVERAGESEQ;
+    const UINT perOutput = (averageOne || averageSeq) ? std::max<UINT>(frames, 1) : 1;
+    const UINT outputs = continuous ? 0 : averageOne ? 1 : averageSeq ? m_destFrames : frames;
+    const bool oneFrame = averageOne || (options & HIS_SEQ_DEST_ONE_FRAME);
+    const UINT skip = (options & HIS_SEQ_COLLATE) ? skipFrames : 0;
+    const size_t pixels = static_cast<size_t>(m_rows) * m_columns;
+    const size_t frameBytes = pixels * (isWide() ? sizeof(uint32_t) : sizeof(uint16_t));
+
+    if (perOutput > 1)
+        m_average.assign(pixels, 0);
+    if (isWide())
+        m_scratch.resize(pixels);
+
+    auto next = std::chrono::steady_clock::now();
+    for (UINT stored = 0; (outputs == 0 || stored < outputs) && !m_abort.load(); ) {
+        const UINT slot = oneFrame ? 0 : stored % m_destFrames;
+        void *dest = static_cast<uint8_t *>(m_dest) + slot * frameBytes;
+
+        UINT integrated = 0;
+        while (integrated < perOutput && !m_abort.load()) {
+            waitForFrame(next);
+            if (m_abort.load())
+                break;
+            const DWORD counter = m_frameCounter.fetch_add(1) + 1;
+            if (m_abortCurrent.exchange(false) || lose(counter))
+                continue;
+            renderFrame(dest);
+            if (perOutput > 1) {
+                if (isWide())
+                    accumulate::add(m_average.data(), static_cast<const uint32_t *>(dest), pixels);
+                else
+                    accumulate::add(m_average.data(), static_cast<const uint16_t *>(dest), pixels);
+            }
+            ++integrated;
+        }
+        if (integrated < perOutput)
+            break;
+
+        if (perOutput > 1) {
+            if (isWide())
+                accumulate::mean(m_average.data(), static_cast<uint32_t *>(dest), pixels, perOutput);
+            else
+                accumulate::mean(m_average.data(), static_cast<uint16_t *>(dest), pixels, perOutput);
+            std::fill(m_average.begin(), m_average.end(), 0);
+        }
+
+        m_actSecBuffFrame.store(slot + 1, std::memory_order_release);
+        m_actAcqFrame.store(++stored, std::memory_order_release);
+        if (m_endFrame)
+            m_endFrame(handle());
+
+        for (UINT s = 0; s < skip && !m_abort.load(); ++s) {
+            waitForFrame(next);
+            m_frameCounter.fetch_add(1);
+        }
+    }
+
+    if (m_endAcq)
+        m_endAcq(handle());
+    m_acquiring.store(false, std::memory_order_release);
+}
+
+void SimDetector::waitForFrame(std::chrono::steady_clock::time_point &next)
+{
+    if (m_cycleTimeUs == 0)
+        return;
+    const auto period = std::chrono::microseconds(m_cycleTimeUs);
+    const auto now = std::chrono::steady_clock::now();
+    // A consumer that blocks the callback for longer than a frame loses
+    // those readouts, just like the real panel; do not burst to catch up.
+    if (next + period < now)
+        next = now;
+    std::unique_lock<std::mutex> lock(m_waitMutex);
+    m_waitCond.wait_until(lock, next, [this] { return m_abort.load(); });
+    next += period;
+}
+
+void SimDetector::renderFrame(void *dest)
+{
+    const bool raw = m_readout && m_readout->sortMode() != m_sortFlags;
+    void *target = dest;
+    if (raw) {
+        m_unsorted.resize((m_readout->pixelCount() * (isWide() ? 4 : 2) + 3) / 4);
+        target = m_unsorted.data();
+    }
+    if (!isWide()) {
+        m_generator->render(static_cast<uint16_t *>(target), m_frameCounter.load());
+    } else {
+        // The generator is 16-bit; scale its output up to the panel's range.
+        m_generator->render(m_scratch.data(), m_frameCounter.load());
+        uint32_t *out = static_cast<uint32_t *>(target);
+        const unsigned shift = m_bits - 16;
+        for (size_t i = 0; i < m_scratch.size(); ++i)
+            out[i] = static_cast<uint32_t>(m_scratch[i]) << shift;
+    }
+    if (!raw)
+        return;
+    if (isWide())
+        m_readout->scramble(m_unsorted.data(), static_cast<uint32_t *>(dest));
+    else
+        m_readout->scramble(reinterpret_cast<const uint16_t *>(m_unsorted.data()), static_cast<uint16_t *>(dest));
+}
+
+void SimDetector::joinFinished()
+{
+    if (m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id())
+        m_thread.join();
+}
@@ -0,0 +1,131 @@
+#ifndef SIMDETECTOR_H
+#define SIMDETECTOR_H
+
+#include "Acq.h"
+#include "descrambler.h"
+#include "framegenerator.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ------------------------------------------------------------------
+// SimDetector
+// Software model of one flat panel behind the XISL API. Each detector
+// owns an acquisition thread that renders frames at the configured
+// cycle time straight into the caller's destination buffers and fires
+// the end-frame / end-acquisition callbacks exactly like the vendor
+// library does, so the host-side frame path can be exercised on Linux.
+//
+// Geometry, frame rate and bit depth default to the environment
+// (XISL_SIM_ROWS, XISL_SIM_COLUMNS, XISL_SIM_FPS, XISL_SIM_BITS) and
+// can be overridden per detector through the regular API calls.
+// XISL_SIM_BITS above 16 models a DETEKTOR_DATATYPE_18BIT panel: the
+// destination buffers then hold 32-bit pixels.
+//
+// XISL_SIM_READOUT=<HIS_SORT_* value> makes the panel clock its pixels
+// out in that mode's channel order (see Descrambler). Frames are sorted
+// as the library would only when the same mode is passed as the sort
+// flags; otherwise the buffers receive the raw readout order.
+//
+// XISL_SIM_DROP_EVERY=N loses every Nth detector frame and reports it
+// through the event callback as XE_DETECTOR_EVENT / XDE_DROPPED_IMAGE;
+// XISL_SIM_PACKET_LOSS_EVERY=N does the same as XE_LIBRARY_EVENT /
+// XLE_HIS_ERROR_PACKET_LOSS, the GigE library's lost-frame event.
+//
+// XISL_SIM_SENSORS=N panels are found by Acquisition_EnumSensors and
+// XISL_SIM_GBIF=N more by the GbIF device list; each is a detector of
+// its own with its own acquisition thread.
+// ------------------------------------------------------------------
+class SimDetector {
+public:
+    typedef void (CALLBACK *Callback)(HACQDESC);
+
+    SimDetector(int channel, UINT rows, UINT columns);
+    ~SimDetector();
+
+    SimDetector(const SimDetector &) = delete;
+    SimDetector &operator=(const SimDetector &) = delete;
+
+    HACQDESC handle() { return static_cast<HACQDESC>(this); }
+    int channel() const { return m_channel; }
+    UINT channelType() const { return m_channelType; }
+    UINT rows() const { return m_rows; }
+    UINT columns() const { return m_columns; }
+    UINT bitsPerPixel() const { return m_bits; }
+    bool isWide() const { return m_bits > 16; }
+    DWORD dataType() const { return isWide() ? DETEKTOR_DATATYPE_18BIT : DATASHORT; }
+    UINT sortFlags() const { return m_sortFlags; }
+    UINT destFrames() const { return m_destFrames; }
+    DWORD cycleTimeUs() const { return m_cycleTimeUs; }
+
+    void setSortFlags(UINT sortFlags) { m_sortFlags = sortFlags; }
+    void setChannelType(UINT channelType) { m_channelType = channelType; }
+    void setCallbacks(Callback endFrame, Callback endAcq);
+    void setAcqData(void *data) { m_acqData = data; }
+    void setEventCallback(XIS_EventCallback callback, void *userData);
+    void *acqData() const { return m_acqData; }
+
+    UINT defineDestBuffers(unsigned short *buffer, UINT frames, UINT rows, UINT columns);
+    UINT setCycleTime(DWORD *cycleTimeUs);
+    UINT acquire(UINT frames, UINT skipFrames, UINT options);
+    UINT abort();
+    UINT abortCurrentFrame();
+    UINT resetFrameCount();
+    bool isAcquiring() const { return m_acquiring.load(std::memory_order_acquire); }
+
+    void actFrame(DWORD *actAcqFrame, DWORD *actSecBuffFrame) const;
+    void latestHeader(CHwHeaderInfo *info, CHwHeaderInfoEx *infoEx) const;
+    DWORD lastError() const { return m_lastError; }
+
+private:
+    void run(UINT frames, UINT skipFrames, UINT options);
+    void waitForFrame(std::chrono::steady_clock::time_point &next);
+    void renderFrame(void *dest);
+    void joinFinished();
+    bool lose(DWORD frameCounter);
+
+    const int m_channel;
+    UINT m_channelType = HIS_BOARD_TYPE_NOONE;
+    UINT m_rows;
+    UINT m_columns;
+    UINT m_bits;
+    UINT m_sortFlags = HIS_SORT_NOSORT;
+    DWORD m_cycleTimeUs;
+    std::unique_ptr<Descrambler> m_readout;   // null: the panel reads out in image order
+
+    void *m_dest = nullptr;         // unsigned short or, for wide panels, DWORD pixels
+    UINT m_destFrames = 0;
+
+    Callback m_endFrame = nullptr;
+    Callback m_endAcq = nullptr;
+    void *m_acqData = nullptr;
+    XIS_EventCallback m_event = nullptr;
+    void *m_eventData = nullptr;
+    UINT m_dropEvery = 0;
+    UINT m_packetLossEvery = 0;
+
+    std::thread m_thread;
+    std::mutex m_waitMutex;
+    std::condition_variable m_waitCond;
+    std::atomic<bool> m_acquiring{false};
+    std::atomic<bool> m_abort{false};
+    std::atomic<bool> m_abortCurrent{false};
+
+    std::atomic<DWORD> m_actAcqFrame{0};
+    std::atomic<DWORD> m_actSecBuffFrame{0};
+    std::atomic<DWORD> m_frameCounter{0};
+    DWORD m_lastError = HIS_ALL_OK;
+
+    std::vector<uint32_t> m_average;
+    std::vector<uint16_t> m_scratch;   // 16-bit render target for wide panels
+    std::vector<uint32_t> m_unsorted;  // image-order frame before scrambling
+    std::unique_ptr<FrameGenerator> m_generator;
+};
+
+#endif // SIMDETECTOR_H
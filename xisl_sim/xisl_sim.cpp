@@ -0,0 +1,432 @@
+// ------------------------------------------------------------------
+// XISL API on top of SimDetector
+// Implements the acquisition subset of Acq.h for Linux build and CI
+// hosts that have no panel attached. Handles are SimDetector pointers
+// that are validated against the registry on every call.
+// ------------------------------------------------------------------
+
+#include "Acq.h"
+#include "simdetector.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+std::mutex g_registryMutex;
+std::vector<std::unique_ptr<SimDetector>> g_detectors;
+
+SimDetector *lookup(HACQDESC hAcqDesc)
+{
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    for (const auto &detector : g_detectors) {
+        if (detector->handle() == hAcqDesc)
+            return detector.get();
+    }
+    return nullptr;
+}
+
+UINT sensorCountFromEnv()
+{
+    const char *value = std::getenv("XISL_SIM_SENSORS");
+    const int count = value ? std::atoi(value) : 1;
+    return static_cast<UINT>(std::max(count, 1));
+}
+
+UINT gbifCountFromEnv()
+{
+    const char *value = std::getenv("XISL_SIM_GBIF");
+    const int count = value ? std::atoi(value) : 0;
+    return static_cast<UINT>(std::max(count, 0));
+}
+
+// The index'th simulated GigE panel, as the device list reports it.
+GBIF_DEVICE_PARAM gbifDevice(UINT index)
+{
+    GBIF_DEVICE_PARAM device;
+    std::memset(&device, 0, sizeof(device));
+    std::snprintf(reinterpret_cast<char *>(device.ucMacAddress), sizeof(device.ucMacAddress), "0050C29B%04X",
+                  index & 0xFFFF);
+    std::snprintf(reinterpret_cast<char *>(device.ucIP), sizeof(device.ucIP), "192.168.10.%u", 10 + index % 240);
+    std::snprintf(reinterpret_cast<char *>(device.ucSubnetMask), sizeof(device.ucSubnetMask), "255.255.255.0");
+    device.dwIPCurrentBootOptions = HIS_GbIF_IP_STATIC;
+    std::snprintf(device.cManufacturerName, sizeof(device.cManufacturerName), "xisl_sim");
+    std::snprintf(device.cModelName, sizeof(device.cModelName), "GbIF panel");
+    std::snprintf(device.cDeviceName, sizeof(device.cDeviceName), "simgbif%u", index);
+    return device;
+}
+
+} // namespace
+
+HIS_RETURN Acquisition_Init(HACQDESC *phAcqDesc, DWORD, int nChannelNr, BOOL,
+                            UINT Rows, UINT Columns, UINT dwSortFlags, BOOL, BOOL)
+{
+    if (!phAcqDesc)
+        return HIS_ERROR_INVALID_PARAM;
+    auto detector = std::make_unique<SimDetector>(nChannelNr, Rows, Columns);
+    detector->setSortFlags(dwSortFlags);
+    *phAcqDesc = detector->handle();
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    g_detectors.push_back(std::move(detector));
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_EnumSensors(UINT *pdwNumSensors, BOOL, BOOL)
+{
+    if (!pdwNumSensors)
+        return HIS_ERROR_INVALID_PARAM;
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    if (g_detectors.empty()) {
+        const UINT count = sensorCountFromEnv();
+        for (UINT i = 0; i < count; ++i)
+            g_detectors.push_back(std::make_unique<SimDetector>(static_cast<int>(i), 0, 0));
+    }
+    *pdwNumSensors = static_cast<UINT>(g_detectors.size());
+    return HIS_ALL_OK;
+}
+
+// Pos is an opaque cursor: 0 on the first call, 0 again after the last sensor.
+HIS_RETURN Acquisition_GetNextSensor(ACQDESCPOS *Pos, HACQDESC *phAcqDesc)
+{
+    if (!Pos || !phAcqDesc)
+        return HIS_ERROR_INVALID_PARAM;
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    const size_t index = static_cast<size_t>(reinterpret_cast<uintptr_t>(*Pos));
+    if (index >= g_detectors.size())
+        return HIS_ERROR_NODESC_AVAILABLE;
+    *phAcqDesc = g_detectors[index]->handle();
+    const size_t next = index + 1;
+    *Pos = next < g_detectors.size() ? reinterpret_cast<ACQDESCPOS>(static_cast<uintptr_t>(next)) : 0;
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GbIF_GetDeviceCnt(long *plNrOfboards)
+{
+    if (!plNrOfboards)
+        return HIS_ERROR_INVALID_PARAM;
+    *plNrOfboards = static_cast<long>(gbifCountFromEnv());
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GbIF_GetDeviceList(GBIF_DEVICE_PARAM *pGBIF_DEVICE_PARAM, int nDeviceCnt)
+{
+    if (!pGBIF_DEVICE_PARAM || nDeviceCnt < 0 || static_cast<UINT>(nDeviceCnt) > gbifCountFromEnv())
+        return HIS_ERROR_INVALID_PARAM;
+    for (int i = 0; i < nDeviceCnt; ++i)
+        pGBIF_DEVICE_PARAM[i] = gbifDevice(static_cast<UINT>(i));
+    return HIS_ALL_OK;
+}
+
+// Opens the device whose IP, MAC or name matches ucAddress, or the
+// first one for HIS_GbIF_FIRST_CAM.
+HIS_RETURN Acquisition_GbIF_Init(HACQDESC *phAcqDesc, int, BOOL, UINT uiRows, UINT uiColumns, BOOL, BOOL,
+                                 long lInitType, GBIF_STRING_DATATYPE *ucAddress)
+{
+    if (!phAcqDesc || (lInitType != HIS_GbIF_FIRST_CAM && !ucAddress))
+        return HIS_ERROR_INVALID_PARAM;
+    const UINT count = gbifCountFromEnv();
+    UINT index = 0;
+    for (; index < count && lInitType != HIS_GbIF_FIRST_CAM; ++index) {
+        const GBIF_DEVICE_PARAM device = gbifDevice(index);
+        const char *address = reinterpret_cast<const char *>(ucAddress);
+        const char *candidate = lInitType == HIS_GbIF_IP    ? reinterpret_cast<const char *>(device.ucIP)
+                                : lInitType == HIS_GbIF_MAC ? reinterpret_cast<const char *>(device.ucMacAddress)
+                                                            : device.cDeviceName;
+        if (std::strcmp(address, candidate) == 0)
+            break;
+    }
+    if (index >= count)
+        return HIS_ERROR_NO_BOARD_IN_SUBNET;
+    auto detector = std::make_unique<SimDetector>(static_cast<int>(index), uiRows, uiColumns);
+    detector->setChannelType(HIS_BOARD_TYPE_ELTEC_GbIF);
+    *phAcqDesc = detector->handle();
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    g_detectors.push_back(std::move(detector));
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetCommChannel(HACQDESC pAcqDesc, UINT *pdwChannelType, int *pnChannelNr)
+{
+    SimDetector *detector = lookup(pAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    if (pdwChannelType)
+        *pdwChannelType = detector->channelType();
+    if (pnChannelNr)
+        *pnChannelNr = detector->channel();
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_SetCallbacksAndMessages(HACQDESC pAcqDesc, HWND, UINT, UINT,
+                                               void (CALLBACK *lpfnEndFrameCallback)(HACQDESC),
+                                               void (CALLBACK *lpfnEndAcqCallback)(HACQDESC))
+{
+    SimDetector *detector = lookup(pAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    detector->setCallbacks(lpfnEndFrameCallback, lpfnEndAcqCallback);
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_SetEventCallback(HACQDESC hAcqDesc, XIS_EventCallback EventCallback, void *userData)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    detector->setEventCallback(EventCallback, userData);
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_DisableEventCallback(HACQDESC hAcqDesc)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    detector->setEventCallback(nullptr, nullptr);
+    return HIS_ALL_OK;
+}
+
+#ifdef XIS_OS_64
+HIS_RETURN Acquisition_SetAcqData(HACQDESC hAcqDesc, void *AcqData)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    detector->setAcqData(AcqData);
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetAcqData(HACQDESC hAcqDesc, void **VoidAcqData)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    if (!VoidAcqData)
+        return HIS_ERROR_INVALID_PARAM;
+    *VoidAcqData = detector->acqData();
+    return HIS_ALL_OK;
+}
+#else
+HIS_RETURN Acquisition_SetAcqData(HACQDESC hAcqDesc, DWORD dwAcqData)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    detector->setAcqData(reinterpret_cast<void *>(static_cast<uintptr_t>(dwAcqData)));
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetAcqData(HACQDESC hAcqDesc, DWORD *dwAcqData)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    if (!dwAcqData)
+        return HIS_ERROR_INVALID_PARAM;
+    *dwAcqData = static_cast<DWORD>(reinterpret_cast<uintptr_t>(detector->acqData()));
+    return HIS_ALL_OK;
+}
+#endif
+
+HIS_RETURN Acquisition_DefineDestBuffers(HACQDESC pAcqDesc, unsigned short *pProcessedData,
+                                         UINT nFrames, UINT nRows, UINT nColumns)
+{
+    SimDetector *detector = lookup(pAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    return detector->defineDestBuffers(pProcessedData, nFrames, nRows, nColumns);
+}
+
+// Correction data is accepted for API compatibility; the simulator
+// always delivers raw frames.
+HIS_RETURN Acquisition_Acquire_Image(HACQDESC pAcqDesc, UINT dwFrames, UINT dwSkipFrms, UINT dwOpt,
+                                     unsigned short *, DWORD *, DWORD *)
+{
+    SimDetector *detector = lookup(pAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    return detector->acquire(dwFrames, dwSkipFrms, dwOpt);
+}
+
+HIS_RETURN Acquisition_Acquire_Image_Ex(HACQDESC hAcqDesc, UINT dwFrames, UINT dwSkipFrms, UINT dwOpt,
+                                        unsigned short *, UINT, unsigned short *,
+                                        unsigned short *, DWORD *, DWORD *)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    return detector->acquire(dwFrames, dwSkipFrms, dwOpt);
+}
+
+HIS_RETURN Acquisition_Abort(HACQDESC hAcqDesc)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    return detector->abort();
+}
+
+HIS_RETURN Acquisition_AbortCurrentFrame(HACQDESC hAcqDesc)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    return detector->abortCurrentFrame();
+}
+
+HIS_RETURN Acquisition_IsAcquiringData(HACQDESC hAcqDesc)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    return (detector && detector->isAcquiring()) ? TRUE : FALSE;
+}
+
+HIS_RETURN Acquisition_Close(HACQDESC hAcqDesc)
+{
+    std::unique_ptr<SimDetector> closed;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        auto it = std::find_if(g_detectors.begin(), g_detectors.end(),
+                               [hAcqDesc](const std::unique_ptr<SimDetector> &detector) {
+                                   return detector->handle() == hAcqDesc;
+                               });
+        if (it == g_detectors.end())
+            return HIS_ERROR_INVALIDACQDESC;
+        closed = std::move(*it);
+        g_detectors.erase(it);
+    }
+    // Destroyed outside the lock: the destructor joins the acquisition
+    // thread, whose callbacks may call back into the API.
+    closed.reset();
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_CloseAll()
+{
+    std::vector<std::unique_ptr<SimDetector>> closed;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        closed.swap(g_detectors);
+    }
+    closed.clear();
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetErrorCode(HACQDESC hAcqDesc, DWORD *dwHISError, DWORD *dwBoardError)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    if (dwHISError)
+        *dwHISError = detector->lastError();
+    if (dwBoardError)
+        *dwBoardError = 0;
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetConfiguration(HACQDESC hAcqDesc,
+                                        UINT *dwFrames, UINT *dwRows, UINT *dwColumns, UINT *dwDataType,
+                                        UINT *dwSortFlags, BOOL *bIRQEnabled, DWORD *dwAcqType, DWORD *dwSystemID,
+                                        DWORD *dwSyncMode, DWORD *dwHwAccess)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    if (dwFrames)
+        *dwFrames = detector->destFrames();
+    if (dwRows)
+        *dwRows = detector->rows();
+    if (dwColumns)
+        *dwColumns = detector->columns();
+    if (dwDataType)
+        *dwDataType = detector->dataType();
+    if (dwSortFlags)
+        *dwSortFlags = detector->sortFlags();
+    if (bIRQEnabled)
+        *bIRQEnabled = TRUE;
+    if (dwAcqType)
+        *dwAcqType = 0;
+    if (dwSystemID)
+        *dwSystemID = detector->bitsPerPixel();
+    if (dwSyncMode)
+        *dwSyncMode = HIS_SYNCMODE_INTERNAL_TIMER;
+    if (dwHwAccess)
+        *dwHwAccess = 0;
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetActFrame(HACQDESC hAcqDesc, DWORD *dwActAcqFrame, DWORD *dwActSecBuffFrame)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    detector->actFrame(dwActAcqFrame, dwActSecBuffFrame);
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetHwHeaderInfo(HACQDESC hAcqDesc, CHwHeaderInfo *pInfo)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    detector->latestHeader(pInfo, nullptr);
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetHwHeaderInfoEx(HACQDESC hAcqDesc, CHwHeaderInfo *pInfo, CHwHeaderInfoEx *pInfoEx)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    detector->latestHeader(pInfo, pInfoEx);
+    return HIS_ALL_OK;
+}
+
+HIS_RETURN Acquisition_GetLatestFrameHeader(HACQDESC hAcqDesc, CHwHeaderInfo *pInfo, CHwHeaderInfoEx *pInfoEx)
+{
+    return Acquisition_GetHwHeaderInfoEx(hAcqDesc, pInfo, pInfoEx);
+}
+
+HIS_RETURN Acquisition_SetTimerSync(HACQDESC hAcqDesc, DWORD *dwCycleTime)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    return detector->setCycleTime(dwCycleTime);
+}
+
+HIS_RETURN Acquisition_SetFrameSyncMode(HACQDESC hAcqDesc, DWORD)
+{
+    return lookup(hAcqDesc) ? HIS_ALL_OK : HIS_ERROR_INVALIDACQDESC;
+}
+
+HIS_RETURN Acquisition_SetCameraMode(HACQDESC hAcqDesc, UINT)
+{
+    return lookup(hAcqDesc) ? HIS_ALL_OK : HIS_ERROR_INVALIDACQDESC;
+}
+
+HIS_RETURN Acquisition_ResetFrameCnt(HACQDESC hAcqDesc)
+{
+    SimDetector *detector = lookup(hAcqDesc);
+    if (!detector)
+        return HIS_ERROR_INVALIDACQDESC;
+    return detector->resetFrameCount();
+}
+
+HIS_RETURN Acquisition_GetVersion(int *major, int *minor, int *release, int *build)
+{
+    if (major)
+        *major = 1;
+    if (minor)
+        *minor = 0;
+    if (release)
+        *release = 0;
+    if (build)
+        *build = 0;
+    return HIS_ALL_OK;
+}
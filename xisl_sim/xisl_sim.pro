@@ -0,0 +1,12 @@
+# Software detector backend exposing the XISL API on Linux.
+# Builds lib/libXISL.so, which daq_flatpanel links in place of the
+# vendor XISL.dll.
+TEMPLATE = lib
+TARGET = XISL
+CONFIG += c++17 shared
+CONFIG -= qt
+DESTDIR = $$PWD/../lib
+INCLUDEPATH += $$PWD/..
+HEADERS += simdetector.h ../accumulate.h ../descrambler.h ../framegenerator.h ../simd.h
+SOURCES += simdetector.cpp xisl_sim.cpp ../accumulate.cpp ../descrambler.cpp ../framegenerator.cpp
+LIBS += -lpthread